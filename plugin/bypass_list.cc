@@ -0,0 +1,189 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "bypass_list.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+static bool IsSeparator(char c) {
+  return c == ';' || c == ',' || isspace((unsigned char)c);
+}
+
+// Parses a dotted IPv4 prefix such as "169.254" or "10.0.0.1" into the
+// high bytes of address.
+static bool ParseIpv4Prefix(const std::string& text, uint32_t* address) {
+  *address = 0;
+  int octets = 0;
+  const char* p = text.c_str();
+  while (*p) {
+    if (!isdigit((unsigned char)*p) || octets == 4) {
+      return false;
+    }
+    int value = 0;
+    while (isdigit((unsigned char)*p)) {
+      value = value * 10 + (*p++ - '0');
+      if (value > 255) {
+        return false;
+      }
+    }
+    *address |= (uint32_t)value << (24 - 8 * octets);
+    ++octets;
+    if (*p == '.') {
+      ++p;
+    }
+  }
+  return octets > 0;
+}
+
+// Glob match where '*' matches any run of characters. Both strings are
+// lower case.
+static bool WildcardMatch(const char* pattern, const char* text) {
+  const char* star = NULL;
+  const char* resume = NULL;
+  while (*text) {
+    if (*pattern == '*') {
+      star = pattern++;
+      resume = text;
+    } else if (*pattern == *text) {
+      ++pattern;
+      ++text;
+    } else if (star) {
+      pattern = star + 1;
+      text = ++resume;
+    } else {
+      return false;
+    }
+  }
+  while (*pattern == '*') {
+    ++pattern;
+  }
+  return *pattern == '\0';
+}
+
+void BypassList::Parse(const char* list) {
+  rules_.clear();
+  has_networks_ = false;
+  if (!list) {
+    return;
+  }
+  const char* ptr = list;
+  while (*ptr) {
+    while (*ptr && IsSeparator(*ptr)) {
+      ++ptr;
+    }
+    const char* end = ptr;
+    while (*end && !IsSeparator(*end)) {
+      ++end;
+    }
+    if (end == ptr) {
+      break;
+    }
+    std::string entry;
+    for (const char* p = ptr; p < end; ++p) {
+      entry += (char)tolower((unsigned char)*p);
+    }
+    ptr = end;
+    size_t scheme_end = entry.find("://");
+    if (scheme_end != std::string::npos) {
+      entry.erase(0, scheme_end + 3);
+    }
+    Rule rule;
+    size_t slash = entry.find('/');
+    if (entry == "<local>") {
+      rule.type = Rule::kLocal;
+    } else if (slash != std::string::npos) {
+      int bits = atoi(entry.c_str() + slash + 1);
+      if (bits < 0 || bits > 32 ||
+          !ParseIpv4Prefix(entry.substr(0, slash), &rule.network)) {
+        continue;
+      }
+      rule.type = Rule::kNetwork;
+      rule.mask = bits == 0 ? 0 : 0xffffffffU << (32 - bits);
+      rule.network &= rule.mask;
+      has_networks_ = true;
+    } else {
+      // A single colon separates a port; IPv6 literals have several.
+      size_t colon = entry.rfind(':');
+      if (colon != std::string::npos && entry.find(':') == colon) {
+        rule.port = atoi(entry.c_str() + colon + 1);
+        entry.erase(colon);
+      }
+      if (entry.size() > 2 && entry[0] == '[' &&
+          entry[entry.size() - 1] == ']') {
+        entry = entry.substr(1, entry.size() - 2);
+      }
+      if (entry.empty()) {
+        continue;
+      }
+      rule.pattern = entry;
+    }
+    rules_.push_back(rule);
+  }
+}
+
+bool BypassList::Matches(const std::string& host, int port) const {
+  return Matches(host, port, NULL);
+}
+
+bool BypassList::Matches(const std::string& host, int port,
+                         const uint32_t* address) const {
+  if (rules_.empty()) {
+    return false;
+  }
+  std::string lower_host;
+  lower_host.reserve(host.size());
+  for (size_t i = 0; i < host.size(); ++i) {
+    lower_host += (char)tolower((unsigned char)host[i]);
+  }
+  uint32_t literal = 0;
+  int ipv4 = -1;  // Whether host is an IPv4 literal, once known.
+  for (size_t i = 0; i < rules_.size(); ++i) {
+    const Rule& rule = rules_[i];
+    switch (rule.type) {
+      case Rule::kLocal:
+        if (lower_host.find('.') == std::string::npos &&
+            lower_host.find(':') == std::string::npos) {
+          return true;
+        }
+        break;
+      case Rule::kNetwork:
+        if (address) {
+          if ((*address & rule.mask) == rule.network) {
+            return true;
+          }
+          break;
+        }
+        if (ipv4 < 0) {
+          ipv4 = std::count(lower_host.begin(), lower_host.end(), '.') == 3 &&
+              ParseIpv4Prefix(lower_host, &literal);
+        }
+        if (ipv4 && (literal & rule.mask) == rule.network) {
+          return true;
+        }
+        break;
+      case Rule::kPattern:
+        if ((rule.port == 0 || rule.port == port) &&
+            WildcardMatch(rule.pattern.c_str(), lower_host.c_str())) {
+          return true;
+        }
+        break;
+    }
+  }
+  return false;
+}
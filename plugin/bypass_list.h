@@ -0,0 +1,69 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#ifndef __BYPASS_LIST_H__
+#define __BYPASS_LIST_H__
+
+#include <string>
+#include <vector>
+
+#include "nptypes.h"
+
+// The hosts that skip the proxy, as kept in ProxyConfig::bypass_list.
+// Entries are separated by ';', ',' or whitespace and may be:
+//   "*.example.com", "10.*"  wildcard patterns, matched case-insensitively;
+//   "example.com:8080"       a pattern that only matches on that port;
+//   "<local>"                any host name without a dot;
+//   "169.254/16"             an IPv4 network, as written on the Mac.
+// A "scheme://" prefix is accepted and ignored.
+class BypassList {
+ public:
+  struct Rule {
+    enum Type {
+      kPattern,
+      kLocal,
+      kNetwork,
+    };
+
+    Rule() : type(kPattern), port(0), network(0), mask(0) {}
+
+    Type type;
+    std::string pattern;  // Lower case.
+    int port;             // 0 matches any port.
+    uint32_t network;
+    uint32_t mask;
+  };
+
+  BypassList() : has_networks_(false) {}
+
+  void Parse(const char* list);
+
+  bool Matches(const std::string& host, int port) const;
+  // Like Matches, but network rules test address, the IPv4 address host
+  // resolved to (host byte order), when it is not NULL.
+  bool Matches(const std::string& host, int port,
+               const uint32_t* address) const;
+  bool empty() const { return rules_.empty(); }
+  // Whether any rule is an IPv4 network, which names only match once
+  // resolved.
+  bool has_networks() const { return has_networks_; }
+  const std::vector<Rule>& rules() const { return rules_; }
+
+ private:
+  std::vector<Rule> rules_;
+  bool has_networks_;
+};
+
+#endif  // __BYPASS_LIST_H__
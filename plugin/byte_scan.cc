@@ -0,0 +1,77 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "byte_scan.h"
+
+static const int kBlockSize = 16;
+
+#if defined(BYTE_SCAN_SSE2)
+bool HasSse2() {
+#if defined(_M_IX86)
+  static int has_sse2 = -1;
+  if (has_sse2 < 0) {
+    int info[4];
+    __cpuid(info, 1);
+    has_sse2 = (info[3] & (1 << 26)) ? 1 : 0;
+  }
+  return has_sse2 == 1;
+#else
+  return true;
+#endif
+}
+#endif
+
+// Bit i is set if p[i] == c, for the up to 16 bytes before end.
+static inline unsigned int MatchMask(const char* p, const char* end, char c) {
+#if defined(BYTE_SCAN_SSE2)
+  if (end - p >= kBlockSize && HasSse2()) {
+    __m128i block = _mm_loadu_si128((const __m128i*)p);
+    return (unsigned int)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(block, _mm_set1_epi8(c)));
+  }
+#endif
+  unsigned int mask = 0;
+  int len = end - p < kBlockSize ? (int)(end - p) : kBlockSize;
+  for (int i = 0; i < len; ++i) {
+    mask |= (unsigned int)(p[i] == c) << i;
+  }
+  return mask;
+}
+
+const char* FindByte(const char* begin, const char* end, char c) {
+  for (const char* p = begin; p < end; p += kBlockSize) {
+    unsigned int mask = MatchMask(p, end, c);
+    if (mask) {
+      return p + ByteScanner::CountTrailingZeros(mask);
+    }
+  }
+  return NULL;
+}
+
+ByteScanner::ByteScanner(const char* begin, const char* end, char c)
+    : block_(begin), next_block_(begin), end_(end), mask_(0), c_(c) {
+}
+
+bool ByteScanner::NextBlock() {
+  while (mask_ == 0) {
+    if (next_block_ >= end_) {
+      return false;
+    }
+    block_ = next_block_;
+    mask_ = MatchMask(block_, end_, c_);
+    next_block_ = block_ + kBlockSize;
+  }
+  return true;
+}
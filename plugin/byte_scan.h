@@ -0,0 +1,81 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Delimiter search over text buffers. Blocks of 16 bytes are compared at
+// once with SSE2 when the CPU has it, and with a plain loop otherwise.
+
+#ifndef __BYTE_SCAN_H__
+#define __BYTE_SCAN_H__
+
+#include <stddef.h>
+
+#if defined(_WINDOWS)
+#include <intrin.h>
+#endif
+
+// SSE2 is part of x86-64. 32 bit Windows builds may still run on CPUs
+// without it and check at runtime; other 32 bit builds only use it when
+// the compiler was told they can.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define BYTE_SCAN_SSE2
+#include <emmintrin.h>
+
+// Whether the SSE2 paths may run on this CPU.
+bool HasSse2();
+#endif
+
+// Returns the first c in [begin, end), or NULL.
+const char* FindByte(const char* begin, const char* end, char c);
+
+// Yields the position of every occurrence of a byte in a buffer, in order.
+// Each block is compared once and its matches are then popped off a bit
+// mask, so a block holding several short lines is not scanned again for
+// each of them.
+class ByteScanner {
+ public:
+  ByteScanner(const char* begin, const char* end, char c);
+
+  // The next occurrence, or NULL when there is none left.
+  const char* Next() {
+    if (mask_ == 0 && !NextBlock()) {
+      return NULL;
+    }
+    const char* match = block_ + CountTrailingZeros(mask_);
+    mask_ &= mask_ - 1;
+    return match;
+  }
+
+  static int CountTrailingZeros(unsigned int mask) {
+#if defined(_WINDOWS)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+  }
+
+ private:
+  // Loads the next block with a match into mask_.
+  bool NextBlock();
+
+  const char* block_;       // The block mask_ belongs to.
+  const char* next_block_;
+  const char* end_;
+  unsigned int mask_;
+  char c_;
+};
+
+#endif  // __BYTE_SCAN_H__
@@ -0,0 +1,50 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "consistent_hash.h"
+
+#include <algorithm>
+
+#include "hash_util.h"
+
+// Points per unit of weight. With 100 points per member the busiest of 4
+// members gets about 10% more than its share of the hosts, of 16 about
+// 20% and of 64 about 35% (see test/upstream_balance_bench.cc).
+static const int kPointsPerWeight = 100;
+
+void ConsistentHashRing::Build(const std::vector<std::string>& names,
+                               const std::vector<int>& weights) {
+  points_.clear();
+  for (size_t i = 0; i < names.size(); ++i) {
+    int count = weights[i] * kPointsPerWeight;
+    uint64_t seed = Fnv1a64(names[i].data(), names[i].size());
+    for (int j = 0; j < count; ++j) {
+      Point point;
+      point.hash = Mix64(seed + j);
+      point.member = (int)i;
+      points_.push_back(point);
+    }
+  }
+  std::sort(points_.begin(), points_.end());
+}
+
+size_t ConsistentHashRing::FindPoint(const std::string& key) const {
+  Point probe;
+  probe.hash = Mix64(Fnv1a64(key.data(), key.size()));
+  probe.member = 0;
+  std::vector<Point>::const_iterator it =
+      std::lower_bound(points_.begin(), points_.end(), probe);
+  return it == points_.end() ? 0 : it - points_.begin();
+}
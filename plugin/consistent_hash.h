@@ -0,0 +1,56 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#ifndef __CONSISTENT_HASH_H__
+#define __CONSISTENT_HASH_H__
+
+#include <string>
+#include <vector>
+
+#include "nptypes.h"
+
+// A consistent-hash ring with virtual nodes. Each member gets a number of
+// points proportional to its weight, so adding or removing a member only
+// moves the keys next to its points.
+class ConsistentHashRing {
+ public:
+  // Rebuilds the ring. names identify the members and decide where their
+  // points go, so the same members always give the same ring.
+  void Build(const std::vector<std::string>& names,
+             const std::vector<int>& weights);
+
+  // The position of the first point at or after the hash of key. Walking
+  // on with NextPoint visits the members in the order that key prefers.
+  size_t FindPoint(const std::string& key) const;
+  size_t NextPoint(size_t point) const {
+    return point + 1 == points_.size() ? 0 : point + 1;
+  }
+  int MemberAt(size_t point) const { return points_[point].member; }
+
+  size_t size() const { return points_.size(); }
+  bool empty() const { return points_.empty(); }
+
+ private:
+  struct Point {
+    uint64_t hash;
+    int member;
+
+    bool operator<(const Point& other) const { return hash < other.hash; }
+  };
+
+  std::vector<Point> points_;
+};
+
+#endif  // __CONSISTENT_HASH_H__
@@ -0,0 +1,114 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "deferred_proxy.h"
+
+#include "npswitchproxy.h"
+#include "stats.h"
+
+DeferredProxy::DeferredProxy(CreateFunc create)
+    : create_(create), ready_event_(true), backend_(NULL) {
+}
+
+DeferredProxy::~DeferredProxy() {
+  PlatformDependentShutdown();
+}
+
+bool DeferredProxy::PlatformDependentStartup() {
+  if (thread_.IsStarted()) {
+    return true;
+  }
+  ready_event_.Reset();
+  return thread_.Start(ThreadMain, this);
+}
+
+void DeferredProxy::PlatformDependentShutdown() {
+  if (!thread_.IsStarted()) {
+    return;
+  }
+  thread_.Join();
+  if (backend_) {
+    backend_->PlatformDependentShutdown();
+    delete backend_;
+    backend_ = NULL;
+  }
+}
+
+void DeferredProxy::ThreadMain(void* arg) {
+  ((DeferredProxy*)arg)->Start();
+}
+
+void DeferredProxy::Start() {
+  int64_t start_us = NowMicros();
+  ProxyBase* backend = create_();
+  if (backend && !backend->PlatformDependentStartup()) {
+    DebugLog("DeferredProxy: the backend did not start\n");
+    delete backend;
+    backend = NULL;
+  }
+  backend_ = backend;
+  stats::Set("backendStartupUs", NowMicros() - start_us);
+  ready_event_.Signal();
+}
+
+ProxyBase* DeferredProxy::backend() {
+  if (!thread_.IsStarted()) {
+    return NULL;
+  }
+  ready_event_.Wait(-1);
+  return backend_;
+}
+
+bool DeferredProxy::GetActiveConnectionName(const void** connection_name) {
+  ProxyBase* proxy = backend();
+  return proxy && proxy->GetActiveConnectionName(connection_name);
+}
+
+bool DeferredProxy::GetProxyConfig(ProxyConfig* config) {
+  ProxyBase* proxy = backend();
+  return proxy && proxy->GetProxyConfig(config);
+}
+
+bool DeferredProxy::SetProxyConfig(const ProxyConfig& config) {
+  ProxyBase* proxy = backend();
+  return proxy && proxy->SetProxyConfig(config);
+}
+
+bool DeferredProxy::UpdateProxyConfig(const ProxyConfig& config,
+                                      int fields) {
+  ProxyBase* proxy = backend();
+  return proxy && proxy->UpdateProxyConfig(config, fields);
+}
+
+ProxyPayload* DeferredProxy::CompilePayload(const ProxyConfig& config) {
+  ProxyBase* proxy = backend();
+  return proxy ? proxy->CompilePayload(config) : NULL;
+}
+
+bool DeferredProxy::ApplyPayload(const ProxyPayload& payload) {
+  ProxyBase* proxy = backend();
+  return proxy && proxy->ApplyPayload(payload);
+}
+
+bool DeferredProxy::EnumerateConnections(std::vector<std::string>* names) {
+  ProxyBase* proxy = backend();
+  return proxy && proxy->EnumerateConnections(names);
+}
+
+bool DeferredProxy::ApplyPayloadToConnection(const ProxyPayload& payload,
+                                             const std::string& name) {
+  ProxyBase* proxy = backend();
+  return proxy && proxy->ApplyPayloadToConnection(payload, name);
+}
@@ -0,0 +1,67 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#ifndef __DEFERRED_PROXY_H__
+#define __DEFERRED_PROXY_H__
+
+#include <string>
+#include <vector>
+
+#include "platform_util.h"
+#include "proxy_base.h"
+#include "proxy_config.h"
+
+// Creates and starts another backend on a thread of its own, so that
+// loading the plugin does not wait for the platform libraries to load.
+// Every call waits until that backend is up, and fails if it could not
+// be created or started.
+class DeferredProxy : public ProxyBase {
+ public:
+  // Creates the backend; NULL if there is none.
+  typedef ProxyBase* (*CreateFunc)();
+
+  explicit DeferredProxy(CreateFunc create);
+  virtual ~DeferredProxy();
+
+  // Starts the thread and returns without waiting for the backend.
+  virtual bool PlatformDependentStartup();
+  virtual void PlatformDependentShutdown();
+  virtual bool GetActiveConnectionName(const void** connection_name);
+  virtual bool GetProxyConfig(ProxyConfig* config);
+  virtual bool SetProxyConfig(const ProxyConfig& config);
+  virtual bool UpdateProxyConfig(const ProxyConfig& config, int fields);
+  virtual ProxyPayload* CompilePayload(const ProxyConfig& config);
+  virtual bool ApplyPayload(const ProxyPayload& payload);
+  virtual bool EnumerateConnections(std::vector<std::string>* names);
+  virtual bool ApplyPayloadToConnection(const ProxyPayload& payload,
+                                        const std::string& name);
+
+ private:
+  static void ThreadMain(void* arg);
+  void Start();
+  // Waits for the backend; NULL if it did not start. Any thread.
+  ProxyBase* backend();
+
+  CreateFunc create_;
+  Thread thread_;
+  WaitableEvent ready_event_;
+  // Set by the thread before ready_event_ is signaled.
+  ProxyBase* backend_;
+
+  DeferredProxy(const DeferredProxy&);
+  void operator=(const DeferredProxy&);
+};
+
+#endif  // __DEFERRED_PROXY_H__
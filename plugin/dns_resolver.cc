@@ -0,0 +1,791 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "dns_resolver.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WINDOWS)
+#include <iphlpapi.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "npswitchproxy.h"
+#include "stats.h"
+
+static const int kDefaultTimeoutMs = 1000;
+static const int kDefaultAttempts = 2;
+static const size_t kDefaultMaxEntries = 4096;
+static const int kDefaultNegativeTtlMs = 30 * 1000;
+// Bounds on the TTLs servers give.
+static const int64_t kMaxTtlMs = 24 * 3600 * 1000LL;
+static const int64_t kSystemAnswerTtlMs = 60 * 1000;
+static const int kMaxWaitMs = 1000;
+
+static const int kDnsPort = 53;
+static const int kTypeA = 1;
+static const int kTypeCname = 5;
+static const int kTypeSoa = 6;
+static const int kClassIn = 1;
+static const int kRcodeNoError = 0;
+static const int kRcodeNameError = 3;
+
+namespace {
+
+uint16_t ReadUint16(const unsigned char* p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+uint32_t ReadUint32(const unsigned char* p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+      ((uint32_t)p[2] << 8) | p[3];
+}
+
+void AppendUint16(std::string* out, int value) {
+  *out += (char)((value >> 8) & 0xff);
+  *out += (char)(value & 0xff);
+}
+
+bool ParseIpv4Literal(const std::string& name, uint32_t* address) {
+  unsigned int parts[4];
+  char tail;
+  if (sscanf(name.c_str(), "%u.%u.%u.%u%c", &parts[0], &parts[1], &parts[2],
+             &parts[3], &tail) != 4) {
+    return false;
+  }
+  *address = 0;
+  for (int i = 0; i < 4; ++i) {
+    if (parts[i] > 255) {
+      return false;
+    }
+    *address = (*address << 8) | parts[i];
+  }
+  return true;
+}
+
+std::string NormalizeName(const std::string& name) {
+  std::string result;
+  result.reserve(name.size());
+  for (size_t i = 0; i < name.size(); ++i) {
+    result += (char)tolower((unsigned char)name[i]);
+  }
+  if (!result.empty() && result[result.size() - 1] == '.') {
+    result.erase(result.size() - 1);
+  }
+  return result;
+}
+
+// Encodes a query for the A record of name; false if name is not a valid
+// DNS name.
+bool BuildQuery(uint16_t id, const std::string& name, std::string* packet) {
+  packet->clear();
+  AppendUint16(packet, id);
+  AppendUint16(packet, 0x0100);  // Recursion desired.
+  AppendUint16(packet, 1);
+  AppendUint16(packet, 0);
+  AppendUint16(packet, 0);
+  AppendUint16(packet, 0);
+  if (name.empty() || name.size() > 253) {
+    return false;
+  }
+  size_t begin = 0;
+  while (begin <= name.size()) {
+    size_t dot = name.find('.', begin);
+    if (dot == std::string::npos) {
+      dot = name.size();
+    }
+    size_t len = dot - begin;
+    if (len == 0 || len > 63) {
+      return false;
+    }
+    *packet += (char)len;
+    packet->append(name, begin, len);
+    begin = dot + 1;
+  }
+  *packet += '\0';
+  AppendUint16(packet, kTypeA);
+  AppendUint16(packet, kClassIn);
+  return true;
+}
+
+// Moves pos past a possibly compressed name.
+bool SkipName(const unsigned char* message, size_t len, size_t* pos) {
+  while (*pos < len) {
+    unsigned char c = message[*pos];
+    if (c == 0) {
+      ++*pos;
+      return true;
+    }
+    if ((c & 0xc0) == 0xc0) {
+      *pos += 2;
+      return *pos <= len;
+    }
+    *pos += 1 + c;
+  }
+  return false;
+}
+
+// Reads the uncompressed name of the question section.
+bool ReadQuestionName(const unsigned char* message, size_t len, size_t* pos,
+                      std::string* name) {
+  name->clear();
+  while (*pos < len) {
+    unsigned char c = message[(*pos)++];
+    if (c == 0) {
+      return true;
+    }
+    if (c > 63 || *pos + c > len) {
+      return false;
+    }
+    if (!name->empty()) {
+      *name += '.';
+    }
+    for (unsigned char i = 0; i < c; ++i) {
+      *name += (char)tolower(message[*pos + i]);
+    }
+    *pos += c;
+  }
+  return false;
+}
+
+bool FindSystemNameServer(struct sockaddr_storage* addr,
+                          socklen_t* addr_len) {
+#if defined(_WINDOWS)
+  ULONG size = 0;
+  if (GetNetworkParams(NULL, &size) != ERROR_BUFFER_OVERFLOW) {
+    return false;
+  }
+  std::vector<char> buffer(size);
+  FIXED_INFO* info = (FIXED_INFO*)&buffer[0];
+  if (GetNetworkParams(info, &size) != NO_ERROR) {
+    return false;
+  }
+  return info->DnsServerList.IpAddress.String[0] &&
+      ResolveHostPort(info->DnsServerList.IpAddress.String, kDnsPort, addr,
+                      addr_len);
+#else
+  FILE* file = fopen("/etc/resolv.conf", "r");
+  if (!file) {
+    return false;
+  }
+  char line[256];
+  char server[128];
+  bool found = false;
+  while (!found && fgets(line, sizeof(line), file)) {
+    found = sscanf(line, " nameserver %127s", server) == 1 &&
+        ResolveHostPort(server, kDnsPort, addr, addr_len);
+  }
+  fclose(file);
+  return found;
+#endif
+}
+
+// "address", "address:port" or "[address]:port".
+bool ParseServer(const std::string& server, struct sockaddr_storage* addr,
+                 socklen_t* addr_len) {
+  std::string host = server;
+  int port = kDnsPort;
+  if (!host.empty() && host[0] == '[') {
+    size_t close = host.find(']');
+    if (close == std::string::npos) {
+      return false;
+    }
+    if (close + 2 < host.size() && host[close + 1] == ':') {
+      port = atoi(host.c_str() + close + 2);
+    }
+    host = host.substr(1, close - 1);
+  } else if (host.find(':') == host.rfind(':') &&
+             host.find(':') != std::string::npos) {
+    port = atoi(host.c_str() + host.find(':') + 1);
+    host.erase(host.find(':'));
+  }
+  return ResolveHostPort(host.c_str(), port, addr, addr_len);
+}
+
+}  // namespace
+
+DnsResolver::Options::Options()
+    : timeout_ms(kDefaultTimeoutMs),
+      attempts(kDefaultAttempts),
+      max_entries(kDefaultMaxEntries),
+      negative_ttl_ms(kDefaultNegativeTtlMs) {
+}
+
+DnsResolver::DnsResolver()
+    : system_event_(false),
+      socket_(INVALID_SOCKET),
+      wakeup_socket_(INVALID_SOCKET),
+      server_addr_len_(0),
+      stop_(false),
+      lookups_(0),
+      hits_(0),
+      next_id_(0) {
+}
+
+DnsResolver::DnsResolver(const Options& options)
+    : options_(options),
+      system_event_(false),
+      socket_(INVALID_SOCKET),
+      wakeup_socket_(INVALID_SOCKET),
+      server_addr_len_(0),
+      stop_(false),
+      lookups_(0),
+      hits_(0),
+      next_id_(0) {
+}
+
+DnsResolver::~DnsResolver() {
+  Stop();
+}
+
+bool DnsResolver::Start() {
+  if (thread_.IsStarted()) {
+    return true;
+  }
+  bool have_server = options_.server.empty() ?
+      FindSystemNameServer(&server_addr_, &server_addr_len_) :
+      ParseServer(options_.server, &server_addr_, &server_addr_len_);
+  if (!have_server) {
+    DebugLog("DnsResolver: no name server, using the system resolver\n");
+    server_addr_len_ = 0;
+  } else {
+    socket_ = socket(server_addr_.ss_family, SOCK_DGRAM, IPPROTO_UDP);
+    if (socket_ == INVALID_SOCKET || !SetNonBlocking(socket_)) {
+      CloseSocket(socket_);
+      socket_ = INVALID_SOCKET;
+      server_addr_len_ = 0;
+    }
+  }
+  wakeup_socket_ = CreateWakeupSocket(&wakeup_addr_);
+  if (wakeup_socket_ == INVALID_SOCKET) {
+    CloseSocket(socket_);
+    socket_ = INVALID_SOCKET;
+    return false;
+  }
+  next_id_ = (uint16_t)(NowNanos() ^ (NowNanos() >> 16));
+  {
+    ScopedLock lock(&lock_);
+    stop_ = false;
+  }
+  if (!thread_.Start(ThreadMain, this)) {
+    CloseSocket(socket_);
+    CloseSocket(wakeup_socket_);
+    socket_ = wakeup_socket_ = INVALID_SOCKET;
+    return false;
+  }
+  if (!system_thread_.Start(SystemThreadMain, this)) {
+    Stop();
+    return false;
+  }
+  return true;
+}
+
+void DnsResolver::Stop() {
+  if (!thread_.IsStarted()) {
+    return;
+  }
+  {
+    ScopedLock lock(&lock_);
+    stop_ = true;
+  }
+  SignalWakeupSocket(wakeup_socket_, wakeup_addr_);
+  thread_.Join();
+  if (system_thread_.IsStarted()) {
+    system_event_.Signal();
+    system_thread_.Join();
+  }
+  CloseSocket(socket_);
+  CloseSocket(wakeup_socket_);
+  socket_ = wakeup_socket_ = INVALID_SOCKET;
+  in_flight_.clear();
+  system_queue_.clear();
+  // Nothing answers what was still being resolved. Waiters give up on it
+  // and the next Start looks it up anew.
+  ScopedLock lock(&lock_);
+  queued_.clear();
+  system_pending_.clear();
+  std::map<std::string, Entry>::iterator it = cache_.begin();
+  while (it != cache_.end()) {
+    if (it->second.pending) {
+      for (size_t i = 0; i < it->second.waiters.size(); ++i) {
+        it->second.waiters[i]->Signal();
+      }
+      cache_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+}
+
+DnsResolver::Result DnsResolver::LookupLocked(const std::string& name,
+                                              uint32_t* address,
+                                              bool* started) {
+  *started = false;
+  stats::Set("dnsLookups", ++lookups_);
+  std::map<std::string, Entry>::iterator it = cache_.find(name);
+  if (it != cache_.end()) {
+    Entry& entry = it->second;
+    if (entry.pending) {
+      stats::Add("dnsDedupedLookups", 1);
+      return kPending;
+    }
+    if (entry.expires_ms > NowMillis()) {
+      stats::Set("dnsCacheHits", ++hits_);
+      *address = entry.address;
+      return entry.found ? kFound : kNotFound;
+    }
+  }
+  Entry& entry = cache_[name];
+  entry.pending = true;
+  queued_.push_back(name);
+  *started = true;
+  return kPending;
+}
+
+DnsResolver::Result DnsResolver::Lookup(const std::string& name,
+                                        uint32_t* address) {
+  std::string normalized = NormalizeName(name);
+  if (ParseIpv4Literal(normalized, address)) {
+    return kFound;
+  }
+  if (!thread_.IsStarted()) {
+    // Without a thread, resolve in place.
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    if (!ResolveHostPort(normalized.c_str(), 0, &addr, &addr_len, AF_INET)) {
+      return kNotFound;
+    }
+    *address = ntohl(((struct sockaddr_in*)&addr)->sin_addr.s_addr);
+    return kFound;
+  }
+  bool started;
+  Result result;
+  {
+    ScopedLock lock(&lock_);
+    result = LookupLocked(normalized, address, &started);
+  }
+  if (started) {
+    SignalWakeupSocket(wakeup_socket_, wakeup_addr_);
+  }
+  return result;
+}
+
+DnsResolver::Result DnsResolver::Resolve(const std::string& name,
+                                         int timeout_ms, uint32_t* address) {
+  Result result = Lookup(name, address);
+  if (result != kPending) {
+    return result;
+  }
+  std::string normalized = NormalizeName(name);
+  WaitableEvent done(true);
+  {
+    ScopedLock lock(&lock_);
+    std::map<std::string, Entry>::iterator it = cache_.find(normalized);
+    if (it == cache_.end()) {
+      return kNotFound;
+    }
+    if (!it->second.pending) {
+      *address = it->second.address;
+      return it->second.found ? kFound : kNotFound;
+    }
+    it->second.waiters.push_back(&done);
+  }
+  done.Wait(timeout_ms);
+  ScopedLock lock(&lock_);
+  std::map<std::string, Entry>::iterator it = cache_.find(normalized);
+  if (it == cache_.end()) {
+    return kNotFound;
+  }
+  Entry& entry = it->second;
+  if (entry.pending) {
+    for (size_t i = 0; i < entry.waiters.size(); ++i) {
+      if (entry.waiters[i] == &done) {
+        entry.waiters.erase(entry.waiters.begin() + i);
+        break;
+      }
+    }
+    return kPending;
+  }
+  *address = entry.address;
+  return entry.found ? kFound : kNotFound;
+}
+
+void DnsResolver::AddListener(void (*callback)(void*), void* arg) {
+  ScopedLock lock(&lock_);
+  Listener listener;
+  listener.callback = callback;
+  listener.arg = arg;
+  listeners_.push_back(listener);
+}
+
+void DnsResolver::RemoveListener(void (*callback)(void*), void* arg) {
+  ScopedLock lock(&lock_);
+  for (size_t i = 0; i < listeners_.size(); ++i) {
+    if (listeners_[i].callback == callback && listeners_[i].arg == arg) {
+      listeners_.erase(listeners_.begin() + i);
+      return;
+    }
+  }
+}
+
+int64_t DnsResolver::lookups() const {
+  ScopedLock lock(&lock_);
+  return lookups_;
+}
+
+int64_t DnsResolver::hits() const {
+  ScopedLock lock(&lock_);
+  return hits_;
+}
+
+// static
+void DnsResolver::ThreadMain(void* arg) {
+  ((DnsResolver*)arg)->Run();
+}
+
+void DnsResolver::Run() {
+  while (true) {
+    std::vector<std::string> names;
+    {
+      ScopedLock lock(&lock_);
+      if (stop_) {
+        break;
+      }
+      names.swap(queued_);
+    }
+    int64_t now_ms = NowMillis();
+    for (size_t i = 0; i < names.size(); ++i) {
+      // Single-label names rely on the search domains of the system.
+      if (server_addr_len_ == 0 ||
+          names[i].find('.') == std::string::npos) {
+        system_queue_.push_back(names[i]);
+        continue;
+      }
+      Query query;
+      query.name = names[i];
+      query.attempts = 0;
+      query.first_sent_us = NowMicros();
+      query.next_send_ms = now_ms;
+      while (in_flight_.count(++next_id_)) {
+      }
+      in_flight_[next_id_] = query;
+    }
+    SendQueries(now_ms);
+    if (!system_queue_.empty()) {
+      {
+        ScopedLock lock(&lock_);
+        system_pending_.insert(system_pending_.end(), system_queue_.begin(),
+                               system_queue_.end());
+      }
+      system_queue_.clear();
+      system_event_.Signal();
+    }
+
+    int64_t wait_ms = kMaxWaitMs;
+    now_ms = NowMillis();
+    for (std::map<uint16_t, Query>::iterator it = in_flight_.begin();
+         it != in_flight_.end(); ++it) {
+      if (it->second.next_send_ms - now_ms < wait_ms) {
+        wait_ms = it->second.next_send_ms - now_ms;
+      }
+    }
+    if (wait_ms < 0) {
+      wait_ms = 0;
+    }
+    fd_set read_fds;
+    FD_ZERO(&read_fds);
+    FD_SET(wakeup_socket_, &read_fds);
+    SocketHandle max_fd = wakeup_socket_;
+    if (socket_ != INVALID_SOCKET) {
+      FD_SET(socket_, &read_fds);
+      if (socket_ > max_fd) {
+        max_fd = socket_;
+      }
+    }
+    struct timeval tv;
+    tv.tv_sec = (long)(wait_ms / 1000);
+    tv.tv_usec = (long)(wait_ms % 1000) * 1000;
+    int ready = select((int)max_fd + 1, &read_fds, NULL, NULL, &tv);
+    if (ready < 0) {
+      SleepMillis(10);
+      continue;
+    }
+    if (FD_ISSET(wakeup_socket_, &read_fds)) {
+      DrainWakeupSocket(wakeup_socket_);
+    }
+    if (socket_ != INVALID_SOCKET && FD_ISSET(socket_, &read_fds)) {
+      ReceiveResponses();
+    }
+  }
+}
+
+// static
+void DnsResolver::SystemThreadMain(void* arg) {
+  ((DnsResolver*)arg)->RunSystemLookups();
+}
+
+void DnsResolver::RunSystemLookups() {
+  while (true) {
+    std::vector<std::string> names;
+    {
+      ScopedLock lock(&lock_);
+      if (stop_) {
+        break;
+      }
+      names.swap(system_pending_);
+    }
+    if (names.empty()) {
+      system_event_.Wait(-1);
+      continue;
+    }
+    for (size_t i = 0; i < names.size(); ++i) {
+      ResolveWithSystem(names[i]);
+    }
+  }
+}
+
+void DnsResolver::SendQueries(int64_t now_ms) {
+  std::map<uint16_t, Query>::iterator it = in_flight_.begin();
+  while (it != in_flight_.end()) {
+    Query& query = it->second;
+    if (query.next_send_ms > now_ms) {
+      ++it;
+      continue;
+    }
+    std::string packet;
+    if (!BuildQuery(it->first, query.name, &packet)) {
+      Complete(query.name, false, 0, options_.negative_ttl_ms);
+      in_flight_.erase(it++);
+      continue;
+    }
+    if (query.attempts == options_.attempts) {
+      stats::Add("dnsQueryTimeouts", 1);
+      system_queue_.push_back(query.name);
+      in_flight_.erase(it++);
+      continue;
+    }
+    ++query.attempts;
+    query.next_send_ms = now_ms + options_.timeout_ms;
+    sendto(socket_, packet.data(), (int)packet.size(), 0,
+           (struct sockaddr*)&server_addr_, server_addr_len_);
+    stats::Add("dnsQueriesSent", 1);
+    ++it;
+  }
+}
+
+void DnsResolver::ReceiveResponses() {
+  unsigned char message[1500];
+  while (true) {
+    struct sockaddr_storage from;
+    socklen_t from_len = sizeof(from);
+    int received = recvfrom(socket_, (char*)message, sizeof(message), 0,
+                            (struct sockaddr*)&from, &from_len);
+    if (received < 0) {
+      return;
+    }
+    size_t len = (size_t)received;
+    // Only answers from the server, to the question that was asked, count.
+    if (from_len != server_addr_len_ ||
+        memcmp(&from, &server_addr_, from_len) != 0 || len < 12 ||
+        !(message[2] & 0x80)) {
+      continue;
+    }
+    std::map<uint16_t, Query>::iterator it =
+        in_flight_.find(ReadUint16(message));
+    if (it == in_flight_.end() || ReadUint16(message + 4) != 1) {
+      continue;
+    }
+    size_t pos = 12;
+    std::string name;
+    if (!ReadQuestionName(message, len, &pos, &name) ||
+        name != it->second.name) {
+      continue;
+    }
+    Query query = it->second;
+    in_flight_.erase(it);
+    stats::Add("dnsQueries", 1);
+    int64_t latency_us = NowMicros() - query.first_sent_us;
+    stats::Add("dnsQueryLatencyUs", latency_us);
+    stats::Set("dnsLastQueryLatencyUs", latency_us);
+
+    bool truncated = (message[2] & 0x02) != 0;
+    int rcode = message[3] & 0x0f;
+    if (truncated ||
+        (rcode != kRcodeNoError && rcode != kRcodeNameError)) {
+      system_queue_.push_back(query.name);
+      continue;
+    }
+    pos += 4;  // Type and class of the question.
+    int answers = ReadUint16(message + 6);
+    int authorities = ReadUint16(message + 8);
+    bool found = false;
+    uint32_t address = 0;
+    int64_t ttl_ms = kMaxTtlMs;
+    int64_t negative_ttl_ms = options_.negative_ttl_ms;
+    bool malformed = false;
+    for (int i = 0; i < answers + authorities && !malformed; ++i) {
+      if (!SkipName(message, len, &pos) || pos + 10 > len) {
+        malformed = true;
+        break;
+      }
+      int type = ReadUint16(message + pos);
+      int klass = ReadUint16(message + pos + 2);
+      int64_t record_ttl_ms = ReadUint32(message + pos + 4) * 1000LL;
+      size_t data_len = ReadUint16(message + pos + 8);
+      pos += 10;
+      if (pos + data_len > len) {
+        malformed = true;
+        break;
+      }
+      if (i < answers && klass == kClassIn &&
+          (type == kTypeA || type == kTypeCname)) {
+        if (record_ttl_ms < ttl_ms) {
+          ttl_ms = record_ttl_ms;
+        }
+        if (type == kTypeA && data_len == 4 && !found) {
+          found = true;
+          address = ReadUint32(message + pos);
+        }
+      } else if (i >= answers && type == kTypeSoa && data_len >= 20) {
+        // The SOA minimum, capped by the TTL of the record itself.
+        int64_t minimum_ms = ReadUint32(message + pos + data_len - 4) * 1000LL;
+        negative_ttl_ms = record_ttl_ms < minimum_ms ? record_ttl_ms :
+            minimum_ms;
+      }
+      pos += data_len;
+    }
+    if (malformed && !found) {
+      system_queue_.push_back(query.name);
+    } else if (found) {
+      Complete(query.name, true, address, ttl_ms);
+    } else {
+      Complete(query.name, false, 0, negative_ttl_ms);
+    }
+  }
+}
+
+void DnsResolver::ResolveWithSystem(const std::string& name) {
+  stats::Add("dnsSystemLookups", 1);
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+  if (ResolveHostPort(name.c_str(), 0, &addr, &addr_len, AF_INET)) {
+    Complete(name, true, ntohl(((struct sockaddr_in*)&addr)->sin_addr.s_addr),
+             kSystemAnswerTtlMs);
+  } else {
+    Complete(name, false, 0, options_.negative_ttl_ms);
+  }
+}
+
+void DnsResolver::Complete(const std::string& name, bool found,
+                           uint32_t address, int64_t ttl_ms) {
+  std::vector<Listener> listeners;
+  {
+    ScopedLock lock(&lock_);
+    int64_t now_ms = NowMillis();
+    Entry& entry = cache_[name];
+    entry.found = found;
+    entry.address = address;
+    entry.pending = false;
+    entry.expires_ms = now_ms + (ttl_ms < kMaxTtlMs ? ttl_ms : kMaxTtlMs);
+    for (size_t i = 0; i < entry.waiters.size(); ++i) {
+      entry.waiters[i]->Signal();
+    }
+    entry.waiters.clear();
+    TrimCache(now_ms);
+    listeners = listeners_;
+  }
+  for (size_t i = 0; i < listeners.size(); ++i) {
+    listeners[i].callback(listeners[i].arg);
+  }
+}
+
+// Drops expired entries once the cache is full, then whatever comes first
+// if that was not enough. Entries in flight are kept.
+void DnsResolver::TrimCache(int64_t now_ms) {
+  if (cache_.size() <= options_.max_entries) {
+    return;
+  }
+  std::map<std::string, Entry>::iterator it = cache_.begin();
+  while (it != cache_.end()) {
+    if (!it->second.pending && it->second.expires_ms <= now_ms) {
+      cache_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+  it = cache_.begin();
+  while (cache_.size() > options_.max_entries && it != cache_.end()) {
+    if (!it->second.pending) {
+      cache_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+}
+
+std::string FormatIpv4(uint32_t address) {
+  char buffer[16];
+  snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", (address >> 24) & 0xff,
+           (address >> 16) & 0xff, (address >> 8) & 0xff, address & 0xff);
+  return buffer;
+}
+
+std::string GetDnsDomain() {
+#if defined(_WINDOWS)
+  ULONG size = 0;
+  if (GetNetworkParams(NULL, &size) != ERROR_BUFFER_OVERFLOW) {
+    return "";
+  }
+  std::vector<char> buffer(size);
+  FIXED_INFO* info = (FIXED_INFO*)&buffer[0];
+  if (GetNetworkParams(info, &size) != NO_ERROR) {
+    return "";
+  }
+  return info->DomainName;
+#else
+  // "domain" wins over "search", as for the resolver itself.
+  std::string domain;
+  FILE* file = fopen("/etc/resolv.conf", "r");
+  if (file) {
+    char line[512];
+    char word[256];
+    while (fgets(line, sizeof(line), file)) {
+      if (sscanf(line, " domain %255s", word) == 1) {
+        domain = word;
+        break;
+      }
+      if (domain.empty() && sscanf(line, " search %255s", word) == 1) {
+        domain = word;
+      }
+    }
+    fclose(file);
+  }
+  if (domain.empty()) {
+    char host[256];
+    if (gethostname(host, sizeof(host)) == 0) {
+      host[sizeof(host) - 1] = '\0';
+      const char* dot = strchr(host, '.');
+      if (dot) {
+        domain = dot + 1;
+      }
+    }
+  }
+  return domain;
+#endif
+}
@@ -0,0 +1,148 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// A caching stub resolver for IPv4 addresses. PAC helpers and bypass
+// rules only ever need A records, so instead of a blocking getaddrinfo per
+// lookup it sends its own UDP queries from one background thread.
+
+#ifndef __DNS_RESOLVER_H__
+#define __DNS_RESOLVER_H__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "net_util.h"
+#include "platform_util.h"
+
+// Answers are cached for the TTL the server gave, failures ("no such
+// name" and "no address") for the TTL of the zone's SOA record. Lookups
+// of a name that is already being resolved wait for the same query.
+// Single-label names, which need the search domains of the system, and
+// queries the server does not answer are resolved with getaddrinfo
+// instead, on a helper thread of their own so that a slow one holds up no
+// query to the server. Thread-safe.
+class DnsResolver {
+ public:
+  struct Options {
+    Options();
+
+    // "address[:port]" of the DNS server; empty to use the system's.
+    std::string server;
+    // Per attempt; a query is sent attempts times before giving up on the
+    // server.
+    int timeout_ms;
+    int attempts;
+    size_t max_entries;
+    // Used for failures when the server sent no SOA record.
+    int negative_ttl_ms;
+  };
+
+  enum Result {
+    kPending,
+    kFound,
+    kNotFound,
+  };
+
+  DnsResolver();
+  explicit DnsResolver(const Options& options);
+  ~DnsResolver();
+
+  bool Start();
+  void Stop();
+
+  // Returns a cached answer at once. Otherwise starts resolving name, or
+  // joins the query already in flight, and returns kPending; listeners
+  // are told when it is done. address is in host byte order.
+  Result Lookup(const std::string& name, uint32_t* address);
+  // Like Lookup, but waits up to timeout_ms for the answer.
+  Result Resolve(const std::string& name, int timeout_ms, uint32_t* address);
+
+  // callback(arg) runs on the resolver thread whenever queries finish.
+  void AddListener(void (*callback)(void*), void* arg);
+  void RemoveListener(void (*callback)(void*), void* arg);
+
+  int64_t lookups() const;
+  int64_t hits() const;
+
+ private:
+  struct Entry {
+    Entry() : address(0), found(false), pending(true), expires_ms(0) {}
+
+    uint32_t address;
+    bool found;
+    bool pending;
+    int64_t expires_ms;
+    std::vector<WaitableEvent*> waiters;
+  };
+
+  struct Query {
+    std::string name;
+    int attempts;
+    int64_t first_sent_us;
+    int64_t next_send_ms;
+  };
+
+  struct Listener {
+    void (*callback)(void*);
+    void* arg;
+  };
+
+  static void ThreadMain(void* arg);
+  void Run();
+  static void SystemThreadMain(void* arg);
+  void RunSystemLookups();
+  void SendQueries(int64_t now_ms);
+  void ReceiveResponses();
+  void ResolveWithSystem(const std::string& name);
+  void Complete(const std::string& name, bool found, uint32_t address,
+                int64_t ttl_ms);
+  void TrimCache(int64_t now_ms);
+  Result LookupLocked(const std::string& name, uint32_t* address,
+                      bool* started);
+
+  Options options_;
+  Thread thread_;
+  Thread system_thread_;
+  WaitableEvent system_event_;  // Signaled when system_pending_ grows.
+  SocketHandle socket_;
+  SocketHandle wakeup_socket_;
+  struct sockaddr_in wakeup_addr_;
+  struct sockaddr_storage server_addr_;
+  socklen_t server_addr_len_;  // 0 if no server is known.
+
+  mutable Mutex lock_;  // Guards everything below.
+  bool stop_;
+  std::map<std::string, Entry> cache_;
+  std::vector<std::string> queued_;  // Waiting to be sent.
+  // Waiting for the helper thread to resolve them with the system.
+  std::vector<std::string> system_pending_;
+  std::vector<Listener> listeners_;
+  int64_t lookups_;
+  int64_t hits_;
+
+  // Owned by the resolver thread.
+  std::map<uint16_t, Query> in_flight_;
+  std::vector<std::string> system_queue_;  // For system_pending_.
+  uint16_t next_id_;
+};
+
+// Formats an address in host byte order as dotted quad.
+std::string FormatIpv4(uint32_t address);
+
+// The DNS suffix of this machine, such as "corp.example.com", or empty.
+std::string GetDnsDomain();
+
+#endif  // __DNS_RESOLVER_H__
@@ -0,0 +1,379 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "file_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(_WINDOWS)
+#include <io.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "platform_util.h"
+#include "utf_convert.h"
+
+static const char* kAppDirectoryName = "SwitchProxy";
+
+#if defined(_WINDOWS)
+static const char kPathSeparator = '\\';
+#else
+static const char kPathSeparator = '/';
+#endif
+
+MappedFile::MappedFile()
+    : data_(NULL), size_(0)
+#if defined(_WINDOWS)
+      , file_(INVALID_HANDLE_VALUE), mapping_(NULL)
+#endif
+{
+}
+
+MappedFile::~MappedFile() {
+  Close();
+}
+
+#if defined(_WINDOWS)
+bool MappedFile::Open(const std::string& path) {
+  Close();
+  // FILE_SHARE_DELETE lets WriteFileAtomically replace the file while it
+  // is mapped.
+  file_ = CreateFileW(Utf8ToWide(path).c_str(), GENERIC_READ,
+                      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                      NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file_ == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file_, &size) || size.HighPart != 0) {
+    Close();
+    return false;
+  }
+  size_ = size.LowPart;
+  if (size_ == 0) {
+    // Empty files cannot be mapped, but are perfectly valid.
+    data_ = "";
+    return true;
+  }
+  mapping_ = CreateFileMappingW(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!mapping_) {
+    Close();
+    return false;
+  }
+  data_ = (const char*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+  if (!data_) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_ && size_ > 0) {
+    UnmapViewOfFile(data_);
+  }
+  if (mapping_) {
+    CloseHandle(mapping_);
+  }
+  if (file_ != INVALID_HANDLE_VALUE) {
+    CloseHandle(file_);
+  }
+  data_ = NULL;
+  size_ = 0;
+  mapping_ = NULL;
+  file_ = INVALID_HANDLE_VALUE;
+}
+#else
+bool MappedFile::Open(const std::string& path) {
+  Close();
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    return false;
+  }
+  size_ = (size_t)info.st_size;
+  if (size_ == 0) {
+    close(fd);
+    data_ = "";
+    return true;
+  }
+  void* data = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after the descriptor is closed.
+  close(fd);
+  if (data == MAP_FAILED) {
+    size_ = 0;
+    return false;
+  }
+  data_ = (const char*)data;
+  return true;
+}
+
+void MappedFile::Close() {
+  if (data_ && size_ > 0) {
+    munmap((void*)data_, size_);
+  }
+  data_ = NULL;
+  size_ = 0;
+}
+#endif
+
+AppendOnlyFile::AppendOnlyFile() : file_(NULL), size_(0) {
+}
+
+AppendOnlyFile::~AppendOnlyFile() {
+  Close();
+}
+
+bool AppendOnlyFile::Open(const std::string& path) {
+  Close();
+#if defined(_WINDOWS)
+  file_ = _wfopen(Utf8ToWide(path).c_str(), L"ab");
+#else
+  file_ = fopen(path.c_str(), "ab");
+#endif
+  if (!file_) {
+    return false;
+  }
+  // The position of a file opened for appending is only defined once
+  // something was written, so find the size explicitly.
+  if (fseek(file_, 0, SEEK_END) != 0) {
+    Close();
+    return false;
+  }
+  size_ = (size_t)ftell(file_);
+  return true;
+}
+
+void AppendOnlyFile::Close() {
+  if (file_) {
+    fclose(file_);
+  }
+  file_ = NULL;
+  size_ = 0;
+}
+
+bool AppendOnlyFile::Append(const std::string& data) {
+  if (!file_ || fwrite(data.data(), 1, data.size(), file_) != data.size()) {
+    return false;
+  }
+  size_ += data.size();
+  return true;
+}
+
+bool AppendOnlyFile::Sync() {
+  if (!file_ || fflush(file_) != 0) {
+    return false;
+  }
+#if defined(_WINDOWS)
+  return _commit(_fileno(file_)) == 0;
+#else
+  return fsync(fileno(file_)) == 0;
+#endif
+}
+
+#if defined(_WINDOWS)
+FileLock::FileLock() : file_(INVALID_HANDLE_VALUE) {
+}
+
+// A handle that shares nothing is the lock; the system closes it when
+// the process dies.
+bool FileLock::TryLock(const std::string& path) {
+  Unlock();
+  file_ = CreateFileW(Utf8ToWide(path).c_str(), GENERIC_READ | GENERIC_WRITE,
+                      0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  return file_ != INVALID_HANDLE_VALUE;
+}
+
+void FileLock::Unlock() {
+  if (file_ != INVALID_HANDLE_VALUE) {
+    CloseHandle(file_);
+  }
+  file_ = INVALID_HANDLE_VALUE;
+}
+#else
+FileLock::FileLock() : fd_(-1) {
+}
+
+// flock locks are per open file, so a second FileLock in this process
+// competes like another process does.
+bool FileLock::TryLock(const std::string& path) {
+  Unlock();
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT, 0600);
+  if (fd_ >= 0 && flock(fd_, LOCK_EX | LOCK_NB) != 0) {
+    Unlock();
+  }
+  return fd_ >= 0;
+}
+
+void FileLock::Unlock() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  fd_ = -1;
+}
+#endif
+
+FileLock::~FileLock() {
+  Unlock();
+}
+
+bool WriteFileAtomically(const std::string& path, const std::string& data) {
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".tmp%lld", (long long)NowNanos());
+  std::string temp_path = path + suffix;
+#if defined(_WINDOWS)
+  FILE* file = _wfopen(Utf8ToWide(temp_path).c_str(), L"wb");
+#else
+  FILE* file = fopen(temp_path.c_str(), "wb");
+#endif
+  if (!file) {
+    return false;
+  }
+  bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+  ok = fflush(file) == 0 && ok;
+  ok = fclose(file) == 0 && ok;
+#if defined(_WINDOWS)
+  ok = ok && MoveFileExW(Utf8ToWide(temp_path).c_str(),
+                         Utf8ToWide(path).c_str(),
+                         MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+  ok = ok && rename(temp_path.c_str(), path.c_str()) == 0;
+#endif
+  if (!ok) {
+    DeleteFileAtPath(temp_path);
+  }
+  return ok;
+}
+
+bool DeleteFileAtPath(const std::string& path) {
+#if defined(_WINDOWS)
+  return DeleteFileW(Utf8ToWide(path).c_str()) != 0;
+#else
+  return unlink(path.c_str()) == 0;
+#endif
+}
+
+bool CreateDirectories(const std::string& path) {
+  if (path.empty()) {
+    return false;
+  }
+  for (size_t i = 1; i <= path.size(); ++i) {
+    if (i < path.size() && path[i] != '/' && path[i] != kPathSeparator) {
+      continue;
+    }
+    std::string prefix = path.substr(0, i);
+#if defined(_WINDOWS)
+    if (prefix.size() == 2 && prefix[1] == ':') {
+      continue;  // A drive such as "C:".
+    }
+    if (!CreateDirectoryW(Utf8ToWide(prefix).c_str(), NULL) &&
+        GetLastError() != ERROR_ALREADY_EXISTS) {
+      return false;
+    }
+#else
+    if (mkdir(prefix.c_str(), 0700) != 0 && errno != EEXIST) {
+      return false;
+    }
+#endif
+  }
+  return true;
+}
+
+static std::string GetAppDirectory(const std::string& base) {
+  if (base.empty()) {
+    return base;
+  }
+  std::string directory = JoinPath(base, kAppDirectoryName);
+  return CreateDirectories(directory) ? directory : std::string();
+}
+
+std::string GetUserCacheDirectory() {
+  std::string base;
+#if defined(_WINDOWS)
+  // LOCALAPPDATA does not exist before Vista.
+  const wchar_t* value = _wgetenv(L"LOCALAPPDATA");
+  if (!value) {
+    value = _wgetenv(L"APPDATA");
+  }
+  if (value) {
+    base = WideToUtf8(value);
+  }
+#elif defined(WEBKIT_DARWIN_SDK)
+  const char* home = getenv("HOME");
+  if (home) {
+    base = JoinPath(JoinPath(home, "Library"), "Caches");
+  }
+#else
+  const char* value = getenv("XDG_CACHE_HOME");
+  if (value && *value) {
+    base = value;
+  } else if ((value = getenv("HOME")) != NULL) {
+    base = JoinPath(value, ".cache");
+  }
+#endif
+  return GetAppDirectory(base);
+}
+
+std::string GetUserDataDirectory() {
+  std::string base;
+#if defined(_WINDOWS)
+  // The roaming profile, so that saved proxies follow the user.
+  const wchar_t* value = _wgetenv(L"APPDATA");
+  if (value) {
+    base = WideToUtf8(value);
+  }
+#elif defined(WEBKIT_DARWIN_SDK)
+  const char* home = getenv("HOME");
+  if (home) {
+    base = JoinPath(JoinPath(home, "Library"), "Application Support");
+  }
+#else
+  const char* value = getenv("XDG_DATA_HOME");
+  if (value && *value) {
+    base = value;
+  } else if ((value = getenv("HOME")) != NULL) {
+    base = JoinPath(JoinPath(value, ".local"), "share");
+  }
+#endif
+  return GetAppDirectory(base);
+}
+
+std::string GetPathFromEnvironment(const char* name) {
+#if defined(_WINDOWS)
+  const wchar_t* value = _wgetenv(Utf8ToWide(name).c_str());
+  return value ? WideToUtf8(value) : "";
+#else
+  const char* value = getenv(name);
+  return value ? value : "";
+#endif
+}
+
+std::string JoinPath(const std::string& directory, const std::string& name) {
+  if (directory.empty() || directory[directory.size() - 1] == kPathSeparator) {
+    return directory + name;
+  }
+  return directory + kPathSeparator + name;
+}
@@ -0,0 +1,125 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Portable file helpers. Paths are UTF-8 on every platform.
+
+#ifndef __FILE_UTIL_H__
+#define __FILE_UTIL_H__
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <string>
+
+#if defined(_WINDOWS)
+#include <windows.h>
+#endif
+
+// A whole file mapped read-only into memory. The file may be replaced
+// (by WriteFileAtomically) while it is mapped; the mapping keeps showing
+// the old contents.
+class MappedFile {
+ public:
+  MappedFile();
+  ~MappedFile();
+
+  bool Open(const std::string& path);
+  void Close();
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const char* data_;
+  size_t size_;
+#if defined(_WINDOWS)
+  HANDLE file_;
+  HANDLE mapping_;
+#endif
+
+  MappedFile(const MappedFile&);
+  void operator=(const MappedFile&);
+};
+
+// A file that is only ever appended to, such as a log. Appends go through
+// the C library buffer; Sync pushes them down to the disk.
+class AppendOnlyFile {
+ public:
+  AppendOnlyFile();
+  ~AppendOnlyFile();
+
+  // Opens path for appending, creating it if needed.
+  bool Open(const std::string& path);
+  void Close();
+  bool IsOpen() const { return file_ != NULL; }
+
+  bool Append(const std::string& data);
+  // Flushes and waits until the data is on the disk.
+  bool Sync();
+  // The file size, including data not synced yet.
+  size_t size() const { return size_; }
+
+ private:
+  FILE* file_;
+  size_t size_;
+
+  AppendOnlyFile(const AppendOnlyFile&);
+  void operator=(const AppendOnlyFile&);
+};
+
+// An exclusive lock on a file, held until Unlock or until the process
+// dies, which keeps other processes from using what it guards. The file
+// is created if needed and left in place.
+class FileLock {
+ public:
+  FileLock();
+  ~FileLock();
+
+  // Fails at once if another process, or another FileLock, holds it.
+  bool TryLock(const std::string& path);
+  void Unlock();
+
+ private:
+#if defined(_WINDOWS)
+  HANDLE file_;
+#else
+  int fd_;
+#endif
+
+  FileLock(const FileLock&);
+  void operator=(const FileLock&);
+};
+
+// Writes data to a temporary file next to path and renames it over path,
+// so that readers see either the old or the new contents, never a part.
+bool WriteFileAtomically(const std::string& path, const std::string& data);
+bool DeleteFileAtPath(const std::string& path);
+// Creates the directory and any missing parents.
+bool CreateDirectories(const std::string& path);
+
+// A per-user directory for data that can be recreated, such as downloads;
+// created if needed. Empty if there is no such place.
+std::string GetUserCacheDirectory();
+// A per-user directory for data that cannot be recreated, such as the
+// saved profiles; created if needed. Empty if there is no such place.
+std::string GetUserDataDirectory();
+
+// The path an environment variable is set to, or empty if it is not set.
+std::string GetPathFromEnvironment(const char* name);
+
+// Joins a directory and a file name with the platform's separator.
+std::string JoinPath(const std::string& directory, const std::string& name);
+
+#endif  // __FILE_UTIL_H__
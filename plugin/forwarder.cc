@@ -0,0 +1,853 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "forwarder.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "byte_scan.h"
+#include "dns_resolver.h"
+#include "http_parser.h"
+#include "npswitchproxy.h"
+#include "stats.h"
+#include "upstream_group.h"
+
+static const int kDefaultConnectTimeoutMs = 500;
+static const int kDefaultDirectConnectTimeoutMs = 20000;
+// Each connection takes two sockets, and the listening and wakeup sockets
+// take the other two of an fd_set.
+static const int kMaxSelectableConnections = (FD_SETSIZE - 2) / 2;
+static const int kDefaultMaxConnections = 500;
+// Upper bound on how long the loop sleeps when nothing is due.
+static const int kMaxSelectWaitMs = 1000;
+// Per direction; reading stops while this much is waiting to be sent.
+static const size_t kMaxBufferedBytes = 65536;
+static const int kReadChunkSize = 16384;
+static const int kRouteCacheSize = 4096;
+
+static const char* kConnectEstablished =
+    "HTTP/1.1 200 Connection established\r\n\r\n";
+static const char* kPacPath = "/proxy.pac";
+
+namespace {
+
+enum ConnectionState {
+  kReadingHead,
+  kResolving,  // Waiting for the resolver, with the request head read.
+  kConnecting,
+  kRelaying,
+  kClosing,  // Flushing an error reply to the client.
+  kClosed,
+};
+
+bool IsHopByHopHeader(const char* line, size_t len) {
+  static const char* kHeaders[] = {
+    "connection:",
+    "proxy-connection:",
+    "keep-alive:",
+  };
+  for (size_t i = 0; i < sizeof(kHeaders) / sizeof(kHeaders[0]); ++i) {
+    size_t name_len = strlen(kHeaders[i]);
+    if (len < name_len) {
+      continue;
+    }
+    size_t j = 0;
+    while (j < name_len &&
+           tolower((unsigned char)line[j]) == kHeaders[i][j]) {
+      ++j;
+    }
+    if (j == name_len) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Rebuilds a plain HTTP request head with the given request target and
+// "Connection: close". Each request on a client connection may need a
+// different route, so connections are not reused across requests.
+std::string BuildForwardedHead(const char* data, const HttpRequestHead& head,
+                               const StringPiece& target) {
+  std::string result;
+  result.reserve(head.head_length + 32);
+  result.append(head.method.data, head.method.len);
+  result += ' ';
+  result.append(target.data, target.len);
+  result += ' ';
+  result.append(head.version.data, head.version.len);
+  result += "\r\n";
+  ByteScanner newlines(data, data + head.head_length, '\n');
+  const char* line = newlines.Next() + 1;
+  const char* newline;
+  while ((newline = newlines.Next()) != NULL) {
+    const char* line_end = newline + 1;
+    size_t len = line_end - line;
+    if (len > 2 && !IsHopByHopHeader(line, len)) {
+      result.append(line, len);
+    }
+    line = line_end;
+  }
+  result += "Connection: close\r\n\r\n";
+  return result;
+}
+
+size_t Pending(const std::string& buffer, size_t offset) {
+  return buffer.size() - offset;
+}
+
+// Returns false on a fatal error; sets eof on an orderly shutdown.
+bool ReadInto(SocketHandle socket, std::string* buffer, bool* eof) {
+  char chunk[kReadChunkSize];
+  int len = SocketRecv(socket, chunk, sizeof(chunk));
+  if (len > 0) {
+    buffer->append(chunk, len);
+    return true;
+  }
+  if (len == 0) {
+    *eof = true;
+    return true;
+  }
+  return LastSocketCallWouldBlock();
+}
+
+// Sends what is pending in buffer; returns false on a fatal error.
+bool WriteFrom(SocketHandle socket, std::string* buffer, size_t* offset) {
+  int len = SocketSend(socket, buffer->data() + *offset,
+                       (int)(buffer->size() - *offset));
+  if (len < 0) {
+    return LastSocketCallWouldBlock();
+  }
+  *offset += len;
+  if (*offset == buffer->size()) {
+    buffer->clear();
+    *offset = 0;
+  }
+  return true;
+}
+
+}  // namespace
+
+struct Forwarder::Connection {
+  Connection()
+      : client(INVALID_SOCKET),
+        upstream(INVALID_SOCKET),
+        state(kReadingHead),
+        client_offset(0),
+        upstream_offset(0),
+        client_eof(false),
+        upstream_eof(false),
+        upstream_shut(false),
+        is_connect(false),
+        port(0),
+        resolved(false),
+        address(0),
+        profile(NULL),
+        group(NULL),
+        upstream_index(-1),
+        attempts(0),
+        first_attempt_us(0),
+        connect_deadline_us(0) {}
+
+  SocketHandle client;
+  SocketHandle upstream;
+  ConnectionState state;
+  // Bytes from the client not yet sent upstream, and the other way round.
+  std::string client_buffer;
+  size_t client_offset;
+  std::string upstream_buffer;
+  size_t upstream_offset;
+  bool client_eof;
+  bool upstream_eof;
+  bool upstream_shut;
+
+  bool is_connect;
+  std::string host;  // Destination, used when going direct.
+  int port;
+  bool resolved;     // Whether address holds the IPv4 address of host.
+  uint32_t address;
+  UpstreamProfile* profile;
+  UpstreamGroup* group;  // NULL when going direct.
+  int upstream_index;
+  std::vector<bool> tried;
+  int attempts;
+  int64_t first_attempt_us;
+  int64_t connect_deadline_us;
+};
+
+Forwarder::Options::Options()
+    : connect_timeout_ms(kDefaultConnectTimeoutMs),
+      direct_connect_timeout_ms(kDefaultDirectConnectTimeoutMs),
+      max_connections(kDefaultMaxConnections),
+      resolver(NULL) {
+}
+
+Forwarder::Forwarder()
+    : listen_socket_(INVALID_SOCKET),
+      wakeup_socket_(INVALID_SOCKET),
+      port_(0),
+      stop_(false),
+      has_pending_profile_(false),
+      profile_(NULL),
+      generation_(1),
+      route_cache_(kRouteCacheSize),
+      route_lookups_(0),
+      route_lookup_ns_(0),
+      published_route_lookups_(0) {
+}
+
+Forwarder::Forwarder(const Options& options)
+    : options_(options),
+      listen_socket_(INVALID_SOCKET),
+      wakeup_socket_(INVALID_SOCKET),
+      port_(0),
+      stop_(false),
+      has_pending_profile_(false),
+      profile_(NULL),
+      generation_(1),
+      route_cache_(kRouteCacheSize),
+      route_lookups_(0),
+      route_lookup_ns_(0),
+      published_route_lookups_(0) {
+  if (options_.max_connections > kMaxSelectableConnections) {
+    options_.max_connections = kMaxSelectableConnections;
+  }
+}
+
+Forwarder::~Forwarder() {
+  Stop();
+}
+
+bool Forwarder::Start(int port) {
+  if (IsRunning()) {
+    return port == 0 || port == port_;
+  }
+  listen_socket_ = ListenOnLoopback(port, &port_);
+  if (listen_socket_ == INVALID_SOCKET) {
+    return false;
+  }
+  wakeup_socket_ = CreateWakeupSocket(&wakeup_addr_);
+  if (wakeup_socket_ == INVALID_SOCKET) {
+    CloseSocket(listen_socket_);
+    listen_socket_ = INVALID_SOCKET;
+    return false;
+  }
+  stop_ = false;
+  if (options_.resolver) {
+    options_.resolver->AddListener(OnNameResolved, this);
+  }
+  if (!thread_.Start(ThreadMain, this)) {
+    if (options_.resolver) {
+      options_.resolver->RemoveListener(OnNameResolved, this);
+    }
+    CloseSocket(listen_socket_);
+    CloseSocket(wakeup_socket_);
+    listen_socket_ = wakeup_socket_ = INVALID_SOCKET;
+    return false;
+  }
+  DebugLog("npswitchproxy: forwarder listening on port %d\n", port_);
+  return true;
+}
+
+void Forwarder::Stop() {
+  if (!IsRunning()) {
+    return;
+  }
+  {
+    ScopedLock lock(&lock_);
+    stop_ = true;
+  }
+  SignalWakeupSocket(wakeup_socket_, wakeup_addr_);
+  thread_.Join();
+  if (options_.resolver) {
+    options_.resolver->RemoveListener(OnNameResolved, this);
+  }
+  for (size_t i = 0; i < connections_.size(); ++i) {
+    CloseConnection(connections_[i]);
+    delete connections_[i];
+  }
+  connections_.clear();
+  if (profile_) {
+    profile_->Release();
+    profile_ = NULL;
+  }
+  CloseSocket(listen_socket_);
+  CloseSocket(wakeup_socket_);
+  listen_socket_ = wakeup_socket_ = INVALID_SOCKET;
+}
+
+void Forwarder::SetProfile(const std::string& description,
+                           const std::string& bypass_list) {
+  {
+    ScopedLock lock(&lock_);
+    pending_profile_ = description;
+    pending_bypass_list_ = bypass_list;
+    has_pending_profile_ = true;
+  }
+  if (IsRunning()) {
+    SignalWakeupSocket(wakeup_socket_, wakeup_addr_);
+  }
+}
+
+std::string Forwarder::profile() {
+  ScopedLock lock(&lock_);
+  return pending_profile_;
+}
+
+void Forwarder::SetPacScript(const std::string& script) {
+  ScopedLock lock(&lock_);
+  pac_script_ = script;
+}
+
+std::string Forwarder::address() const {
+  char address[32];
+  snprintf(address, sizeof(address), "127.0.0.1:%d", port_);
+  return address;
+}
+
+std::string Forwarder::pac_url() const {
+  char url[64];
+  snprintf(url, sizeof(url), "http://127.0.0.1:%d%s", port_, kPacPath);
+  return url;
+}
+
+// static
+void Forwarder::ThreadMain(void* arg) {
+  ((Forwarder*)arg)->Run();
+}
+
+// static
+void Forwarder::OnNameResolved(void* arg) {
+  Forwarder* forwarder = (Forwarder*)arg;
+  SignalWakeupSocket(forwarder->wakeup_socket_, forwarder->wakeup_addr_);
+}
+
+void Forwarder::ApplyPendingProfile() {
+  std::string description;
+  std::string bypass_list;
+  {
+    ScopedLock lock(&lock_);
+    if (!has_pending_profile_) {
+      return;
+    }
+    description = pending_profile_;
+    bypass_list = pending_bypass_list_;
+    has_pending_profile_ = false;
+  }
+  UpstreamProfile* profile = new UpstreamProfile(description, bypass_list);
+  // Names the resolver does not know yet are finished in Run(); requests
+  // that need them wait in kResolving meanwhile.
+  profile->ResolveUpstreams(options_.resolver);
+  if (profile_) {
+    profile_->Release();
+  }
+  profile_ = profile;
+  // Generation 0 marks empty cache slots.
+  if (++generation_ == 0) {
+    ++generation_;
+  }
+}
+
+// Returns false while the decision waits for host to be resolved.
+bool Forwarder::IsBypassed(const std::string& host, int port, bool* direct) {
+  const BypassList& bypass_list = profile_->bypass_list();
+  if (bypass_list.empty()) {
+    *direct = false;
+    return true;
+  }
+  int64_t start = NowNanos();
+  bool decided = true;
+  if (!route_cache_.Lookup(host, port, generation_, direct)) {
+    *direct = bypass_list.Matches(host, port);
+    if (*direct || !bypass_list.has_networks() || !options_.resolver) {
+      route_cache_.Insert(host, port, generation_, *direct);
+    } else {
+      // Network rules also match the address of a name. That answer
+      // expires with its DNS record, so the route cache does not keep it.
+      uint32_t address;
+      DnsResolver::Result result = options_.resolver->Lookup(host, &address);
+      decided = result != DnsResolver::kPending;
+      *direct = result == DnsResolver::kFound &&
+          bypass_list.Matches(host, port, &address);
+    }
+  }
+  ++route_lookups_;
+  route_lookup_ns_ += NowNanos() - start;
+  return decided;
+}
+
+// The counters live on the loop thread and are copied out once per loop
+// iteration, which keeps the stats lock off the per-connection path.
+void Forwarder::PublishStats() {
+  if (route_lookups_ == published_route_lookups_) {
+    return;
+  }
+  published_route_lookups_ = route_lookups_;
+  stats::Set("routeCacheLookups", route_lookups_);
+  stats::Set("routeCacheHits", route_cache_.hits());
+  stats::Set("routeCacheLookupNs", route_lookup_ns_);
+}
+
+void Forwarder::Run() {
+  while (true) {
+    {
+      ScopedLock lock(&lock_);
+      if (stop_) {
+        break;
+      }
+    }
+    ApplyPendingProfile();
+    if (profile_ && profile_->resolving()) {
+      profile_->ResolveUpstreams(options_.resolver);
+    }
+
+    fd_set read_fds, write_fds, error_fds;
+    FD_ZERO(&read_fds);
+    FD_ZERO(&write_fds);
+    FD_ZERO(&error_fds);
+    SocketHandle max_fd = wakeup_socket_;
+    FD_SET(wakeup_socket_, &read_fds);
+    if ((int)connections_.size() < options_.max_connections) {
+      FD_SET(listen_socket_, &read_fds);
+      if (listen_socket_ > max_fd) {
+        max_fd = listen_socket_;
+      }
+    }
+    int64_t now = NowMicros();
+    int64_t wait_us = kMaxSelectWaitMs * 1000LL;
+    for (size_t i = 0; i < connections_.size(); ++i) {
+      Connection* conn = connections_[i];
+      switch (conn->state) {
+        case kReadingHead:
+          FD_SET(conn->client, &read_fds);
+          break;
+        case kResolving:
+          // The resolver wakes the loop up when it has an answer.
+          break;
+        case kConnecting:
+          FD_SET(conn->upstream, &write_fds);
+          FD_SET(conn->upstream, &error_fds);
+          if (conn->connect_deadline_us - now < wait_us) {
+            wait_us = conn->connect_deadline_us - now;
+          }
+          break;
+        case kRelaying:
+          if (!conn->client_eof &&
+              Pending(conn->client_buffer, conn->client_offset) <
+              kMaxBufferedBytes) {
+            FD_SET(conn->client, &read_fds);
+          }
+          if (!conn->upstream_eof &&
+              Pending(conn->upstream_buffer, conn->upstream_offset) <
+              kMaxBufferedBytes) {
+            FD_SET(conn->upstream, &read_fds);
+          }
+          if (Pending(conn->upstream_buffer, conn->upstream_offset) > 0) {
+            FD_SET(conn->client, &write_fds);
+          }
+          if (Pending(conn->client_buffer, conn->client_offset) > 0) {
+            FD_SET(conn->upstream, &write_fds);
+          }
+          break;
+        case kClosing:
+          FD_SET(conn->client, &write_fds);
+          break;
+        case kClosed:
+          break;
+      }
+      if (conn->client != INVALID_SOCKET && conn->client > max_fd) {
+        max_fd = conn->client;
+      }
+      if (conn->upstream != INVALID_SOCKET && conn->upstream > max_fd) {
+        max_fd = conn->upstream;
+      }
+    }
+    if (wait_us < 0) {
+      wait_us = 0;
+    }
+    struct timeval tv;
+    tv.tv_sec = (long)(wait_us / 1000000);
+    tv.tv_usec = (long)(wait_us % 1000000);
+    int ready = select((int)max_fd + 1, &read_fds, &write_fds, &error_fds,
+                       &tv);
+    if (ready < 0) {
+      DebugLog("npswitchproxy: forwarder select failed\n");
+      SleepMillis(10);
+      continue;
+    }
+    if (FD_ISSET(wakeup_socket_, &read_fds)) {
+      DrainWakeupSocket(wakeup_socket_);
+    }
+    if (FD_ISSET(listen_socket_, &read_fds)) {
+      AcceptConnections();
+    }
+    // New connections are appended, so iterate over the old ones only.
+    size_t count = connections_.size();
+    for (size_t i = 0; i < count; ++i) {
+      HandleConnection(connections_[i], &read_fds, &write_fds, &error_fds);
+    }
+    size_t live = 0;
+    for (size_t i = 0; i < connections_.size(); ++i) {
+      if (connections_[i]->state == kClosed) {
+        delete connections_[i];
+      } else {
+        connections_[live++] = connections_[i];
+      }
+    }
+    connections_.resize(live);
+    PublishStats();
+  }
+}
+
+void Forwarder::AcceptConnections() {
+  while ((int)connections_.size() < options_.max_connections) {
+    SocketHandle client = accept(listen_socket_, NULL, NULL);
+    if (client == INVALID_SOCKET) {
+      break;
+    }
+    if (!FitsInFdSet(client) || !SetNonBlocking(client)) {
+      CloseSocket(client);
+      continue;
+    }
+    Connection* conn = new Connection;
+    conn->client = client;
+    connections_.push_back(conn);
+    stats::Add("forwarderConnections", 1);
+  }
+}
+
+void Forwarder::HandleConnection(Connection* conn, fd_set* read_fds,
+                                 fd_set* write_fds, fd_set* error_fds) {
+  switch (conn->state) {
+    case kReadingHead:
+      if (FD_ISSET(conn->client, read_fds)) {
+        if (!ReadInto(conn->client, &conn->client_buffer, &conn->client_eof) ||
+            conn->client_eof) {
+          CloseConnection(conn);
+          return;
+        }
+        HandleRequestHead(conn);
+      }
+      break;
+    case kResolving:
+      HandleRequestHead(conn);
+      break;
+    case kConnecting:
+      if (FD_ISSET(conn->upstream, error_fds)) {
+        OnConnectFailed(conn);
+      } else if (FD_ISSET(conn->upstream, write_fds)) {
+        if (GetSocketError(conn->upstream) != 0) {
+          OnConnectFailed(conn);
+        } else {
+          OnConnected(conn);
+        }
+      } else if (NowMicros() >= conn->connect_deadline_us) {
+        stats::Add("forwarderConnectTimeouts", 1);
+        OnConnectFailed(conn);
+      }
+      break;
+    case kRelaying:
+      Relay(conn, read_fds, write_fds);
+      break;
+    case kClosing:
+      if (FD_ISSET(conn->client, write_fds)) {
+        if (!WriteFrom(conn->client, &conn->upstream_buffer,
+                       &conn->upstream_offset) ||
+            conn->upstream_buffer.empty()) {
+          CloseConnection(conn);
+        }
+      }
+      break;
+    case kClosed:
+      break;
+  }
+}
+
+void Forwarder::HandleRequestHead(Connection* conn) {
+  HttpRequestHead head;
+  const std::string& buffer = conn->client_buffer;
+  HttpParseResult result = ParseHttpRequestHead(buffer.data(), buffer.size(),
+                                                &head);
+  if (result == kHttpParseIncomplete) {
+    return;
+  }
+  // Requests to a proxy name an absolute URI; a path is meant for us.
+  if (result == kHttpParseDone && head.target.len > 0 &&
+      head.target.data[0] == '/') {
+    ServeLocalRequest(conn, head);
+    return;
+  }
+  std::string scheme;
+  StringPiece path;
+  if (result == kHttpParseError ||
+      !GetRequestDestination(head, &scheme, &conn->host, &conn->port,
+                             &path)) {
+    FailRequest(conn, "400 Bad Request");
+    return;
+  }
+  conn->is_connect = head.method.Equals("CONNECT");
+  bool direct = true;
+  if (profile_ && !IsBypassed(conn->host, conn->port, &direct)) {
+    conn->state = kResolving;
+    return;
+  }
+  conn->group = direct ? NULL : profile_->GroupForScheme(scheme);
+  if (conn->group && profile_->resolving()) {
+    conn->state = kResolving;
+    return;
+  }
+  if (!conn->group && options_.resolver) {
+    DnsResolver::Result result =
+        options_.resolver->Lookup(conn->host, &conn->address);
+    if (result == DnsResolver::kPending) {
+      conn->state = kResolving;
+      return;
+    }
+    conn->resolved = result == DnsResolver::kFound;
+  }
+  if (conn->group) {
+    conn->profile = profile_;
+    conn->profile->AddRef();
+    conn->tried.assign(conn->group->upstreams.size(), false);
+  }
+  std::string body = buffer.substr(head.head_length);
+  if (conn->is_connect) {
+    // An upstream proxy gets the CONNECT as is; going direct, the tunnel
+    // starts right after our own 200 reply.
+    if (!conn->group) {
+      conn->client_buffer = body;
+    }
+  } else {
+    // Proxies take the absolute URI, servers the origin-form path.
+    conn->client_buffer =
+        BuildForwardedHead(buffer.data(), head,
+                           conn->group ? head.target : path) + body;
+  }
+  conn->client_offset = 0;
+  conn->first_attempt_us = NowMicros();
+  ConnectNext(conn);
+}
+
+void Forwarder::ServeLocalRequest(Connection* conn,
+                                  const HttpRequestHead& head) {
+  std::string script;
+  {
+    ScopedLock lock(&lock_);
+    script = pac_script_;
+  }
+  size_t path_len = 0;
+  while (path_len < head.target.len && head.target.data[path_len] != '?') {
+    ++path_len;
+  }
+  bool is_head = head.method.Equals("HEAD");
+  if (script.empty() || (!is_head && !head.method.Equals("GET")) ||
+      !StringPiece(head.target.data, path_len).Equals(kPacPath)) {
+    FailRequest(conn, "404 Not Found");
+    return;
+  }
+  char length[32];
+  snprintf(length, sizeof(length), "%lu", (unsigned long)script.size());
+  conn->upstream_buffer = std::string(
+      "HTTP/1.1 200 OK\r\n"
+      "Content-Type: application/x-ns-proxy-autoconfig\r\n"
+      "Cache-Control: no-cache\r\n"
+      "Content-Length: ") + length + "\r\nConnection: close\r\n\r\n";
+  if (!is_head) {
+    conn->upstream_buffer += script;
+  }
+  conn->upstream_offset = 0;
+  conn->state = kClosing;
+  stats::Add("forwarderPacRequests", 1);
+}
+
+void Forwarder::ConnectNext(Connection* conn) {
+  int64_t now = NowMicros();
+  struct sockaddr_storage addr;
+  socklen_t addr_len = 0;
+  while (true) {
+    if (conn->group) {
+      int index = conn->group->Pick(conn->host, now / 1000, conn->tried);
+      if (index < 0) {
+        FailRequest(conn, "502 Bad Gateway");
+        return;
+      }
+      conn->tried[index] = true;
+      Upstream& upstream = conn->group->upstreams[index];
+      ++conn->attempts;
+      if (!upstream.resolved) {
+        upstream.breaker.RecordFailure(now / 1000);
+        continue;
+      }
+      conn->upstream_index = index;
+      ++upstream.active_connections;
+      memcpy(&addr, &upstream.addr, upstream.addr_len);
+      addr_len = upstream.addr_len;
+    } else if (conn->resolved) {
+      if (conn->attempts++ > 0) {
+        FailRequest(conn, "502 Bad Gateway");
+        return;
+      }
+      struct sockaddr_in* addr4 = (struct sockaddr_in*)&addr;
+      memset(addr4, 0, sizeof(*addr4));
+      addr4->sin_family = AF_INET;
+      addr4->sin_port = htons((uint16_t)conn->port);
+      addr4->sin_addr.s_addr = htonl(conn->address);
+      addr_len = sizeof(*addr4);
+    } else {
+      // Without a resolver, or for an IPv6 literal, which never blocks.
+      if (conn->attempts++ > 0 ||
+          (options_.resolver &&
+           conn->host.find(':') == std::string::npos) ||
+          !ResolveHostPort(conn->host.c_str(), conn->port, &addr,
+                           &addr_len)) {
+        FailRequest(conn, "502 Bad Gateway");
+        return;
+      }
+    }
+    conn->upstream = CreateNonBlockingSocket(addr.ss_family);
+    if (conn->upstream != INVALID_SOCKET && FitsInFdSet(conn->upstream) &&
+        ConnectNonBlocking(conn->upstream, (struct sockaddr*)&addr,
+                           addr_len) != kConnectFailed) {
+      conn->state = kConnecting;
+      // The short timeout is only for failing over to another upstream.
+      // Direct connects and the last upstream left get as long as a
+      // browser would give them.
+      int timeout_ms = options_.direct_connect_timeout_ms;
+      if (conn->group) {
+        for (size_t i = 0; i < conn->tried.size(); ++i) {
+          if (!conn->tried[i]) {
+            timeout_ms = options_.connect_timeout_ms;
+            break;
+          }
+        }
+      }
+      conn->connect_deadline_us = now + timeout_ms * 1000LL;
+      return;
+    }
+    CloseSocket(conn->upstream);
+    conn->upstream = INVALID_SOCKET;
+    if (conn->group) {
+      Upstream& upstream = conn->group->upstreams[conn->upstream_index];
+      upstream.breaker.RecordFailure(now / 1000);
+      --upstream.active_connections;
+      conn->upstream_index = -1;
+    }
+  }
+}
+
+void Forwarder::OnConnectFailed(Connection* conn) {
+  CloseSocket(conn->upstream);
+  conn->upstream = INVALID_SOCKET;
+  stats::Add("forwarderUpstreamFailures", 1);
+  if (conn->group) {
+    Upstream& upstream = conn->group->upstreams[conn->upstream_index];
+    upstream.breaker.RecordFailure(NowMillis());
+    --upstream.active_connections;
+    conn->upstream_index = -1;
+    DebugLog("npswitchproxy: upstream %s:%d failed\n",
+             upstream.server.host.c_str(), upstream.server.port);
+  }
+  ConnectNext(conn);
+}
+
+void Forwarder::OnConnected(Connection* conn) {
+  if (conn->group) {
+    Upstream& upstream = conn->group->upstreams[conn->upstream_index];
+    upstream.breaker.RecordSuccess();
+    if (conn->attempts > 1) {
+      // Time from the first connect attempt to a working upstream.
+      stats::Add("forwarderFailovers", 1);
+      stats::Set("forwarderLastFailoverUs",
+                 NowMicros() - conn->first_attempt_us);
+    }
+  } else if (conn->is_connect) {
+    conn->upstream_buffer = kConnectEstablished;
+    conn->upstream_offset = 0;
+  }
+  conn->state = kRelaying;
+}
+
+void Forwarder::Relay(Connection* conn, fd_set* read_fds,
+                      fd_set* write_fds) {
+  bool ok = true;
+  if (ok && FD_ISSET(conn->client, read_fds)) {
+    ok = ReadInto(conn->client, &conn->client_buffer, &conn->client_eof);
+  }
+  if (ok && FD_ISSET(conn->upstream, read_fds)) {
+    ok = ReadInto(conn->upstream, &conn->upstream_buffer,
+                  &conn->upstream_eof);
+  }
+  if (ok && FD_ISSET(conn->client, write_fds)) {
+    ok = WriteFrom(conn->client, &conn->upstream_buffer,
+                   &conn->upstream_offset);
+  }
+  if (ok && FD_ISSET(conn->upstream, write_fds)) {
+    ok = WriteFrom(conn->upstream, &conn->client_buffer,
+                   &conn->client_offset);
+  }
+  if (!ok) {
+    CloseConnection(conn);
+    return;
+  }
+  if (conn->client_eof && !conn->upstream_shut &&
+      Pending(conn->client_buffer, conn->client_offset) == 0) {
+    ShutdownSend(conn->upstream);
+    conn->upstream_shut = true;
+  }
+  // Once the far end is done and everything it sent has been delivered,
+  // there is nothing left to relay.
+  if (conn->upstream_eof &&
+      Pending(conn->upstream_buffer, conn->upstream_offset) == 0) {
+    CloseConnection(conn);
+  }
+}
+
+void Forwarder::FailRequest(Connection* conn, const char* status) {
+  ReleaseUpstream(conn);
+  CloseSocket(conn->upstream);
+  conn->upstream = INVALID_SOCKET;
+  conn->upstream_buffer = std::string("HTTP/1.1 ") + status +
+      "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+  conn->upstream_offset = 0;
+  conn->state = kClosing;
+}
+
+void Forwarder::ReleaseUpstream(Connection* conn) {
+  if (conn->group && conn->upstream_index >= 0) {
+    Upstream& upstream = conn->group->upstreams[conn->upstream_index];
+    --upstream.active_connections;
+    if (conn->state == kConnecting) {
+      upstream.breaker.CancelTrial();
+    }
+  }
+  conn->upstream_index = -1;
+  conn->group = NULL;
+  if (conn->profile) {
+    conn->profile->Release();
+    conn->profile = NULL;
+  }
+}
+
+void Forwarder::CloseConnection(Connection* conn) {
+  if (conn->state == kClosed) {
+    return;
+  }
+  ReleaseUpstream(conn);
+  CloseSocket(conn->client);
+  CloseSocket(conn->upstream);
+  conn->client = conn->upstream = INVALID_SOCKET;
+  conn->state = kClosed;
+}
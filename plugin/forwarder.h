@@ -0,0 +1,127 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#ifndef __FORWARDER_H__
+#define __FORWARDER_H__
+
+#include <string>
+#include <vector>
+
+#include "net_util.h"
+#include "platform_util.h"
+#include "route_cache.h"
+
+class DnsResolver;
+struct HttpRequestHead;
+class UpstreamProfile;
+struct UpstreamGroup;
+
+// A local HTTP proxy on 127.0.0.1 that the system proxy setting points to
+// when a profile needs more than one upstream per scheme. It reads the
+// request line and Host header of each plain HTTP request or CONNECT,
+// sends hosts on the bypass list direct, picks an upstream for the rest
+// and relays bytes in both directions. Connect failures
+// and timeouts trip a per-upstream circuit breaker and the connection is
+// retried on the next upstream of the group right away. It also serves a
+// PAC script at /proxy.pac for clients that take an auto-config URL.
+class Forwarder {
+ public:
+  struct Options {
+    Options();
+
+    // How long a connect to an upstream may take before failing over to
+    // the next one.
+    int connect_timeout_ms;
+    // How long a connect may take when there is nothing to fail over to:
+    // going direct, or to the last upstream not tried yet.
+    int direct_connect_timeout_ms;
+    // At most what one select() can watch.
+    int max_connections;
+    // Not owned. Resolves destinations without blocking the event loop
+    // and lets bypass networks match names; NULL resolves them in place.
+    DnsResolver* resolver;
+  };
+
+  Forwarder();
+  explicit Forwarder(const Options& options);
+  ~Forwarder();
+
+  // Listens on 127.0.0.1:port, or an ephemeral port if port is 0, and
+  // starts the event loop thread.
+  bool Start(int port);
+  void Stop();
+  bool IsRunning() const { return thread_.IsStarted(); }
+  int port() const { return port_; }
+  // "127.0.0.1:port", as the system proxy setting names the forwarder.
+  std::string address() const;
+
+  // Replaces the upstream profile and bypass list used for new
+  // connections. Connections in flight keep using the upstream they have.
+  void SetProfile(const std::string& description,
+                  const std::string& bypass_list);
+  std::string profile();
+
+  // Serves script at pac_url() from now on; empty stops serving it. Each
+  // request gets either the old or the new script, never a mix.
+  void SetPacScript(const std::string& script);
+  std::string pac_url() const;
+
+ private:
+  struct Connection;
+
+  static void ThreadMain(void* arg);
+  static void OnNameResolved(void* arg);
+  void Run();
+  void ApplyPendingProfile();
+  void AcceptConnections();
+  void HandleConnection(Connection* conn, fd_set* read_fds,
+                        fd_set* write_fds, fd_set* error_fds);
+  void HandleRequestHead(Connection* conn);
+  void ServeLocalRequest(Connection* conn, const HttpRequestHead& head);
+  bool IsBypassed(const std::string& host, int port, bool* direct);
+  void PublishStats();
+  void ConnectNext(Connection* conn);
+  void OnConnectFailed(Connection* conn);
+  void OnConnected(Connection* conn);
+  void Relay(Connection* conn, fd_set* read_fds, fd_set* write_fds);
+  void FailRequest(Connection* conn, const char* status);
+  void ReleaseUpstream(Connection* conn);
+  void CloseConnection(Connection* conn);
+
+  Options options_;
+  Thread thread_;
+  SocketHandle listen_socket_;
+  SocketHandle wakeup_socket_;
+  struct sockaddr_in wakeup_addr_;
+  int port_;
+
+  mutable Mutex lock_;  // Guards stop_, pending_profile_ and pac_script_.
+  bool stop_;
+  bool has_pending_profile_;
+  std::string pending_profile_;
+  std::string pending_bypass_list_;
+  std::string pac_script_;
+
+  // Owned by the event loop thread.
+  UpstreamProfile* profile_;
+  uint32_t generation_;  // Bumped whenever profile_ changes.
+  RouteCache route_cache_;
+  int64_t route_lookups_;
+  int64_t route_lookup_ns_;
+  int64_t published_route_lookups_;
+  std::vector<Connection*> connections_;
+};
+
+#endif  // __FORWARDER_H__
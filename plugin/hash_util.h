@@ -0,0 +1,47 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#ifndef __HASH_UTIL_H__
+#define __HASH_UTIL_H__
+
+#include <stddef.h>
+
+#include "nptypes.h"
+
+// FNV-1a, 64 bit. Stable across platforms and releases, so it may be used
+// for anything that is persisted or compared between processes.
+inline uint64_t Fnv1a64(const void* data, size_t len,
+                        uint64_t hash = 14695981039346656037ULL) {
+  const unsigned char* p = (const unsigned char*)data;
+  for (size_t i = 0; i < len; ++i) {
+    hash ^= p[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// The MurmurHash3 finalizer. FNV leaves similar short keys such as
+// "a1.example.com" and "a2.example.com" close together in the high bits;
+// this spreads them over the whole range.
+inline uint64_t Mix64(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+#endif  // __HASH_UTIL_H__
@@ -0,0 +1,432 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "http_client.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dns_resolver.h"
+#include "net_util.h"
+#include "platform_util.h"
+
+static const int kMaxRedirects = 5;
+
+namespace {
+
+bool EqualsIgnoreCase(const std::string& a, const char* b) {
+  size_t len = strlen(b);
+  if (a.size() != len) {
+    return false;
+  }
+  for (size_t i = 0; i < len; ++i) {
+    if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string Trim(const std::string& text) {
+  size_t begin = text.find_first_not_of(" \t");
+  if (begin == std::string::npos) {
+    return std::string();
+  }
+  size_t end = text.find_last_not_of(" \t\r");
+  return text.substr(begin, end - begin + 1);
+}
+
+// Waits until socket is readable, or writable if write is set. Returns
+// false once deadline_ms has passed.
+bool WaitForSocket(SocketHandle socket, bool write, int64_t deadline_ms) {
+  int64_t remaining_ms = deadline_ms - NowMillis();
+  if (remaining_ms <= 0) {
+    return false;
+  }
+  fd_set fds;
+  FD_ZERO(&fds);
+  FD_SET(socket, &fds);
+  struct timeval timeout;
+  timeout.tv_sec = (long)(remaining_ms / 1000);
+  timeout.tv_usec = (long)(remaining_ms % 1000) * 1000;
+  int ready = select((int)socket + 1, write ? NULL : &fds,
+                     write ? &fds : NULL, NULL, &timeout);
+  return ready > 0;
+}
+
+// The parsed status line and headers of a response.
+struct ResponseHead {
+  ResponseHead()
+      : status(0), head_length(0), content_length(-1), chunked(false) {}
+
+  int status;
+  size_t head_length;
+  long content_length;
+  bool chunked;
+  std::string etag;
+  std::string last_modified;
+  std::string location;
+};
+
+// Returns false until data holds the complete head.
+bool ParseResponseHead(const std::string& data, ResponseHead* head,
+                       bool* malformed) {
+  *malformed = false;
+  size_t end = data.find("\r\n\r\n");
+  size_t terminator = 4;
+  if (end == std::string::npos) {
+    end = data.find("\n\n");
+    terminator = 2;
+    if (end == std::string::npos) {
+      return false;
+    }
+  }
+  head->head_length = end + terminator;
+  size_t line_end = data.find('\n');
+  std::string status_line = data.substr(0, line_end);
+  if (status_line.compare(0, 5, "HTTP/") != 0 ||
+      status_line.find(' ') == std::string::npos) {
+    *malformed = true;
+    return true;
+  }
+  head->status = atoi(status_line.c_str() + status_line.find(' ') + 1);
+  size_t pos = line_end + 1;
+  while (pos < end) {
+    size_t next = data.find('\n', pos);
+    if (next == std::string::npos || next > end) {
+      next = end;
+    }
+    std::string line = data.substr(pos, next - pos);
+    pos = next + 1;
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) {
+      continue;
+    }
+    std::string name = Trim(line.substr(0, colon));
+    std::string value = Trim(line.substr(colon + 1));
+    if (EqualsIgnoreCase(name, "content-length")) {
+      head->content_length = atol(value.c_str());
+    } else if (EqualsIgnoreCase(name, "transfer-encoding")) {
+      head->chunked = value.find("chunked") != std::string::npos;
+    } else if (EqualsIgnoreCase(name, "etag")) {
+      head->etag = value;
+    } else if (EqualsIgnoreCase(name, "last-modified")) {
+      head->last_modified = value;
+    } else if (EqualsIgnoreCase(name, "location")) {
+      head->location = value;
+    }
+  }
+  return true;
+}
+
+// Decodes a chunked body. Returns false until the last chunk has arrived;
+// sets malformed if it cannot be decoded.
+bool DecodeChunkedBody(const std::string& data, size_t begin,
+                       std::string* body, bool* malformed) {
+  *malformed = false;
+  body->clear();
+  size_t pos = begin;
+  while (true) {
+    size_t line_end = data.find('\n', pos);
+    if (line_end == std::string::npos) {
+      return false;
+    }
+    char* end;
+    unsigned long size = strtoul(data.c_str() + pos, &end, 16);
+    if (end == data.c_str() + pos) {
+      *malformed = true;
+      return true;
+    }
+    pos = line_end + 1;
+    if (size == 0) {
+      return true;  // Trailers, if any, are of no interest.
+    }
+    if (data.size() < pos + size + 1) {
+      return false;
+    }
+    body->append(data, pos, size);
+    pos += size;
+    // The CRLF after the chunk data.
+    if (data[pos] == '\r') {
+      ++pos;
+    }
+    if (pos >= data.size()) {
+      return false;
+    }
+    if (data[pos] != '\n') {
+      *malformed = true;
+      return true;
+    }
+    ++pos;
+  }
+}
+
+bool SendAll(SocketHandle socket, const std::string& data,
+             int64_t deadline_ms) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    int n = SocketSend(socket, data.data() + sent, (int)(data.size() - sent));
+    if (n > 0) {
+      sent += n;
+    } else if (n < 0 && LastSocketCallWouldBlock()) {
+      if (!WaitForSocket(socket, true, deadline_ms)) {
+        return false;
+      }
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+// IPv6 literals go to the system resolver, which does not block on them.
+bool ResolveHost(DnsResolver* resolver, const std::string& host, int port,
+                 int64_t deadline_ms, struct sockaddr_storage* addr,
+                 socklen_t* addr_len) {
+  if (!resolver || host.find(':') != std::string::npos) {
+    return ResolveHostPort(host.c_str(), port, addr, addr_len);
+  }
+  uint32_t address;
+  int64_t timeout_ms = deadline_ms - NowMillis();
+  if (timeout_ms <= 0 ||
+      resolver->Resolve(host, (int)timeout_ms, &address) !=
+      DnsResolver::kFound) {
+    return false;
+  }
+  struct sockaddr_in* addr4 = (struct sockaddr_in*)addr;
+  memset(addr4, 0, sizeof(*addr4));
+  addr4->sin_family = AF_INET;
+  addr4->sin_port = htons((uint16_t)port);
+  addr4->sin_addr.s_addr = htonl(address);
+  *addr_len = sizeof(*addr4);
+  return true;
+}
+
+// One request and response, without following redirects.
+bool FetchOnce(const HttpRequest& request, const std::string& url,
+               int64_t deadline_ms, ResponseHead* head, std::string* body,
+               std::string* error) {
+  std::string host;
+  int port;
+  std::string path;
+  if (!ParseHttpUrl(url, &host, &port, &path)) {
+    *error = "unsupported url " + url;
+    return false;
+  }
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+  if (!ResolveHost(request.resolver, host, port, deadline_ms, &addr,
+                   &addr_len)) {
+    *error = "cannot resolve " + host;
+    return false;
+  }
+  SocketHandle socket = CreateNonBlockingSocket(addr.ss_family);
+  if (socket == INVALID_SOCKET) {
+    *error = "cannot create socket";
+    return false;
+  }
+  ConnectResult connected = ConnectNonBlocking(
+      socket, (struct sockaddr*)&addr, addr_len);
+  if (connected == kConnectInProgress &&
+      (!WaitForSocket(socket, true, deadline_ms) ||
+       GetSocketError(socket) != 0)) {
+    connected = kConnectFailed;
+  }
+  if (connected == kConnectFailed) {
+    CloseSocket(socket);
+    *error = "cannot connect to " + host;
+    return false;
+  }
+
+  std::string host_header = host.find(':') != std::string::npos ?
+      "[" + host + "]" : host;
+  if (port != 80) {
+    char port_text[16];
+    snprintf(port_text, sizeof(port_text), ":%d", port);
+    host_header += port_text;
+  }
+  std::string message = "GET " + path + " HTTP/1.1\r\n"
+      "Host: " + host_header + "\r\n"
+      "Accept: */*\r\n"
+      "Connection: close\r\n";
+  if (!request.if_none_match.empty()) {
+    message += "If-None-Match: " + request.if_none_match + "\r\n";
+  }
+  if (!request.if_modified_since.empty()) {
+    message += "If-Modified-Since: " + request.if_modified_since + "\r\n";
+  }
+  message += "\r\n";
+  if (!SendAll(socket, message, deadline_ms)) {
+    CloseSocket(socket);
+    *error = "cannot send request";
+    return false;
+  }
+
+  std::string data;
+  bool have_head = false;
+  bool complete = false;
+  bool malformed = false;
+  char buffer[16384];
+  while (!complete && !malformed) {
+    int n = SocketRecv(socket, buffer, sizeof(buffer));
+    if (n < 0 && LastSocketCallWouldBlock()) {
+      if (!WaitForSocket(socket, false, deadline_ms)) {
+        *error = "timed out";
+        break;
+      }
+      continue;
+    }
+    if (n <= 0) {
+      // The server closed the connection, which ends a body without a
+      // length.
+      complete = have_head && !head->chunked && head->content_length < 0;
+      if (!complete) {
+        *error = "connection closed early";
+      }
+      break;
+    }
+    data.append(buffer, n);
+    if (data.size() > request.max_body_size + sizeof(buffer)) {
+      *error = "response too large";
+      break;
+    }
+    if (!have_head) {
+      have_head = ParseResponseHead(data, head, &malformed);
+    }
+    if (!have_head || malformed) {
+      continue;
+    }
+    // 304 and 204 responses have no body.
+    if (head->status == 304 || head->status == 204 ||
+        head->content_length == 0) {
+      complete = true;
+    } else if (head->chunked) {
+      complete = DecodeChunkedBody(data, head->head_length, body,
+                                   &malformed);
+    } else if (head->content_length > 0) {
+      complete = data.size() - head->head_length >=
+          (size_t)head->content_length;
+    }
+  }
+  CloseSocket(socket);
+  if (malformed) {
+    *error = "malformed response";
+    return false;
+  }
+  if (!complete) {
+    return false;
+  }
+  if (!head->chunked && head->status != 304 && head->status != 204) {
+    body->assign(data, head->head_length, std::string::npos);
+    if (head->content_length >= 0 &&
+        body->size() > (size_t)head->content_length) {
+      body->resize(head->content_length);
+    }
+  }
+  if (body->size() > request.max_body_size) {
+    *error = "response too large";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+bool ParseHttpUrl(const std::string& url, std::string* host, int* port,
+                  std::string* path) {
+  static const char kScheme[] = "http://";
+  if (url.size() < sizeof(kScheme) - 1) {
+    return false;
+  }
+  for (size_t i = 0; i < sizeof(kScheme) - 1; ++i) {
+    if (tolower((unsigned char)url[i]) != kScheme[i]) {
+      return false;
+    }
+  }
+  size_t begin = sizeof(kScheme) - 1;
+  size_t end = url.find_first_of("/?#", begin);
+  if (end == std::string::npos) {
+    end = url.size();
+  }
+  std::string authority = url.substr(begin, end - begin);
+  size_t at = authority.rfind('@');
+  if (at != std::string::npos) {
+    authority.erase(0, at + 1);
+  }
+  *port = 80;
+  size_t port_begin = std::string::npos;
+  if (!authority.empty() && authority[0] == '[') {
+    size_t close = authority.find(']');
+    if (close == std::string::npos) {
+      return false;
+    }
+    *host = authority.substr(1, close - 1);
+    if (close + 1 < authority.size() && authority[close + 1] == ':') {
+      port_begin = close + 2;
+    }
+  } else {
+    size_t colon = authority.find(':');
+    *host = authority.substr(0, colon);
+    if (colon != std::string::npos) {
+      port_begin = colon + 1;
+    }
+  }
+  if (port_begin != std::string::npos && port_begin < authority.size()) {
+    *port = atoi(authority.c_str() + port_begin);
+  }
+  if (host->empty() || *port <= 0 || *port > 65535) {
+    return false;
+  }
+  size_t fragment = url.find('#', end);
+  *path = url.substr(end, fragment == std::string::npos ?
+                     std::string::npos : fragment - end);
+  if (path->empty() || (*path)[0] != '/') {
+    path->insert(0, "/");
+  }
+  return true;
+}
+
+bool HttpGet(const HttpRequest& request, HttpResponse* response,
+             std::string* error) {
+  int64_t deadline_ms = NowMillis() + request.timeout_ms;
+  std::string url = request.url;
+  for (int redirects = 0; ; ++redirects) {
+    ResponseHead head;
+    std::string body;
+    if (!FetchOnce(request, url, deadline_ms, &head, &body, error)) {
+      return false;
+    }
+    bool redirect = head.status == 301 || head.status == 302 ||
+        head.status == 303 || head.status == 307 || head.status == 308;
+    if (redirect && !head.location.empty() && redirects < kMaxRedirects) {
+      if (head.location[0] == '/') {
+        // Relative to the host of the current url.
+        size_t host_end = url.find('/', url.find("://") + 3);
+        url = url.substr(0, host_end) + head.location;
+      } else {
+        url = head.location;
+      }
+      continue;
+    }
+    response->status = head.status;
+    response->etag = head.etag;
+    response->last_modified = head.last_modified;
+    response->body.swap(body);
+    response->final_url = url;
+    return true;
+  }
+}
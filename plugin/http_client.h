@@ -0,0 +1,62 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// A small blocking HTTP/1.1 client for fetching proxy auto-config files.
+// Plain http only; each request uses its own connection.
+
+#ifndef __HTTP_CLIENT_H__
+#define __HTTP_CLIENT_H__
+
+#include <stddef.h>
+
+#include <string>
+
+class DnsResolver;
+
+struct HttpRequest {
+  HttpRequest() : timeout_ms(10000), max_body_size(4 << 20), resolver(NULL) {}
+
+  std::string url;
+  // Validators of a cached copy. When set, the server may answer 304.
+  std::string if_none_match;
+  std::string if_modified_since;
+  // For the whole request, redirects included.
+  int timeout_ms;
+  size_t max_body_size;
+  // Not owned. Resolves host names instead of the system resolver.
+  DnsResolver* resolver;
+};
+
+struct HttpResponse {
+  HttpResponse() : status(0) {}
+
+  int status;
+  std::string etag;
+  std::string last_modified;
+  std::string body;
+  std::string final_url;  // After redirects.
+};
+
+// Splits an http:// URL. The path includes the query and is "/" if empty.
+bool ParseHttpUrl(const std::string& url, std::string* host, int* port,
+                  std::string* path);
+
+// Sends a GET and follows up to a few redirects. Returns false with a
+// message in error if no response was received; any status counts as a
+// response.
+bool HttpGet(const HttpRequest& request, HttpResponse* response,
+             std::string* error);
+
+#endif  // __HTTP_CLIENT_H__
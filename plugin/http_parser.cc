@@ -0,0 +1,142 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "http_parser.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#include "byte_scan.h"
+#include "proxy_server_list.h"
+
+// Request heads larger than this are rejected rather than buffered.
+static const size_t kMaxHeadLength = 16384;
+
+static void TrimSpaces(const char** begin, const char** end) {
+  while (*begin < *end && (**begin == ' ' || **begin == '\t')) {
+    ++*begin;
+  }
+  while (*end > *begin && ((*end)[-1] == ' ' || (*end)[-1] == '\t' ||
+                           (*end)[-1] == '\r')) {
+    --*end;
+  }
+}
+
+// No whitespace is allowed between a header name and its colon, so a line
+// is the Host header exactly when it starts with "host:" in any case.
+static bool IsHostHeader(const char* line, size_t len) {
+  return len >= 5 && (line[0] | 0x20) == 'h' && (line[1] | 0x20) == 'o' &&
+         (line[2] | 0x20) == 's' && (line[3] | 0x20) == 't' && line[4] == ':';
+}
+
+static bool ParseRequestLine(const char* begin, const char* end,
+                             HttpRequestHead* head) {
+  const char* space = FindByte(begin, end, ' ');
+  if (!space || space == begin) {
+    return false;
+  }
+  head->method = StringPiece(begin, space - begin);
+  const char* target = space + 1;
+  space = FindByte(target, end, ' ');
+  if (!space || space == target) {
+    return false;
+  }
+  head->target = StringPiece(target, space - target);
+  const char* version = space + 1;
+  const char* version_end = end;
+  TrimSpaces(&version, &version_end);
+  if (version_end - version < 5 || strncmp(version, "HTTP/", 5) != 0) {
+    return false;
+  }
+  head->version = StringPiece(version, version_end - version);
+  return true;
+}
+
+HttpParseResult ParseHttpRequestHead(const char* data, size_t len,
+                                     HttpRequestHead* head) {
+  *head = HttpRequestHead();
+  // Only the line ends are searched for; everything else is looked at a
+  // constant number of bytes per line.
+  ByteScanner newlines(data, data + len, '\n');
+  const char* line = data;
+  bool first_line = true;
+  const char* newline;
+  while ((newline = newlines.Next()) != NULL) {
+    const char* line_end = newline;
+    if (line_end > line && line_end[-1] == '\r') {
+      --line_end;
+    }
+    if (first_line) {
+      if (!ParseRequestLine(line, line_end, head)) {
+        return kHttpParseError;
+      }
+      first_line = false;
+    } else if (line_end == line) {
+      head->head_length = newline + 1 - data;
+      return kHttpParseDone;
+    } else if (head->host.empty() && IsHostHeader(line, line_end - line)) {
+      const char* value = line + 5;
+      const char* value_end = line_end;
+      TrimSpaces(&value, &value_end);
+      head->host = StringPiece(value, value_end - value);
+    }
+    line = newline + 1;
+  }
+  return len >= kMaxHeadLength ? kHttpParseError : kHttpParseIncomplete;
+}
+
+bool GetRequestDestination(const HttpRequestHead& head, std::string* scheme,
+                           std::string* host, int* port, StringPiece* path) {
+  const char* target = head.target.data;
+  const char* target_end = target + head.target.len;
+  if (head.method.Equals("CONNECT")) {
+    *scheme = "https";
+    *path = StringPiece();
+    return ParseHostPort(target, target_end, 443, host, port);
+  }
+  const char* authority = NULL;
+  scheme->clear();
+  for (const char* p = target; p + 3 <= target_end; ++p) {
+    if (p[0] == ':' && p[1] == '/' && p[2] == '/') {
+      for (const char* s = target; s < p; ++s) {
+        *scheme += (char)tolower((unsigned char)*s);
+      }
+      authority = p + 3;
+      break;
+    }
+    if (!isalpha((unsigned char)*p)) {
+      break;
+    }
+  }
+  if (authority) {
+    const char* authority_end = authority;
+    while (authority_end < target_end && *authority_end != '/' &&
+           *authority_end != '?') {
+      ++authority_end;
+    }
+    *path = authority_end < target_end ?
+        StringPiece(authority_end, target_end - authority_end) :
+        StringPiece("/", 1);
+    int default_port = *scheme == "https" ? 443 : (*scheme == "ftp" ? 21 : 80);
+    return ParseHostPort(authority, authority_end, default_port, host, port);
+  }
+  if (head.host.empty()) {
+    return false;
+  }
+  *scheme = "http";
+  *path = head.target;
+  return ParseHostPort(head.host.data, head.host.data + head.host.len, 80,
+                       host, port);
+}
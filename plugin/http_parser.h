@@ -0,0 +1,52 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Just enough HTTP/1.x request parsing to route a request: the request
+// line and the Host header. All results point into the caller's buffer.
+
+#ifndef __HTTP_PARSER_H__
+#define __HTTP_PARSER_H__
+
+#include <string>
+
+#include "string_piece.h"
+
+struct HttpRequestHead {
+  HttpRequestHead() : head_length(0) {}
+
+  StringPiece method;
+  StringPiece target;   // The request-target exactly as sent.
+  StringPiece version;
+  StringPiece host;     // Value of the Host header, without whitespace.
+  size_t head_length;   // Up to and including the terminating blank line.
+};
+
+enum HttpParseResult {
+  kHttpParseIncomplete,
+  kHttpParseDone,
+  kHttpParseError,
+};
+
+HttpParseResult ParseHttpRequestHead(const char* data, size_t len,
+                                     HttpRequestHead* head);
+
+// Where a parsed request wants to go. CONNECT requests carry "host:port",
+// proxy requests an absolute URI and anything else only a Host header.
+// scheme is "https" for CONNECT. path is the origin-form target, which is
+// what a request sent directly to the server must use.
+bool GetRequestDestination(const HttpRequestHead& head, std::string* scheme,
+                           std::string* host, int* port, StringPiece* path);
+
+#endif  // __HTTP_PARSER_H__
@@ -8,6 +8,11 @@
 
 #include "mac_proxy.h"
 
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
 #include "npswitchproxy.h"
 
 static const char* const kNetworkSetupPath = "/usr/sbin/networksetup";
@@ -51,9 +56,18 @@ bool MacProxy::GetAuthorizationForRootPrivilege() {
 
 OSStatus MacProxy::RunNetworkSetupCommand(char *const *args) {
   int state;
+  FILE* output = NULL;
   OSStatus status = AuthorizationExecuteWithPrivileges(
       authorization_, kNetworkSetupPath, kAuthorizationFlagDefaults,
-      args, NULL);
+      args, &output);
+  if (output) {
+    // The pipe closes when this command exits. wait() alone may reap the
+    // command of a concurrent apply instead and return too early.
+    char buffer[256];
+    while (fread(buffer, 1, sizeof(buffer), output) > 0) {
+    }
+    fclose(output);
+  }
   wait(&state);
   return status;
 }
@@ -377,8 +391,82 @@ void MacProxy::ParseProxyServerDescription(
   }
 }
 
-bool MacProxy::SetProxyConfig(const ProxyConfig& config) {
+// The networksetup options and values that apply a setting. The
+// service name, which goes between the option and its values, is looked
+// up when the payload is applied since the active service may change.
+class MacProxyPayload : public ProxyPayload {
+ public:
+  struct Command {
+    std::string option;
+    std::string value;
+    std::string port;  // Empty if the option takes no port.
+  };
+
+  void Add(const char* option, const char* value, const char* port = "") {
+    Command command;
+    command.option = option;
+    command.value = value;
+    command.port = port;
+    commands.push_back(command);
+  }
+
+  std::vector<Command> commands;
+};
+
+// The options for the http, https, ftp and socks entries of
+// ParseProxyServerDescription.
+static const char* const kProxyStateOptions[4] = {
+  "-setwebproxystate",
+  "-setsecurewebproxystate",
+  "-setftpproxystate",
+  "-setsocksfirewallproxystate",
+};
+static const char* const kProxyOptions[4] = {
+  "-setwebproxy",
+  "-setsecurewebproxy",
+  "-setftpproxy",
+  "-setsocksfirewallproxy",
+};
 
+ProxyPayload* MacProxy::CompilePayload(const ProxyConfig& config) {
+  MacProxyPayload* payload = new MacProxyPayload;
+  if (!config.use_proxy) {
+    payload->Add("-setautoproxystate", "off");
+    for (int i = 0; i < 4; ++i) {
+      payload->Add(kProxyStateOptions[i], "off");
+    }
+    return payload;
+  }
+  if (config.auto_config && config.auto_config_url) {
+    payload->Add("-setautoproxystate", "on");
+    payload->Add("-setautoproxyurl", config.auto_config_url);
+  }
+  if (!config.proxy_server) {
+    return payload;
+  }
+  char *proxies[4];
+  char *ports[4];
+  for (int i = 0; i < 4; ++i) {
+    proxies[i] = new char[kMaxCommandArgumentLength + 1];
+    ports[i] = new char[kMaxPortLength + 1];
+    bzero(proxies[i], kMaxCommandArgumentLength + 1);
+    bzero(ports[i], kMaxPortLength + 1);
+  }
+  ParseProxyServerDescription(config.proxy_server, proxies, ports);
+  for (int i = 0; i < 4; ++i) {
+    if (strlen(proxies[i])) {
+      payload->Add(kProxyStateOptions[i], "on");
+      payload->Add(kProxyOptions[i], proxies[i], ports[i]);
+    }
+  }
+  for (int i = 0; i < 4; ++i) {
+    delete [] proxies[i];
+    delete [] ports[i];
+  }
+  return payload;
+}
+
+bool MacProxy::ApplyPayload(const ProxyPayload& payload) {
   SCPreferencesRef sc_preference = SCPreferencesCreate(
       kCFAllocatorDefault, CFSTR("Chrome Switch Proxy Plugin"), NULL);
   SCNetworkSetRef network_set = SCNetworkSetCopyCurrent(sc_preference);
@@ -388,7 +476,7 @@ bool MacProxy::SetProxyConfig(const ProxyConfig& config) {
   }
   SCNetworkServiceRef service =
       MacProxy::CopyActiveNetworkService(network_set);
-  if (!service || !GetAuthorizationForRootPrivilege()) {
+  if (!service) {
     CFRelease(network_set);
     CFRelease(sc_preference);
     return false;
@@ -396,104 +484,105 @@ bool MacProxy::SetProxyConfig(const ProxyConfig& config) {
   CFStringRef service_name = SCNetworkServiceGetName(service);
   char *service_name_str =
       MacProxy::CreateCStringFromString(service_name);
-  char *args[kMaxArgNum];
-  args[0] = new char[kMaxCommandArgumentLength + 1];
-  args[1] = new char[kMaxCommandArgumentLength + 1];
-  args[2] = new char[kMaxCommandArgumentLength + 1];
-  for (int i = 3; i < kMaxArgNum; ++i) {
-    args[i] = NULL;
+  bool ok = RunPayloadCommands(payload, service_name_str);
+  delete [] service_name_str;
+  CFRelease(service);
+  CFRelease(network_set);
+  CFRelease(sc_preference);
+  return ok;
+}
+
+bool MacProxy::UpdateProxyConfig(const ProxyConfig& config, int fields) {
+  if ((fields & kUseProxyField) && !config.use_proxy) {
+    // Turns everything off, whatever the other fields are.
+    return SetProxyConfig(config);
+  }
+  // networksetup keeps a state per scheme, so turning the proxy on takes
+  // the server to know which ones, and setting the server takes knowing
+  // whether the proxy is on.
+  if (!(fields & kUseProxyField) != !(fields & kProxyServerField)) {
+    return ProxyBase::UpdateProxyConfig(config, fields);
+  }
+  MacProxyPayload payload;
+  if (fields & kAutoConfigField) {
+    payload.Add("-setautoproxystate", config.auto_config ? "on" : "off");
   }
-  for (int i = 0; i < 3; ++i) {
-    bzero(args[i], kMaxCommandArgumentLength);
+  if ((fields & kAutoConfigUrlField) && config.auto_config_url) {
+    payload.Add("-setautoproxyurl", config.auto_config_url);
   }
-  strncpy(args[1], service_name_str, kMaxCommandArgumentLength);
+  if ((fields & kProxyServerField) && config.proxy_server) {
+    ProxyConfig server;
+    server.CopyFields(config, kUseProxyField | kProxyServerField);
+    MacProxyPayload* server_payload =
+        static_cast<MacProxyPayload*>(CompilePayload(server));
+    payload.commands.insert(payload.commands.end(),
+                            server_payload->commands.begin(),
+                            server_payload->commands.end());
+    delete server_payload;
+  }
+  // The bypass list and auto detect are not set on the Mac.
+  if (payload.commands.empty()) {
+    return true;
+  }
+  return ApplyPayload(payload);
+}
 
-  if (!config.use_proxy) {
-    strncpy(args[0], "-setautoproxystate", kMaxCommandArgumentLength);
-    strncpy(args[2], "off", kMaxCommandArgumentLength);
-    RunNetworkSetupCommand(args);
-    strncpy(args[0], "-setwebproxystate", kMaxCommandArgumentLength);
-    strncpy(args[2], "off", kMaxCommandArgumentLength);
-    RunNetworkSetupCommand(args);
-    strncpy(args[0], "-setsecurewebproxystate", kMaxCommandArgumentLength);
-    strncpy(args[2], "off", kMaxCommandArgumentLength);
-    RunNetworkSetupCommand(args);
-    strncpy(args[0], "-setftpproxystate", kMaxCommandArgumentLength);
-    strncpy(args[2], "off", kMaxCommandArgumentLength);
-    RunNetworkSetupCommand(args);
-    strncpy(args[0], "-setsocksfirewallproxystate", kMaxCommandArgumentLength);
-    strncpy(args[2], "off", kMaxCommandArgumentLength);
-    RunNetworkSetupCommand(args);
-  } else {
-    if (config.auto_config && config.auto_config_url) {
-      strncpy(args[2], "on", kMaxCommandArgumentLength);
-      RunNetworkSetupCommand(args);
-      strncpy(args[0], "-setautoproxyurl", kMaxCommandArgumentLength);
-      strncpy(args[2], config.auto_config_url, kMaxCommandArgumentLength);
-      RunNetworkSetupCommand(args);
-    }
-    char *proxies[4];
-    char *ports[4];
-    for (int i = 0; i < 4; ++i) {
-      proxies[i] = new char[kMaxCommandArgumentLength + 1];
-      ports[i] = new char[kMaxPortLength + 1];
-      bzero(proxies[i], kMaxCommandArgumentLength + 1);
-      bzero(ports[i], kMaxPortLength + 1);
-    }
-    ParseProxyServerDescription(config.proxy_server, proxies, ports);
-    for (int i = 0; i < 4; ++i ) {
-      if (strlen(proxies[i])) {
-        switch (i) {
-          case 0:
-            strncpy(args[0], "-setwebproxystate", kMaxCommandArgumentLength);
-            strncpy(args[2], "on", kMaxCommandArgumentLength);
-            RunNetworkSetupCommand(args);
-            strncpy(args[0], "-setwebproxy", kMaxCommandArgumentLength);
-            strncpy(args[2], proxies[i], kMaxCommandArgumentLength);
-            break;
-          case 1:
-            strncpy(args[0], "-setsecurewebproxystate",
-                    kMaxCommandArgumentLength);
-            strncpy(args[2], "on", kMaxCommandArgumentLength);
-            RunNetworkSetupCommand(args);
-            strncpy(args[0], "-setsecurewebproxy", kMaxCommandArgumentLength);
-            strncpy(args[2], proxies[i], kMaxCommandArgumentLength);
-            break;
-          case 2:
-            strncpy(args[0], "-setftpproxystate", kMaxCommandArgumentLength);
-            strncpy(args[2], "on", kMaxCommandArgumentLength);
-            RunNetworkSetupCommand(args);
-            strncpy(args[0], "-setftpproxy", kMaxCommandArgumentLength);
-            strncpy(args[2], proxies[i], kMaxCommandArgumentLength);
-            break;
-          case 3:
-            strncpy(args[0], "-setsocksfirewallproxystate",
-                    kMaxCommandArgumentLength);
-            strncpy(args[2], "on", kMaxCommandArgumentLength);
-            RunNetworkSetupCommand(args);
-            strncpy(args[0], "-setsocksfirewallproxy",
-                    kMaxCommandArgumentLength);
-            strncpy(args[2], proxies[i], kMaxCommandArgumentLength);
-            break;
-        }
-        args[3] = new char[kMaxPortLength + 1];
-        strncpy(args[3], ports[i], kMaxPortLength);
-        RunNetworkSetupCommand(args);
-        delete [] args[3];
-        args[3] = NULL;
-      }
-    }
-    for (int i = 0; i < 4; ++i) {
-      delete [] proxies[i];
-      delete [] ports[i];
+bool MacProxy::EnumerateConnections(std::vector<std::string>* names) {
+  names->clear();
+  SCPreferencesRef sc_preference = SCPreferencesCreate(
+      kCFAllocatorDefault, CFSTR("Chrome Switch Proxy Plugin"), NULL);
+  SCNetworkSetRef network_set = SCNetworkSetCopyCurrent(sc_preference);
+  if (!network_set) {
+    CFRelease(sc_preference);
+    return false;
+  }
+  CFArrayRef services = SCNetworkSetCopyServices(network_set);
+  long count = services ? CFArrayGetCount(services) : 0;
+  for (long i = 0; i < count; ++i) {
+    SCNetworkServiceRef service =
+        (SCNetworkServiceRef) CFArrayGetValueAtIndex(services, i);
+    if (service && SCNetworkServiceGetEnabled(service)) {
+      char* name =
+          MacProxy::CreateCStringFromString(SCNetworkServiceGetName(service));
+      names->push_back(name);
+      delete [] name;
     }
   }
-  delete [] args[0];
-  delete [] args[1];
-  delete [] args[2];
-  delete service_name_str;
-  CFRelease(service);
+  if (services) {
+    CFRelease(services);
+  }
   CFRelease(network_set);
   CFRelease(sc_preference);
   return true;
 }
+
+bool MacProxy::ApplyPayloadToConnection(const ProxyPayload& payload,
+                                        const std::string& name) {
+  return RunPayloadCommands(payload, name.c_str());
+}
+
+bool MacProxy::RunPayloadCommands(const ProxyPayload& proxy_payload,
+                                  const char* service_name) {
+  const MacProxyPayload& payload =
+      static_cast<const MacProxyPayload&>(proxy_payload);
+  {
+    ScopedLock lock(&authorization_lock_);
+    if (!GetAuthorizationForRootPrivilege()) {
+      return false;
+    }
+  }
+  // networksetup only reads its arguments.
+  char *args[kMaxArgNum];
+  bool ok = true;
+  for (size_t i = 0; i < payload.commands.size(); ++i) {
+    const MacProxyPayload::Command& command = payload.commands[i];
+    args[0] = const_cast<char*>(command.option.c_str());
+    args[1] = const_cast<char*>(service_name);
+    args[2] = const_cast<char*>(command.value.c_str());
+    args[3] = command.port.empty() ?
+        NULL : const_cast<char*>(command.port.c_str());
+    args[4] = NULL;
+    ok = RunNetworkSetupCommand(args) == errAuthorizationSuccess && ok;
+  }
+  return ok;
+}
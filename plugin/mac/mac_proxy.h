@@ -9,6 +9,7 @@
 #define __MAC_PROXY_H__
 #include "proxy_config.h"
 
+#include "platform_util.h"
 #include "proxy_base.h"
 
 #include <Security/Security.h>
@@ -22,7 +23,12 @@ class MacProxy : public ProxyBase {
   virtual void PlatformDependentShutdown();
   virtual bool GetActiveConnectionName(const void** connection_name);
   virtual bool GetProxyConfig(ProxyConfig* config);
-  virtual bool SetProxyConfig(const ProxyConfig& config);
+  virtual bool UpdateProxyConfig(const ProxyConfig& config, int fields);
+  virtual ProxyPayload* CompilePayload(const ProxyConfig& config);
+  virtual bool ApplyPayload(const ProxyPayload& payload);
+  virtual bool EnumerateConnections(std::vector<std::string>* names);
+  virtual bool ApplyPayloadToConnection(const ProxyPayload& payload,
+                                        const std::string& name);
 
  private:
   bool GetAuthorizationForRootPrivilege();
@@ -33,6 +39,9 @@ class MacProxy : public ProxyBase {
       const char* proxy_server, char* proxies[4], char* ports[4]);
 
   OSStatus RunNetworkSetupCommand(char *const* args);
+  // Runs the networksetup commands of payload for the service.
+  bool RunPayloadCommands(const ProxyPayload& payload,
+                          const char* service_name);
 
   static bool GetBoolFromDictionary(
       CFDictionaryRef dict,
@@ -56,6 +65,8 @@ class MacProxy : public ProxyBase {
       SCNetworkSetRef network_set);
 
   AuthorizationRef authorization_;;
+  // Serializes the authorization calls of concurrent applies.
+  Mutex authorization_lock_;
 };
 
 #endif  // __MAC_PROXY_H__
\ No newline at end of file
@@ -0,0 +1,259 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "net_util.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "platform_util.h"
+
+#if !defined(_WINDOWS)
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#endif
+
+bool InitializeSockets() {
+#if defined(_WINDOWS)
+  WSADATA data;
+  return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+#else
+  return true;
+#endif
+}
+
+void ShutdownSockets() {
+#if defined(_WINDOWS)
+  WSACleanup();
+#endif
+}
+
+bool ResolveHostPort(const char* host, int port,
+                     struct sockaddr_storage* addr, socklen_t* addr_len,
+                     int family) {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = family;
+  hints.ai_socktype = SOCK_STREAM;
+  char port_str[16];
+  snprintf(port_str, sizeof(port_str), "%d", port);
+  struct addrinfo* result = NULL;
+  if (getaddrinfo(host, port_str, &hints, &result) != 0 || !result) {
+    return false;
+  }
+  memcpy(addr, result->ai_addr, result->ai_addrlen);
+  *addr_len = (socklen_t)result->ai_addrlen;
+  freeaddrinfo(result);
+  return true;
+}
+
+bool FitsInFdSet(SocketHandle socket) {
+#if defined(_WINDOWS)
+  // Windows fd_sets hold handles of any value, up to FD_SETSIZE of them.
+  return true;
+#else
+  return socket >= 0 && socket < FD_SETSIZE;
+#endif
+}
+
+bool SetNonBlocking(SocketHandle socket) {
+#if defined(_WINDOWS)
+  u_long non_blocking = 1;
+  return ioctlsocket(socket, FIONBIO, &non_blocking) == 0;
+#else
+  int flags = fcntl(socket, F_GETFL, 0);
+  return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+SocketHandle CreateNonBlockingSocket(int family) {
+  SocketHandle s = socket(family, SOCK_STREAM, IPPROTO_TCP);
+  if (s == INVALID_SOCKET) {
+    return INVALID_SOCKET;
+  }
+  if (!SetNonBlocking(s)) {
+    CloseSocket(s);
+    return INVALID_SOCKET;
+  }
+  int one = 1;
+  setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+#if defined(SO_NOSIGPIPE)
+  setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, (const char*)&one, sizeof(one));
+#endif
+  return s;
+}
+
+void CloseSocket(SocketHandle socket) {
+  if (socket == INVALID_SOCKET) {
+    return;
+  }
+#if defined(_WINDOWS)
+  closesocket(socket);
+#else
+  close(socket);
+#endif
+}
+
+void ShutdownSend(SocketHandle socket) {
+#if defined(_WINDOWS)
+  shutdown(socket, SD_SEND);
+#else
+  shutdown(socket, SHUT_WR);
+#endif
+}
+
+ConnectResult ConnectNonBlocking(SocketHandle socket,
+                                 const struct sockaddr* addr,
+                                 socklen_t addr_len) {
+  if (connect(socket, addr, addr_len) == 0) {
+    return kConnectDone;
+  }
+#if defined(_WINDOWS)
+  int error = WSAGetLastError();
+  if (error == WSAEWOULDBLOCK || error == WSAEINPROGRESS) {
+    return kConnectInProgress;
+  }
+#else
+  if (errno == EINPROGRESS || errno == EINTR) {
+    return kConnectInProgress;
+  }
+#endif
+  return kConnectFailed;
+}
+
+int GetSocketError(SocketHandle socket) {
+  int error = 0;
+  socklen_t len = sizeof(error);
+  if (getsockopt(socket, SOL_SOCKET, SO_ERROR, (char*)&error, &len) != 0) {
+    return -1;
+  }
+  return error;
+}
+
+bool LastSocketCallWouldBlock() {
+#if defined(_WINDOWS)
+  return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+  return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+int SocketSend(SocketHandle socket, const char* data, int len) {
+#if defined(MSG_NOSIGNAL)
+  return (int)send(socket, data, len, MSG_NOSIGNAL);
+#else
+  return (int)send(socket, data, len, 0);
+#endif
+}
+
+int SocketRecv(SocketHandle socket, char* buffer, int len) {
+  return (int)recv(socket, buffer, len, 0);
+}
+
+SocketHandle ListenOnLoopback(int port, int* bound_port) {
+  SocketHandle s = CreateNonBlockingSocket(AF_INET);
+  if (s == INVALID_SOCKET) {
+    return INVALID_SOCKET;
+  }
+  int one = 1;
+  setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons((unsigned short)port);
+  if (bind(s, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+      listen(s, SOMAXCONN) != 0) {
+    CloseSocket(s);
+    return INVALID_SOCKET;
+  }
+  socklen_t len = sizeof(addr);
+  if (getsockname(s, (struct sockaddr*)&addr, &len) != 0) {
+    CloseSocket(s);
+    return INVALID_SOCKET;
+  }
+  if (bound_port) {
+    *bound_port = ntohs(addr.sin_port);
+  }
+  return s;
+}
+
+SocketHandle CreateWakeupSocket(struct sockaddr_in* addr) {
+  SocketHandle s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (s == INVALID_SOCKET) {
+    return INVALID_SOCKET;
+  }
+  memset(addr, 0, sizeof(*addr));
+  addr->sin_family = AF_INET;
+  addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(*addr);
+  if (!SetNonBlocking(s) ||
+      bind(s, (struct sockaddr*)addr, sizeof(*addr)) != 0 ||
+      getsockname(s, (struct sockaddr*)addr, &len) != 0) {
+    CloseSocket(s);
+    return INVALID_SOCKET;
+  }
+  return s;
+}
+
+void SignalWakeupSocket(SocketHandle socket, const struct sockaddr_in& addr) {
+  char byte = 0;
+  sendto(socket, &byte, 1, 0, (const struct sockaddr*)&addr, sizeof(addr));
+}
+
+void DrainWakeupSocket(SocketHandle socket) {
+  char buffer[64];
+  while (recv(socket, buffer, sizeof(buffer), 0) > 0) {
+  }
+}
+
+bool GetPrimaryIpv4Address(char* buffer, int len) {
+  // Connecting a UDP socket only selects the route and source address.
+  SocketHandle s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (s == INVALID_SOCKET) {
+    return false;
+  }
+  struct sockaddr_in remote;
+  memset(&remote, 0, sizeof(remote));
+  remote.sin_family = AF_INET;
+  remote.sin_port = htons(53);
+  remote.sin_addr.s_addr = htonl(0x08080808);
+  struct sockaddr_in local;
+  socklen_t local_len = sizeof(local);
+  bool ok = connect(s, (struct sockaddr*)&remote, sizeof(remote)) == 0 &&
+      getsockname(s, (struct sockaddr*)&local, &local_len) == 0 &&
+      local.sin_addr.s_addr != 0;
+  CloseSocket(s);
+  if (ok) {
+    FormatAddress((struct sockaddr*)&local, buffer, len);
+  }
+  return ok;
+}
+
+void FormatAddress(const struct sockaddr* addr, char* buffer, int len) {
+  buffer[0] = 0;
+  if (addr->sa_family == AF_INET) {
+    const unsigned char* ip = (const unsigned char*)
+        &((const struct sockaddr_in*)addr)->sin_addr;
+    snprintf(buffer, len, "%d.%d.%d.%d", ip[0], ip[1], ip[2], ip[3]);
+  } else if (addr->sa_family == AF_INET6) {
+    getnameinfo(addr, sizeof(struct sockaddr_in6), buffer, len, NULL, 0,
+                NI_NUMERICHOST);
+  }
+}
@@ -0,0 +1,107 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Portable non-blocking socket helpers on top of winsock and BSD sockets.
+// Event loops use select(), which is the one readiness API available on
+// every platform the plugin ships on.
+
+#ifndef __NET_UTIL_H__
+#define __NET_UTIL_H__
+
+#if defined(_WINDOWS)
+// The winsock default of 64 sockets per fd_set is too small for probing
+// and forwarding.
+#ifndef FD_SETSIZE
+#define FD_SETSIZE 1024
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET SocketHandle;
+typedef int socklen_t;
+#else
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+typedef int SocketHandle;
+#ifndef INVALID_SOCKET
+#define INVALID_SOCKET (-1)
+#endif
+#endif
+
+#include "nptypes.h"
+
+enum ConnectResult {
+  kConnectFailed = -1,
+  kConnectDone = 0,
+  kConnectInProgress = 1,
+};
+
+// Must be called once before any other socket call. Safe to call again.
+bool InitializeSockets();
+void ShutdownSockets();
+
+// Resolves host (a name or a literal) and port into addr with a blocking
+// lookup, optionally restricted to one address family. Returns false if
+// the name cannot be resolved.
+bool ResolveHostPort(const char* host, int port,
+                     struct sockaddr_storage* addr, socklen_t* addr_len,
+                     int family = AF_UNSPEC);
+
+// The address of the interface that carries the default route, found
+// without sending anything. Formatted as by FormatAddress.
+bool GetPrimaryIpv4Address(char* buffer, int len);
+
+// Whether socket can be put in an fd_set. On POSIX that takes a
+// descriptor below FD_SETSIZE, which a process with many files open may
+// not get.
+bool FitsInFdSet(SocketHandle socket);
+
+// Creates a non-blocking TCP socket of the given address family.
+SocketHandle CreateNonBlockingSocket(int family);
+bool SetNonBlocking(SocketHandle socket);
+void CloseSocket(SocketHandle socket);
+// Half-closes the sending direction.
+void ShutdownSend(SocketHandle socket);
+
+// Starts a non-blocking connect. Completion of kConnectInProgress is
+// signaled by writability; GetSocketError then tells whether it succeeded.
+ConnectResult ConnectNonBlocking(SocketHandle socket,
+                                 const struct sockaddr* addr,
+                                 socklen_t addr_len);
+int GetSocketError(SocketHandle socket);
+
+// True if the last send/recv/accept failed only because it would block.
+bool LastSocketCallWouldBlock();
+
+// Returns the number of bytes transferred, 0 on orderly shutdown (recv
+// only) or -1 on error. Never raises SIGPIPE.
+int SocketSend(SocketHandle socket, const char* data, int len);
+int SocketRecv(SocketHandle socket, char* buffer, int len);
+
+// Opens a non-blocking listening socket on 127.0.0.1. A zero port picks an
+// ephemeral one; the bound port is returned in bound_port.
+SocketHandle ListenOnLoopback(int port, int* bound_port);
+
+// A non-blocking UDP socket on 127.0.0.1 that an event loop can select on
+// and other threads can wake it up through with SignalWakeupSocket.
+SocketHandle CreateWakeupSocket(struct sockaddr_in* addr);
+void SignalWakeupSocket(SocketHandle socket, const struct sockaddr_in& addr);
+void DrainWakeupSocket(SocketHandle socket);
+
+// Formats the numeric address of addr into buffer.
+void FormatAddress(const struct sockaddr* addr, char* buffer, int len);
+
+#endif  // __NET_UTIL_H__
@@ -0,0 +1,64 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "network_rules.h"
+
+#include <ctype.h>
+
+static std::string ToLower(const std::string& text) {
+  std::string result(text);
+  for (size_t i = 0; i < result.size(); ++i) {
+    result[i] = (char)tolower((unsigned char)result[i]);
+  }
+  return result;
+}
+
+void NetworkRules::Set(const std::vector<Rule>& rules) {
+  rules_.clear();
+  for (size_t i = 0; i < rules.size(); ++i) {
+    CompiledRule rule;
+    rule.profile_id = rules[i].profile_id;
+    rule.network.Parse(rules[i].network.c_str());
+    // Connection names may look like anything, so only a rule that
+    // parses as a single network and nothing else is one.
+    if (rule.network.rules().size() != 1 ||
+        rule.network.rules()[0].type != BypassList::Rule::kNetwork ||
+        rules[i].network.find('/') == std::string::npos) {
+      rule.network = BypassList();
+      rule.connection = ToLower(rules[i].network);
+      if (rule.connection.empty()) {
+        continue;
+      }
+    }
+    rules_.push_back(rule);
+  }
+}
+
+bool NetworkRules::Match(const std::string& connection,
+                         const std::string& address,
+                         uint32_t* profile_id) const {
+  std::string lower_connection = ToLower(connection);
+  for (size_t i = 0; i < rules_.size(); ++i) {
+    const CompiledRule& rule = rules_[i];
+    bool matches = rule.connection.empty() ?
+        !address.empty() && rule.network.Matches(address, 0) :
+        rule.connection == lower_connection;
+    if (matches) {
+      *profile_id = rule.profile_id;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,58 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#ifndef __NETWORK_RULES_H__
+#define __NETWORK_RULES_H__
+
+#include <string>
+#include <vector>
+
+#include "bypass_list.h"
+#include "nptypes.h"
+
+// Which saved profile to switch to on which network. A rule names the
+// network either by its connection name, compared case-insensitively,
+// e.g. "Wi-Fi", "Work VPN" or "LAN" for the default connection on
+// Windows, or by an IPv4 network such as "10.20/16", which the address of
+// the interface carrying the default route must be in. Rules are tried in
+// order and the first match wins.
+class NetworkRules {
+ public:
+  struct Rule {
+    Rule() : profile_id(0) {}
+
+    std::string network;
+    uint32_t profile_id;
+  };
+
+  void Set(const std::vector<Rule>& rules);
+  bool empty() const { return rules_.empty(); }
+
+  // address is the numeric IPv4 address of the primary interface, or
+  // empty if there is none.
+  bool Match(const std::string& connection, const std::string& address,
+             uint32_t* profile_id) const;
+
+ private:
+  struct CompiledRule {
+    std::string connection;  // Lower case; empty for a network rule.
+    BypassList network;
+    uint32_t profile_id;
+  };
+
+  std::vector<CompiledRule> rules_;
+};
+
+#endif  // __NETWORK_RULES_H__
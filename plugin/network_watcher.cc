@@ -0,0 +1,284 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "network_watcher.h"
+
+#include <string.h>
+
+#if defined(_WINDOWS)
+#include <iphlpapi.h>
+#elif defined(__linux__)
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <unistd.h>
+#else
+#include <net/if.h>
+#include <net/route.h>
+#include <unistd.h>
+#endif
+
+#include "npswitchproxy.h"
+
+// A burst is over once no event came for this long...
+static const int kSettleMs = 50;
+// ...or at the latest this long after its first event.
+static const int kMaxSettleMs = 500;
+// Before retrying after the system failed to deliver events.
+static const int kRetryMs = 1000;
+
+NetworkWatcher::NetworkWatcher()
+    : callback_(NULL),
+      arg_(NULL),
+#if defined(_WINDOWS)
+      stop_event_(NULL),
+      notify_handle_(NULL),
+      pending_(false) {
+  memset(&overlapped_, 0, sizeof(overlapped_));
+#else
+      route_socket_(INVALID_SOCKET),
+      wakeup_socket_(INVALID_SOCKET),
+      stop_(false) {
+#endif
+}
+
+NetworkWatcher::~NetworkWatcher() {
+  Stop();
+}
+
+bool NetworkWatcher::Start(Callback callback, void* arg) {
+  if (thread_.IsStarted()) {
+    return true;
+  }
+  callback_ = callback;
+  arg_ = arg;
+#if defined(_WINDOWS)
+  stop_event_ = CreateEvent(NULL, TRUE, FALSE, NULL);
+  overlapped_.hEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+  if (!stop_event_ || !overlapped_.hEvent ||
+      !thread_.Start(ThreadMain, this)) {
+    if (stop_event_) {
+      CloseHandle(stop_event_);
+    }
+    if (overlapped_.hEvent) {
+      CloseHandle(overlapped_.hEvent);
+    }
+    stop_event_ = overlapped_.hEvent = NULL;
+    return false;
+  }
+#else
+#if defined(__linux__)
+  route_socket_ = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+  struct sockaddr_nl addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV4_ROUTE;
+  if (route_socket_ != INVALID_SOCKET &&
+      bind(route_socket_, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    CloseSocket(route_socket_);
+    route_socket_ = INVALID_SOCKET;
+  }
+#else
+  route_socket_ = socket(PF_ROUTE, SOCK_RAW, AF_UNSPEC);
+#endif
+  if (route_socket_ == INVALID_SOCKET || !SetNonBlocking(route_socket_)) {
+    CloseSocket(route_socket_);
+    route_socket_ = INVALID_SOCKET;
+    return false;
+  }
+  wakeup_socket_ = CreateWakeupSocket(&wakeup_addr_);
+  {
+    ScopedLock lock(&lock_);
+    stop_ = false;
+  }
+  if (wakeup_socket_ == INVALID_SOCKET || !thread_.Start(ThreadMain, this)) {
+    CloseSocket(route_socket_);
+    CloseSocket(wakeup_socket_);
+    route_socket_ = wakeup_socket_ = INVALID_SOCKET;
+    return false;
+  }
+#endif
+  return true;
+}
+
+void NetworkWatcher::Stop() {
+  if (!thread_.IsStarted()) {
+    return;
+  }
+#if defined(_WINDOWS)
+  SetEvent(stop_event_);
+  thread_.Join();
+  CloseHandle(stop_event_);
+  CloseHandle(overlapped_.hEvent);
+  stop_event_ = overlapped_.hEvent = NULL;
+#else
+  {
+    ScopedLock lock(&lock_);
+    stop_ = true;
+  }
+  SignalWakeupSocket(wakeup_socket_, wakeup_addr_);
+  thread_.Join();
+  CloseSocket(route_socket_);
+  CloseSocket(wakeup_socket_);
+  route_socket_ = wakeup_socket_ = INVALID_SOCKET;
+#endif
+}
+
+// static
+void NetworkWatcher::ThreadMain(void* arg) {
+  ((NetworkWatcher*)arg)->Run();
+}
+
+void NetworkWatcher::Run() {
+  while (true) {
+    WaitResult result = WaitForChange(-1);
+    if (result == kFailed) {
+      DebugLog("NetworkWatcher: cannot wait for changes\n");
+      result = WaitForChange(kRetryMs);
+    }
+    if (result == kStopped) {
+      break;
+    }
+    if (result != kChanged) {
+      continue;
+    }
+    int64_t changed_us = NowMicros();
+    int64_t deadline_ms = changed_us / 1000 + kMaxSettleMs;
+    while (result == kChanged) {
+      int64_t wait_ms = deadline_ms - NowMillis();
+      if (wait_ms <= 0) {
+        break;
+      }
+      result = WaitForChange(wait_ms < kSettleMs ? (int)wait_ms : kSettleMs);
+    }
+    if (result == kStopped) {
+      break;
+    }
+    callback_(arg_, changed_us);
+  }
+#if defined(_WINDOWS)
+  if (pending_) {
+    // The request belongs to this thread, so it is cancelled here.
+    CancelIo(notify_handle_);
+    DWORD transferred;
+    GetOverlappedResult(notify_handle_, &overlapped_, &transferred, TRUE);
+    pending_ = false;
+  }
+#endif
+}
+
+#if defined(_WINDOWS)
+NetworkWatcher::WaitResult NetworkWatcher::WaitForChange(int timeout_ms) {
+  if (!pending_) {
+    if (NotifyAddrChange(&notify_handle_, &overlapped_) != ERROR_IO_PENDING) {
+      return WaitForSingleObject(stop_event_, timeout_ms < 0 ?
+                                 INFINITE : timeout_ms) == WAIT_OBJECT_0 ?
+          kStopped : kFailed;
+    }
+    pending_ = true;
+  }
+  HANDLE handles[] = {stop_event_, overlapped_.hEvent};
+  DWORD result = WaitForMultipleObjects(
+      2, handles, FALSE, timeout_ms < 0 ? INFINITE : timeout_ms);
+  if (result == WAIT_OBJECT_0) {
+    return kStopped;
+  }
+  if (result == WAIT_OBJECT_0 + 1) {
+    pending_ = false;
+    return kChanged;
+  }
+  return result == WAIT_TIMEOUT ? kTimedOut : kFailed;
+}
+#else
+// Whether a routing message is about the network as a whole rather than
+// one destination; the kernel also reports every ARP entry it learns.
+#if defined(__linux__)
+static bool IsNetworkChange(const char*, size_t size) {
+  // Only the groups that matter were subscribed to.
+  return size >= sizeof(struct nlmsghdr);
+}
+#else
+static bool IsNetworkChange(const char* message, size_t size) {
+  if (size < sizeof(struct rt_msghdr)) {
+    return false;
+  }
+  const struct rt_msghdr* header = (const struct rt_msghdr*)message;
+  switch (header->rtm_type) {
+    case RTM_NEWADDR:
+    case RTM_DELADDR:
+    case RTM_IFINFO:
+      return true;
+    case RTM_ADD:
+    case RTM_DELETE:
+    case RTM_CHANGE:
+      // Routes through a gateway to a network, e.g. the default route.
+      return (header->rtm_flags & RTF_GATEWAY) &&
+          !(header->rtm_flags & RTF_HOST);
+    default:
+      return false;
+  }
+}
+#endif
+
+NetworkWatcher::WaitResult NetworkWatcher::WaitForChange(int timeout_ms) {
+  int64_t deadline_ms = NowMillis() + timeout_ms;
+  while (true) {
+    {
+      ScopedLock lock(&lock_);
+      if (stop_) {
+        return kStopped;
+      }
+    }
+    fd_set read_fds;
+    FD_ZERO(&read_fds);
+    FD_SET(route_socket_, &read_fds);
+    FD_SET(wakeup_socket_, &read_fds);
+    SocketHandle max_fd = route_socket_ > wakeup_socket_ ?
+        route_socket_ : wakeup_socket_;
+    struct timeval tv;
+    struct timeval* timeout = NULL;
+    if (timeout_ms >= 0) {
+      int64_t wait_ms = deadline_ms - NowMillis();
+      if (wait_ms < 0) {
+        wait_ms = 0;
+      }
+      tv.tv_sec = (long)(wait_ms / 1000);
+      tv.tv_usec = (long)(wait_ms % 1000) * 1000;
+      timeout = &tv;
+    }
+    int ready = select((int)max_fd + 1, &read_fds, NULL, NULL, timeout);
+    if (ready < 0) {
+      return kFailed;
+    }
+    if (ready == 0) {
+      return kTimedOut;
+    }
+    if (FD_ISSET(wakeup_socket_, &read_fds)) {
+      DrainWakeupSocket(wakeup_socket_);
+    }
+    bool changed = false;
+    if (FD_ISSET(route_socket_, &read_fds)) {
+      char buffer[4096];
+      int received;
+      while ((received = SocketRecv(route_socket_, buffer,
+                                    sizeof(buffer))) > 0) {
+        changed = changed || IsNetworkChange(buffer, received);
+      }
+    }
+    if (changed) {
+      return kChanged;
+    }
+  }
+}
+#endif
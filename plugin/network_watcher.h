@@ -0,0 +1,78 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Tells when the network of the machine changes: an address comes or
+// goes, an interface goes up or down, or the default route moves, as on
+// joining another Wi-Fi network or connecting a VPN. The system pushes
+// these events, so nothing is polled.
+
+#ifndef __NETWORK_WATCHER_H__
+#define __NETWORK_WATCHER_H__
+
+#include "net_util.h"
+#include "platform_util.h"
+
+// Reports each burst of changes once, after it settled: bringing up an
+// interface produces several events within a few milliseconds, and the
+// connection name and addresses are only final after the last one.
+class NetworkWatcher {
+ public:
+  // Runs on the watcher thread. changed_us is the NowMicros() of the
+  // first event of the burst.
+  typedef void (*Callback)(void* arg, int64_t changed_us);
+
+  NetworkWatcher();
+  ~NetworkWatcher();
+
+  bool Start(Callback callback, void* arg);
+  void Stop();
+  bool IsRunning() const { return thread_.IsStarted(); }
+
+ private:
+  enum WaitResult {
+    kChanged,
+    kTimedOut,
+    kStopped,
+    kFailed,
+  };
+
+  static void ThreadMain(void* arg);
+  void Run();
+  // Waits up to timeout_ms, or forever if it is negative, for the system
+  // to report a change.
+  WaitResult WaitForChange(int timeout_ms);
+
+  Callback callback_;
+  void* arg_;
+  Thread thread_;
+#if defined(_WINDOWS)
+  HANDLE stop_event_;
+  // Of the NotifyAddrChange request in flight, if pending_.
+  HANDLE notify_handle_;
+  OVERLAPPED overlapped_;
+  bool pending_;
+#else
+  SocketHandle route_socket_;
+  SocketHandle wakeup_socket_;
+  struct sockaddr_in wakeup_addr_;
+  Mutex lock_;  // Guards stop_.
+  bool stop_;
+#endif
+
+  NetworkWatcher(const NetworkWatcher&);
+  void operator=(const NetworkWatcher&);
+};
+
+#endif  // __NETWORK_WATCHER_H__
@@ -0,0 +1,191 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "np_util.h"
+
+#include <string.h>
+
+#include "npswitchproxy.h"
+
+void StringToNPVariant(const std::string& value, NPVariant* variant) {
+  uint32_t len = (uint32_t)value.size();
+  char* utf8 = (char*)npnfuncs->memalloc(len + 1);
+  memcpy(utf8, value.data(), len);
+  utf8[len] = 0;
+  STRINGN_TO_NPVARIANT(utf8, len, *variant);
+}
+
+std::string NPStringToString(const NPString& str) {
+  return std::string(str.UTF8Characters, str.UTF8Length);
+}
+
+static bool NumberFromVariant(const NPVariant& variant, double* value) {
+  if (NPVARIANT_IS_INT32(variant)) {
+    *value = NPVARIANT_TO_INT32(variant);
+  } else if (NPVARIANT_IS_DOUBLE(variant)) {
+    *value = NPVARIANT_TO_DOUBLE(variant);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// The length of a javascript array, or -1 if array is not one.
+static int GetArrayLength(NPP npp, const NPVariant& array) {
+  if (!NPVARIANT_IS_OBJECT(array)) {
+    return -1;
+  }
+  double count = 0;
+  if (!GetNumberProperty(npp, NPVARIANT_TO_OBJECT(array), "length", &count)) {
+    return -1;
+  }
+  return (int)count;
+}
+
+bool NPArrayToStrings(NPP npp, const NPVariant& array,
+                      std::vector<std::string>* strings) {
+  strings->clear();
+  int count = GetArrayLength(npp, array);
+  if (count < 0) {
+    return false;
+  }
+  NPObject* obj = NPVARIANT_TO_OBJECT(array);
+  for (int i = 0; i < count; ++i) {
+    NPVariant element;
+    if (!npnfuncs->getproperty(npp, obj, npnfuncs->getintidentifier(i),
+                               &element)) {
+      continue;
+    }
+    if (NPVARIANT_IS_STRING(element)) {
+      strings->push_back(NPStringToString(NPVARIANT_TO_STRING(element)));
+    }
+    npnfuncs->releasevariantvalue(&element);
+  }
+  return true;
+}
+
+bool NPArrayToObjects(NPP npp, const NPVariant& array,
+                      std::vector<NPObject*>* objects) {
+  objects->clear();
+  int count = GetArrayLength(npp, array);
+  if (count < 0) {
+    return false;
+  }
+  NPObject* obj = NPVARIANT_TO_OBJECT(array);
+  for (int i = 0; i < count; ++i) {
+    NPVariant element;
+    if (!npnfuncs->getproperty(npp, obj, npnfuncs->getintidentifier(i),
+                               &element)) {
+      continue;
+    }
+    if (NPVARIANT_IS_OBJECT(element)) {
+      // Hand the reference held by element over to the caller.
+      objects->push_back(NPVARIANT_TO_OBJECT(element));
+    } else {
+      npnfuncs->releasevariantvalue(&element);
+    }
+  }
+  return true;
+}
+
+bool GetStringProperty(NPP npp, NPObject* obj, const char* name,
+                       std::string* value) {
+  NPVariant variant;
+  if (!npnfuncs->getproperty(npp, obj, npnfuncs->getstringidentifier(name),
+                             &variant)) {
+    return false;
+  }
+  bool ok = NPVARIANT_IS_STRING(variant);
+  if (ok) {
+    *value = NPStringToString(NPVARIANT_TO_STRING(variant));
+  }
+  npnfuncs->releasevariantvalue(&variant);
+  return ok;
+}
+
+bool GetNumberProperty(NPP npp, NPObject* obj, const char* name,
+                       double* value) {
+  NPVariant variant;
+  if (!npnfuncs->getproperty(npp, obj, npnfuncs->getstringidentifier(name),
+                             &variant)) {
+    return false;
+  }
+  bool ok = NumberFromVariant(variant, value);
+  npnfuncs->releasevariantvalue(&variant);
+  return ok;
+}
+
+static NPObject* ConstructFromWindow(NPP npp, const char* constructor) {
+  NPObject* window = NULL;
+  if (npnfuncs->getvalue(npp, NPNVWindowNPObject, &window) != NPERR_NO_ERROR ||
+      !window) {
+    return NULL;
+  }
+  NPVariant result;
+  NPObject* obj = NULL;
+  if (npnfuncs->invoke(npp, window, npnfuncs->getstringidentifier(constructor),
+                       NULL, 0, &result)) {
+    if (NPVARIANT_IS_OBJECT(result)) {
+      // Hand the reference held by result over to the caller.
+      obj = NPVARIANT_TO_OBJECT(result);
+    } else {
+      npnfuncs->releasevariantvalue(&result);
+    }
+  }
+  npnfuncs->releaseobject(window);
+  return obj;
+}
+
+NPObject* CreateJSArray(NPP npp) {
+  return ConstructFromWindow(npp, "Array");
+}
+
+NPObject* CreateJSObject(NPP npp) {
+  return ConstructFromWindow(npp, "Object");
+}
+
+bool AppendToJSArray(NPP npp, NPObject* array, const NPVariant& value) {
+  NPVariant result;
+  if (!npnfuncs->invoke(npp, array, npnfuncs->getstringidentifier("push"),
+                        &value, 1, &result)) {
+    return false;
+  }
+  npnfuncs->releasevariantvalue(&result);
+  return true;
+}
+
+bool SetStringProperty(NPP npp, NPObject* obj, const char* name,
+                       const std::string& value) {
+  NPVariant variant;
+  // The browser copies the value, so it can point into our own buffer.
+  STRINGN_TO_NPVARIANT(value.data(), (uint32_t)value.size(), variant);
+  return npnfuncs->setproperty(npp, obj, npnfuncs->getstringidentifier(name),
+                               &variant);
+}
+
+bool SetNumberProperty(NPP npp, NPObject* obj, const char* name,
+                       double value) {
+  NPVariant variant;
+  DOUBLE_TO_NPVARIANT(value, variant);
+  return npnfuncs->setproperty(npp, obj, npnfuncs->getstringidentifier(name),
+                               &variant);
+}
+
+bool SetBoolProperty(NPP npp, NPObject* obj, const char* name, bool value) {
+  NPVariant variant;
+  BOOLEAN_TO_NPVARIANT(value, variant);
+  return npnfuncs->setproperty(npp, obj, npnfuncs->getstringidentifier(name),
+                               &variant);
+}
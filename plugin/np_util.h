@@ -0,0 +1,64 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Helpers to move plain data between the plugin and javascript. They must
+// only be called on the browser's main thread.
+
+#ifndef __NP_UTIL_H__
+#define __NP_UTIL_H__
+
+#include <string>
+#include <vector>
+
+#include "npapi.h"
+#include "npfunctions.h"
+#include "npruntime.h"
+
+// Copies value into a browser allocated string variant, as needed for
+// values returned to javascript.
+void StringToNPVariant(const std::string& value, NPVariant* variant);
+
+std::string NPStringToString(const NPString& str);
+
+// Reads a javascript array of strings. Non-string elements are skipped.
+bool NPArrayToStrings(NPP npp, const NPVariant& array,
+                      std::vector<std::string>* strings);
+
+// Reads a javascript array of objects. Other elements are skipped. The
+// caller releases the objects.
+bool NPArrayToObjects(NPP npp, const NPVariant& array,
+                      std::vector<NPObject*>* objects);
+
+// Reads a property of obj. Fails if it is missing or of another type.
+bool GetStringProperty(NPP npp, NPObject* obj, const char* name,
+                       std::string* value);
+bool GetNumberProperty(NPP npp, NPObject* obj, const char* name,
+                       double* value);
+
+// Creates an empty javascript array or object in the page of npp. The
+// caller owns the returned reference.
+NPObject* CreateJSArray(NPP npp);
+NPObject* CreateJSObject(NPP npp);
+
+// Appends value to a javascript array.
+bool AppendToJSArray(NPP npp, NPObject* array, const NPVariant& value);
+
+bool SetStringProperty(NPP npp, NPObject* obj, const char* name,
+                       const std::string& value);
+bool SetNumberProperty(NPP npp, NPObject* obj, const char* name,
+                       double value);
+bool SetBoolProperty(NPP npp, NPObject* obj, const char* name, bool value);
+
+#endif  // __NP_UTIL_H__
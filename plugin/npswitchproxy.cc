@@ -20,8 +20,32 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <algorithm>
+#include <map>
+#include <set>
+
+#include "deferred_proxy.h"
+#include "dns_resolver.h"
+#include "file_util.h"
+#include "forwarder.h"
+#include "net_util.h"
+#include "network_rules.h"
+#include "network_watcher.h"
+#include "np_util.h"
+#include "pac_generator.h"
+#include "pac_loader.h"
+#include "pac_script.h"
+#include "profile_objects.h"
+#include "profile_store.h"
 #include "proxy_base.h"
 #include "proxy_config.h"
+#include "proxy_prober.h"
+#include "proxy_resolver.h"
+#include "proxy_trace.h"
+#include "shared_state.h"
+#include "stats.h"
+#include "utf_convert.h"
+#include "wpad_discovery.h"
 
 #if defined(_WINDOWS)
 #include "win/winproxy.h"
@@ -39,6 +63,31 @@ NPNetscapeFuncs* npnfuncs = NULL;  // Browser's function table.
 const char* kGetProxyConfigMethod = "getProxyConfig";
 const char* kSetProxyConfigMethod = "setProxyConfig";
 const char* kGetConnectionNameProperty = "connectionName";
+const char* kSetProbeTargetsMethod = "setProbeTargets";
+const char* kGetProxyHealthMethod = "getProxyHealth";
+const char* kSetForwarderProfileMethod = "setForwarderProfile";
+const char* kForwarderProfileProperty = "forwarderProfile";
+const char* kStatsProperty = "stats";
+const char* kActiveProfileIdProperty = "activeProfileId";
+const char* kProfilesProperty = "profiles";
+const char* kSetPacScriptMethod = "setPacScript";
+const char* kFindProxyForURLMethod = "findProxyForURL";
+const char* kLoadPacUrlMethod = "loadPacUrl";
+const char* kDiscoverPacUrlMethod = "discoverPacUrl";
+const char* kServePacProfileMethod = "servePacProfile";
+const char* kResolveProxiesMethod = "resolveProxies";
+const char* kListProfilesMethod = "listProfiles";
+const char* kAddProfileMethod = "addProfile";
+const char* kSetProfileFieldMethod = "setProfileField";
+const char* kDeleteProfileMethod = "deleteProfile";
+const char* kClearProfilesMethod = "clearProfiles";
+const char* kSyncProfilesMethod = "syncProfiles";
+const char* kApplyProfileMethod = "applyProfile";
+const char* kSetNetworkRulesMethod = "setNetworkRules";
+const char* kListConnectionsMethod = "listConnections";
+const char* kApplyProfileToConnectionsMethod = "applyProfileToConnections";
+const char* kWatchSystemStateMethod = "watchSystemState";
+const char* kUseProfileStoreMethod = "useProfileStore";
 
 void DebugLog(const char* format, ...) {
 #ifdef DEBUG
@@ -52,21 +101,420 @@ void DebugLog(const char* format, ...) {
 }
 
 static ProxyBase* proxyImpl;
+// Created on the first setProbeTargets so that no thread runs unless the
+// UI asks for health information.
+static ProxyProber* prober = NULL;
+// Started on the first setForwarderProfile, for profiles that list more
+// than one upstream per scheme, or servePacProfile.
+static Forwarder* forwarder = NULL;
+// Compiled on the first setPacScript or loadPacUrl.
+static PacScript* pac_script = NULL;
+// Fetches and caches the script of the auto-config URL in use.
+static PacLoader* pac_loader = NULL;
+// Whether pac_script follows pac_loader, rather than a setPacScript text.
+static bool pac_from_url = false;
+// Shared by the PAC helpers and the forwarder, so that a name resolved by
+// one is cached for the other.
+static DnsResolver* dns_resolver = NULL;
+static SystemPacHost* pac_host = NULL;
+// Remembers the PAC URL WPAD found, per connection.
+static WpadDiscovery* wpad = NULL;
+// Created on the first resolveProxies.
+static ProxyResolver* proxy_resolver = NULL;
+// PAC scripts spend most of their time waiting for DNS, so a few more
+// threads than cores still pay off.
+static const int kProxyResolverThreads = 4;
+// Opened on first use. NULL while it cannot be opened, or before
+// useProfileStore named it.
+static ProfileStore* profile_store = NULL;
+static std::string profile_store_name;
+// What plugin.profiles and its elements reach profile_store through, so
+// that they outlive it safely. Set along with profile_store.
+static ProfileStoreRef* profile_store_ref = NULL;
+// Applying to a connection mostly waits for the system, so a profile is
+// applied to this many connections at once.
+static const int kBulkApplyThreads = 4;
+
+// A saved profile compiled for applyProfile, so that switching to it does
+// no parsing or conversion.
+struct CompiledProfile {
+  CompiledProfile()
+      : payload(NULL), has_bypass_list(false), auto_detect(false) {}
+
+  ProxyPayload* payload;  // Owned.
+  // The upstreams the forwarder gets, for profiles that need it.
+  std::string forwarder_profile;
+  // The system setting and forwarder address it was compiled with. The
+  // payload bakes them in, so a change in either makes it stale.
+  std::string bypass_list;
+  bool has_bypass_list;
+  bool auto_detect;
+  std::string forwarder_address;
+  // The auto-config URL, or for ";pac=local" the script that is served.
+  std::string pac_url;
+  std::string pac_script;
+};
+// By profile id. Dropped when the profile is edited, and recompiled when
+// the system setting or forwarder address it was compiled with changed,
+// whichever process changed them.
+static std::map<uint32_t, CompiledProfile> compiled_profiles;
+// The script findProxyForURL should evaluate after a profile switch. It is
+// loaded on first use, so that the switch itself compiles nothing.
+static std::string deferred_pac_url;
+static std::string deferred_pac_source;
+// Started by setNetworkRules while there are rules. Its events are handed
+// to the main thread through the instance that set the rules.
+static NetworkWatcher* network_watcher = NULL;
+static NetworkRules network_rules;
+static NPP network_npp = NULL;
+// Told about each switch the rules make. Retained.
+static NPObject* network_callback = NULL;
+// The connection name and address rules were last applied for.
+static std::string last_network;
+// The scriptable objects alive, so that what they cache can be released
+// along with the instance they were made for.
+static std::set<PluginObj*> plugin_objects;
+// The browser hands out one identifier per name for as long as it runs.
+static NPIdentifier get_proxy_config_identifier = NULL;
+// The setting and connection as the plugin in one of the browser's
+// processes last read them, so that the others need not ask the system.
+// NULL if the shared memory cannot be opened, or while tracing.
+static SharedState* shared_state = NULL;
+// Set up by NP_Initialize if the environment names a trace to play.
+static TracePlayer* trace_player = NULL;
+// Told, through the instance that asked, whenever the shared state
+// changes. Retained.
+static NPObject* state_callback = NULL;
+static NPP state_npp = NULL;
+static Mutex state_npp_lock;  // The state's thread reads state_npp.
+// When NP_Initialize ran, to time the first answer the page gets about
+// the system; that answer is what the icon waits for.
+static int64_t initialize_us = 0;
+static bool first_state_served = false;
+
+static DnsResolver* GetDnsResolver() {
+  if (!dns_resolver) {
+    dns_resolver = new DnsResolver;
+    if (!dns_resolver->Start()) {
+      DebugLog("npswitchproxy: cannot start the DNS resolver\n");
+    }
+  }
+  return dns_resolver;
+}
+
+// Identifies the active connection for per-network caches; "LAN" for the
+// default one.
+static std::string GetActiveConnectionKey() {
+  const void* connection_name = NULL;
+  if (!proxyImpl->GetActiveConnectionName(&connection_name)) {
+    return "";
+  }
+  if (!connection_name) {
+    return "LAN";
+  }
+#if defined(_WINDOWS)
+  // WinProxy returns the wide string the Inet APIs take.
+  const wchar_t* wide_name = (const wchar_t*)connection_name;
+  std::string key((const char*)wide_name, wcslen(wide_name) * sizeof(wchar_t));
+  delete [] wide_name;
+#else
+  std::string key((const char*)connection_name);
+  delete [] (const char*)connection_name;
+#endif
+  return key;
+}
+
+// The name of the active connection as the UI shows it, in UTF-8.
+static std::string GetActiveConnectionDisplayName() {
+  const void* connection_name = NULL;
+  if (!proxyImpl->GetActiveConnectionName(&connection_name)) {
+    return "";
+  }
+  if (!connection_name) {
+    return "LAN";
+  }
+#if defined(_WINDOWS)
+  const wchar_t* wide_name = (const wchar_t*)connection_name;
+  std::string name = WideToUtf8(wide_name);
+  delete [] wide_name;
+#else
+  std::string name((const char*)connection_name);
+  delete [] (const char*)connection_name;
+#endif
+  return name;
+}
+
+static void AssignStringToVar(const std::string& str, char** out) {
+  delete [] *out;
+  *out = new char[str.size() + 1];
+  memcpy(*out, str.c_str(), str.size() + 1);
+}
+
+// Reads what the shared state holds from the system. Runs on the shared
+// state's thread of the one process that leads.
+static bool ReadSystemState(void*, SystemState* state) {
+  ProxyConfig config;
+  if (!proxyImpl->GetProxyConfig(&config)) {
+    return false;
+  }
+  state->auto_detect = config.auto_detect;
+  state->auto_config = config.auto_config;
+  state->use_proxy = config.use_proxy;
+  state->has_auto_config_url = config.auto_config_url != NULL;
+  state->has_proxy_server = config.proxy_server != NULL;
+  state->has_bypass_list = config.bypass_list != NULL;
+  state->auto_config_url = config.auto_config_url ? config.auto_config_url : "";
+  state->proxy_server = config.proxy_server ? config.proxy_server : "";
+  state->bypass_list = config.bypass_list ? config.bypass_list : "";
+  state->connection_name = GetActiveConnectionDisplayName();
+  return true;
+}
+
+static void RecordFirstSystemState() {
+  if (!first_state_served) {
+    first_state_served = true;
+    stats::Set("firstSystemStateUs", NowMicros() - initialize_us);
+  }
+}
+
+// The system proxy setting as the shared state holds it, without asking
+// the system. False if the shared state is not current.
+static bool ReadSharedProxyConfig(ProxyConfig* config,
+                                  uint32_t* generation) {
+  SystemState state;
+  if (!shared_state || !shared_state->Read(&state, generation)) {
+    return false;
+  }
+  config->auto_detect = state.auto_detect;
+  config->auto_config = state.auto_config;
+  config->use_proxy = state.use_proxy;
+  if (state.has_auto_config_url) {
+    AssignStringToVar(state.auto_config_url, &config->auto_config_url);
+  }
+  if (state.has_proxy_server) {
+    AssignStringToVar(state.proxy_server, &config->proxy_server);
+  }
+  if (state.has_bypass_list) {
+    AssignStringToVar(state.bypass_list, &config->bypass_list);
+  }
+  return true;
+}
+
+// The system proxy setting, from the shared state when it is current.
+// generation, if not NULL, is set to that of the shared state, or 0 if
+// the setting came from the system.
+static bool ReadProxyConfig(ProxyConfig* config,
+                            uint32_t* generation = NULL) {
+  uint32_t state_generation;
+  if (!ReadSharedProxyConfig(config, &state_generation)) {
+    bool ok = proxyImpl->GetProxyConfig(config);
+    RecordFirstSystemState();
+    if (generation) {
+      *generation = 0;
+    }
+    return ok;
+  }
+  RecordFirstSystemState();
+  if (generation) {
+    *generation = state_generation;
+  }
+  return true;
+}
+
+// Tells the other processes that this one changed the system setting.
+static void RefreshSharedState() {
+  if (shared_state) {
+    shared_state->RequestRefresh();
+  }
+}
+
+static WpadDiscovery* GetWpadDiscovery() {
+  if (!wpad) {
+    wpad = new WpadDiscovery(GetDnsResolver());
+  }
+  return wpad;
+}
+
+// Blocks for up to the discovery timeout unless the answer is cached.
+static bool DiscoverPacUrl(std::string* url) {
+  return GetWpadDiscovery()->Discover(GetActiveConnectionKey(), url);
+}
+
+static Forwarder* GetForwarder() {
+  if (!forwarder) {
+    Forwarder::Options options;
+    options.resolver = GetDnsResolver();
+    forwarder = new Forwarder(options);
+  }
+  return forwarder;
+}
+
+// The bypass list argument at index, or that of the system setting.
+static std::string GetBypassListArgument(const NPVariant* args,
+                                         uint32_t argCount, uint32_t index) {
+  if (argCount > index && NPVARIANT_IS_STRING(args[index])) {
+    return NPStringToString(NPVARIANT_TO_STRING(args[index]));
+  }
+  ProxyConfig config;
+  if (ReadProxyConfig(&config) && config.bypass_list) {
+    return config.bypass_list;
+  }
+  return "";
+}
+
+static int GetIntArgument(const NPVariant* args, uint32_t argCount,
+                           uint32_t index) {
+  if (argCount > index) {
+    if (NPVARIANT_IS_INT32(args[index])) {
+      return NPVARIANT_TO_INT32(args[index]);
+    } else if (NPVARIANT_IS_DOUBLE(args[index])) {
+      return (int)NPVARIANT_TO_DOUBLE(args[index]);
+    }
+  }
+  return 0;
+}
+
+static SystemPacHost* GetPacHost() {
+  if (!pac_host) {
+    pac_host = new SystemPacHost(GetDnsResolver());
+  }
+  return pac_host;
+}
+
+static ProfileStore* GetProfileStore() {
+  if (!profile_store && !profile_store_name.empty()) {
+    std::string directory = GetUserDataDirectory();
+    if (directory.empty()) {
+      return NULL;
+    }
+    profile_store = new ProfileStore;
+    if (!profile_store->Open(JoinPath(
+            directory, "profiles-" + profile_store_name + ".log"))) {
+      delete profile_store;
+      profile_store = NULL;
+    } else {
+      profile_store_ref = new ProfileStoreRef(profile_store);
+    }
+  }
+  return profile_store;
+}
+
+// Syncs and closes the store. The views of it the page still holds stay
+// valid and read as empty.
+static void CloseProfileStore() {
+  for (std::set<PluginObj*>::iterator it = plugin_objects.begin();
+       it != plugin_objects.end(); ++it) {
+    if ((*it)->profiles) {
+      npnfuncs->releaseobject((*it)->profiles);
+      (*it)->profiles = NULL;
+    }
+  }
+  if (profile_store_ref) {
+    profile_store_ref->Detach();
+    profile_store_ref->Release();
+    profile_store_ref = NULL;
+  }
+  delete profile_store;
+  profile_store = NULL;
+}
+
+static PacScript* GetPacScript() {
+  if (!pac_script) {
+    pac_script = new PacScript(GetPacHost());
+  }
+  return pac_script;
+}
+
+// Loads the cached script of url at once, if there is one, and has the
+// network copy fetched in the background.
+static bool LoadPacUrl(const std::string& url) {
+  if (!pac_loader) {
+    pac_loader = new PacLoader(GetUserCacheDirectory());
+  }
+  pac_from_url = true;
+  std::string script;
+  std::string error;
+  if (!pac_loader->Load(url, &script)) {
+    return false;
+  }
+  if (!GetPacScript()->Load(script, &error)) {
+    DebugLog("LoadPacUrl: %s: %s\n", url.c_str(), error.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Drops the script in use and what was waiting to replace it, so that
+// lookups follow the system setting again.
+static void UnloadPacScript() {
+  deferred_pac_source.clear();
+  deferred_pac_url.clear();
+  delete pac_script;
+  pac_script = NULL;
+  delete pac_loader;
+  pac_loader = NULL;
+  pac_from_url = false;
+}
+
+// Switches to the script fetched in the background, if a new one came in.
+static void ApplyPacUpdate() {
+  std::string script;
+  std::string error;
+  if (pac_from_url && pac_loader && pac_loader->TakeUpdate(&script) &&
+      !GetPacScript()->Load(script, &error)) {
+    DebugLog("ApplyPacUpdate: %s\n", error.c_str());
+  }
+}
+
+// Drops what plugin keeps for its instance.
+static void ReleasePluginCaches(PluginObj* plugin) {
+  if (plugin->proxy_config) {
+    npnfuncs->releaseobject(plugin->proxy_config);
+  }
+  plugin->proxy_config = NULL;
+  plugin->proxy_config_generation = 0;
+  if (plugin->profiles) {
+    npnfuncs->releaseobject(plugin->profiles);
+  }
+  plugin->profiles = NULL;
+}
 
 // Javascript example use:
 // config = plugin.GetProxyConfig;
 // if (config.use_proxy) {
 //   Show proxy is on.
 // }
+// Calls return the same object until the setting changes. While the
+// shared state is current, telling that it did not change takes one look
+// at its generation and allocates nothing.
 static bool InvokeGetProxyConfig(NPObject* obj, const NPVariant* args,
                                  uint32_t argCount, NPVariant* result) {
   PluginObj* plugin = (PluginObj*)obj;
-  ProxyConfigObj* proxy = CreateProxyConfigObj(plugin->npp);
-  if (!proxyImpl->GetProxyConfig(&proxy->config)) {
-    return false;
+  uint32_t generation;
+  if (!plugin->proxy_config || !plugin->proxy_config_generation ||
+      !shared_state || !shared_state->ReadGeneration(&generation) ||
+      generation != plugin->proxy_config_generation) {
+    ProxyConfig config;
+    if (!ReadProxyConfig(&config, &generation)) {
+      return false;
+    }
+    if (!plugin->proxy_config ||
+        !plugin->proxy_config->config.Equals(config)) {
+      ProxyConfigObj* proxy = CreateProxyConfigObj(plugin->npp);
+      if (!proxy) {
+        return false;
+      }
+      proxy->config.Swap(&config);
+      if (plugin->proxy_config) {
+        npnfuncs->releaseobject(plugin->proxy_config);
+      }
+      plugin->proxy_config = proxy;
+      stats::Add("proxyConfigSnapshots", 1);
+    }
+    plugin->proxy_config_generation = generation;
   }
-  npnfuncs->retainobject(proxy);
-  OBJECT_TO_NPVARIANT((NPObject*)proxy, *result);
+  npnfuncs->retainobject(plugin->proxy_config);
+  OBJECT_TO_NPVARIANT((NPObject*)plugin->proxy_config, *result);
   return true;
 }
 
@@ -77,75 +525,1076 @@ static void AssignNPStringToVar(const NPString str, char **out) {
   (*out)[str.UTF8Length] = 0;
 }
 
+static void ForgetCompiledProfile(uint32_t id) {
+  std::map<uint32_t, CompiledProfile>::iterator it =
+      compiled_profiles.find(id);
+  if (it != compiled_profiles.end()) {
+    delete it->second.payload;
+    compiled_profiles.erase(it);
+  }
+}
+
+static void ForgetCompiledProfiles() {
+  for (std::map<uint32_t, CompiledProfile>::iterator it =
+       compiled_profiles.begin(); it != compiled_profiles.end(); ++it) {
+    delete it->second.payload;
+  }
+  compiled_profiles.clear();
+}
+
+// The fields of setProxyConfig, in the order of its positional form.
+static const struct {
+  int field;
+  const char* const* name;  // As getProxyConfig names it.
+} kProxyConfigFields[] = {
+  {kUseProxyField, &kUseProxyProperty},
+  {kProxyServerField, &kProxyServerProperty},
+  {kAutoConfigField, &kAutoConfigProperty},
+  {kAutoConfigUrlField, &kAutoConfigUrlProperty},
+  {kBypassListField, &kBypassListProperty},
+  {kAutoDetectField, &kAutoDetectProperty},
+};
+
+// Sets field of config to value. Fails if value is of the wrong type.
+static bool SetProxyConfigField(int field, const NPVariant& value,
+                                ProxyConfig* config) {
+  bool* flag = config->BoolField(field);
+  if (flag) {
+    if (!NPVARIANT_IS_BOOLEAN(value)) {
+      return false;
+    }
+    *flag = NPVARIANT_TO_BOOLEAN(value);
+    return true;
+  }
+  if (!NPVARIANT_IS_STRING(value)) {
+    return false;
+  }
+  AssignNPStringToVar(NPVARIANT_TO_STRING(value), config->StringField(field));
+  return true;
+}
+
 // The following forms are supported.
-// plugin.SetProxyConfig(use_proxy);
-// plugin.SetProxyConfig(use_proxy, proxy_server);
-// plugin.SetProxyConfig(use_proxy, proxy_server, auto_config);
-// plugin.SetProxyConfig(use_proxy, proxy_server, auto_config,
+// plugin.setProxyConfig(use_proxy);
+// plugin.setProxyConfig(use_proxy, proxy_server);
+// plugin.setProxyConfig(use_proxy, proxy_server, auto_config);
+// plugin.setProxyConfig(use_proxy, proxy_server, auto_config,
 //                       auto_config_url);
-// plugin.SetProxyConfig(use_proxy, proxy_server, auto_config,
+// plugin.setProxyConfig(use_proxy, proxy_server, auto_config,
 //                       auto_config_url, bypass_list);
-// plugin.SetProxyConfig(use_proxy, proxy_server, auto_config,
+// plugin.setProxyConfig(use_proxy, proxy_server, auto_config,
 //                       auto_config_url, bypass_list, auto_detect);
+// plugin.setProxyConfig({proxyServer: "a:80", useProxy: true});
+// The object takes any of the fields getProxyConfig returns. Only the
+// fields given are written. Arguments of the wrong type fail the call
+// without changing anything. If the setting ends up with an auto-config
+// URL that was given or was not in effect before, its script is loaded.
 static bool InvokeSetProxyConfig(NPObject* obj, const NPVariant* args,
                                  uint32_t argCount, NPVariant* result) {
-  ProxyConfig config;  
-  if (!proxyImpl->GetProxyConfig(&config)) {
+  static const uint32_t kFieldCount =
+      sizeof(kProxyConfigFields) / sizeof(kProxyConfigFields[0]);
+  PluginObj* plugin = (PluginObj*)obj;
+  ProxyConfig config;
+  int fields = 0;
+  if (argCount == 1 && NPVARIANT_IS_OBJECT(args[0])) {
+    NPObject* object = NPVARIANT_TO_OBJECT(args[0]);
+    for (uint32_t i = 0; i < kFieldCount; ++i) {
+      NPIdentifier name =
+          npnfuncs->getstringidentifier(*kProxyConfigFields[i].name);
+      if (!npnfuncs->hasproperty(plugin->npp, object, name)) {
+        continue;
+      }
+      NPVariant value;
+      if (!npnfuncs->getproperty(plugin->npp, object, name, &value)) {
+        return false;
+      }
+      bool ok = SetProxyConfigField(kProxyConfigFields[i].field, value,
+                                    &config);
+      npnfuncs->releasevariantvalue(&value);
+      if (!ok) {
+        return false;
+      }
+      fields |= kProxyConfigFields[i].field;
+    }
+  } else {
+    if (argCount == 0 || argCount > kFieldCount) {
+      return false;
+    }
+    for (uint32_t i = 0; i < argCount; ++i) {
+      if (!SetProxyConfigField(kProxyConfigFields[i].field, args[i],
+                               &config)) {
+        return false;
+      }
+      fields |= kProxyConfigFields[i].field;
+    }
+  }
+  if (!fields) {
+    return true;
+  }
+  // Asking the system what the setting was would cost more than the
+  // update, so only the shared state is asked.
+  ProxyConfig before;
+  uint32_t generation;
+  bool has_before = ReadSharedProxyConfig(&before, &generation);
+  if (!proxyImpl->UpdateProxyConfig(config, fields)) {
+    return false;
+  }
+  RefreshSharedState();
+  if (fields & (kBypassListField | kAutoDetectField)) {
+    // Compiled profiles carry the bypass list and auto-detection.
+    ForgetCompiledProfiles();
+  }
+  // The fields left out keep their values, so the setting as it ended up
+  // is the one before with the given fields on top.
+  static const int kAutoConfigFields = kAutoConfigField | kAutoConfigUrlField;
+  if (!has_before && (fields & kAutoConfigFields) != kAutoConfigFields) {
+    if (fields & kAutoConfigFields) {
+      // Whether a script is in effect now is not known; the next lookup
+      // follows the system setting.
+      UnloadPacScript();
+    }
+    return true;
+  }
+  ProxyConfig after;
+  if (has_before) {
+    after.CopyFields(before, kAllProxyConfigFields);
+  }
+  after.CopyFields(config, fields);
+  if (after.auto_config && after.auto_config_url && *after.auto_config_url) {
+    bool was_in_effect = has_before && before.auto_config &&
+        before.auto_config_url &&
+        !strcmp(before.auto_config_url, after.auto_config_url);
+    if (!was_in_effect || (fields & kAutoConfigUrlField)) {
+      LoadPacUrl(after.auto_config_url);
+    }
+  }
+  return true;
+}
+
+// plugin.setProbeTargets(["a:80", "http=b:80;https=c:443", ...]);
+static bool InvokeSetProbeTargets(NPObject* obj, const NPVariant* args,
+                                  uint32_t argCount, NPVariant* result) {
+  PluginObj* plugin = (PluginObj*)obj;
+  std::vector<std::string> proxies;
+  if (argCount != 1 || !NPArrayToStrings(plugin->npp, args[0], &proxies)) {
+    return false;
+  }
+  if (!prober) {
+    ProxyProber::Options options;
+    options.resolver = GetDnsResolver();
+    prober = new ProxyProber(options);
+  }
+  prober->SetTargets(proxies);
+  if (!prober->Start()) {
+    return false;
+  }
+  VOID_TO_NPVARIANT(*result);
+  return true;
+}
+
+// Javascript example use:
+// health = plugin.getProxyHealth();
+// health[0].proxy is the fastest reachable proxy, with health[0].latency in
+// milliseconds and health[0].successRate in [0, 1]. A negative latency means
+// that the proxy has not answered yet.
+static bool InvokeGetProxyHealth(NPObject* obj, const NPVariant* args,
+                                 uint32_t argCount, NPVariant* result) {
+  PluginObj* plugin = (PluginObj*)obj;
+  std::vector<ProxyHealth> health;
+  if (prober) {
+    prober->GetHealth(&health);
+  }
+  NPObject* array = CreateJSArray(plugin->npp);
+  if (!array) {
+    return false;
+  }
+  for (size_t i = 0; i < health.size(); ++i) {
+    NPObject* item = CreateJSObject(plugin->npp);
+    if (!item) {
+      continue;
+    }
+    SetStringProperty(plugin->npp, item, "proxy", health[i].proxy);
+    SetNumberProperty(plugin->npp, item, "latency", health[i].latency_ms);
+    SetNumberProperty(plugin->npp, item, "successRate",
+                      health[i].success_rate);
+    SetNumberProperty(plugin->npp, item, "probes", health[i].probes);
+    NPVariant value;
+    OBJECT_TO_NPVARIANT(item, value);
+    AppendToJSArray(plugin->npp, array, value);
+    npnfuncs->releaseobject(item);
+  }
+  OBJECT_TO_NPVARIANT(array, *result);
+  return true;
+}
+
+// Javascript example use:
+// address = plugin.setForwarderProfile("http=a:80,b:80;https=c:443", 8118);
+// The system proxy is then set to the returned "127.0.0.1:port", and each
+// connection fails over from a to b as soon as a stops answering. The port
+// is optional; without it an ephemeral one is picked the first time. An
+// optional third argument gives the hosts to send direct; by default the
+// bypass list of the current system setting is used.
+static bool InvokeSetForwarderProfile(NPObject* obj, const NPVariant* args,
+                                      uint32_t argCount, NPVariant* result) {
+  if (argCount < 1 || !NPVARIANT_IS_STRING(args[0])) {
+    return false;
+  }
+  int port = GetIntArgument(args, argCount, 1);
+  std::string bypass_list = GetBypassListArgument(args, argCount, 2);
+  GetForwarder()->SetProfile(NPStringToString(NPVARIANT_TO_STRING(args[0])),
+                             bypass_list);
+  if (!forwarder->Start(port)) {
+    return false;
+  }
+  StringToNPVariant(forwarder->address(), result);
+  return true;
+}
+
+// Javascript example use:
+// error = plugin.setPacScript(pacText);
+// Compiles the script of an auto_config_url so that findProxyForURL can
+// evaluate it without a round trip through the browser. Returns "" on
+// success or a message such as "line 12: expected ')'"; the previously
+// loaded script stays in use when compiling fails.
+static bool InvokeSetPacScript(NPObject* obj, const NPVariant* args,
+                               uint32_t argCount, NPVariant* result) {
+  if (argCount != 1 || !NPVARIANT_IS_STRING(args[0])) {
+    return false;
+  }
+  std::string error;
+  if (GetPacScript()->Load(NPStringToString(NPVARIANT_TO_STRING(args[0])),
+                           &error)) {
+    pac_from_url = false;
+  }
+  StringToNPVariant(error, result);
+  return true;
+}
+
+// Javascript example use:
+// cached = plugin.loadPacUrl("http://wpad.corp/proxy.pac");
+// Makes findProxyForURL use the script at the URL. A copy cached on disk
+// is used right away, in which case true is returned; the URL is fetched
+// in the background either way and a changed script replaces the cached
+// one. setProxyConfig does the same for the auto-config URL it applies.
+static bool InvokeLoadPacUrl(NPObject* obj, const NPVariant* args,
+                             uint32_t argCount, NPVariant* result) {
+  if (argCount != 1 || !NPVARIANT_IS_STRING(args[0])) {
+    return false;
+  }
+  BOOLEAN_TO_NPVARIANT(
+      LoadPacUrl(NPStringToString(NPVARIANT_TO_STRING(args[0]))), *result);
+  return true;
+}
+
+// Javascript example use:
+// url = plugin.servePacProfile("http=a:80,b:80;https=c:443", 8118);
+// Generates a PAC script from the profile and the bypass list and serves
+// it at the returned "http://127.0.0.1:port/proxy.pac", from the same
+// local server as setForwarderProfile. The system auto-config URL only
+// needs to be set once: later calls swap the served script in place. The
+// port and the bypass list (third argument) are optional as for
+// setForwarderProfile. findProxyForURL evaluates the generated script too.
+static bool InvokeServePacProfile(NPObject* obj, const NPVariant* args,
+                                  uint32_t argCount, NPVariant* result) {
+  if (argCount < 1 || !NPVARIANT_IS_STRING(args[0])) {
+    return false;
+  }
+  int port = GetIntArgument(args, argCount, 1);
+  std::string script;
+  std::string error;
+  if (!GeneratePacScript(NPStringToString(NPVARIANT_TO_STRING(args[0])),
+                         GetBypassListArgument(args, argCount, 2), &script) ||
+      !GetPacScript()->Load(script, &error)) {
+    DebugLog("servePacProfile: %s\n", error.c_str());
+    return false;
+  }
+  pac_from_url = false;
+  GetForwarder()->SetPacScript(script);
+  if (!forwarder->Start(port)) {
+    return false;
+  }
+  StringToNPVariant(forwarder->pac_url(), result);
+  return true;
+}
+
+// Javascript example use:
+// url = plugin.discoverPacUrl();
+// Runs WPAD for the active connection and returns the URL of the PAC file
+// it found, such as "http://wpad.corp.example.com/wpad.dat", or "". The
+// result is cached, so only the first call on a network waits.
+static bool InvokeDiscoverPacUrl(NPObject* obj, const NPVariant* args,
+                                 uint32_t argCount, NPVariant* result) {
+  std::string url;
+  DiscoverPacUrl(&url);
+  StringToNPVariant(url, result);
+  return true;
+}
+
+// The script findProxyForURL and resolveProxies evaluate. If nothing was
+// loaded yet, it follows the auto-config URL of the system, or the one
+// WPAD finds; discovery runs in the background and never blocks the
+// caller. NULL if there is no script.
+static PacScript* GetActivePacScript() {
+  std::string error;
+  if (!deferred_pac_source.empty()) {
+    if (!GetPacScript()->Load(deferred_pac_source, &error)) {
+      DebugLog("GetActivePacScript: %s\n", error.c_str());
+    }
+    pac_from_url = false;
+    deferred_pac_source.clear();
+  } else if (!deferred_pac_url.empty()) {
+    LoadPacUrl(deferred_pac_url);
+    deferred_pac_url.clear();
+  } else if (!pac_script && !pac_loader) {
+    ProxyConfig config;
+    std::string url;
+    if (ReadProxyConfig(&config) && config.auto_config &&
+        config.auto_config_url && *config.auto_config_url) {
+      LoadPacUrl(config.auto_config_url);
+    } else if (config.auto_detect &&
+               GetWpadDiscovery()->DiscoverInBackground(
+                   GetActiveConnectionKey(), &url) ==
+               WpadDiscovery::kFound) {
+      // Until discovery is done, requests go direct.
+      LoadPacUrl(url);
+    }
+  }
+  ApplyPacUpdate();
+  if (!pac_script || !pac_script->IsLoaded()) {
+    return NULL;
+  }
+  return pac_script;
+}
+
+// Javascript example use:
+// proxies = plugin.findProxyForURL("http://intranet/");
+// proxies is what FindProxyForURL of the loaded script returned, such as
+// "PROXY a:80; DIRECT".
+static bool InvokeFindProxyForURL(NPObject* obj, const NPVariant* args,
+                                  uint32_t argCount, NPVariant* result) {
+  if (argCount != 1 || !NPVARIANT_IS_STRING(args[0])) {
+    return false;
+  }
+  PacScript* pac_script = GetActivePacScript();
+  if (!pac_script) {
+    return false;
+  }
+  std::string proxies;
+  std::string error;
+  if (!pac_script->FindProxyForURL(
+      NPStringToString(NPVARIANT_TO_STRING(args[0])), &proxies, &error)) {
+    DebugLog("findProxyForURL: %s\n", error.c_str());
+    return false;
+  }
+  StringToNPVariant(proxies, result);
+  return true;
+}
+
+// Javascript example use:
+// proxies = plugin.resolveProxies(["http://intranet/", "https://a.com/"]);
+// proxies[i] tells where urls[i] goes under the current system setting,
+// in the form FindProxyForURL returns, e.g. "PROXY a:80" or "DIRECT": from
+// the auto-config script if one is in use, otherwise from the proxy server
+// and the bypass list. A URL without a host gives "". The whole batch is
+// resolved in one call, over a few threads if it is large.
+static bool InvokeResolveProxies(NPObject* obj, const NPVariant* args,
+                                 uint32_t argCount, NPVariant* result) {
+  PluginObj* plugin = (PluginObj*)obj;
+  std::vector<std::string> urls;
+  ProxyConfig config;
+  if (argCount != 1 || !NPArrayToStrings(plugin->npp, args[0], &urls) ||
+      !ReadProxyConfig(&config)) {
+    return false;
+  }
+  ProxySettings settings;
+  settings.use_proxy = config.use_proxy;
+  if (config.proxy_server) {
+    settings.proxy_server = config.proxy_server;
+  }
+  if (config.bypass_list) {
+    settings.bypass_list = config.bypass_list;
+  }
+  // A system proxy pointing to the forwarder stands for its profile.
+  if (forwarder && forwarder->IsRunning() &&
+      settings.proxy_server == forwarder->address()) {
+    settings.proxy_server = forwarder->profile();
+  }
+  if (config.auto_config || config.auto_detect) {
+    PacScript* pac_script = GetActivePacScript();
+    if (pac_script) {
+      settings.pac_source = pac_script->source();
+    }
+  }
+  if (!proxy_resolver) {
+    proxy_resolver = new ProxyResolver(GetPacHost(), kProxyResolverThreads);
+  }
+  std::vector<std::string> proxies;
+  proxy_resolver->Resolve(settings, urls, &proxies);
+
+  NPObject* array = CreateJSArray(plugin->npp);
+  if (!array) {
     return false;
   }
-  if (argCount == 1 && NPVARIANT_IS_BOOLEAN(args[0])) {
-    config.use_proxy = NPVARIANT_TO_BOOLEAN(args[0]);
-  } else if (argCount == 2 &&
-             NPVARIANT_IS_BOOLEAN(args[0]) &&
-             NPVARIANT_IS_STRING(args[1])) {
-    config.use_proxy = NPVARIANT_TO_BOOLEAN(args[0]);    
-    AssignNPStringToVar(NPVARIANT_TO_STRING(args[1]), &config.proxy_server);
-  } else if (argCount == 3 &&
-             NPVARIANT_IS_BOOLEAN(args[0]) &&
-             NPVARIANT_IS_STRING(args[1]) &&
-             NPVARIANT_IS_BOOLEAN(args[2])) {
-    config.use_proxy = NPVARIANT_TO_BOOLEAN(args[0]);    
-    AssignNPStringToVar(NPVARIANT_TO_STRING(args[1]), &config.proxy_server);
-    config.auto_config = NPVARIANT_TO_BOOLEAN(args[2]);
-  } else if (argCount == 4 &&
-             NPVARIANT_IS_BOOLEAN(args[0]) &&
-             NPVARIANT_IS_STRING(args[1]) &&
-             NPVARIANT_IS_BOOLEAN(args[2]) &&
-             NPVARIANT_IS_STRING(args[3])) {
-    config.use_proxy = NPVARIANT_TO_BOOLEAN(args[0]);
-    AssignNPStringToVar(NPVARIANT_TO_STRING(args[1]), &config.proxy_server);
-    config.auto_config = NPVARIANT_TO_BOOLEAN(args[2]);
-    AssignNPStringToVar(NPVARIANT_TO_STRING(args[3]), &config.auto_config_url);
-  } else if (argCount == 5 &&
-             NPVARIANT_IS_BOOLEAN(args[0]) &&
-             NPVARIANT_IS_STRING(args[1]) &&
-             NPVARIANT_IS_BOOLEAN(args[2]) &&
-             NPVARIANT_IS_STRING(args[3]) &&
-             NPVARIANT_IS_STRING(args[4])) {
-    config.use_proxy = NPVARIANT_TO_BOOLEAN(args[0]);
-    AssignNPStringToVar(NPVARIANT_TO_STRING(args[1]), &config.proxy_server);
-    config.auto_config = NPVARIANT_TO_BOOLEAN(args[2]);
-    AssignNPStringToVar(NPVARIANT_TO_STRING(args[3]), &config.auto_config_url);
-    AssignNPStringToVar(NPVARIANT_TO_STRING(args[4]), &config.bypass_list);
-  } else if (argCount == 6 &&
-             NPVARIANT_IS_BOOLEAN(args[0]) &&
-             NPVARIANT_IS_STRING(args[1]) &&
-             NPVARIANT_IS_BOOLEAN(args[2]) &&
-             NPVARIANT_IS_STRING(args[3]) &&
-             NPVARIANT_IS_STRING(args[4]) &&
-             NPVARIANT_IS_BOOLEAN(args[5])) {
-    config.use_proxy = NPVARIANT_TO_BOOLEAN(args[0]);
-    AssignNPStringToVar(NPVARIANT_TO_STRING(args[1]), &config.proxy_server);
-    config.auto_config = NPVARIANT_TO_BOOLEAN(args[2]);
-    AssignNPStringToVar(NPVARIANT_TO_STRING(args[3]), &config.auto_config_url);
-    AssignNPStringToVar(NPVARIANT_TO_STRING(args[4]), &config.bypass_list);    
-    config.auto_detect = NPVARIANT_TO_BOOLEAN(args[5]);
-  }
-  return proxyImpl->SetProxyConfig(config);
+  for (size_t i = 0; i < proxies.size(); ++i) {
+    NPVariant value;
+    // The browser copies the string.
+    STRINGN_TO_NPVARIANT(proxies[i].data(), (uint32_t)proxies[i].size(),
+                         value);
+    AppendToJSArray(plugin->npp, array, value);
+  }
+  OBJECT_TO_NPVARIANT(array, *result);
+  return true;
+}
+
+// Javascript example use:
+// plugin.useProfileStore("3f9c0a17");
+// Names the store the profile methods use. Every browser profile runs its
+// own copy of the plugin and must keep its own list, so the page makes up
+// a name once and keeps it with its other settings. Letters, digits, '-'
+// and '_' only.
+static bool InvokeUseProfileStore(NPObject* obj, const NPVariant* args,
+                                  uint32_t argCount, NPVariant* result) {
+  if (argCount != 1 || !NPVARIANT_IS_STRING(args[0])) {
+    return false;
+  }
+  std::string name = NPStringToString(NPVARIANT_TO_STRING(args[0]));
+  if (name.empty() || name.size() > 64 ||
+      name.find_first_not_of("abcdefghijklmnopqrstuvwxyz"
+                             "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_") !=
+      std::string::npos) {
+    return false;
+  }
+  if (name != profile_store_name) {
+    CloseProfileStore();
+    ForgetCompiledProfiles();
+    profile_store_name = name;
+  }
+  BOOLEAN_TO_NPVARIANT(GetProfileStore() != NULL, *result);
+  return true;
+}
+
+// Javascript example use:
+// profiles = plugin.listProfiles();
+// profiles[0].id, profiles[0].proxy and profiles[0].notes describe the
+// first saved profile of the popup.
+static bool InvokeListProfiles(NPObject* obj, const NPVariant* args,
+                               uint32_t argCount, NPVariant* result) {
+  PluginObj* plugin = (PluginObj*)obj;
+  ProfileStore* store = GetProfileStore();
+  if (!store) {
+    return false;
+  }
+  std::vector<Profile> profiles;
+  store->List(&profiles);
+  NPObject* array = CreateJSArray(plugin->npp);
+  if (!array) {
+    return false;
+  }
+  for (size_t i = 0; i < profiles.size(); ++i) {
+    NPObject* item = CreateJSObject(plugin->npp);
+    if (!item) {
+      continue;
+    }
+    SetNumberProperty(plugin->npp, item, "id", profiles[i].id);
+    SetStringProperty(plugin->npp, item, "proxy", profiles[i].proxy);
+    SetStringProperty(plugin->npp, item, "notes", profiles[i].notes);
+    NPVariant value;
+    OBJECT_TO_NPVARIANT(item, value);
+    AppendToJSArray(plugin->npp, array, value);
+    npnfuncs->releaseobject(item);
+  }
+  OBJECT_TO_NPVARIANT(array, *result);
+  return true;
+}
+
+// Javascript example use:
+// id = plugin.addProfile("http=a:80;https=b:443", "office");
+// The new profile goes in front of all others.
+static bool InvokeAddProfile(NPObject* obj, const NPVariant* args,
+                             uint32_t argCount, NPVariant* result) {
+  ProfileStore* store = GetProfileStore();
+  if (!store || argCount != 2 || !NPVARIANT_IS_STRING(args[0]) ||
+      !NPVARIANT_IS_STRING(args[1])) {
+    return false;
+  }
+  uint32_t id = store->Add(NPStringToString(NPVARIANT_TO_STRING(args[0])),
+                           NPStringToString(NPVARIANT_TO_STRING(args[1])));
+  DOUBLE_TO_NPVARIANT(id, *result);
+  return true;
+}
+
+// Javascript example use:
+// plugin.setProfileField(id, "notes", "home");
+// field is "proxy" or "notes". Only the changed field is written, so this
+// is cheap enough to call on every key stroke.
+static bool InvokeSetProfileField(NPObject* obj, const NPVariant* args,
+                                  uint32_t argCount, NPVariant* result) {
+  ProfileStore* store = GetProfileStore();
+  if (!store || argCount != 3 || !NPVARIANT_IS_STRING(args[1]) ||
+      !NPVARIANT_IS_STRING(args[2])) {
+    return false;
+  }
+  std::string field = NPStringToString(NPVARIANT_TO_STRING(args[1]));
+  if (field != "proxy" && field != "notes") {
+    return false;
+  }
+  bool ok = store->SetField(
+      (uint32_t)GetIntArgument(args, argCount, 0),
+      field == "proxy" ? ProfileStore::kProxyField : ProfileStore::kNotesField,
+      NPStringToString(NPVARIANT_TO_STRING(args[2])));
+  if (field == "proxy") {
+    ForgetCompiledProfile((uint32_t)GetIntArgument(args, argCount, 0));
+  }
+  BOOLEAN_TO_NPVARIANT(ok, *result);
+  return true;
+}
+
+// plugin.deleteProfile(id);
+static bool InvokeDeleteProfile(NPObject* obj, const NPVariant* args,
+                                uint32_t argCount, NPVariant* result) {
+  ProfileStore* store = GetProfileStore();
+  if (!store || argCount != 1) {
+    return false;
+  }
+  uint32_t id = (uint32_t)GetIntArgument(args, argCount, 0);
+  ForgetCompiledProfile(id);
+  BOOLEAN_TO_NPVARIANT(store->Delete(id), *result);
+  return true;
+}
+
+// plugin.clearProfiles();
+static bool InvokeClearProfiles(NPObject* obj, const NPVariant* args,
+                                uint32_t argCount, NPVariant* result) {
+  ProfileStore* store = GetProfileStore();
+  if (!store) {
+    return false;
+  }
+  store->Clear();
+  ForgetCompiledProfiles();
+  VOID_TO_NPVARIANT(*result);
+  return true;
+}
+
+// Javascript example use:
+// if (plugin.syncProfiles()) { localStorage.removeItem("proxyList"); }
+// Changes reach the disk within a second on their own; this writes and
+// syncs them now and tells whether that worked.
+static bool InvokeSyncProfiles(NPObject* obj, const NPVariant* args,
+                               uint32_t argCount, NPVariant* result) {
+  ProfileStore* store = GetProfileStore();
+  if (!store) {
+    return false;
+  }
+  BOOLEAN_TO_NPVARIANT(store->Sync(), *result);
+  return true;
+}
+
+// Turns a profile as the popup stores it, e.g. "a:80,b:80;pac=local", into
+// what applying it takes. The bypass list and auto-detection are those of
+// system, the current system setting.
+static bool CompileProfile(const Profile& profile, int port,
+                           const ProxyConfig& system,
+                           CompiledProfile* compiled) {
+  static const char kPacSuffix[] = ";pac=";
+  ProxyConfig config;
+  config.CopyFields(system, kAllProxyConfigFields);
+  std::string description = profile.proxy;
+  std::string pac;
+  size_t suffix = description.find(kPacSuffix);
+  if (suffix != std::string::npos) {
+    size_t begin = suffix + sizeof(kPacSuffix) - 1;
+    pac = description.substr(begin, description.find(';', begin) - begin);
+    description.erase(suffix);
+  }
+  compiled->has_bypass_list = config.bypass_list != NULL;
+  if (config.bypass_list) {
+    compiled->bypass_list = config.bypass_list;
+  }
+  compiled->auto_detect = config.auto_detect;
+  std::string proxy_server = description;
+  compiled->pac_url = pac;
+  bool use_forwarder = description.find_first_of(",|") != std::string::npos;
+  if (pac == "local") {
+    if (!GeneratePacScript(description, compiled->bypass_list,
+                           &compiled->pac_script)) {
+      return false;
+    }
+    use_forwarder = true;
+  }
+  Forwarder* fwd = NULL;
+  if (use_forwarder) {
+    fwd = GetForwarder();
+    if (!fwd->Start(fwd->IsRunning() ? 0 : port)) {
+      return false;
+    }
+    compiled->forwarder_address = fwd->address();
+  }
+  if (description.find_first_of(",|") != std::string::npos) {
+    compiled->forwarder_profile = description;
+    proxy_server = fwd->address();
+  }
+  if (!compiled->pac_script.empty()) {
+    compiled->pac_url = fwd->pac_url();
+  }
+  config.use_proxy = true;
+  config.auto_config = !compiled->pac_url.empty();
+  AssignStringToVar(proxy_server, &config.proxy_server);
+  AssignStringToVar(compiled->pac_url, &config.auto_config_url);
+  compiled->payload = proxyImpl->CompilePayload(config);
+  return compiled->payload != NULL;
+}
+
+// Whether compiled still matches system, the current system setting, and
+// the forwarder it points at still listens where it did.
+static bool IsCompiledProfileCurrent(const CompiledProfile& compiled,
+                                     const ProxyConfig& system) {
+  if (compiled.auto_detect != system.auto_detect ||
+      compiled.has_bypass_list != (system.bypass_list != NULL) ||
+      (system.bypass_list && compiled.bypass_list != system.bypass_list)) {
+    return false;
+  }
+  if (compiled.forwarder_address.empty()) {
+    return true;
+  }
+  return forwarder && forwarder->IsRunning() &&
+      forwarder->address() == compiled.forwarder_address;
+}
+
+// Switches the system setting to the saved profile id, compiling it first
+// if needed. port is used if the forwarder is not running yet. Sets
+// address to the forwarder address if the profile uses it, otherwise "".
+// The setting goes to the active connection, or if connections is not
+// NULL to each of them, with the outcome of each in results.
+static bool ApplyProfile(uint32_t id, int port,
+                         const std::vector<std::string>* connections,
+                         std::vector<bool>* results, std::string* address) {
+  ProfileStore* store = GetProfileStore();
+  if (!store) {
+    return false;
+  }
+  ProxyConfig system;
+  if (!ReadProxyConfig(&system)) {
+    return false;
+  }
+  std::map<uint32_t, CompiledProfile>::iterator it =
+      compiled_profiles.find(id);
+  if (it != compiled_profiles.end() &&
+      !IsCompiledProfileCurrent(it->second, system)) {
+    ForgetCompiledProfile(id);
+    it = compiled_profiles.end();
+    stats::Add("compiledProfilesStale", 1);
+  }
+  if (it == compiled_profiles.end()) {
+    Profile profile;
+    CompiledProfile compiled;
+    if (!store->Get(id, &profile) ||
+        !CompileProfile(profile, port, system, &compiled)) {
+      delete compiled.payload;
+      return false;
+    }
+    it = compiled_profiles.insert(std::make_pair(id, compiled)).first;
+    stats::Add("profilesCompiled", 1);
+  }
+  int64_t start_us = NowMicros();
+  const CompiledProfile& compiled = it->second;
+  bool applied = false;
+  if (connections) {
+    proxyImpl->ApplyPayloadToConnections(*compiled.payload, *connections,
+                                         kBulkApplyThreads, results);
+    applied = std::find(results->begin(), results->end(), true) !=
+        results->end();
+    stats::Set("lastBulkApplyUs", NowMicros() - start_us);
+    stats::Set("lastBulkApplyConnections", (int64_t)connections->size());
+  } else if (!proxyImpl->ApplyPayload(*compiled.payload)) {
+    return false;
+  } else {
+    applied = true;
+    stats::Set("lastApplyProfileUs", NowMicros() - start_us);
+  }
+  // What the forwarder serves and the script lookups use change only once
+  // the setting pointing at them is in place.
+  if (applied) {
+    if (!compiled.forwarder_profile.empty()) {
+      forwarder->SetProfile(compiled.forwarder_profile, compiled.bypass_list);
+    }
+    if (!compiled.pac_script.empty()) {
+      forwarder->SetPacScript(compiled.pac_script);
+      deferred_pac_source = compiled.pac_script;
+      deferred_pac_url.clear();
+    } else if (!compiled.pac_url.empty()) {
+      deferred_pac_url = compiled.pac_url;
+      deferred_pac_source.clear();
+    } else {
+      UnloadPacScript();
+    }
+  }
+  RefreshSharedState();
+  bool uses_forwarder = !compiled.forwarder_profile.empty() ||
+      !compiled.pac_script.empty();
+  *address = uses_forwarder ? forwarder->address() : "";
+  return true;
+}
+
+// Javascript example use:
+// address = plugin.applyProfile(profiles[i].id, 8118);
+// Switches the system setting to a saved profile the way the popup does,
+// including the forwarder for pools and ";pac=local". Each profile is
+// compiled once into the platform's form and kept until it is edited, so
+// switching back and forth costs no parsing. The optional port is used
+// if the forwarder is not running yet. Returns the forwarder address if
+// the profile uses it, otherwise "".
+static bool InvokeApplyProfile(NPObject* obj, const NPVariant* args,
+                               uint32_t argCount, NPVariant* result) {
+  std::string address;
+  if (argCount < 1 ||
+      !ApplyProfile((uint32_t)GetIntArgument(args, argCount, 0),
+                    GetIntArgument(args, argCount, 1), NULL, NULL,
+                    &address)) {
+    return false;
+  }
+  StringToNPVariant(address, result);
+  return true;
+}
+
+// Javascript example use:
+// connections = plugin.listConnections();
+// The names of all connections a profile can be applied to, active or
+// not, e.g. ["LAN", "Work VPN"] on Windows or ["Wi-Fi", "Ethernet"] on
+// the Mac.
+static bool InvokeListConnections(NPObject* obj, const NPVariant* args,
+                                  uint32_t argCount, NPVariant* result) {
+  PluginObj* plugin = (PluginObj*)obj;
+  std::vector<std::string> names;
+  if (!proxyImpl->EnumerateConnections(&names)) {
+    return false;
+  }
+  NPObject* array = CreateJSArray(plugin->npp);
+  if (!array) {
+    return false;
+  }
+  for (size_t i = 0; i < names.size(); ++i) {
+    NPVariant value;
+    // The browser copies the string.
+    STRINGN_TO_NPVARIANT(names[i].data(), (uint32_t)names[i].size(), value);
+    AppendToJSArray(plugin->npp, array, value);
+  }
+  OBJECT_TO_NPVARIANT(array, *result);
+  return true;
+}
+
+// Javascript example use:
+// applied = plugin.applyProfileToConnections(profiles[i].id,
+//                                            ["Wi-Fi", "Work VPN"], 8118);
+// Like applyProfile, but for each of the given connections, or all that
+// listConnections names if none are given, at once. applied.address is
+// what applyProfile returns; applied.results holds one {connection, ok}
+// per connection.
+static bool InvokeApplyProfileToConnections(NPObject* obj,
+                                            const NPVariant* args,
+                                            uint32_t argCount,
+                                            NPVariant* result) {
+  PluginObj* plugin = (PluginObj*)obj;
+  std::vector<std::string> connections;
+  if (argCount < 1 ||
+      (argCount > 1 &&
+       !NPArrayToStrings(plugin->npp, args[1], &connections)) ||
+      (argCount < 2 && !proxyImpl->EnumerateConnections(&connections))) {
+    return false;
+  }
+  std::vector<bool> results;
+  std::string address;
+  if (!ApplyProfile((uint32_t)GetIntArgument(args, argCount, 0),
+                    GetIntArgument(args, argCount, 2), &connections,
+                    &results, &address)) {
+    return false;
+  }
+  NPObject* applied = CreateJSObject(plugin->npp);
+  NPObject* array = CreateJSArray(plugin->npp);
+  if (!applied || !array) {
+    if (applied) {
+      npnfuncs->releaseobject(applied);
+    }
+    if (array) {
+      npnfuncs->releaseobject(array);
+    }
+    return false;
+  }
+  for (size_t i = 0; i < connections.size(); ++i) {
+    NPObject* item = CreateJSObject(plugin->npp);
+    if (!item) {
+      continue;
+    }
+    SetStringProperty(plugin->npp, item, "connection", connections[i]);
+    SetBoolProperty(plugin->npp, item, "ok", results[i]);
+    NPVariant value;
+    OBJECT_TO_NPVARIANT(item, value);
+    AppendToJSArray(plugin->npp, array, value);
+    npnfuncs->releaseobject(item);
+  }
+  SetStringProperty(plugin->npp, applied, "address", address);
+  NPVariant value;
+  OBJECT_TO_NPVARIANT(array, value);
+  npnfuncs->setproperty(plugin->npp, applied,
+                        npnfuncs->getstringidentifier("results"), &value);
+  npnfuncs->releaseobject(array);
+  OBJECT_TO_NPVARIANT(applied, *result);
+  return true;
+}
+
+// Applies the profile the rules give for the network the machine is on,
+// unless the rules were already applied for it. A profile that could not
+// be applied is tried again on the next event. changed_us is when the
+// network changed, for the switch latency.
+static void ApplyNetworkRules(int64_t changed_us) {
+  std::string connection = GetActiveConnectionDisplayName();
+  char address[64];
+  if (!GetPrimaryIpv4Address(address, sizeof(address))) {
+    address[0] = 0;
+  }
+  std::string network = connection + "\n" + address;
+  if (network == last_network) {
+    return;
+  }
+  uint32_t id;
+  std::string forwarder_address;
+  if (!network_rules.Match(connection, address, &id)) {
+    last_network = network;
+    return;
+  }
+  if (!ApplyProfile(id, 0, NULL, NULL, &forwarder_address)) {
+    DebugLog("ApplyNetworkRules: cannot apply profile %u on %s\n", id,
+             connection.c_str());
+    return;
+  }
+  last_network = network;
+  stats::Add("networkSwitches", 1);
+  stats::Set("lastNetworkSwitchUs", NowMicros() - changed_us);
+  if (network_callback) {
+    NPVariant args[2];
+    INT32_TO_NPVARIANT((int32_t)id, args[0]);
+    STRINGN_TO_NPVARIANT(forwarder_address.data(),
+                         (uint32_t)forwarder_address.size(), args[1]);
+    NPVariant result;
+    if (npnfuncs->invokeDefault(network_npp, network_callback, args, 2,
+                                &result)) {
+      npnfuncs->releasevariantvalue(&result);
+    }
+  }
+}
+
+static void OnNetworkChangedOnMainThread(void* arg) {
+  int64_t* changed_us = (int64_t*)arg;
+  // The setting may differ per connection.
+  RefreshSharedState();
+  // The rules may have been dropped since the event was posted.
+  if (network_watcher && network_watcher->IsRunning()) {
+    ApplyNetworkRules(*changed_us);
+  }
+  delete changed_us;
+}
+
+static void OnNetworkChanged(void* arg, int64_t changed_us) {
+  npnfuncs->pluginthreadasynccall(network_npp, OnNetworkChangedOnMainThread,
+                                  new int64_t(changed_us));
+}
+
+static void StopNetworkWatcher() {
+  if (network_watcher) {
+    network_watcher->Stop();
+  }
+  if (network_callback) {
+    npnfuncs->releaseobject(network_callback);
+    network_callback = NULL;
+  }
+  network_npp = NULL;
+}
+
+// Javascript example use:
+// plugin.setNetworkRules([{network: "Work VPN", profile: 3},
+//                         {network: "10.20/16", profile: 5}],
+//                        function(id, address) { ... });
+// Switches to the profile of the first matching rule whenever the network
+// changes, and once right away. network is a connection name or an IPv4
+// network the primary address is in; see NetworkRules. The optional
+// function is called with the profile id and the forwarder address, as
+// applyProfile returns it, after each switch. An empty list stops it.
+static bool InvokeSetNetworkRules(NPObject* obj, const NPVariant* args,
+                                  uint32_t argCount, NPVariant* result) {
+  PluginObj* plugin = (PluginObj*)obj;
+  std::vector<NPObject*> objects;
+  if (argCount < 1 || !NPArrayToObjects(plugin->npp, args[0], &objects)) {
+    return false;
+  }
+  std::vector<NetworkRules::Rule> rules;
+  for (size_t i = 0; i < objects.size(); ++i) {
+    NetworkRules::Rule rule;
+    double profile_id;
+    if (GetStringProperty(plugin->npp, objects[i], "network",
+                          &rule.network) &&
+        GetNumberProperty(plugin->npp, objects[i], "profile", &profile_id)) {
+      rule.profile_id = (uint32_t)profile_id;
+      rules.push_back(rule);
+    }
+    npnfuncs->releaseobject(objects[i]);
+  }
+  StopNetworkWatcher();
+  network_rules.Set(rules);
+  last_network.clear();
+  if (network_rules.empty()) {
+    return true;
+  }
+  network_npp = plugin->npp;
+  if (argCount > 1 && NPVARIANT_IS_OBJECT(args[1])) {
+    network_callback = npnfuncs->retainobject(NPVARIANT_TO_OBJECT(args[1]));
+  }
+  if (!network_watcher) {
+    network_watcher = new NetworkWatcher;
+  }
+  if (!network_watcher->Start(OnNetworkChanged, NULL)) {
+    DebugLog("setNetworkRules: cannot watch the network\n");
+  }
+  ApplyNetworkRules(NowMicros());
+  return true;
+}
+
+static void OnSystemStateChangedOnMainThread(void* arg) {
+  if (state_callback) {
+    NPVariant result;
+    if (npnfuncs->invokeDefault(state_npp, state_callback, NULL, 0,
+                                &result)) {
+      npnfuncs->releasevariantvalue(&result);
+    }
+  }
+}
+
+static void OnSystemStateChanged(void* arg) {
+  ScopedLock lock(&state_npp_lock);
+  if (state_npp) {
+    npnfuncs->pluginthreadasynccall(state_npp,
+                                    OnSystemStateChangedOnMainThread, NULL);
+  }
+}
+
+static void StopWatchingSystemState() {
+  ScopedLock lock(&state_npp_lock);
+  if (state_callback) {
+    npnfuncs->releaseobject(state_callback);
+    state_callback = NULL;
+  }
+  state_npp = NULL;
+}
+
+// Javascript example use:
+// plugin.watchSystemState(function() { ... });
+// Calls the function whenever the proxy setting or the active connection
+// changes, such as when the state the last session left, which is what
+// the plugin answers with right after it loads, turns out to be out of
+// date. null stops it.
+static bool InvokeWatchSystemState(NPObject* obj, const NPVariant* args,
+                                   uint32_t argCount, NPVariant* result) {
+  PluginObj* plugin = (PluginObj*)obj;
+  if (argCount != 1 ||
+      (!NPVARIANT_IS_OBJECT(args[0]) && !NPVARIANT_IS_NULL(args[0]))) {
+    return false;
+  }
+  StopWatchingSystemState();
+  if (NPVARIANT_IS_OBJECT(args[0])) {
+    ScopedLock lock(&state_npp_lock);
+    state_callback = npnfuncs->retainobject(NPVARIANT_TO_OBJECT(args[0]));
+    state_npp = plugin->npp;
+  }
+  return true;
+}
+
+static bool GetForwarderProfile(NPObject* obj, NPVariant* result) {
+  StringToNPVariant(forwarder ? forwarder->profile() : "", result);
+  return true;
+}
+
+// Javascript example use:
+// id = plugin.activeProfileId;
+// The id of the first saved profile equivalent to the current system
+// setting, or -1 if none is or no proxy is in use. A setting pointing to
+// the forwarder stands for its profile, and the PAC script the forwarder
+// serves for ";pac=local".
+static bool GetActiveProfileId(NPObject* obj, NPVariant* result) {
+  ProfileStore* store = GetProfileStore();
+  ProxyConfig config;
+  if (!store || !ReadProxyConfig(&config)) {
+    return false;
+  }
+  uint32_t id = 0;
+  if (config.use_proxy) {
+    std::string proxy = config.proxy_server ? config.proxy_server : "";
+    bool forwarding = forwarder && forwarder->IsRunning();
+    if (forwarding && proxy == forwarder->address()) {
+      proxy = forwarder->profile();
+    }
+    if (config.auto_config && config.auto_config_url) {
+      proxy += ";pac=";
+      proxy += forwarding && config.auto_config_url == forwarder->pac_url() ?
+          "local" : config.auto_config_url;
+    }
+    if (!store->FindByProxy(proxy, &id)) {
+      id = 0;
+    }
+  }
+  INT32_TO_NPVARIANT(id ? (int32_t)id : -1, *result);
+  return true;
+}
+
+// Javascript example use:
+// profiles = plugin.profiles;
+// profiles.length, profiles[i].id, profiles[i].proxy and profiles[i].notes
+// read the saved profiles in list order, like listProfiles() but without
+// copying them; only the rows that are read cost anything. The object is
+// live, so every read returns the same one until the store changes.
+static bool GetProfiles(NPObject* obj, NPVariant* result) {
+  PluginObj* plugin = (PluginObj*)obj;
+  if (!GetProfileStore()) {
+    return false;
+  }
+  if (!plugin->profiles) {
+    plugin->profiles = CreateProfileListObject(plugin->npp,
+                                               profile_store_ref);
+    if (!plugin->profiles) {
+      return false;
+    }
+  }
+  npnfuncs->retainobject(plugin->profiles);
+  OBJECT_TO_NPVARIANT(plugin->profiles, *result);
+  return true;
+}
+
+// Javascript example use:
+// failovers = plugin.stats.forwarderFailovers;
+static bool GetStats(NPObject* obj, NPVariant* result) {
+  PluginObj* plugin = (PluginObj*)obj;
+  NPObject* counters = CreateJSObject(plugin->npp);
+  if (!counters) {
+    return false;
+  }
+  std::map<std::string, int64_t> snapshot;
+  stats::Snapshot(&snapshot);
+  for (std::map<std::string, int64_t>::const_iterator it = snapshot.begin();
+       it != snapshot.end(); ++it) {
+    SetNumberProperty(plugin->npp, counters, it->first.c_str(),
+                      (double)it->second);
+  }
+  OBJECT_TO_NPVARIANT(counters, *result);
+  return true;
 }
 
 static bool GetConnectionName(NPObject* obj, NPVariant* result) {
   DebugLog("npswitchproxy: GetConnectionName\n");
+  SystemState state;
+  uint32_t generation;
+  if (shared_state && shared_state->Read(&state, &generation)) {
+    RecordFirstSystemState();
+    StringToNPVariant(state.connection_name.empty() ?
+                      "__No connection__" : state.connection_name, result);
+    return true;
+  }
+  RecordFirstSystemState();
   char* utf8_result;
   const char* connection_name;
   if (!proxyImpl->GetActiveConnectionName((const void **)&connection_name)) {
@@ -171,11 +1620,18 @@ static NPObject* Allocate(NPP instance, NPClass* npclass) {
   // Keeping npp since we need to use it to create
   // other scriptable objects.
   obj->npp = instance;
+  obj->proxy_config = NULL;
+  obj->proxy_config_generation = 0;
+  obj->profiles = NULL;
+  plugin_objects.insert(obj);
   return (NPObject*)obj;
 }
 
 static void Deallocate(NPObject* obj) {
-  delete((PluginObj*) obj);
+  PluginObj* plugin = (PluginObj*)obj;
+  ReleasePluginCaches(plugin);
+  plugin_objects.erase(plugin);
+  delete plugin;
 }
 
 static bool HasMethod(NPObject* obj, NPIdentifier methodName) {
@@ -193,6 +1649,11 @@ static bool Invoke(NPObject* obj, NPIdentifier methodName,
                    const NPVariant* args, uint32_t argCount,
                    NPVariant* result) {
   DebugLog("npswitchproxy: Invoke\n");
+  // Pages poll getProxyConfig, so it is told by its identifier without
+  // copying the name out of the browser.
+  if (methodName == get_proxy_config_identifier) {
+    return InvokeGetProxyConfig(obj, args, argCount, result);
+  }
   char* name = npnfuncs->utf8fromidentifier(methodName);
   bool ret_val = false;
   if (!name) {
@@ -204,6 +1665,70 @@ static bool Invoke(NPObject* obj, NPIdentifier methodName,
   } else if (!strncmp((const char*)name, kSetProxyConfigMethod,
                       strlen(kSetProxyConfigMethod))) {
     ret_val = InvokeSetProxyConfig(obj, args, argCount, result);
+  } else if (!strncmp((const char*)name, kSetProbeTargetsMethod,
+                      strlen(kSetProbeTargetsMethod))) {
+    ret_val = InvokeSetProbeTargets(obj, args, argCount, result);
+  } else if (!strncmp((const char*)name, kGetProxyHealthMethod,
+                      strlen(kGetProxyHealthMethod))) {
+    ret_val = InvokeGetProxyHealth(obj, args, argCount, result);
+  } else if (!strncmp((const char*)name, kSetForwarderProfileMethod,
+                      strlen(kSetForwarderProfileMethod))) {
+    ret_val = InvokeSetForwarderProfile(obj, args, argCount, result);
+  } else if (!strncmp((const char*)name, kSetPacScriptMethod,
+                      strlen(kSetPacScriptMethod))) {
+    ret_val = InvokeSetPacScript(obj, args, argCount, result);
+  } else if (!strncmp((const char*)name, kFindProxyForURLMethod,
+                      strlen(kFindProxyForURLMethod))) {
+    ret_val = InvokeFindProxyForURL(obj, args, argCount, result);
+  } else if (!strncmp((const char*)name, kLoadPacUrlMethod,
+                      strlen(kLoadPacUrlMethod))) {
+    ret_val = InvokeLoadPacUrl(obj, args, argCount, result);
+  } else if (!strncmp((const char*)name, kDiscoverPacUrlMethod,
+                      strlen(kDiscoverPacUrlMethod))) {
+    ret_val = InvokeDiscoverPacUrl(obj, args, argCount, result);
+  } else if (!strncmp((const char*)name, kServePacProfileMethod,
+                      strlen(kServePacProfileMethod))) {
+    ret_val = InvokeServePacProfile(obj, args, argCount, result);
+  } else if (!strncmp((const char*)name, kResolveProxiesMethod,
+                      strlen(kResolveProxiesMethod))) {
+    ret_val = InvokeResolveProxies(obj, args, argCount, result);
+  } else if (!strncmp((const char*)name, kListProfilesMethod,
+                      strlen(kListProfilesMethod))) {
+    ret_val = InvokeListProfiles(obj, args, argCount, result);
+  } else if (!strncmp((const char*)name, kAddProfileMethod,
+                      strlen(kAddProfileMethod))) {
+    ret_val = InvokeAddProfile(obj, args, argCount, result);
+  } else if (!strncmp((const char*)name, kSetProfileFieldMethod,
+                      strlen(kSetProfileFieldMethod))) {
+    ret_val = InvokeSetProfileField(obj, args, argCount, result);
+  } else if (!strncmp((const char*)name, kDeleteProfileMethod,
+                      strlen(kDeleteProfileMethod))) {
+    ret_val = InvokeDeleteProfile(obj, args, argCount, result);
+  } else if (!strncmp((const char*)name, kClearProfilesMethod,
+                      strlen(kClearProfilesMethod))) {
+    ret_val = InvokeClearProfiles(obj, args, argCount, result);
+  } else if (!strncmp((const char*)name, kSyncProfilesMethod,
+                      strlen(kSyncProfilesMethod))) {
+    ret_val = InvokeSyncProfiles(obj, args, argCount, result);
+  } else if (!strncmp((const char*)name, kApplyProfileToConnectionsMethod,
+                      strlen(kApplyProfileToConnectionsMethod))) {
+    // Before applyProfile, which is a prefix of it.
+    ret_val = InvokeApplyProfileToConnections(obj, args, argCount, result);
+  } else if (!strncmp((const char*)name, kApplyProfileMethod,
+                      strlen(kApplyProfileMethod))) {
+    ret_val = InvokeApplyProfile(obj, args, argCount, result);
+  } else if (!strncmp((const char*)name, kSetNetworkRulesMethod,
+                      strlen(kSetNetworkRulesMethod))) {
+    ret_val = InvokeSetNetworkRules(obj, args, argCount, result);
+  } else if (!strncmp((const char*)name, kListConnectionsMethod,
+                      strlen(kListConnectionsMethod))) {
+    ret_val = InvokeListConnections(obj, args, argCount, result);
+  } else if (!strncmp((const char*)name, kWatchSystemStateMethod,
+                      strlen(kWatchSystemStateMethod))) {
+    ret_val = InvokeWatchSystemState(obj, args, argCount, result);
+  } else if (!strncmp((const char*)name, kUseProfileStoreMethod,
+                      strlen(kUseProfileStoreMethod))) {
+    ret_val = InvokeUseProfileStore(obj, args, argCount, result);
   } else {
     // Aim exception handling. 
     npnfuncs->setexception(obj, "exception during invocation");
@@ -221,8 +1746,16 @@ static bool HasProperty(NPObject* obj, NPIdentifier propertyName) {
   DebugLog("npswitchproxy: HasProperty\n");
   char* name = npnfuncs->utf8fromidentifier(propertyName);
   bool ret_val = false;
-  if (name && !strncmp((const char*)name, kGetConnectionNameProperty,
-                       strlen(kGetConnectionNameProperty))) {
+  if (name && (!strncmp((const char*)name, kGetConnectionNameProperty,
+                        strlen(kGetConnectionNameProperty)) ||
+               !strncmp((const char*)name, kForwarderProfileProperty,
+                        strlen(kForwarderProfileProperty)) ||
+               !strncmp((const char*)name, kStatsProperty,
+                        strlen(kStatsProperty)) ||
+               !strncmp((const char*)name, kActiveProfileIdProperty,
+                        strlen(kActiveProfileIdProperty)) ||
+               !strncmp((const char*)name, kProfilesProperty,
+                        strlen(kProfilesProperty)))) {
     ret_val = true;
   }
   DebugLog("Property: %s = %d\n", name, ret_val);
@@ -241,6 +1774,18 @@ static bool GetProperty(NPObject* obj, NPIdentifier propertyName,
   if (name && !strncmp((const char*)name, kGetConnectionNameProperty,
                        strlen(kGetConnectionNameProperty))) {
     ret_val = GetConnectionName(obj, result);
+  } else if (name && !strncmp((const char*)name, kForwarderProfileProperty,
+                              strlen(kForwarderProfileProperty))) {
+    ret_val = GetForwarderProfile(obj, result);
+  } else if (name && !strncmp((const char*)name, kStatsProperty,
+                              strlen(kStatsProperty))) {
+    ret_val = GetStats(obj, result);
+  } else if (name && !strncmp((const char*)name, kActiveProfileIdProperty,
+                              strlen(kActiveProfileIdProperty))) {
+    ret_val = GetActiveProfileId(obj, result);
+  } else if (name && !strncmp((const char*)name, kProfilesProperty,
+                              strlen(kProfilesProperty))) {
+    ret_val = GetProfiles(obj, result);
   }
   if (name) {
     npnfuncs->memfree(name);
@@ -271,6 +1816,19 @@ static NPError NewNPInstance(NPMIMEType pluginType, NPP instance,
 }
 
 static NPError DestroyNPInstance(NPP instance, NPSavedData** save) {
+  if (instance == network_npp) {
+    StopNetworkWatcher();
+  }
+  if (instance == state_npp) {
+    StopWatchingSystemState();
+  }
+  // The objects made for the instance go with it.
+  for (std::set<PluginObj*>::iterator it = plugin_objects.begin();
+       it != plugin_objects.end(); ++it) {
+    if ((*it)->npp == instance) {
+      ReleasePluginCaches(*it);
+    }
+  }
   if(so) {
     npnfuncs->releaseobject(so);
   }
@@ -325,6 +1883,45 @@ static NPError SetWindow(NPP instance, NPWindow* pNPWindow) {
   return NPERR_NO_ERROR;
 }
 
+static ProxyFactory proxy_factory = NULL;
+
+void SetProxyFactory(ProxyFactory factory) {
+  proxy_factory = factory;
+}
+
+// The platform backend, unless the environment asks for a trace to be
+// replayed instead, or for the platform's calls to be recorded.
+static ProxyBase* CreateProxyImpl() {
+  std::string replay_path = GetPathFromEnvironment(kReplayTraceVariable);
+  if (!replay_path.empty()) {
+    ReplayProxy* replay = new ReplayProxy;
+    if (!replay->Open(replay_path)) {
+      delete replay;
+      return NULL;
+    }
+    return replay;
+  }
+  ProxyBase* platform = NULL;
+#if defined(_WINDOWS)
+  platform = new WinProxy;
+#elif defined(WEBKIT_DARWIN_SDK)
+  platform = new MacProxy;
+#else
+  if (proxy_factory) {
+    platform = proxy_factory();
+  }
+#endif
+  std::string record_path = GetPathFromEnvironment(kRecordTraceVariable);
+  if (!platform || record_path.empty()) {
+    return platform;
+  }
+  RecordingProxy* recording = new RecordingProxy(platform);
+  if (!recording->Open(record_path)) {
+    DebugLog("npswitchproxy: cannot record to %s\n", record_path.c_str());
+  }
+  return recording;
+}
+
 // EXPORT
 #ifdef __cplusplus
 extern "C" {
@@ -358,36 +1955,89 @@ NPError OSCALL NP_Initialize(NPNetscapeFuncs* npnf) {
       return NPERR_INCOMPATIBLE_VERSION_ERROR;
     }
     npnfuncs = npnf;
+    get_proxy_config_identifier =
+        npnfuncs->getstringidentifier(kGetProxyConfigMethod);
 #if !defined(_WINDOWS) && !defined(WEBKIT_DARWIN_SDK)
     NP_GetEntryPoints(nppfuncs);
 #endif
 
-#if defined(_WINDOWS)
-    proxyImpl = new WinProxy; 
-#elif defined(WEBKIT_DARWIN_SDK)
-    proxyImpl = new MacProxy;
-#endif
-
+    initialize_us = NowMicros();
+    // Loading the platform libraries takes a while, so the backend starts
+    // on a thread while the page is served from the shared state.
+    proxyImpl = new DeferredProxy(CreateProxyImpl);
     if (!proxyImpl->PlatformDependentStartup()) {
       return NPERR_MODULE_LOAD_FAILED_ERROR;
     }
+    if (!InitializeSockets()) {
+      return NPERR_MODULE_LOAD_FAILED_ERROR;
+    }
+    std::string play_path = GetPathFromEnvironment(kPlayTraceVariable);
+    if (!play_path.empty()) {
+      trace_player = new TracePlayer(proxyImpl);
+      if (!trace_player->Open(play_path) || !trace_player->Start()) {
+        DebugLog("npswitchproxy: cannot play %s\n", play_path.c_str());
+        delete trace_player;
+        trace_player = NULL;
+      }
+    }
+    if (IsTracing()) {
+      // Every call a trace holds is one the plugin made for the page.
+      return NPERR_NO_ERROR;
+    }
+    shared_state = new SharedState;
+    if (!shared_state->Open("shared_state", ReadSystemState,
+                            OnSystemStateChanged, NULL)) {
+      DebugLog("npswitchproxy: no shared state\n");
+      delete shared_state;
+      shared_state = NULL;
+    }
     return NPERR_NO_ERROR;
 }
 
 NPError	OSCALL NP_Shutdown() {
   DebugLog("npswitchproxy: NP_Shutdown\n");
-  proxyImpl->PlatformDependentShutdown();
-  delete proxyImpl;
+  ForgetCompiledProfiles();
+  // Reads the system setting on its thread.
+  delete shared_state;
+  shared_state = NULL;
+  delete network_watcher;
+  network_watcher = NULL;
+  delete prober;
+  prober = NULL;
+  delete forwarder;
+  forwarder = NULL;
+  delete proxy_resolver;
+  proxy_resolver = NULL;
+  CloseProfileStore();
+  profile_store_name.clear();
+  delete pac_loader;
+  pac_loader = NULL;
+  delete pac_script;
+  pac_script = NULL;
+  delete pac_host;
+  pac_host = NULL;
+  delete wpad;
+  wpad = NULL;
+  delete dns_resolver;
+  dns_resolver = NULL;
+  ShutdownSockets();
+  delete trace_player;
+  trace_player = NULL;
+  if (proxyImpl) {
+    proxyImpl->PlatformDependentShutdown();
+    delete proxyImpl;
+    proxyImpl = NULL;
+  }
   return NPERR_NO_ERROR;
 }
 
-#if defined(_WIN32) || defined (__OS2__)
+#if defined(_WIN32) || defined (__OS2__) || defined(XP_UNIX)
 char* NP_GetMIMEDescription(void) {
 #else
 const char* NP_GetMIMEDescription(void) {
 #endif
   DebugLog("npswitchproxy: NP_GetMIMEDescription\n");
-  return "application/x-switch-proxy::wzzhu@cs.hku.hk";
+  return (char*)"application/x-switch-proxy::wzzhu@cs.hku.hk";
 }
 
 // Needs to be present for WebKit based browsers.
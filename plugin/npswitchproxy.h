@@ -22,13 +22,54 @@
 #include "npfunctions.h"
 #include "npruntime.h"
 
+class ProxyBase;
+struct ProxyConfigObj;
+
 struct PluginObj : NPObject {
   NPP npp;
+  // What getProxyConfig last returned, with one reference of our own, and
+  // the shared state generation it was read at; 0 if it was read from the
+  // system. Returned again for as long as the setting stays the same.
+  ProxyConfigObj* proxy_config;
+  uint32_t proxy_config_generation;
+  // What plugin.profiles returns for the open store, with one reference of
+  // our own.
+  NPObject* profiles;
 };
 extern NPNetscapeFuncs* npnfuncs;
 extern void DebugLog(const char* msg, ...);
 extern const char* kGetProxyConfigMethod;
 extern const char* kSetProxyConfigMethod;
 extern const char* kGetConnectionNameProperty;
+extern const char* kSetProbeTargetsMethod;
+extern const char* kGetProxyHealthMethod;
+extern const char* kSetForwarderProfileMethod;
+extern const char* kForwarderProfileProperty;
+extern const char* kStatsProperty;
+extern const char* kActiveProfileIdProperty;
+extern const char* kProfilesProperty;
+extern const char* kSetPacScriptMethod;
+extern const char* kFindProxyForURLMethod;
+extern const char* kLoadPacUrlMethod;
+extern const char* kDiscoverPacUrlMethod;
+extern const char* kServePacProfileMethod;
+extern const char* kResolveProxiesMethod;
+extern const char* kListProfilesMethod;
+extern const char* kAddProfileMethod;
+extern const char* kSetProfileFieldMethod;
+extern const char* kDeleteProfileMethod;
+extern const char* kClearProfilesMethod;
+extern const char* kSyncProfilesMethod;
+extern const char* kApplyProfileMethod;
+extern const char* kSetNetworkRulesMethod;
+extern const char* kListConnectionsMethod;
+extern const char* kApplyProfileToConnectionsMethod;
+extern const char* kWatchSystemStateMethod;
+extern const char* kUseProfileStoreMethod;
+
+// Makes the backend on platforms without one of their own, such as the
+// headless build the tests run. Set before NP_Initialize.
+typedef ProxyBase* (*ProxyFactory)();
+extern void SetProxyFactory(ProxyFactory factory);
 
 #endif  // __NPSWITCHPROXY_H__
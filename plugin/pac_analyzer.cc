@@ -0,0 +1,250 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "pac_analyzer.h"
+
+#include <algorithm>
+#include <set>
+
+// Chains shorter than this are about as fast to run one test at a time.
+static const size_t kMinTests = 4;
+
+namespace {
+
+bool IsLiteral(const PacNode* node) {
+  // shExpMatch compares C strings, so a NUL would end the pattern early.
+  return node->kind == kPacString &&
+      node->text.find('\0') == std::string::npos;
+}
+
+class ChainFinder {
+ public:
+  ChainFinder(const std::map<std::string, int>& script_functions,
+              PacRuleChain* chain)
+      : script_functions_(script_functions), chain_(chain) {}
+
+  // Adds the rule of an if statement, and those of its else if branches.
+  // Returns false if node is no rule.
+  bool AddRules(const PacNode* node);
+
+ private:
+  bool AddTests(const PacNode* condition, PacRule* rule);
+  bool AddCallTests(const PacNode* call, PacRule* rule);
+  bool IsChainVariable(const PacNode* node);
+
+  const std::map<std::string, int>& script_functions_;
+  PacRuleChain* chain_;
+};
+
+bool ChainFinder::AddRules(const PacNode* node) {
+  if (node->kind != kPacIf || chain_->tail) {
+    return false;
+  }
+  const PacNode* then = node->children[1];
+  if (then->kind == kPacBlock && then->children.size() == 1) {
+    then = then->children[0];
+  }
+  if (then->kind != kPacReturn || then->children.empty() ||
+      then->children[0]->kind != kPacString) {
+    return false;
+  }
+  PacRule rule;
+  rule.result = then->children[0]->text;
+  std::string variable = chain_->variable;
+  if (!AddTests(node->children[0], &rule)) {
+    chain_->variable = variable;
+    return false;
+  }
+  chain_->rules.push_back(rule);
+  if (node->children.size() > 2 && !AddRules(node->children[2])) {
+    chain_->tail = node->children[2];
+  }
+  return true;
+}
+
+bool ChainFinder::AddTests(const PacNode* condition, PacRule* rule) {
+  switch (condition->kind) {
+    case kPacLogical:
+      return condition->op == kPacOpOr &&
+          AddTests(condition->children[0], rule) &&
+          AddTests(condition->children[1], rule);
+    case kPacCall:
+      return AddCallTests(condition, rule);
+    case kPacBinary: {
+      if (condition->op != kPacOpEq && condition->op != kPacOpStrictEq) {
+        return false;
+      }
+      const PacNode* left = condition->children[0];
+      const PacNode* right = condition->children[1];
+      if (left->kind == kPacString) {
+        std::swap(left, right);
+      }
+      if (!IsLiteral(right) || !IsChainVariable(left)) {
+        return false;
+      }
+      rule->tests.push_back(PacHostTest(PacHostTest::kExact, right->text));
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+bool ChainFinder::AddCallTests(const PacNode* call, PacRule* rule) {
+  const std::string& name = call->text;
+  const std::vector<PacNode*>& args = call->children;
+  if (script_functions_.count(name) || args.empty() ||
+      !IsChainVariable(args[0])) {
+    return false;
+  }
+  if (name == "isPlainHostName") {
+    if (args.size() != 1) {
+      return false;
+    }
+    rule->tests.push_back(PacHostTest(PacHostTest::kPlainHostName, ""));
+    return true;
+  }
+  if (args.size() != 2 || !IsLiteral(args[1])) {
+    return false;
+  }
+  const std::string& text = args[1]->text;
+  if (name == "dnsDomainIs") {
+    rule->tests.push_back(PacHostTest(PacHostTest::kSuffix, text));
+    return true;
+  }
+  if (name == "localHostOrDomainIs") {
+    // Either the full name, or a name without dots that is its first
+    // label.
+    rule->tests.push_back(PacHostTest(PacHostTest::kExact, text));
+    size_t dot = text.find('.');
+    if (dot != std::string::npos) {
+      rule->tests.push_back(PacHostTest(PacHostTest::kExact,
+                                        text.substr(0, dot)));
+    }
+    return true;
+  }
+  if (name == "shExpMatch") {
+    size_t stars = text.find_first_not_of('*');
+    if (stars == std::string::npos) {
+      stars = text.size();
+    }
+    std::string rest = text.substr(stars);
+    if (rest.find_first_of("*?") != std::string::npos) {
+      return false;
+    }
+    rule->tests.push_back(PacHostTest(
+        stars > 0 ? PacHostTest::kSuffix : PacHostTest::kExact, rest));
+    return true;
+  }
+  return false;
+}
+
+bool ChainFinder::IsChainVariable(const PacNode* node) {
+  if (node->kind != kPacIdentifier) {
+    return false;
+  }
+  if (chain_->variable.empty()) {
+    chain_->variable = node->text;
+  }
+  return node->text == chain_->variable;
+}
+
+}  // namespace
+
+bool FindPacRuleChain(const std::vector<PacNode*>& statements, size_t begin,
+                      const std::map<std::string, int>& script_functions,
+                      PacRuleChain* chain) {
+  *chain = PacRuleChain();
+  ChainFinder finder(script_functions, chain);
+  size_t end = begin;
+  while (end < statements.size() &&
+         ((statements[end]->kind == kPacEmpty && !chain->tail) ||
+          finder.AddRules(statements[end]))) {
+    ++end;
+  }
+  chain->num_statements = end - begin;
+  size_t num_tests = 0;
+  for (size_t i = 0; i < chain->rules.size(); ++i) {
+    num_tests += chain->rules[i].tests.size();
+  }
+  return num_tests >= kMinTests;
+}
+
+PacDependencies AnalyzePacDependencies(const PacProgram& program,
+                                       int function) {
+  std::set<int> clock_builtins;
+  clock_builtins.insert(FindPacBuiltin("weekdayRange"));
+  clock_builtins.insert(FindPacBuiltin("timeRange"));
+  std::set<int> network_builtins;
+  network_builtins.insert(FindPacBuiltin("dnsResolve"));
+  network_builtins.insert(FindPacBuiltin("isResolvable"));
+  network_builtins.insert(FindPacBuiltin("isInNet"));
+  network_builtins.insert(FindPacBuiltin("myIpAddress"));
+
+  // Functions are laid out one after the other, so each one ends where
+  // the next one starts.
+  std::vector<int> entries;
+  for (size_t i = 0; i < program.functions.size(); ++i) {
+    entries.push_back(program.functions[i].entry);
+  }
+  std::sort(entries.begin(), entries.end());
+  int begin = program.functions[function].entry;
+  int end = (int)program.code.size();
+  std::vector<int>::iterator next =
+      std::upper_bound(entries.begin(), entries.end(), begin);
+  if (next != entries.end()) {
+    end = *next;
+  }
+  // The top level may set up globals; it runs once, before any call.
+  int top_level_begin = program.functions[0].entry;
+  int top_level_end = (int)program.code.size();
+  next = std::upper_bound(entries.begin(), entries.end(), top_level_begin);
+  if (next != entries.end()) {
+    top_level_end = *next;
+  }
+
+  PacDependencies dependencies;
+  const std::vector<int>& code = program.code;
+  for (int pc = 0; pc < (int)code.size();
+       pc += 1 + PacOperandCount(code[pc])) {
+    bool top_level = pc >= top_level_begin && pc < top_level_end;
+    switch (code[pc]) {
+      case kPacInstrLoadLocal:
+      case kPacInstrStoreLocal:
+        if (pc >= begin && pc < end && code[pc + 1] == 0 &&
+            program.functions[function].num_params > 0) {
+          dependencies.reads_first_param = true;
+        }
+        break;
+      case kPacInstrStoreGlobal:
+        if (!top_level) {
+          dependencies.writes_globals = true;
+        }
+        break;
+      case kPacInstrCallBuiltin:
+        if (top_level) {
+          break;
+        }
+        if (clock_builtins.count(code[pc + 1])) {
+          dependencies.reads_clock = true;
+        }
+        if (network_builtins.count(code[pc + 1])) {
+          dependencies.reads_network = true;
+        }
+        break;
+    }
+  }
+  return dependencies;
+}
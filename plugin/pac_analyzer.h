@@ -0,0 +1,96 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Static analysis of PAC scripts: finds the chains of host rules that make
+// up most of a typical corporate PAC file, so that the compiler can answer
+// them with a PacDecisionTable instead of testing rule after rule.
+
+#ifndef __PAC_ANALYZER_H__
+#define __PAC_ANALYZER_H__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "pac_ast.h"
+#include "pac_vm.h"
+
+// One test of a rule condition, on the variable of the chain.
+struct PacHostTest {
+  enum Kind {
+    kExact,          // The host is text.
+    kSuffix,         // The host ends with text.
+    kPlainHostName,  // isPlainHostName(host).
+  };
+
+  PacHostTest(Kind kind, const std::string& text) : kind(kind), text(text) {}
+
+  Kind kind;
+  std::string text;
+};
+
+// if (test || test || ...) return "result";
+struct PacRule {
+  std::vector<PacHostTest> tests;
+  std::string result;
+};
+
+struct PacRuleChain {
+  PacRuleChain() : num_statements(0), tail(NULL) {}
+
+  // The variable all tests look at, usually the host parameter.
+  std::string variable;
+  std::vector<PacRule> rules;
+  // How many statements of the list the chain covers.
+  size_t num_statements;
+  // The final else of an if/else if chain, which runs when no rule
+  // matches; NULL if there is none.
+  const PacNode* tail;
+};
+
+// Looks for a chain of rules starting at statements[begin]. Only tests
+// whose outcome the table reproduces exactly are taken: dnsDomainIs,
+// localHostOrDomainIs, isPlainHostName, shExpMatch with an exact or
+// "*suffix" pattern, and == against a string, all on the same variable
+// and with literal arguments. script_functions are the functions the
+// script defines, since those shadow the builtins. Returns false if no
+// chain worth a table starts there.
+bool FindPacRuleChain(const std::vector<PacNode*>& statements, size_t begin,
+                      const std::map<std::string, int>& script_functions,
+                      PacRuleChain* chain);
+
+// What the result of a function depends on besides its arguments.
+struct PacDependencies {
+  PacDependencies()
+      : reads_first_param(false), reads_clock(false), reads_network(false),
+        writes_globals(false) {}
+
+  // Whether the first parameter is used, i.e. the url of FindProxyForURL.
+  bool reads_first_param;
+  // weekdayRange, timeRange.
+  bool reads_clock;
+  // dnsResolve, isResolvable, isInNet, myIpAddress.
+  bool reads_network;
+  // Any function of the script assigns a global, so a call may see the
+  // state left by the one before.
+  bool writes_globals;
+};
+
+// Conservative: every function of the script is assumed to be reachable
+// from function.
+PacDependencies AnalyzePacDependencies(const PacProgram& program,
+                                       int function);
+
+#endif  // __PAC_ANALYZER_H__
@@ -0,0 +1,123 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Syntax tree of a proxy auto-config script. PAC files are JavaScript, but
+// in practice only a small part of the language is used: functions, var,
+// if/else, loops, return, string, array and object literals, the usual
+// operators, a few string methods and the PAC helper functions. That is
+// the part represented here.
+
+#ifndef __PAC_AST_H__
+#define __PAC_AST_H__
+
+#include <string>
+#include <vector>
+
+enum PacNodeKind {
+  // Expressions.
+  kPacNumber,       // number
+  kPacString,       // text
+  kPacBoolean,      // number is 0 or 1
+  kPacNull,
+  kPacUndefined,
+  kPacIdentifier,   // text
+  kPacArray,        // children are the elements
+  kPacObject,       // params are the property names, children the values
+  kPacUnary,        // op, children[0]
+  kPacBinary,       // op, children[0..1]
+  kPacLogical,      // op is kPacOpAnd or kPacOpOr, children[0..1]
+  kPacConditional,  // children: condition, then, else
+  kPacAssign,       // op is kPacOpAssign or a compound op; text is the
+                    // variable, children[0] the value
+  kPacIncrement,    // text is the variable, op is kPacOpAdd or kPacOpSub,
+                    // number is 1 for prefix and 0 for postfix
+  kPacCall,         // text is the function, children are the arguments
+  kPacMethodCall,   // text is the method, children[0] the receiver, the
+                    // rest the arguments
+  kPacMember,       // text is the property, children[0] the object
+  kPacIndex,        // children: object, index
+
+  // Statements.
+  kPacVar,          // children are kPacAssign or kPacIdentifier nodes
+  kPacExpression,   // children[0]
+  kPacIf,           // children: condition, then[, else]
+  kPacWhile,        // children: condition, body
+  kPacFor,          // children: init, condition, step, body; any of the
+                    // first three may be kPacEmpty
+  kPacReturn,       // children[0] if a value is returned
+  kPacBreak,
+  kPacContinue,
+  kPacBlock,        // children are the statements
+  kPacEmpty,
+  kPacFunction,     // text is the name, params the parameter names,
+                    // children[0] the body block
+};
+
+enum PacOperator {
+  kPacOpNone,
+  kPacOpAdd,
+  kPacOpSub,
+  kPacOpMul,
+  kPacOpDiv,
+  kPacOpMod,
+  kPacOpNeg,
+  kPacOpPlus,
+  kPacOpNot,
+  kPacOpEq,
+  kPacOpNe,
+  kPacOpStrictEq,
+  kPacOpStrictNe,
+  kPacOpLt,
+  kPacOpLe,
+  kPacOpGt,
+  kPacOpGe,
+  kPacOpAnd,
+  kPacOpOr,
+  kPacOpAssign,
+  kPacOpTypeof,
+};
+
+struct PacNode {
+  PacNode(PacNodeKind kind, int line)
+      : kind(kind), op(kPacOpNone), number(0), line(line) {}
+
+  PacNodeKind kind;
+  PacOperator op;
+  double number;
+  std::string text;
+  std::vector<std::string> params;
+  std::vector<PacNode*> children;
+  int line;
+};
+
+// Owns all nodes of a parsed script.
+class PacAst {
+ public:
+  PacAst() {}
+  ~PacAst();
+
+  PacNode* NewNode(PacNodeKind kind, int line);
+
+  // The top level statements, function declarations included.
+  std::vector<PacNode*> statements;
+
+ private:
+  std::vector<PacNode*> nodes_;
+
+  PacAst(const PacAst&);
+  void operator=(const PacAst&);
+};
+
+#endif  // __PAC_AST_H__
@@ -0,0 +1,172 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "pac_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "file_util.h"
+#include "hash_util.h"
+#include "platform_util.h"
+
+static const char* kIndexFileName = "pac_index.txt";
+// URLs remembered; the least recently stored one goes first.
+static const size_t kMaxEntries = 16;
+
+namespace {
+
+// Index lines are "url\thash\tetag\tlast-modified".
+bool IsIndexField(const std::string& text) {
+  return text.find_first_of("\t\r\n") == std::string::npos;
+}
+
+void SplitFields(const std::string& line, std::vector<std::string>* fields) {
+  fields->clear();
+  size_t begin = 0;
+  while (true) {
+    size_t tab = line.find('\t', begin);
+    fields->push_back(line.substr(begin, tab == std::string::npos ?
+                                  std::string::npos : tab - begin));
+    if (tab == std::string::npos) {
+      break;
+    }
+    begin = tab + 1;
+  }
+}
+
+}  // namespace
+
+PacCache::PacCache(const std::string& directory) : directory_(directory) {
+}
+
+bool PacCache::Lookup(const std::string& url, Entry* entry,
+                      std::string* script) {
+  std::vector<Entry> entries;
+  if (!ReadIndex(&entries)) {
+    return false;
+  }
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (entries[i].url != url) {
+      continue;
+    }
+    MappedFile file;
+    if (!file.Open(ScriptPath(entries[i].hash)) ||
+        Fnv1a64(file.data(), file.size()) != entries[i].hash) {
+      return false;
+    }
+    *entry = entries[i];
+    script->assign(file.data(), file.size());
+    return true;
+  }
+  return false;
+}
+
+bool PacCache::Store(Entry* entry, const std::string& script) {
+  if (directory_.empty() || !IsIndexField(entry->url) ||
+      !IsIndexField(entry->etag) || !IsIndexField(entry->last_modified)) {
+    return false;
+  }
+  entry->hash = Fnv1a64(script.data(), script.size());
+  std::string path = ScriptPath(entry->hash);
+  MappedFile existing;
+  if (!existing.Open(path) ||
+      Fnv1a64(existing.data(), existing.size()) != entry->hash) {
+    existing.Close();
+    if (!WriteFileAtomically(path, script)) {
+      return false;
+    }
+  }
+
+  std::vector<Entry> entries;
+  ReadIndex(&entries);
+  std::vector<uint64_t> dropped;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (entries[i].url == entry->url) {
+      dropped.push_back(entries[i].hash);
+      entries.erase(entries.begin() + i);
+      break;
+    }
+  }
+  entries.push_back(*entry);
+  while (entries.size() > kMaxEntries) {
+    dropped.push_back(entries[0].hash);
+    entries.erase(entries.begin());
+  }
+  if (!WriteIndex(entries)) {
+    return false;
+  }
+  // Remove scripts that no URL refers to any more.
+  for (size_t i = 0; i < dropped.size(); ++i) {
+    bool used = false;
+    for (size_t j = 0; j < entries.size() && !used; ++j) {
+      used = entries[j].hash == dropped[i];
+    }
+    if (!used) {
+      DeleteFileAtPath(ScriptPath(dropped[i]));
+    }
+  }
+  return true;
+}
+
+bool PacCache::ReadIndex(std::vector<Entry>* entries) {
+  entries->clear();
+  if (directory_.empty()) {
+    return false;
+  }
+  MappedFile file;
+  if (!file.Open(JoinPath(directory_, kIndexFileName))) {
+    return false;
+  }
+  std::string text(file.data(), file.size());
+  std::vector<std::string> fields;
+  size_t begin = 0;
+  while (begin < text.size()) {
+    size_t end = text.find('\n', begin);
+    if (end == std::string::npos) {
+      break;  // An unterminated line was cut off.
+    }
+    SplitFields(text.substr(begin, end - begin), &fields);
+    begin = end + 1;
+    if (fields.size() != 4) {
+      continue;
+    }
+    Entry entry;
+    entry.url = fields[0];
+    entry.hash = strtoull(fields[1].c_str(), NULL, 16);
+    entry.etag = fields[2];
+    entry.last_modified = fields[3];
+    entries->push_back(entry);
+  }
+  return true;
+}
+
+bool PacCache::WriteIndex(const std::vector<Entry>& entries) {
+  std::string text;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    char hash[32];
+    snprintf(hash, sizeof(hash), "%016llx",
+             (unsigned long long)entries[i].hash);
+    text += entries[i].url + "\t" + hash + "\t" + entries[i].etag + "\t" +
+        entries[i].last_modified + "\n";
+  }
+  return WriteFileAtomically(JoinPath(directory_, kIndexFileName), text);
+}
+
+std::string PacCache::ScriptPath(uint64_t hash) const {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.pac", (unsigned long long)hash);
+  return JoinPath(directory_, name);
+}
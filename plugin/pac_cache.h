@@ -0,0 +1,60 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// On-disk cache of proxy auto-config scripts, so that a PAC is usable at
+// startup before the network has answered.
+
+#ifndef __PAC_CACHE_H__
+#define __PAC_CACHE_H__
+
+#include <string>
+#include <vector>
+
+#include "nptypes.h"
+
+// Scripts are stored content-addressed, one file per distinct script named
+// after its hash, so URLs serving the same script share it and a
+// truncated file is detected on load. An index maps each URL to its
+// script and the validators the server sent with it. All files are
+// replaced atomically. Not thread-safe.
+class PacCache {
+ public:
+  struct Entry {
+    Entry() : hash(0) {}
+
+    std::string url;
+    uint64_t hash;  // Of the script text.
+    std::string etag;
+    std::string last_modified;
+  };
+
+  // An empty directory disables the cache.
+  explicit PacCache(const std::string& directory);
+
+  // Returns the entry of url and its script, read through a mapping of
+  // its file.
+  bool Lookup(const std::string& url, Entry* entry, std::string* script);
+  // Stores script as the current one of entry.url; entry.hash is set.
+  bool Store(Entry* entry, const std::string& script);
+
+ private:
+  bool ReadIndex(std::vector<Entry>* entries);
+  bool WriteIndex(const std::vector<Entry>& entries);
+  std::string ScriptPath(uint64_t hash) const;
+
+  std::string directory_;
+};
+
+#endif  // __PAC_CACHE_H__
@@ -0,0 +1,606 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "pac_compiler.h"
+
+#include <stdio.h>
+
+#include <map>
+
+#include "pac_analyzer.h"
+
+namespace {
+
+class Compiler {
+ public:
+  Compiler(const PacAst& ast, PacProgram* program)
+      : ast_(ast), program_(program), locals_(NULL), tail_(NULL),
+        tail_jump_(-1), failed_(false) {}
+
+  bool Compile(std::string* error);
+
+ private:
+  struct Loop {
+    std::vector<int> breaks;
+    std::vector<int> continues;
+  };
+
+  typedef std::map<std::string, int> Scope;
+
+  void CompileFunction(const PacNode* function, int index);
+  void CollectVars(const PacNode* node, Scope* scope, int* next_slot);
+  void CompileStatement(const PacNode* node);
+  void CompileStatements(const std::vector<PacNode*>& statements);
+  void CompileRuleChain(const PacRuleChain& chain,
+                        const std::vector<PacNode*>& statements,
+                        size_t begin);
+  void CompileExpression(const PacNode* node);
+  void CompileLoad(const std::string& name);
+  void CompileStore(const std::string& name);
+
+  void Emit(int op) { program_->code.push_back(op); }
+  void Emit(int op, int operand) {
+    Emit(op);
+    Emit(operand);
+  }
+  void Emit(int op, int operand1, int operand2) {
+    Emit(op, operand1);
+    Emit(operand2);
+  }
+  // Emits a jump and returns where its target goes, for PatchJump.
+  int EmitJump(int op) {
+    Emit(op, -1);
+    return (int)program_->code.size() - 1;
+  }
+  void PatchJump(int operand) {
+    program_->code[operand] = (int)program_->code.size();
+  }
+  void PatchJumps(const std::vector<int>& operands, int target) {
+    for (size_t i = 0; i < operands.size(); ++i) {
+      program_->code[operands[i]] = target;
+    }
+  }
+  int Here() const { return (int)program_->code.size(); }
+
+  int StringConstant(const std::string& value);
+  int NumberConstant(double value);
+  int GlobalSlot(const std::string& name);
+  void Fail(const PacNode* node, const std::string& message);
+
+  const PacAst& ast_;
+  PacProgram* program_;
+  std::map<std::string, int> functions_;
+  std::map<std::string, int> globals_;
+  std::map<std::string, int> string_constants_;
+  std::map<double, int> number_constants_;
+  const Scope* locals_;  // NULL at the top level.
+  std::vector<Loop> loops_;
+  // The else branch a decision table jumps to when no rule matches, and
+  // the operand to patch with its address.
+  const PacNode* tail_;
+  int tail_jump_;
+  bool failed_;
+  std::string error_;
+};
+
+bool Compiler::Compile(std::string* error) {
+  *program_ = PacProgram();
+  program_->functions.push_back(PacFunction());
+  program_->functions[0].name = "<top level>";
+  std::vector<const PacNode*> functions;
+  for (size_t i = 0; i < ast_.statements.size(); ++i) {
+    const PacNode* node = ast_.statements[i];
+    if (node->kind != kPacFunction) {
+      continue;
+    }
+    // A later declaration of the same name replaces the earlier one.
+    if (functions_.count(node->text)) {
+      functions[functions_[node->text] - 1] = node;
+      continue;
+    }
+    functions_[node->text] = (int)functions.size() + 1;
+    functions.push_back(node);
+    PacFunction function;
+    function.name = node->text;
+    program_->functions.push_back(function);
+  }
+
+  program_->functions[0].entry = Here();
+  for (size_t i = 0; i < ast_.statements.size() && !failed_; ++i) {
+    if (ast_.statements[i]->kind != kPacFunction) {
+      CompileStatement(ast_.statements[i]);
+    }
+  }
+  Emit(kPacInstrPushUndefined);
+  Emit(kPacInstrReturn);
+
+  for (size_t i = 0; i < functions.size() && !failed_; ++i) {
+    CompileFunction(functions[i], (int)i + 1);
+  }
+  if (failed_) {
+    *error = error_;
+    return false;
+  }
+  return true;
+}
+
+void Compiler::CompileFunction(const PacNode* node, int index) {
+  Scope scope;
+  int next_slot = 0;
+  for (size_t i = 0; i < node->params.size(); ++i) {
+    if (!scope.count(node->params[i])) {
+      scope[node->params[i]] = next_slot++;
+    }
+  }
+  PacFunction& function = program_->functions[index];
+  function.num_params = next_slot;
+  CollectVars(node->children[0], &scope, &next_slot);
+  function.num_locals = next_slot;
+  function.entry = Here();
+  locals_ = &scope;
+  CompileStatement(node->children[0]);
+  Emit(kPacInstrPushUndefined);
+  Emit(kPacInstrReturn);
+  locals_ = NULL;
+}
+
+// var declarations are visible in the whole function, wherever they are.
+void Compiler::CollectVars(const PacNode* node, Scope* scope,
+                           int* next_slot) {
+  if (node->kind == kPacVar) {
+    for (size_t i = 0; i < node->children.size(); ++i) {
+      const std::string& name = node->children[i]->text;
+      if (!scope->count(name)) {
+        (*scope)[name] = (*next_slot)++;
+      }
+    }
+    return;
+  }
+  for (size_t i = 0; i < node->children.size(); ++i) {
+    PacNodeKind kind = node->children[i]->kind;
+    if (kind == kPacVar || kind == kPacBlock || kind == kPacIf ||
+        kind == kPacWhile || kind == kPacFor) {
+      CollectVars(node->children[i], scope, next_slot);
+    }
+  }
+}
+
+void Compiler::CompileStatement(const PacNode* node) {
+  if (failed_) {
+    return;
+  }
+  if (node == tail_) {
+    PatchJump(tail_jump_);
+    tail_ = NULL;
+  }
+  switch (node->kind) {
+    case kPacVar:
+      for (size_t i = 0; i < node->children.size(); ++i) {
+        const PacNode* declaration = node->children[i];
+        if (declaration->kind == kPacAssign) {
+          CompileExpression(declaration->children[0]);
+          CompileStore(declaration->text);
+        } else if (!locals_) {
+          GlobalSlot(declaration->text);
+        }
+      }
+      break;
+    case kPacExpression:
+      CompileExpression(node->children[0]);
+      Emit(kPacInstrPop);
+      break;
+    case kPacIf: {
+      CompileExpression(node->children[0]);
+      int to_else = EmitJump(kPacInstrJumpIfFalse);
+      CompileStatement(node->children[1]);
+      if (node->children.size() > 2) {
+        int to_end = EmitJump(kPacInstrJump);
+        PatchJump(to_else);
+        CompileStatement(node->children[2]);
+        PatchJump(to_end);
+      } else {
+        PatchJump(to_else);
+      }
+      break;
+    }
+    case kPacWhile: {
+      int start = Here();
+      CompileExpression(node->children[0]);
+      int to_end = EmitJump(kPacInstrJumpIfFalse);
+      loops_.push_back(Loop());
+      CompileStatement(node->children[1]);
+      Emit(kPacInstrJump, start);
+      PatchJump(to_end);
+      PatchJumps(loops_.back().breaks, Here());
+      PatchJumps(loops_.back().continues, start);
+      loops_.pop_back();
+      break;
+    }
+    case kPacFor: {
+      const PacNode* init = node->children[0];
+      if (init->kind == kPacVar) {
+        CompileStatement(init);
+      } else if (init->kind != kPacEmpty) {
+        CompileExpression(init);
+        Emit(kPacInstrPop);
+      }
+      int start = Here();
+      int to_end = -1;
+      if (node->children[1]->kind != kPacEmpty) {
+        CompileExpression(node->children[1]);
+        to_end = EmitJump(kPacInstrJumpIfFalse);
+      }
+      loops_.push_back(Loop());
+      CompileStatement(node->children[3]);
+      int step = Here();
+      if (node->children[2]->kind != kPacEmpty) {
+        CompileExpression(node->children[2]);
+        Emit(kPacInstrPop);
+      }
+      Emit(kPacInstrJump, start);
+      if (to_end >= 0) {
+        PatchJump(to_end);
+      }
+      PatchJumps(loops_.back().breaks, Here());
+      PatchJumps(loops_.back().continues, step);
+      loops_.pop_back();
+      break;
+    }
+    case kPacReturn:
+      if (!locals_) {
+        Fail(node, "return outside of a function");
+        break;
+      }
+      if (node->children.empty()) {
+        Emit(kPacInstrPushUndefined);
+      } else {
+        CompileExpression(node->children[0]);
+      }
+      Emit(kPacInstrReturn);
+      break;
+    case kPacBreak:
+    case kPacContinue:
+      if (loops_.empty()) {
+        Fail(node, "break or continue outside of a loop");
+        break;
+      }
+      if (node->kind == kPacBreak) {
+        loops_.back().breaks.push_back(EmitJump(kPacInstrJump));
+      } else {
+        loops_.back().continues.push_back(EmitJump(kPacInstrJump));
+      }
+      break;
+    case kPacBlock:
+      CompileStatements(node->children);
+      break;
+    case kPacEmpty:
+      break;
+    default:
+      Fail(node, "unexpected statement");
+      break;
+  }
+}
+
+void Compiler::CompileStatements(const std::vector<PacNode*>& statements) {
+  for (size_t i = 0; i < statements.size(); ++i) {
+    PacRuleChain chain;
+    if (locals_ && FindPacRuleChain(statements, i, functions_, &chain)) {
+      CompileRuleChain(chain, statements, i);
+      i += chain.num_statements - 1;
+    } else {
+      CompileStatement(statements[i]);
+    }
+  }
+}
+
+// The table decides for string values. Anything else is left to the
+// statements themselves, compiled as usual right after the table, so the
+// result is the same either way.
+void Compiler::CompileRuleChain(const PacRuleChain& chain,
+                                const std::vector<PacNode*>& statements,
+                                size_t begin) {
+  PacDecisionTable table;
+  for (size_t i = 0; i < chain.rules.size(); ++i) {
+    const PacRule& rule = chain.rules[i];
+    for (size_t j = 0; j < rule.tests.size(); ++j) {
+      const PacHostTest& test = rule.tests[j];
+      switch (test.kind) {
+        case PacHostTest::kExact:
+          table.AddExact(test.text, (int)i);
+          break;
+        case PacHostTest::kSuffix:
+          table.AddSuffix(test.text, (int)i);
+          break;
+        case PacHostTest::kPlainHostName:
+          table.AddPlainHostName((int)i);
+          break;
+      }
+    }
+    table.results.push_back(StringConstant(rule.result));
+  }
+  int index = (int)program_->tables.size();
+  program_->tables.push_back(table);
+
+  CompileLoad(chain.variable);
+  Emit(kPacInstrDecide, index, -1);
+  int miss = Here() - 1;
+  Emit(kPacInstrReturn);
+  if (chain.tail) {
+    tail_ = chain.tail;
+    tail_jump_ = miss;
+  }
+  for (size_t i = 0; i < chain.num_statements; ++i) {
+    CompileStatement(statements[begin + i]);
+  }
+  if (!chain.tail) {
+    PatchJump(miss);
+  }
+}
+
+void Compiler::CompileExpression(const PacNode* node) {
+  if (failed_) {
+    return;
+  }
+  switch (node->kind) {
+    case kPacNumber:
+      Emit(kPacInstrPushConstant, NumberConstant(node->number));
+      break;
+    case kPacString:
+      Emit(kPacInstrPushConstant, StringConstant(node->text));
+      break;
+    case kPacBoolean:
+      Emit(node->number != 0 ? kPacInstrPushTrue : kPacInstrPushFalse);
+      break;
+    case kPacNull:
+      Emit(kPacInstrPushNull);
+      break;
+    case kPacUndefined:
+      Emit(kPacInstrPushUndefined);
+      break;
+    case kPacIdentifier:
+      CompileLoad(node->text);
+      break;
+    case kPacArray:
+      for (size_t i = 0; i < node->children.size(); ++i) {
+        CompileExpression(node->children[i]);
+      }
+      Emit(kPacInstrMakeArray, (int)node->children.size());
+      break;
+    case kPacObject:
+      for (size_t i = 0; i < node->children.size(); ++i) {
+        Emit(kPacInstrPushConstant, StringConstant(node->params[i]));
+        CompileExpression(node->children[i]);
+      }
+      Emit(kPacInstrMakeObject, (int)node->children.size());
+      break;
+    case kPacUnary:
+      CompileExpression(node->children[0]);
+      switch (node->op) {
+        case kPacOpNot:
+          Emit(kPacInstrNot);
+          break;
+        case kPacOpNeg:
+          Emit(kPacInstrNeg);
+          break;
+        case kPacOpPlus:
+          Emit(kPacInstrToNumber);
+          break;
+        case kPacOpTypeof:
+          Emit(kPacInstrTypeof);
+          break;
+        default:
+          Fail(node, "bad unary operator");
+          break;
+      }
+      break;
+    case kPacBinary: {
+      static const struct {
+        PacOperator op;
+        PacOpcode opcode;
+      } kOpcodes[] = {
+        {kPacOpAdd, kPacInstrAdd},
+        {kPacOpSub, kPacInstrSub},
+        {kPacOpMul, kPacInstrMul},
+        {kPacOpDiv, kPacInstrDiv},
+        {kPacOpMod, kPacInstrMod},
+        {kPacOpEq, kPacInstrEq},
+        {kPacOpNe, kPacInstrNe},
+        {kPacOpStrictEq, kPacInstrStrictEq},
+        {kPacOpStrictNe, kPacInstrStrictNe},
+        {kPacOpLt, kPacInstrLt},
+        {kPacOpLe, kPacInstrLe},
+        {kPacOpGt, kPacInstrGt},
+        {kPacOpGe, kPacInstrGe},
+      };
+      CompileExpression(node->children[0]);
+      CompileExpression(node->children[1]);
+      for (size_t i = 0; i < sizeof(kOpcodes) / sizeof(kOpcodes[0]); ++i) {
+        if (kOpcodes[i].op == node->op) {
+          Emit(kOpcodes[i].opcode);
+          return;
+        }
+      }
+      Fail(node, "bad binary operator");
+      break;
+    }
+    case kPacLogical: {
+      CompileExpression(node->children[0]);
+      int to_end = EmitJump(node->op == kPacOpAnd ? kPacInstrJumpIfFalseOrPop :
+                            kPacInstrJumpIfTrueOrPop);
+      CompileExpression(node->children[1]);
+      PatchJump(to_end);
+      break;
+    }
+    case kPacConditional: {
+      CompileExpression(node->children[0]);
+      int to_else = EmitJump(kPacInstrJumpIfFalse);
+      CompileExpression(node->children[1]);
+      int to_end = EmitJump(kPacInstrJump);
+      PatchJump(to_else);
+      CompileExpression(node->children[2]);
+      PatchJump(to_end);
+      break;
+    }
+    case kPacAssign:
+      if (node->op == kPacOpAssign) {
+        CompileExpression(node->children[0]);
+      } else {
+        PacNode binary(kPacBinary, node->line);
+        binary.op = node->op;
+        PacNode target(kPacIdentifier, node->line);
+        target.text = node->text;
+        binary.children.push_back(&target);
+        binary.children.push_back(node->children[0]);
+        CompileExpression(&binary);
+      }
+      Emit(kPacInstrDup);
+      CompileStore(node->text);
+      break;
+    case kPacIncrement:
+      CompileLoad(node->text);
+      Emit(kPacInstrToNumber);
+      if (node->number == 0) {
+        Emit(kPacInstrDup);  // Postfix: the old value is the result.
+      }
+      Emit(kPacInstrPushConstant, NumberConstant(1));
+      Emit(node->op == kPacOpAdd ? kPacInstrAdd : kPacInstrSub);
+      if (node->number != 0) {
+        Emit(kPacInstrDup);
+      }
+      CompileStore(node->text);
+      break;
+    case kPacCall: {
+      std::map<std::string, int>::const_iterator function =
+          functions_.find(node->text);
+      int builtin = FindPacBuiltin(node->text);
+      if (function == functions_.end() && builtin < 0) {
+        Fail(node, "unknown function " + node->text);
+        break;
+      }
+      for (size_t i = 0; i < node->children.size(); ++i) {
+        CompileExpression(node->children[i]);
+      }
+      int argc = (int)node->children.size();
+      if (function != functions_.end()) {
+        Emit(kPacInstrCall, function->second, argc);
+      } else {
+        Emit(kPacInstrCallBuiltin, builtin, argc);
+      }
+      break;
+    }
+    case kPacMethodCall: {
+      int method = FindPacMethod(node->text);
+      if (method < 0) {
+        Fail(node, "unsupported method " + node->text);
+        break;
+      }
+      for (size_t i = 0; i < node->children.size(); ++i) {
+        CompileExpression(node->children[i]);
+      }
+      Emit(kPacInstrCallMethod, method, (int)node->children.size() - 1);
+      break;
+    }
+    case kPacMember:
+      CompileExpression(node->children[0]);
+      if (node->text == "length") {
+        Emit(kPacInstrGetLength);
+      } else {
+        // obj.name is obj["name"].
+        Emit(kPacInstrPushConstant, StringConstant(node->text));
+        Emit(kPacInstrGetIndex);
+      }
+      break;
+    case kPacIndex:
+      CompileExpression(node->children[0]);
+      CompileExpression(node->children[1]);
+      Emit(kPacInstrGetIndex);
+      break;
+    default:
+      Fail(node, "unexpected expression");
+      break;
+  }
+}
+
+void Compiler::CompileLoad(const std::string& name) {
+  if (locals_) {
+    Scope::const_iterator local = locals_->find(name);
+    if (local != locals_->end()) {
+      Emit(kPacInstrLoadLocal, local->second);
+      return;
+    }
+  }
+  Emit(kPacInstrLoadGlobal, GlobalSlot(name));
+}
+
+void Compiler::CompileStore(const std::string& name) {
+  if (locals_) {
+    Scope::const_iterator local = locals_->find(name);
+    if (local != locals_->end()) {
+      Emit(kPacInstrStoreLocal, local->second);
+      return;
+    }
+  }
+  Emit(kPacInstrStoreGlobal, GlobalSlot(name));
+}
+
+int Compiler::StringConstant(const std::string& value) {
+  std::map<std::string, int>::iterator it = string_constants_.find(value);
+  if (it != string_constants_.end()) {
+    return it->second;
+  }
+  int index = (int)program_->constants.size();
+  program_->constants.push_back(PacValue(value));
+  string_constants_[value] = index;
+  return index;
+}
+
+int Compiler::NumberConstant(double value) {
+  std::map<double, int>::iterator it = number_constants_.find(value);
+  if (it != number_constants_.end()) {
+    return it->second;
+  }
+  int index = (int)program_->constants.size();
+  program_->constants.push_back(PacValue(value));
+  number_constants_[value] = index;
+  return index;
+}
+
+int Compiler::GlobalSlot(const std::string& name) {
+  std::map<std::string, int>::iterator it = globals_.find(name);
+  if (it != globals_.end()) {
+    return it->second;
+  }
+  int index = (int)program_->globals.size();
+  program_->globals.push_back(name);
+  globals_[name] = index;
+  return index;
+}
+
+void Compiler::Fail(const PacNode* node, const std::string& message) {
+  if (!failed_) {
+    char line[32];
+    snprintf(line, sizeof(line), "line %d: ", node->line);
+    error_ = line + message;
+    failed_ = true;
+  }
+}
+
+}  // namespace
+
+bool CompilePacScript(const PacAst& ast, PacProgram* program,
+                      std::string* error) {
+  Compiler compiler(ast, program);
+  return compiler.Compile(error);
+}
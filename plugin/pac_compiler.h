@@ -0,0 +1,31 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#ifndef __PAC_COMPILER_H__
+#define __PAC_COMPILER_H__
+
+#include <string>
+
+#include "pac_ast.h"
+#include "pac_vm.h"
+
+// Compiles a parsed script to bytecode. Calls are bound at compile time:
+// to a function of the script if there is one of that name, else to a PAC
+// builtin. Calling anything else is an error, as is any property other
+// than length and any method the VM does not implement.
+bool CompilePacScript(const PacAst& ast, PacProgram* program,
+                      std::string* error);
+
+#endif  // __PAC_COMPILER_H__
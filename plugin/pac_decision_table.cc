@@ -0,0 +1,131 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "pac_decision_table.h"
+
+#include "hash_util.h"
+
+PacDecisionTable::PacDecisionTable()
+    : nodes_(1), num_edges_(0), plain_rule_(kNoRule) {
+  edge_keys_.resize(64);
+  edge_children_.resize(64);
+}
+
+void PacDecisionTable::AddExact(const std::string& name, int rule) {
+  int node = AddPath(name);
+  if (rule < nodes_[node].exact_rule) {
+    nodes_[node].exact_rule = rule;
+  }
+}
+
+void PacDecisionTable::AddSuffix(const std::string& suffix, int rule) {
+  int node = AddPath(suffix);
+  if (rule < nodes_[node].suffix_rule) {
+    nodes_[node].suffix_rule = rule;
+  }
+}
+
+void PacDecisionTable::AddPlainHostName(int rule) {
+  if (rule < plain_rule_) {
+    plain_rule_ = rule;
+  }
+}
+
+int PacDecisionTable::Lookup(const std::string& host) const {
+  int best = plain_rule_;
+  if (best != kNoRule && host.find_first_of(".:") != std::string::npos) {
+    best = kNoRule;
+  }
+  int node = 0;
+  if (nodes_[0].suffix_rule < best) {
+    best = nodes_[0].suffix_rule;
+  }
+  size_t i = host.size();
+  for (; i > 0; --i) {
+    node = FindChild(node, (unsigned char)host[i - 1]);
+    if (node < 0) {
+      break;
+    }
+    if (nodes_[node].suffix_rule < best) {
+      best = nodes_[node].suffix_rule;
+    }
+  }
+  if (i == 0 && nodes_[node].exact_rule < best) {
+    best = nodes_[node].exact_rule;
+  }
+  return best == kNoRule ? -1 : best;
+}
+
+int PacDecisionTable::AddPath(const std::string& name) {
+  int node = 0;
+  for (size_t i = name.size(); i > 0; --i) {
+    unsigned char c = (unsigned char)name[i - 1];
+    int child = FindChild(node, c);
+    if (child < 0) {
+      child = (int)nodes_.size();
+      nodes_.push_back(Node());
+      AddChild(node, c, child);
+    }
+    node = child;
+  }
+  return node;
+}
+
+int PacDecisionTable::FindChild(int node, unsigned char c) const {
+  uint64_t key = ((uint64_t)node << 8 | c) + 1;
+  size_t mask = edge_keys_.size() - 1;
+  for (size_t slot = (size_t)Mix64(key) & mask; edge_keys_[slot] != 0;
+       slot = (slot + 1) & mask) {
+    if (edge_keys_[slot] == key) {
+      return edge_children_[slot];
+    }
+  }
+  return -1;
+}
+
+void PacDecisionTable::AddChild(int node, unsigned char c, int child) {
+  // Kept at most half full so that probe sequences stay short.
+  if ((num_edges_ + 1) * 2 > edge_keys_.size()) {
+    GrowEdges();
+  }
+  uint64_t key = ((uint64_t)node << 8 | c) + 1;
+  size_t mask = edge_keys_.size() - 1;
+  size_t slot = (size_t)Mix64(key) & mask;
+  while (edge_keys_[slot] != 0) {
+    slot = (slot + 1) & mask;
+  }
+  edge_keys_[slot] = key;
+  edge_children_[slot] = child;
+  ++num_edges_;
+}
+
+void PacDecisionTable::GrowEdges() {
+  std::vector<uint64_t> keys(edge_keys_.size() * 2);
+  std::vector<int> children(keys.size());
+  size_t mask = keys.size() - 1;
+  for (size_t i = 0; i < edge_keys_.size(); ++i) {
+    if (edge_keys_[i] == 0) {
+      continue;
+    }
+    size_t slot = (size_t)Mix64(edge_keys_[i]) & mask;
+    while (keys[slot] != 0) {
+      slot = (slot + 1) & mask;
+    }
+    keys[slot] = edge_keys_[i];
+    children[slot] = edge_children_[i];
+  }
+  edge_keys_.swap(keys);
+  edge_children_.swap(children);
+}
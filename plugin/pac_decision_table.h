@@ -0,0 +1,79 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Lookup structure that answers a chain of host rules such as
+//   if (dnsDomainIs(host, ".corp.com") || shExpMatch(host, "*.corp.net"))
+//     return "PROXY a:80";
+//   else if (host == "intranet") return "DIRECT";
+// in one pass over the host name instead of one test per rule.
+
+#ifndef __PAC_DECISION_TABLE_H__
+#define __PAC_DECISION_TABLE_H__
+
+#include <string>
+#include <vector>
+
+#include "nptypes.h"
+
+// Rules are numbered in the order of the chain; Lookup returns the first
+// one that matches. All host names of a table live in one trie of the
+// reversed names, so a lookup walks the host from its last character and
+// touches each character once, however many rules there are.
+class PacDecisionTable {
+ public:
+  PacDecisionTable();
+
+  // host == name.
+  void AddExact(const std::string& name, int rule);
+  // host ends with suffix. An empty suffix matches every host.
+  void AddSuffix(const std::string& suffix, int rule);
+  // host contains neither '.' nor ':', as isPlainHostName.
+  void AddPlainHostName(int rule);
+
+  // The first rule matching host, or -1 if none does.
+  int Lookup(const std::string& host) const;
+
+  int num_rules() const { return (int)results.size(); }
+
+  // What each rule returns, as a constant index of the program.
+  std::vector<int> results;
+
+ private:
+  struct Node {
+    Node() : suffix_rule(kNoRule), exact_rule(kNoRule) {}
+
+    int suffix_rule;
+    int exact_rule;
+  };
+
+  static const int kNoRule = 0x7fffffff;
+
+  // Returns the node reached from the root by name read backwards,
+  // creating the missing ones.
+  int AddPath(const std::string& name);
+  int FindChild(int node, unsigned char c) const;
+  void AddChild(int node, unsigned char c, int child);
+  void GrowEdges();
+
+  std::vector<Node> nodes_;
+  // Open-addressed hash of (parent, character) to child; a key of 0 marks
+  // a free slot.
+  std::vector<uint64_t> edge_keys_;
+  std::vector<int> edge_children_;
+  size_t num_edges_;
+  int plain_rule_;
+};
+
+#endif  // __PAC_DECISION_TABLE_H__
@@ -0,0 +1,213 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "pac_generator.h"
+
+#include <stdio.h>
+
+#include <map>
+#include <vector>
+
+#include "bypass_list.h"
+#include "platform_util.h"
+#include "proxy_server_list.h"
+
+namespace {
+
+std::string Quote(const std::string& text) {
+  std::string result = "\"";
+  for (size_t i = 0; i < text.size(); ++i) {
+    unsigned char c = (unsigned char)text[i];
+    if (c == '"' || c == '\\') {
+      result += '\\';
+      result += (char)c;
+    } else if (c < 0x20 || c >= 0x7f) {
+      char escape[8];
+      snprintf(escape, sizeof(escape), "\\x%02x", c);
+      result += escape;
+    } else {
+      result += (char)c;
+    }
+  }
+  return result + "\"";
+}
+
+std::string FormatIpv4Mask(uint32_t address) {
+  char buffer[16];
+  snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", (address >> 24) & 0xff,
+           (address >> 16) & 0xff, (address >> 8) & 0xff, address & 0xff);
+  return buffer;
+}
+
+void AppendObject(const char* name, const std::vector<std::string>& keys,
+                  std::string* script) {
+  *script += "var ";
+  *script += name;
+  *script += " = {";
+  for (size_t i = 0; i < keys.size(); ++i) {
+    *script += i == 0 ? "\n  " : ",\n  ";
+    *script += Quote(keys[i]) + ": 1";
+  }
+  *script += keys.empty() ? "};\n" : "\n};\n";
+}
+
+bool IsWildcard(const std::string& pattern) {
+  return pattern.find('*') != std::string::npos;
+}
+
+}  // namespace
+
+bool GeneratePacScript(const std::string& description,
+                       const std::string& bypass_list, std::string* script) {
+  std::vector<ProxyServerGroup> groups;
+  if (!ParseProxyServerGroups(description.c_str(), &groups)) {
+    return false;
+  }
+  BypassList bypass;
+  bypass.Parse(bypass_list.c_str());
+
+  // Sorts the rules by how they can be matched. Rules with a port need
+  // the port of the URL, so they are keyed by "host:port".
+  std::vector<std::string> hosts;
+  std::vector<std::string> suffixes;
+  std::vector<std::string> patterns;
+  std::vector<int> pattern_ports;
+  std::vector<const BypassList::Rule*> networks;
+  bool local = false;
+  bool needs_port = false;
+  const std::vector<BypassList::Rule>& rules = bypass.rules();
+  for (size_t i = 0; i < rules.size(); ++i) {
+    const BypassList::Rule& rule = rules[i];
+    if (rule.type == BypassList::Rule::kLocal) {
+      local = true;
+    } else if (rule.type == BypassList::Rule::kNetwork) {
+      networks.push_back(&rule);
+    } else if (rule.port == 0 && !IsWildcard(rule.pattern)) {
+      hosts.push_back(rule.pattern);
+    } else if (rule.port == 0 && rule.pattern.compare(0, 2, "*.") == 0 &&
+               !IsWildcard(rule.pattern.substr(2))) {
+      suffixes.push_back(rule.pattern.substr(2));
+    } else {
+      patterns.push_back(rule.pattern);
+      pattern_ports.push_back(rule.port);
+      needs_port = needs_port || rule.port != 0;
+    }
+  }
+
+  script->clear();
+  *script += "// Generated from the proxy profile " + Quote(description) +
+      ".\n";
+  *script += "var proxies = {";
+  for (size_t i = 0; i < groups.size(); ++i) {
+    *script += i == 0 ? "\n  " : ",\n  ";
+    *script += Quote(groups[i].scheme) + ": " + Quote(FormatPacResult(groups[i]));
+  }
+  *script += "\n};\n";
+  AppendObject("direct_hosts", hosts, script);
+  AppendObject("direct_suffixes", suffixes, script);
+  *script += "var direct_patterns = [";
+  for (size_t i = 0; i < patterns.size(); ++i) {
+    char port[16];
+    snprintf(port, sizeof(port), "%d", pattern_ports[i]);
+    *script += i == 0 ? "\n  " : ",\n  ";
+    *script += "[" + Quote(patterns[i]) + ", " + port + "]";
+  }
+  *script += patterns.empty() ? "];\n" : "\n];\n";
+  *script += "var direct_networks = [";
+  for (size_t i = 0; i < networks.size(); ++i) {
+    *script += i == 0 ? "\n  " : ",\n  ";
+    *script += "[\"" + FormatIpv4Mask(networks[i]->network) + "\", \"" +
+        FormatIpv4Mask(networks[i]->mask) + "\"]";
+  }
+  *script += networks.empty() ? "];\n" : "\n];\n";
+
+  if (needs_port) {
+    *script +=
+        "\n"
+        "function urlPort(url, scheme) {\n"
+        "  var begin = url.indexOf(\"://\") + 3;\n"
+        "  var end = url.indexOf(\"/\", begin);\n"
+        "  var authority = end < 0 ? url.substring(begin) :\n"
+        "      url.substring(begin, end);\n"
+        "  var colon = authority.lastIndexOf(\":\");\n"
+        "  if (colon > authority.lastIndexOf(\"]\")) {\n"
+        "    return authority.substring(colon + 1) * 1;\n"
+        "  }\n"
+        "  return scheme == \"https\" ? 443 : scheme == \"ftp\" ? 21 : 80;\n"
+        "}\n";
+  }
+
+  *script +=
+      "\n"
+      "function isDirect(url, host, scheme) {\n"
+      "  if (direct_hosts[host] === 1) {\n"
+      "    return true;\n"
+      "  }\n"
+      "  for (var i = host.indexOf(\".\"); i >= 0;\n"
+      "       i = host.indexOf(\".\", i + 1)) {\n"
+      "    if (direct_suffixes[host.substring(i + 1)] === 1) {\n"
+      "      return true;\n"
+      "    }\n"
+      "  }\n";
+  if (local) {
+    *script +=
+        "  if (host.indexOf(\".\") < 0 && host.indexOf(\":\") < 0) {\n"
+        "    return true;\n"
+        "  }\n";
+  }
+  if (needs_port) {
+    *script +=
+        "  for (var j = 0; j < direct_patterns.length; ++j) {\n"
+        "    var port = direct_patterns[j][1];\n"
+        "    if ((port == 0 || port == urlPort(url, scheme)) &&\n"
+        "        shExpMatch(host, direct_patterns[j][0])) {\n"
+        "      return true;\n"
+        "    }\n"
+        "  }\n";
+  } else if (!patterns.empty()) {
+    *script +=
+        "  for (var j = 0; j < direct_patterns.length; ++j) {\n"
+        "    if (shExpMatch(host, direct_patterns[j][0])) {\n"
+        "      return true;\n"
+        "    }\n"
+        "  }\n";
+  }
+  if (!networks.empty()) {
+    *script +=
+        "  for (var k = 0; k < direct_networks.length; ++k) {\n"
+        "    if (isInNet(host, direct_networks[k][0],\n"
+        "                direct_networks[k][1])) {\n"
+        "      return true;\n"
+        "    }\n"
+        "  }\n";
+  }
+  *script +=
+      "  return false;\n"
+      "}\n"
+      "\n"
+      "function FindProxyForURL(url, host) {\n"
+      "  host = host.toLowerCase();\n"
+      "  var scheme = url.substring(0, url.indexOf(\":\")).toLowerCase();\n"
+      "  if (isDirect(url, host, scheme)) {\n"
+      "    return \"DIRECT\";\n"
+      "  }\n"
+      "  var proxy = proxies[scheme];\n"
+      "  if (typeof proxy != \"string\") {\n"
+      "    proxy = proxies[\"\"];\n"
+      "  }\n"
+      "  return typeof proxy == \"string\" ? proxy : \"DIRECT\";\n"
+      "}\n";
+  return true;
+}
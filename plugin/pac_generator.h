@@ -0,0 +1,33 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Turns a proxy profile and its bypass list into a PAC script, so that a
+// profile can be handed to anything that takes an auto-config URL.
+
+#ifndef __PAC_GENERATOR_H__
+#define __PAC_GENERATOR_H__
+
+#include <string>
+
+// Writes FindProxyForURL for description, a proxy server description
+// such as "http=a:80,b:80;https=c:443 socks=d:1080", and bypass_list, as
+// parsed by ParseProxyServerGroups and BypassList. Exact hosts and
+// "*.domain" rules become properties of objects, so that a lookup costs
+// one property access per label of the host rather than one shExpMatch
+// per rule. Returns false if description names no server.
+bool GeneratePacScript(const std::string& description,
+                       const std::string& bypass_list, std::string* script);
+
+#endif  // __PAC_GENERATOR_H__
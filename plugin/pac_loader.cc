@@ -0,0 +1,186 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "pac_loader.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+
+#include "file_util.h"
+#include "hash_util.h"
+#include "http_client.h"
+#include "npswitchproxy.h"
+#include "stats.h"
+
+PacLoader::PacLoader(const std::string& cache_directory)
+    : wake_event_(false),
+      cache_(cache_directory),
+      stop_(false),
+      current_hash_(0),
+      has_update_(false) {
+}
+
+PacLoader::~PacLoader() {
+  Stop();
+}
+
+bool PacLoader::Load(const std::string& url, std::string* script) {
+  url_ = url;
+  std::string path = FileUrlToPath(url);
+  if (!path.empty()) {
+    ScopedLock lock(&lock_);
+    current_url_ = url;
+    has_update_ = false;
+    MappedFile file;
+    if (!file.Open(path)) {
+      return false;
+    }
+    script->assign(file.data(), file.size());
+    return true;
+  }
+
+  bool cached;
+  {
+    ScopedLock lock(&lock_);
+    PacCache::Entry entry;
+    cached = cache_.Lookup(url, &entry, script);
+    current_url_ = url;
+    current_hash_ = cached ? entry.hash : 0;
+    has_update_ = false;
+    pending_url_ = url;
+    stop_ = false;
+  }
+  stats::Add(cached ? "pacCacheLoads" : "pacCacheColdLoads", 1);
+  if (!thread_.IsStarted()) {
+    thread_.Start(ThreadMain, this);
+  }
+  wake_event_.Signal();
+  return cached;
+}
+
+bool PacLoader::TakeUpdate(std::string* script) {
+  ScopedLock lock(&lock_);
+  if (!has_update_) {
+    return false;
+  }
+  script->swap(update_);
+  update_.clear();
+  has_update_ = false;
+  return true;
+}
+
+void PacLoader::Stop() {
+  if (!thread_.IsStarted()) {
+    return;
+  }
+  {
+    ScopedLock lock(&lock_);
+    stop_ = true;
+  }
+  wake_event_.Signal();
+  thread_.Join();
+}
+
+// static
+void PacLoader::ThreadMain(void* arg) {
+  ((PacLoader*)arg)->Run();
+}
+
+void PacLoader::Run() {
+  while (true) {
+    std::string url;
+    {
+      ScopedLock lock(&lock_);
+      if (stop_) {
+        break;
+      }
+      url.swap(pending_url_);
+    }
+    if (url.empty()) {
+      wake_event_.Wait(-1);
+    } else {
+      Revalidate(url);
+    }
+  }
+}
+
+void PacLoader::Revalidate(const std::string& url) {
+  HttpRequest request;
+  request.url = url;
+  PacCache::Entry entry;
+  {
+    ScopedLock lock(&lock_);
+    std::string cached_script;
+    if (cache_.Lookup(url, &entry, &cached_script)) {
+      request.if_none_match = entry.etag;
+      request.if_modified_since = entry.last_modified;
+    }
+  }
+  HttpResponse response;
+  std::string error;
+  if (!HttpGet(request, &response, &error) ||
+      (response.status != 200 && response.status != 304)) {
+    DebugLog("PacLoader: fetching %s failed: %s (status %d)\n", url.c_str(),
+             error.c_str(), response.status);
+    stats::Add("pacFetchErrors", 1);
+    return;
+  }
+  if (response.status == 304) {
+    stats::Add("pacFetchNotModified", 1);
+    return;
+  }
+  stats::Add("pacFetches", 1);
+  entry.url = url;
+  entry.etag = response.etag;
+  entry.last_modified = response.last_modified;
+  ScopedLock lock(&lock_);
+  cache_.Store(&entry, response.body);
+  uint64_t hash = Fnv1a64(response.body.data(), response.body.size());
+  if (url == current_url_ && hash != current_hash_) {
+    current_hash_ = hash;
+    update_.swap(response.body);
+    has_update_ = true;
+  }
+}
+
+std::string FileUrlToPath(const std::string& url) {
+  static const char kScheme[] = "file://";
+  if (url.size() <= sizeof(kScheme) - 1) {
+    return std::string();
+  }
+  for (size_t i = 0; i < sizeof(kScheme) - 1; ++i) {
+    if (tolower((unsigned char)url[i]) != kScheme[i]) {
+      return std::string();
+    }
+  }
+  std::string path;
+  for (size_t i = sizeof(kScheme) - 1; i < url.size(); ++i) {
+    if (url[i] == '%' && i + 2 < url.size() &&
+        isxdigit((unsigned char)url[i + 1]) &&
+        isxdigit((unsigned char)url[i + 2])) {
+      path += (char)strtol(url.substr(i + 1, 2).c_str(), NULL, 16);
+      i += 2;
+    } else {
+      path += url[i];
+    }
+  }
+#if defined(_WINDOWS)
+  // file:///C:/dir/proxy.pac
+  if (path.size() > 2 && path[0] == '/' && path[2] == ':') {
+    path.erase(0, 1);
+  }
+#endif
+  return path;
+}
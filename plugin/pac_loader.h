@@ -0,0 +1,70 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#ifndef __PAC_LOADER_H__
+#define __PAC_LOADER_H__
+
+#include <string>
+
+#include "pac_cache.h"
+#include "platform_util.h"
+
+// Gets the script of an auto-config URL without making the caller wait
+// for the network: Load answers from the on-disk cache right away and
+// revalidates the cached copy on a background thread with a conditional
+// GET. A script that changed is stored and handed over by TakeUpdate.
+// file:// URLs are read directly.
+class PacLoader {
+ public:
+  // An empty cache_directory keeps nothing on disk.
+  explicit PacLoader(const std::string& cache_directory);
+  ~PacLoader();
+
+  // Makes url the current one. Returns true with the cached script if
+  // there is one; either way the network copy is fetched in the
+  // background.
+  bool Load(const std::string& url, std::string* script);
+
+  // Returns true once per script of the current url that was fetched
+  // after Load and differs from the one Load returned.
+  bool TakeUpdate(std::string* script);
+
+  const std::string& url() const { return url_; }
+
+  void Stop();
+
+ private:
+  static void ThreadMain(void* arg);
+  void Run();
+  void Revalidate(const std::string& url);
+
+  Thread thread_;
+  WaitableEvent wake_event_;
+  std::string url_;  // Only used by the calling thread.
+
+  Mutex lock_;  // Guards everything below.
+  PacCache cache_;
+  bool stop_;
+  std::string pending_url_;
+  std::string current_url_;
+  uint64_t current_hash_;
+  bool has_update_;
+  std::string update_;
+};
+
+// The local path of a file:// URL, or "" for other URLs.
+std::string FileUrlToPath(const std::string& url);
+
+#endif  // __PAC_LOADER_H__
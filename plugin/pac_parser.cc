@@ -0,0 +1,840 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "pac_parser.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Deeply nested expressions would otherwise overflow the native stack.
+static const int kMaxNestingDepth = 200;
+
+PacAst::~PacAst() {
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    delete nodes_[i];
+  }
+}
+
+PacNode* PacAst::NewNode(PacNodeKind kind, int line) {
+  PacNode* node = new PacNode(kind, line);
+  nodes_.push_back(node);
+  return node;
+}
+
+namespace {
+
+enum TokenType {
+  kTokenEnd,
+  kTokenNumber,
+  kTokenString,
+  kTokenIdentifier,
+  kTokenPunctuator,
+};
+
+struct Token {
+  Token() : type(kTokenEnd), number(0), line(1), newline_before(false) {}
+
+  TokenType type;
+  std::string text;  // Identifier, punctuator or decoded string.
+  double number;
+  int line;
+  bool newline_before;
+};
+
+void AppendUtf8(unsigned int code_point, std::string* out) {
+  if (code_point < 0x80) {
+    *out += (char)code_point;
+  } else if (code_point < 0x800) {
+    *out += (char)(0xc0 | (code_point >> 6));
+    *out += (char)(0x80 | (code_point & 0x3f));
+  } else {
+    *out += (char)(0xe0 | (code_point >> 12));
+    *out += (char)(0x80 | ((code_point >> 6) & 0x3f));
+    *out += (char)(0x80 | (code_point & 0x3f));
+  }
+}
+
+int HexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+class Lexer {
+ public:
+  explicit Lexer(const std::string& source)
+      : source_(source), pos_(0), line_(1) {}
+
+  // Reads the next token; returns false with error set on bad input.
+  bool Next(Token* token, std::string* error);
+
+ private:
+  bool SkipSpaceAndComments(bool* newline, std::string* error);
+  bool ReadString(char quote, Token* token, std::string* error);
+  char Peek(size_t offset) const {
+    return pos_ + offset < source_.size() ? source_[pos_ + offset] : '\0';
+  }
+
+  const std::string& source_;
+  size_t pos_;
+  int line_;
+};
+
+bool Lexer::SkipSpaceAndComments(bool* newline, std::string* error) {
+  *newline = false;
+  while (pos_ < source_.size()) {
+    char c = source_[pos_];
+    if (c == '\n') {
+      *newline = true;
+      ++line_;
+      ++pos_;
+    } else if (isspace((unsigned char)c)) {
+      ++pos_;
+    } else if (c == '/' && Peek(1) == '/') {
+      while (pos_ < source_.size() && source_[pos_] != '\n') {
+        ++pos_;
+      }
+    } else if (c == '/' && Peek(1) == '*') {
+      size_t end = source_.find("*/", pos_ + 2);
+      if (end == std::string::npos) {
+        char message[64];
+        snprintf(message, sizeof(message), "line %d: unterminated comment",
+                 line_);
+        *error = message;
+        return false;
+      }
+      for (size_t i = pos_; i < end; ++i) {
+        if (source_[i] == '\n') {
+          *newline = true;
+          ++line_;
+        }
+      }
+      pos_ = end + 2;
+    } else {
+      break;
+    }
+  }
+  return true;
+}
+
+bool Lexer::ReadString(char quote, Token* token, std::string* error) {
+  ++pos_;
+  token->type = kTokenString;
+  while (pos_ < source_.size() && source_[pos_] != quote) {
+    char c = source_[pos_++];
+    if (c == '\n') {
+      break;
+    }
+    if (c != '\\') {
+      token->text += c;
+      continue;
+    }
+    char escape = Peek(0);
+    ++pos_;
+    switch (escape) {
+      case 'n': token->text += '\n'; break;
+      case 't': token->text += '\t'; break;
+      case 'r': token->text += '\r'; break;
+      case 'b': token->text += '\b'; break;
+      case 'f': token->text += '\f'; break;
+      case 'v': token->text += '\v'; break;
+      case '0': token->text += '\0'; break;
+      case 'x':
+      case 'u': {
+        int digits = escape == 'x' ? 2 : 4;
+        unsigned int value = 0;
+        for (int i = 0; i < digits; ++i) {
+          int digit = HexValue(Peek(0));
+          if (digit < 0) {
+            value = '?';
+            break;
+          }
+          value = value * 16 + digit;
+          ++pos_;
+        }
+        AppendUtf8(value, &token->text);
+        break;
+      }
+      case '\n':
+        ++line_;  // Line continuation.
+        break;
+      default:
+        token->text += escape;
+        break;
+    }
+  }
+  if (pos_ >= source_.size() || source_[pos_] != quote) {
+    char message[64];
+    snprintf(message, sizeof(message), "line %d: unterminated string",
+             line_);
+    *error = message;
+    return false;
+  }
+  ++pos_;
+  return true;
+}
+
+bool Lexer::Next(Token* token, std::string* error) {
+  *token = Token();
+  if (!SkipSpaceAndComments(&token->newline_before, error)) {
+    return false;
+  }
+  token->line = line_;
+  if (pos_ >= source_.size()) {
+    token->type = kTokenEnd;
+    return true;
+  }
+  char c = source_[pos_];
+  if (c == '"' || c == '\'') {
+    return ReadString(c, token, error);
+  }
+  if (isdigit((unsigned char)c) ||
+      (c == '.' && isdigit((unsigned char)Peek(1)))) {
+    const char* begin = source_.c_str() + pos_;
+    char* end;
+    if (c == '0' && (Peek(1) == 'x' || Peek(1) == 'X')) {
+      token->number = (double)strtoul(begin + 2, &end, 16);
+    } else {
+      token->number = strtod(begin, &end);
+    }
+    pos_ += end - begin;
+    token->type = kTokenNumber;
+    return true;
+  }
+  if (isalpha((unsigned char)c) || c == '_' || c == '$') {
+    size_t begin = pos_;
+    while (pos_ < source_.size() &&
+           (isalnum((unsigned char)source_[pos_]) || source_[pos_] == '_' ||
+            source_[pos_] == '$')) {
+      ++pos_;
+    }
+    token->type = kTokenIdentifier;
+    token->text = source_.substr(begin, pos_ - begin);
+    return true;
+  }
+  static const char* kPunctuators[] = {
+    "===", "!==", "==", "!=", "<=", ">=", "&&", "||", "++", "--", "+=",
+    "-=", "*=", "/=", "%=", "{", "}", "(", ")", "[", "]", ";", ",", "<",
+    ">", "+", "-", "*", "/", "%", "!", "?", ":", "=", ".",
+  };
+  for (size_t i = 0; i < sizeof(kPunctuators) / sizeof(kPunctuators[0]);
+       ++i) {
+    size_t len = strlen(kPunctuators[i]);
+    if (source_.compare(pos_, len, kPunctuators[i]) == 0) {
+      token->type = kTokenPunctuator;
+      token->text = kPunctuators[i];
+      pos_ += len;
+      return true;
+    }
+  }
+  char message[64];
+  snprintf(message, sizeof(message), "line %d: unexpected character '%c'",
+           line_, c);
+  *error = message;
+  return false;
+}
+
+class Parser {
+ public:
+  Parser(const std::string& source, PacAst* ast)
+      : lexer_(source), ast_(ast), depth_(0), failed_(false) {}
+
+  bool ParseProgram(std::string* error);
+
+ private:
+  // Token helpers.
+  void Advance();
+  bool Is(const char* punctuator) const {
+    return token_.type == kTokenPunctuator && token_.text == punctuator;
+  }
+  bool IsKeyword(const char* keyword) const {
+    return token_.type == kTokenIdentifier && token_.text == keyword;
+  }
+  bool Accept(const char* punctuator);
+  bool Expect(const char* punctuator);
+  bool ExpectStatementEnd();
+  PacNode* Fail(const std::string& message);
+
+  PacNode* ParseFunction();
+  PacNode* ParseStatement();
+  PacNode* ParseBlock();
+  PacNode* ParseVar();
+  PacNode* ParseExpression();
+  PacNode* ParseAssignment();
+  PacNode* ParseConditional();
+  PacNode* ParseBinary(int level);
+  PacNode* ParseUnary();
+  PacNode* ParsePostfix();
+  PacNode* ParsePrimary();
+
+  Lexer lexer_;
+  Token token_;
+  PacAst* ast_;
+  int depth_;
+  bool failed_;
+  std::string error_;
+};
+
+// Binary operators by precedence level, lowest first.
+struct BinaryOperator {
+  int level;
+  const char* text;
+  PacOperator op;
+};
+
+const BinaryOperator kBinaryOperators[] = {
+  {0, "||", kPacOpOr},
+  {1, "&&", kPacOpAnd},
+  {2, "===", kPacOpStrictEq},
+  {2, "!==", kPacOpStrictNe},
+  {2, "==", kPacOpEq},
+  {2, "!=", kPacOpNe},
+  {3, "<=", kPacOpLe},
+  {3, ">=", kPacOpGe},
+  {3, "<", kPacOpLt},
+  {3, ">", kPacOpGt},
+  {4, "+", kPacOpAdd},
+  {4, "-", kPacOpSub},
+  {5, "*", kPacOpMul},
+  {5, "/", kPacOpDiv},
+  {5, "%", kPacOpMod},
+};
+const int kBinaryLevels = 6;
+
+void Parser::Advance() {
+  if (failed_) {
+    token_ = Token();
+    return;
+  }
+  if (!lexer_.Next(&token_, &error_)) {
+    failed_ = true;
+    token_ = Token();
+  }
+}
+
+bool Parser::Accept(const char* punctuator) {
+  if (Is(punctuator)) {
+    Advance();
+    return true;
+  }
+  return false;
+}
+
+bool Parser::Expect(const char* punctuator) {
+  if (Accept(punctuator)) {
+    return true;
+  }
+  Fail(std::string("expected '") + punctuator + "'");
+  return false;
+}
+
+// A statement ends with ';', or without one before '}', a line break or
+// the end of the script.
+bool Parser::ExpectStatementEnd() {
+  if (Accept(";") || Is("}") || token_.type == kTokenEnd ||
+      token_.newline_before) {
+    return true;
+  }
+  Fail("expected ';'");
+  return false;
+}
+
+PacNode* Parser::Fail(const std::string& message) {
+  if (!failed_) {
+    char line[32];
+    snprintf(line, sizeof(line), "line %d: ", token_.line);
+    error_ = line + message;
+    failed_ = true;
+  }
+  return NULL;
+}
+
+bool Parser::ParseProgram(std::string* error) {
+  Advance();
+  while (!failed_ && token_.type != kTokenEnd) {
+    PacNode* statement = IsKeyword("function") ? ParseFunction() :
+        ParseStatement();
+    if (statement) {
+      ast_->statements.push_back(statement);
+    }
+  }
+  if (failed_) {
+    *error = error_;
+    return false;
+  }
+  return true;
+}
+
+PacNode* Parser::ParseFunction() {
+  PacNode* node = ast_->NewNode(kPacFunction, token_.line);
+  Advance();
+  if (token_.type != kTokenIdentifier) {
+    return Fail("expected function name");
+  }
+  node->text = token_.text;
+  Advance();
+  if (!Expect("(")) {
+    return NULL;
+  }
+  while (!failed_ && !Is(")")) {
+    if (token_.type != kTokenIdentifier) {
+      return Fail("expected parameter name");
+    }
+    node->params.push_back(token_.text);
+    Advance();
+    if (!Is(")") && !Expect(",")) {
+      return NULL;
+    }
+  }
+  Advance();
+  PacNode* body = ParseBlock();
+  if (!body) {
+    return NULL;
+  }
+  node->children.push_back(body);
+  return node;
+}
+
+PacNode* Parser::ParseBlock() {
+  PacNode* node = ast_->NewNode(kPacBlock, token_.line);
+  if (!Expect("{")) {
+    return NULL;
+  }
+  while (!failed_ && !Is("}")) {
+    if (token_.type == kTokenEnd) {
+      return Fail("expected '}'");
+    }
+    PacNode* statement = ParseStatement();
+    if (statement) {
+      node->children.push_back(statement);
+    }
+  }
+  Advance();
+  return failed_ ? NULL : node;
+}
+
+PacNode* Parser::ParseVar() {
+  PacNode* node = ast_->NewNode(kPacVar, token_.line);
+  Advance();
+  do {
+    if (token_.type != kTokenIdentifier) {
+      return Fail("expected variable name");
+    }
+    PacNode* name = ast_->NewNode(kPacIdentifier, token_.line);
+    name->text = token_.text;
+    Advance();
+    if (Accept("=")) {
+      PacNode* assign = ast_->NewNode(kPacAssign, name->line);
+      assign->op = kPacOpAssign;
+      assign->text = name->text;
+      PacNode* value = ParseAssignment();
+      if (!value) {
+        return NULL;
+      }
+      assign->children.push_back(value);
+      node->children.push_back(assign);
+    } else {
+      node->children.push_back(name);
+    }
+  } while (Accept(","));
+  return failed_ ? NULL : node;
+}
+
+PacNode* Parser::ParseStatement() {
+  if (++depth_ > kMaxNestingDepth) {
+    return Fail("nested too deeply");
+  }
+  PacNode* node = NULL;
+  int line = token_.line;
+  if (Is("{")) {
+    node = ParseBlock();
+  } else if (Accept(";")) {
+    node = ast_->NewNode(kPacEmpty, line);
+  } else if (IsKeyword("var")) {
+    node = ParseVar();
+    if (node && !ExpectStatementEnd()) {
+      node = NULL;
+    }
+  } else if (IsKeyword("if")) {
+    Advance();
+    node = ast_->NewNode(kPacIf, line);
+    PacNode* condition = NULL;
+    PacNode* then = NULL;
+    if (Expect("(") && (condition = ParseExpression()) != NULL &&
+        Expect(")") && (then = ParseStatement()) != NULL) {
+      node->children.push_back(condition);
+      node->children.push_back(then);
+      if (IsKeyword("else")) {
+        Advance();
+        PacNode* otherwise = ParseStatement();
+        if (otherwise) {
+          node->children.push_back(otherwise);
+        }
+      }
+    }
+  } else if (IsKeyword("while")) {
+    Advance();
+    node = ast_->NewNode(kPacWhile, line);
+    PacNode* condition = NULL;
+    PacNode* body = NULL;
+    if (Expect("(") && (condition = ParseExpression()) != NULL &&
+        Expect(")") && (body = ParseStatement()) != NULL) {
+      node->children.push_back(condition);
+      node->children.push_back(body);
+    }
+  } else if (IsKeyword("for")) {
+    Advance();
+    node = ast_->NewNode(kPacFor, line);
+    Expect("(");
+    PacNode* parts[3] = {NULL, NULL, NULL};
+    for (int i = 0; i < 3 && !failed_; ++i) {
+      const char* end = i < 2 ? ";" : ")";
+      if (Is(end)) {
+        parts[i] = ast_->NewNode(kPacEmpty, token_.line);
+      } else if (i == 0 && IsKeyword("var")) {
+        parts[i] = ParseVar();
+      } else {
+        parts[i] = ParseExpression();
+      }
+      if (i == 0 && IsKeyword("in")) {
+        return Fail("for-in loops are not supported");
+      }
+      Expect(end);
+    }
+    PacNode* body = failed_ ? NULL : ParseStatement();
+    if (body) {
+      for (int i = 0; i < 3; ++i) {
+        node->children.push_back(parts[i]);
+      }
+      node->children.push_back(body);
+    }
+  } else if (IsKeyword("return")) {
+    Advance();
+    node = ast_->NewNode(kPacReturn, line);
+    if (!Is(";") && !Is("}") && token_.type != kTokenEnd &&
+        !token_.newline_before) {
+      PacNode* value = ParseExpression();
+      if (value) {
+        node->children.push_back(value);
+      }
+    }
+    ExpectStatementEnd();
+  } else if (IsKeyword("break") || IsKeyword("continue")) {
+    node = ast_->NewNode(IsKeyword("break") ? kPacBreak : kPacContinue,
+                         line);
+    Advance();
+    ExpectStatementEnd();
+  } else if (IsKeyword("function")) {
+    node = Fail("nested functions are not supported");
+  } else {
+    PacNode* expression = ParseExpression();
+    if (expression && ExpectStatementEnd()) {
+      node = ast_->NewNode(kPacExpression, line);
+      node->children.push_back(expression);
+    }
+  }
+  --depth_;
+  return failed_ ? NULL : node;
+}
+
+PacNode* Parser::ParseExpression() {
+  return ParseAssignment();
+}
+
+PacNode* Parser::ParseAssignment() {
+  PacNode* target = ParseConditional();
+  if (!target || token_.type != kTokenPunctuator) {
+    return target;
+  }
+  static const struct {
+    const char* text;
+    PacOperator op;
+  } kAssignments[] = {
+    {"=", kPacOpAssign},
+    {"+=", kPacOpAdd},
+    {"-=", kPacOpSub},
+    {"*=", kPacOpMul},
+    {"/=", kPacOpDiv},
+    {"%=", kPacOpMod},
+  };
+  for (size_t i = 0; i < sizeof(kAssignments) / sizeof(kAssignments[0]);
+       ++i) {
+    if (token_.text != kAssignments[i].text) {
+      continue;
+    }
+    if (target->kind != kPacIdentifier) {
+      return Fail("only variables can be assigned to");
+    }
+    PacNode* node = ast_->NewNode(kPacAssign, token_.line);
+    node->op = kAssignments[i].op;
+    node->text = target->text;
+    Advance();
+    PacNode* value = ParseAssignment();
+    if (!value) {
+      return NULL;
+    }
+    node->children.push_back(value);
+    return node;
+  }
+  return target;
+}
+
+PacNode* Parser::ParseConditional() {
+  PacNode* condition = ParseBinary(0);
+  if (!condition || !Is("?")) {
+    return condition;
+  }
+  PacNode* node = ast_->NewNode(kPacConditional, token_.line);
+  Advance();
+  PacNode* then = ParseAssignment();
+  if (!then || !Expect(":")) {
+    return NULL;
+  }
+  PacNode* otherwise = ParseAssignment();
+  if (!otherwise) {
+    return NULL;
+  }
+  node->children.push_back(condition);
+  node->children.push_back(then);
+  node->children.push_back(otherwise);
+  return node;
+}
+
+PacNode* Parser::ParseBinary(int level) {
+  if (level == kBinaryLevels) {
+    return ParseUnary();
+  }
+  PacNode* left = ParseBinary(level + 1);
+  while (left && token_.type == kTokenPunctuator) {
+    const BinaryOperator* found = NULL;
+    for (size_t i = 0;
+         i < sizeof(kBinaryOperators) / sizeof(kBinaryOperators[0]); ++i) {
+      if (kBinaryOperators[i].level == level &&
+          token_.text == kBinaryOperators[i].text) {
+        found = &kBinaryOperators[i];
+        break;
+      }
+    }
+    if (!found) {
+      break;
+    }
+    PacNode* node = ast_->NewNode(
+        found->op == kPacOpAnd || found->op == kPacOpOr ? kPacLogical :
+        kPacBinary, token_.line);
+    node->op = found->op;
+    Advance();
+    PacNode* right = ParseBinary(level + 1);
+    if (!right) {
+      return NULL;
+    }
+    node->children.push_back(left);
+    node->children.push_back(right);
+    left = node;
+  }
+  return left;
+}
+
+PacNode* Parser::ParseUnary() {
+  if (++depth_ > kMaxNestingDepth) {
+    return Fail("nested too deeply");
+  }
+  PacNode* node = NULL;
+  int line = token_.line;
+  if (Is("!") || Is("-") || Is("+") || IsKeyword("typeof")) {
+    node = ast_->NewNode(kPacUnary, line);
+    node->op = Is("!") ? kPacOpNot : Is("-") ? kPacOpNeg :
+        Is("+") ? kPacOpPlus : kPacOpTypeof;
+    Advance();
+    PacNode* operand = ParseUnary();
+    if (operand) {
+      node->children.push_back(operand);
+    }
+  } else if (Is("++") || Is("--")) {
+    node = ast_->NewNode(kPacIncrement, line);
+    node->op = Is("++") ? kPacOpAdd : kPacOpSub;
+    node->number = 1;
+    Advance();
+    PacNode* operand = ParseUnary();
+    if (operand && operand->kind != kPacIdentifier) {
+      Fail("only variables can be incremented");
+    } else if (operand) {
+      node->text = operand->text;
+    }
+  } else {
+    node = ParsePostfix();
+  }
+  --depth_;
+  return failed_ ? NULL : node;
+}
+
+PacNode* Parser::ParsePostfix() {
+  PacNode* node = ParsePrimary();
+  while (node && !failed_) {
+    int line = token_.line;
+    if (Is("(")) {
+      PacNode* call;
+      if (node->kind == kPacIdentifier) {
+        call = ast_->NewNode(kPacCall, line);
+        call->text = node->text;
+      } else if (node->kind == kPacMember) {
+        call = ast_->NewNode(kPacMethodCall, line);
+        call->text = node->text;
+        call->children.push_back(node->children[0]);
+      } else {
+        return Fail("only named functions can be called");
+      }
+      Advance();
+      while (!failed_ && !Is(")")) {
+        PacNode* argument = ParseAssignment();
+        if (!argument) {
+          return NULL;
+        }
+        call->children.push_back(argument);
+        if (!Is(")") && !Expect(",")) {
+          return NULL;
+        }
+      }
+      Advance();
+      node = call;
+    } else if (Accept(".")) {
+      if (token_.type != kTokenIdentifier) {
+        return Fail("expected property name");
+      }
+      PacNode* member = ast_->NewNode(kPacMember, line);
+      member->text = token_.text;
+      member->children.push_back(node);
+      Advance();
+      node = member;
+    } else if (Accept("[")) {
+      PacNode* index = ast_->NewNode(kPacIndex, line);
+      PacNode* key = ParseExpression();
+      if (!key || !Expect("]")) {
+        return NULL;
+      }
+      index->children.push_back(node);
+      index->children.push_back(key);
+      node = index;
+    } else if ((Is("++") || Is("--")) && !token_.newline_before) {
+      if (node->kind != kPacIdentifier) {
+        return Fail("only variables can be incremented");
+      }
+      PacNode* increment = ast_->NewNode(kPacIncrement, line);
+      increment->op = Is("++") ? kPacOpAdd : kPacOpSub;
+      increment->number = 0;
+      increment->text = node->text;
+      Advance();
+      node = increment;
+    } else {
+      break;
+    }
+  }
+  return failed_ ? NULL : node;
+}
+
+PacNode* Parser::ParsePrimary() {
+  PacNode* node = NULL;
+  int line = token_.line;
+  switch (token_.type) {
+    case kTokenNumber:
+      node = ast_->NewNode(kPacNumber, line);
+      node->number = token_.number;
+      Advance();
+      return node;
+    case kTokenString:
+      node = ast_->NewNode(kPacString, line);
+      node->text = token_.text;
+      Advance();
+      return node;
+    case kTokenIdentifier:
+      if (token_.text == "true" || token_.text == "false") {
+        node = ast_->NewNode(kPacBoolean, line);
+        node->number = token_.text == "true" ? 1 : 0;
+      } else if (token_.text == "null") {
+        node = ast_->NewNode(kPacNull, line);
+      } else if (token_.text == "undefined") {
+        node = ast_->NewNode(kPacUndefined, line);
+      } else if (token_.text == "function" || token_.text == "new" ||
+                 token_.text == "this") {
+        return Fail("'" + token_.text + "' is not supported");
+      } else {
+        node = ast_->NewNode(kPacIdentifier, line);
+        node->text = token_.text;
+      }
+      Advance();
+      return node;
+    case kTokenPunctuator:
+      if (Accept("(")) {
+        node = ParseExpression();
+        if (!node || !Expect(")")) {
+          return NULL;
+        }
+        return node;
+      }
+      if (Accept("[")) {
+        node = ast_->NewNode(kPacArray, line);
+        while (!failed_ && !Is("]")) {
+          PacNode* element = ParseAssignment();
+          if (!element) {
+            return NULL;
+          }
+          node->children.push_back(element);
+          if (!Is("]") && !Expect(",")) {
+            return NULL;
+          }
+        }
+        Advance();
+        return failed_ ? NULL : node;
+      }
+      if (Accept("{")) {
+        node = ast_->NewNode(kPacObject, line);
+        while (!failed_ && !Is("}")) {
+          if (token_.type != kTokenString &&
+              token_.type != kTokenIdentifier) {
+            return Fail("expected property name");
+          }
+          node->params.push_back(token_.text);
+          Advance();
+          PacNode* value = Expect(":") ? ParseAssignment() : NULL;
+          if (!value) {
+            return NULL;
+          }
+          node->children.push_back(value);
+          if (!Is("}") && !Expect(",")) {
+            return NULL;
+          }
+        }
+        Advance();
+        return failed_ ? NULL : node;
+      }
+      if (Is("/")) {
+        return Fail("regular expressions are not supported");
+      }
+      return Fail("unexpected '" + token_.text + "'");
+    case kTokenEnd:
+      return Fail("unexpected end of script");
+  }
+  return NULL;
+}
+
+}  // namespace
+
+bool ParsePacScript(const std::string& source, PacAst* ast,
+                    std::string* error) {
+  Parser parser(source, ast);
+  return parser.ParseProgram(error);
+}
@@ -0,0 +1,41 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#ifndef __PAC_PARSER_H__
+#define __PAC_PARSER_H__
+
+#include <string>
+
+#include "pac_ast.h"
+
+// Parses the source of a PAC script into ast. On failure returns false and
+// describes the first problem in error, e.g. "line 3: expected ')'".
+// Semicolons may be left out at the end of a line, as browsers allow.
+//
+// Only the subset of JavaScript that PAC scripts use is taken: var,
+// function declarations at the top level, if/else, for, while, break,
+// continue, return, the arithmetic, comparison, logical, ?:, typeof, ++,
+// -- and +=-style operators, and array and object literals. Scripts that
+// use any of the following are rejected, and the caller falls back to
+// whatever it does for a script that cannot be loaded:
+// - switch, do-while, try/catch/throw, with, labels, for-in;
+// - the bitwise and shift operators (& | ^ ~ << >> >>> and their
+//   assignments), in, instanceof, delete, void and the comma operator;
+// - new, nested or anonymous functions and regular expressions;
+// - assignment to properties or elements, as in o.a = 1 or a[0] = 1.
+bool ParsePacScript(const std::string& source, PacAst* ast,
+                    std::string* error);
+
+#endif  // __PAC_PARSER_H__
@@ -0,0 +1,88 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "pac_result_cache.h"
+
+#include "hash_util.h"
+
+static uint64_t HashHost(const std::string& host, uint64_t script_hash) {
+  return Mix64(Fnv1a64(host.data(), host.size()) ^ script_hash);
+}
+
+PacResultCache::PacResultCache(int capacity)
+    : sets_((capacity + kWays - 1) / kWays),
+      clock_(0),
+      hits_(0),
+      misses_(0) {
+  if (sets_ == 0) {
+    sets_ = 1;
+  }
+  entries_.resize(sets_ * kWays);
+}
+
+PacResultCache::Entry* PacResultCache::FindSet(uint64_t hash) {
+  return &entries_[(size_t)(hash % sets_) * kWays];
+}
+
+bool PacResultCache::Lookup(const std::string& host, uint64_t script_hash,
+                            int64_t now_ms, std::string* result) {
+  uint64_t hash = HashHost(host, script_hash);
+  Entry* set = FindSet(hash);
+  for (int i = 0; i < kWays; ++i) {
+    Entry& entry = set[i];
+    if (entry.used && entry.hash == hash &&
+        entry.script_hash == script_hash && entry.host == host) {
+      if (entry.expires_ms != 0 && entry.expires_ms <= now_ms) {
+        entry.used = false;
+        break;
+      }
+      entry.last_use = ++clock_;
+      *result = entry.result;
+      ++hits_;
+      return true;
+    }
+  }
+  ++misses_;
+  return false;
+}
+
+void PacResultCache::Insert(const std::string& host, uint64_t script_hash,
+                            int64_t expires_ms, const std::string& result) {
+  uint64_t hash = HashHost(host, script_hash);
+  Entry* set = FindSet(hash);
+  // Prefer a slot of the same host, then a free one or one of another
+  // script, then the least recently used.
+  Entry* victim = &set[0];
+  for (int i = 0; i < kWays; ++i) {
+    Entry& entry = set[i];
+    if (entry.used && entry.hash == hash &&
+        entry.script_hash == script_hash && entry.host == host) {
+      victim = &entry;
+      break;
+    }
+    bool victim_live = victim->used && victim->script_hash == script_hash;
+    bool entry_live = entry.used && entry.script_hash == script_hash;
+    if (victim_live && (!entry_live || entry.last_use < victim->last_use)) {
+      victim = &entry;
+    }
+  }
+  victim->hash = hash;
+  victim->host = host;
+  victim->script_hash = script_hash;
+  victim->expires_ms = expires_ms;
+  victim->last_use = ++clock_;
+  victim->used = true;
+  victim->result = result;
+}
@@ -0,0 +1,70 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#ifndef __PAC_RESULT_CACHE_H__
+#define __PAC_RESULT_CACHE_H__
+
+#include <string>
+#include <vector>
+
+#include "nptypes.h"
+
+// Remembers what FindProxyForURL returned for a host. Entries are keyed by
+// the host and a hash of the script text, so a changed script never sees
+// the results of the old one, while reloading the same text keeps them.
+// Set-associative with least recently used eviction, like RouteCache.
+// Not thread-safe.
+class PacResultCache {
+ public:
+  // capacity is rounded up to a whole number of sets.
+  explicit PacResultCache(int capacity);
+
+  // Returns true and sets result if host has an unexpired entry for the
+  // script.
+  bool Lookup(const std::string& host, uint64_t script_hash, int64_t now_ms,
+              std::string* result);
+  // expires_ms of 0 means the entry stays valid as long as it is cached.
+  void Insert(const std::string& host, uint64_t script_hash,
+              int64_t expires_ms, const std::string& result);
+
+  int64_t hits() const { return hits_; }
+  int64_t misses() const { return misses_; }
+
+ private:
+  enum { kWays = 4 };
+
+  struct Entry {
+    Entry() : hash(0), script_hash(0), expires_ms(0), last_use(0),
+              used(false) {}
+
+    uint64_t hash;
+    std::string host;
+    uint64_t script_hash;
+    int64_t expires_ms;
+    uint32_t last_use;
+    bool used;
+    std::string result;
+  };
+
+  Entry* FindSet(uint64_t hash);
+
+  std::vector<Entry> entries_;
+  size_t sets_;
+  uint32_t clock_;
+  int64_t hits_;
+  int64_t misses_;
+};
+
+#endif  // __PAC_RESULT_CACHE_H__
@@ -0,0 +1,194 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "pac_script.h"
+
+#include <ctype.h>
+
+#include "dns_resolver.h"
+#include "hash_util.h"
+#include "net_util.h"
+#include "pac_analyzer.h"
+#include "pac_ast.h"
+#include "pac_compiler.h"
+#include "pac_parser.h"
+#include "platform_util.h"
+#include "stats.h"
+
+// About the TTL of a DNS record, so that a cached result is not much older
+// than the addresses it was computed from.
+static const int64_t kPacNetworkResultTtlMs = 60 * 1000;
+static const int kPacResultCacheSize = 4096;
+// A script waiting longer than this for a name treats it as unresolvable.
+static const int kPacResolveTimeoutMs = 2000;
+
+bool SystemPacHost::ResolveHost(const std::string& host,
+                                std::string* address) {
+  // PAC helpers such as isInNet only know IPv4.
+  if (resolver_) {
+    uint32_t resolved;
+    if (host.empty() || resolver_->Resolve(host, kPacResolveTimeoutMs,
+                                           &resolved) != DnsResolver::kFound) {
+      return false;
+    }
+    *address = FormatIpv4(resolved);
+    return true;
+  }
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+  if (host.empty() ||
+      !ResolveHostPort(host.c_str(), 80, &addr, &addr_len, AF_INET)) {
+    return false;
+  }
+  char buffer[64];
+  FormatAddress((struct sockaddr*)&addr, buffer, sizeof(buffer));
+  *address = buffer;
+  return true;
+}
+
+std::string SystemPacHost::MyIpAddress() {
+  char buffer[64];
+  if (!GetPrimaryIpv4Address(buffer, sizeof(buffer))) {
+    return "127.0.0.1";
+  }
+  return buffer;
+}
+
+PacScript::PacScript(PacHost* host)
+    : host_(host ? host : &system_host_), program_(NULL), vm_(NULL),
+      find_proxy_function_(-1), script_hash_(0), cache_ttl_ms_(-1),
+      cache_(kPacResultCacheSize) {
+}
+
+PacScript::~PacScript() {
+  delete vm_;
+  delete program_;
+}
+
+bool PacScript::Load(const std::string& source, std::string* error) {
+  PacAst ast;
+  if (!ParsePacScript(source, &ast, error)) {
+    return false;
+  }
+  PacProgram* program = new PacProgram;
+  int function = -1;
+  if (CompilePacScript(ast, program, error)) {
+    function = program->FindFunction("FindProxyForURL");
+    if (function < 0) {
+      *error = "FindProxyForURL is not defined";
+    }
+  }
+  PacVm* vm = NULL;
+  if (function >= 0) {
+    vm = new PacVm(program, host_);
+    if (!vm->Initialize(error)) {
+      delete vm;
+      vm = NULL;
+    }
+  }
+  if (!vm) {
+    delete program;
+    return false;
+  }
+  delete vm_;
+  delete program_;
+  program_ = program;
+  vm_ = vm;
+  find_proxy_function_ = function;
+  source_ = source;
+  script_hash_ = Fnv1a64(source.data(), source.size());
+  PacDependencies dependencies = AnalyzePacDependencies(*program, function);
+  if (dependencies.reads_first_param || dependencies.reads_clock ||
+      dependencies.writes_globals) {
+    cache_ttl_ms_ = -1;
+  } else {
+    cache_ttl_ms_ = dependencies.reads_network ? kPacNetworkResultTtlMs : 0;
+  }
+  return true;
+}
+
+bool PacScript::FindProxyForURL(const std::string& url, std::string* result,
+                                std::string* error) {
+  if (!vm_) {
+    *error = "no script loaded";
+    return false;
+  }
+  std::vector<PacValue> args;
+  args.push_back(PacValue(url));
+  std::string host;
+  if (!GetHostFromUrl(url, &host)) {
+    *error = "bad url";
+    return false;
+  }
+  int64_t now_ms = NowMillis();
+  if (IsCacheable()) {
+    // Added rather than set, since scripts on other threads count too.
+    bool hit = cache_.Lookup(host, script_hash_, now_ms, result);
+    stats::Add(hit ? "pacCacheHits" : "pacCacheMisses", 1);
+    if (hit) {
+      return true;
+    }
+  }
+  args.push_back(PacValue(host));
+  PacValue value;
+  if (!vm_->Call(find_proxy_function_, args, &value, error)) {
+    return false;
+  }
+  *result = vm_->ToString(value);
+  if (IsCacheable()) {
+    cache_.Insert(host, script_hash_,
+                  cache_ttl_ms_ ? now_ms + cache_ttl_ms_ : 0, *result);
+  }
+  return true;
+}
+
+double PacScript::cache_hit_ratio() const {
+  int64_t lookups = cache_.hits() + cache_.misses();
+  return lookups ? (double)cache_.hits() / lookups : 0;
+}
+
+bool GetHostFromUrl(const std::string& url, std::string* host) {
+  size_t begin = url.find("://");
+  begin = begin == std::string::npos ? 0 : begin + 3;
+  size_t end = url.find_first_of("/?#", begin);
+  if (end == std::string::npos) {
+    end = url.size();
+  }
+  size_t at = url.rfind('@', end);
+  if (at != std::string::npos && at >= begin) {
+    begin = at + 1;
+  }
+  std::string authority = url.substr(begin, end - begin);
+  if (!authority.empty() && authority[0] == '[') {
+    size_t close = authority.find(']');
+    if (close == std::string::npos) {
+      return false;
+    }
+    authority = authority.substr(1, close - 1);
+  } else {
+    size_t colon = authority.find(':');
+    if (colon != std::string::npos) {
+      authority.erase(colon);
+    }
+  }
+  if (authority.empty()) {
+    return false;
+  }
+  host->resize(authority.size());
+  for (size_t i = 0; i < authority.size(); ++i) {
+    (*host)[i] = (char)tolower((unsigned char)authority[i]);
+  }
+  return true;
+}
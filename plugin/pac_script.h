@@ -0,0 +1,93 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#ifndef __PAC_SCRIPT_H__
+#define __PAC_SCRIPT_H__
+
+#include <string>
+
+#include "nptypes.h"
+#include "pac_result_cache.h"
+#include "pac_vm.h"
+
+class DnsResolver;
+
+// Resolves names with resolver, or the system resolver if it is NULL.
+// Blocking, though answers cached by resolver come back at once.
+class SystemPacHost : public PacHost {
+ public:
+  explicit SystemPacHost(DnsResolver* resolver = NULL)
+      : resolver_(resolver) {}
+
+  virtual bool ResolveHost(const std::string& host, std::string* address);
+  virtual std::string MyIpAddress();
+
+ private:
+  DnsResolver* resolver_;
+};
+
+// A proxy auto-config script compiled to bytecode, ready to answer
+// FindProxyForURL. When the script provably looks at nothing but the host,
+// results are cached per host; results that depend on DNS are kept for
+// kPacNetworkResultTtlMs only. Not thread-safe.
+class PacScript {
+ public:
+  // host is not owned; NULL means the system resolver.
+  explicit PacScript(PacHost* host);
+  ~PacScript();
+
+  // Compiles source and runs its top level code. On failure returns false
+  // with a message in error and the previous script stays loaded.
+  bool Load(const std::string& source, std::string* error);
+  bool IsLoaded() const { return vm_ != NULL; }
+
+  // Runs FindProxyForURL(url, host) with host taken from url and returns
+  // its result, e.g. "PROXY a:80; DIRECT".
+  bool FindProxyForURL(const std::string& url, std::string* result,
+                       std::string* error);
+
+  // The bytecode of the loaded script; NULL before the first Load.
+  const PacProgram* program() const { return program_; }
+  // The source of the loaded script, for loading it into another PacScript
+  // that a different thread uses.
+  const std::string& source() const { return source_; }
+  uint64_t script_hash() const { return script_hash_; }
+
+  // Whether results of the loaded script are cached.
+  bool IsCacheable() const { return cache_ttl_ms_ >= 0; }
+  // Share of FindProxyForURL calls answered from the cache, in [0, 1].
+  double cache_hit_ratio() const;
+
+ private:
+  PacHost* host_;
+  SystemPacHost system_host_;
+  PacProgram* program_;
+  PacVm* vm_;
+  int find_proxy_function_;
+  std::string source_;
+  uint64_t script_hash_;
+  // How long results stay cached; 0 for ever and -1 for not at all.
+  int64_t cache_ttl_ms_;
+  PacResultCache cache_;
+
+  PacScript(const PacScript&);
+  void operator=(const PacScript&);
+};
+
+// The host part of url as FindProxyForURL receives it: lower case, without
+// user info, port or the brackets of an IPv6 literal.
+bool GetHostFromUrl(const std::string& url, std::string* host);
+
+#endif  // __PAC_SCRIPT_H__
@@ -0,0 +1,1192 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "pac_vm.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "npswitchproxy.h"
+
+// Bounds on a single Initialize or Call, so that a broken or hostile
+// script cannot hang the caller.
+static const int kMaxInstructions = 5000000;
+static const size_t kMaxCallDepth = 100;
+static const size_t kMaxArrays = 100000;
+static const size_t kMaxStringLength = 1024 * 1024;
+// The bytes of strings and array elements one Initialize or Call may
+// create, counted whether or not they are still in use.
+static const size_t kMaxCallBytes = 64 * 1024 * 1024;
+
+namespace {
+
+enum PacBuiltin {
+  kBuiltinIsPlainHostName,
+  kBuiltinDnsDomainIs,
+  kBuiltinLocalHostOrDomainIs,
+  kBuiltinIsResolvable,
+  kBuiltinIsInNet,
+  kBuiltinDnsResolve,
+  kBuiltinMyIpAddress,
+  kBuiltinDnsDomainLevels,
+  kBuiltinShExpMatch,
+  kBuiltinWeekdayRange,
+  kBuiltinTimeRange,
+  kBuiltinAlert,
+  kBuiltinCount,
+};
+
+const char* kBuiltinNames[kBuiltinCount] = {
+  "isPlainHostName",
+  "dnsDomainIs",
+  "localHostOrDomainIs",
+  "isResolvable",
+  "isInNet",
+  "dnsResolve",
+  "myIpAddress",
+  "dnsDomainLevels",
+  "shExpMatch",
+  "weekdayRange",
+  "timeRange",
+  "alert",
+};
+
+enum PacMethod {
+  kMethodToLowerCase,
+  kMethodToUpperCase,
+  kMethodIndexOf,
+  kMethodLastIndexOf,
+  kMethodSubstring,
+  kMethodSubstr,
+  kMethodSlice,
+  kMethodCharAt,
+  kMethodCharCodeAt,
+  kMethodSplit,
+  kMethodJoin,
+  kMethodTrim,
+  kMethodReplace,
+  kMethodToString,
+  kMethodCount,
+};
+
+const char* kMethodNames[kMethodCount] = {
+  "toLowerCase",
+  "toUpperCase",
+  "indexOf",
+  "lastIndexOf",
+  "substring",
+  "substr",
+  "slice",
+  "charAt",
+  "charCodeAt",
+  "split",
+  "join",
+  "trim",
+  "replace",
+  "toString",
+};
+
+bool IsNaN(double value) {
+  return value != value;
+}
+
+std::string NumberToString(double value) {
+  if (IsNaN(value)) {
+    return "NaN";
+  }
+  if (IsNaN(value - value)) {
+    return value > 0 ? "Infinity" : "-Infinity";
+  }
+  if (value == 0) {
+    // Also -0.
+    return "0";
+  }
+  if (value < 0) {
+    return "-" + NumberToString(-value);
+  }
+  // The shortest digits that read back as the same number, as
+  // d.ddde[+-]x.
+  char buffer[32];
+  for (int precision = 0; precision <= 16; ++precision) {
+    snprintf(buffer, sizeof(buffer), "%.*e", precision, value);
+    if (strtod(buffer, NULL) == value) {
+      break;
+    }
+  }
+  std::string digits;
+  const char* p = buffer;
+  for (; *p != 'e'; ++p) {
+    if (*p != '.') {
+      digits += *p;
+    }
+  }
+  // As in ECMA-262 Number::toString: the value is 0.digits * 10^point.
+  int point = atoi(p + 1) + 1;
+  int count = (int)digits.size();
+  if (count <= point && point <= 21) {
+    return digits + std::string(point - count, '0');
+  }
+  if (0 < point && point <= 21) {
+    return digits.substr(0, point) + "." + digits.substr(point);
+  }
+  if (-6 < point && point <= 0) {
+    return "0." + std::string(-point, '0') + digits;
+  }
+  int exponent = point - 1;
+  snprintf(buffer, sizeof(buffer), "e%c%d", exponent < 0 ? '-' : '+',
+           exponent < 0 ? -exponent : exponent);
+  if (count == 1) {
+    return digits + buffer;
+  }
+  return digits.substr(0, 1) + "." + digits.substr(1) + buffer;
+}
+
+double StringToNumber(const std::string& text) {
+  const char* begin = text.c_str();
+  while (isspace((unsigned char)*begin)) {
+    ++begin;
+  }
+  if (*begin == '\0') {
+    return 0;
+  }
+  char* end;
+  double value;
+  if (begin[0] == '0' && (begin[1] == 'x' || begin[1] == 'X')) {
+    value = (double)strtoul(begin + 2, &end, 16);
+  } else {
+    value = strtod(begin, &end);
+  }
+  while (isspace((unsigned char)*end)) {
+    ++end;
+  }
+  return *end == '\0' ? value : sqrt(-1.0);
+}
+
+double ToNumber(const PacValue& value) {
+  switch (value.type) {
+    case PacValue::kUndefined:
+      return sqrt(-1.0);
+    case PacValue::kNull:
+      return 0;
+    case PacValue::kBoolean:
+    case PacValue::kNumber:
+      return value.number;
+    case PacValue::kString:
+      return StringToNumber(value.string);
+    case PacValue::kArray:
+    case PacValue::kObject:
+      return sqrt(-1.0);
+  }
+  return 0;
+}
+
+bool ToBoolean(const PacValue& value) {
+  switch (value.type) {
+    case PacValue::kUndefined:
+    case PacValue::kNull:
+      return false;
+    case PacValue::kBoolean:
+      return value.number != 0;
+    case PacValue::kNumber:
+      return value.number != 0 && !IsNaN(value.number);
+    case PacValue::kString:
+      return !value.string.empty();
+    case PacValue::kArray:
+    case PacValue::kObject:
+      return true;
+  }
+  return false;
+}
+
+// Integer argument as the string methods take it: NaN is 0.
+int ToInteger(const PacValue& value) {
+  double number = ToNumber(value);
+  if (IsNaN(number)) {
+    return 0;
+  }
+  if (number > 1e9) {
+    return 1000000000;
+  }
+  if (number < -1e9) {
+    return -1000000000;
+  }
+  return (int)number;
+}
+
+int Clamp(int value, int low, int high) {
+  return value < low ? low : (value > high ? high : value);
+}
+
+std::string ToLower(const std::string& text) {
+  std::string result(text);
+  for (size_t i = 0; i < result.size(); ++i) {
+    result[i] = (char)tolower((unsigned char)result[i]);
+  }
+  return result;
+}
+
+// shExpMatch glob: '*' matches any run, '?' any single character.
+bool ShellExpressionMatch(const char* text, const char* pattern) {
+  const char* star = NULL;
+  const char* resume = NULL;
+  while (*text) {
+    if (*pattern == '*') {
+      star = pattern++;
+      resume = text;
+    } else if (*pattern == '?' || *pattern == *text) {
+      ++pattern;
+      ++text;
+    } else if (star) {
+      pattern = star + 1;
+      text = ++resume;
+    } else {
+      return false;
+    }
+  }
+  while (*pattern == '*') {
+    ++pattern;
+  }
+  return *pattern == '\0';
+}
+
+bool ParseIpv4(const std::string& text, unsigned int* address) {
+  unsigned int parts[4];
+  char tail;
+  if (sscanf(text.c_str(), "%u.%u.%u.%u%c", &parts[0], &parts[1], &parts[2],
+             &parts[3], &tail) != 4) {
+    return false;
+  }
+  *address = 0;
+  for (int i = 0; i < 4; ++i) {
+    if (parts[i] > 255) {
+      return false;
+    }
+    *address = (*address << 8) | parts[i];
+  }
+  return true;
+}
+
+int WeekdayIndex(const std::string& name) {
+  static const char* kDays[] = {"SUN", "MON", "TUE", "WED", "THU", "FRI",
+                                "SAT"};
+  for (int i = 0; i < 7; ++i) {
+    if (name == kDays[i]) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Whether value lies in [low, high], wrapping around when low > high as in
+// weekdayRange("FRI", "MON").
+bool InWrappedRange(int value, int low, int high) {
+  return low <= high ? (low <= value && value <= high) :
+      (value >= low || value <= high);
+}
+
+struct tm CurrentTime(bool gmt) {
+  time_t now = time(NULL);
+  struct tm result;
+#if defined(_WINDOWS)
+  if (gmt) {
+    gmtime_s(&result, &now);
+  } else {
+    localtime_s(&result, &now);
+  }
+#else
+  if (gmt) {
+    gmtime_r(&now, &result);
+  } else {
+    localtime_r(&now, &result);
+  }
+#endif
+  return result;
+}
+
+// Drops a trailing "GMT" argument; returns whether there was one.
+bool TakeGmtArgument(PacValue* args, int* argc) {
+  if (*argc > 0 && args[*argc - 1].type == PacValue::kString &&
+      args[*argc - 1].string == "GMT") {
+    --*argc;
+    return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+int PacProgram::FindFunction(const std::string& name) const {
+  for (size_t i = 1; i < functions.size(); ++i) {
+    if (functions[i].name == name) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+int PacOperandCount(int opcode) {
+  switch (opcode) {
+    case kPacInstrPushConstant:
+    case kPacInstrLoadLocal:
+    case kPacInstrStoreLocal:
+    case kPacInstrLoadGlobal:
+    case kPacInstrStoreGlobal:
+    case kPacInstrJump:
+    case kPacInstrJumpIfFalse:
+    case kPacInstrJumpIfFalseOrPop:
+    case kPacInstrJumpIfTrueOrPop:
+    case kPacInstrMakeArray:
+    case kPacInstrMakeObject:
+      return 1;
+    case kPacInstrCall:
+    case kPacInstrCallBuiltin:
+    case kPacInstrCallMethod:
+    case kPacInstrDecide:
+      return 2;
+    default:
+      return 0;
+  }
+}
+
+int FindPacBuiltin(const std::string& name) {
+  for (int i = 0; i < kBuiltinCount; ++i) {
+    if (name == kBuiltinNames[i]) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+const char* PacBuiltinName(int builtin) {
+  return builtin >= 0 && builtin < kBuiltinCount ? kBuiltinNames[builtin] :
+      "";
+}
+
+int FindPacMethod(const std::string& name) {
+  for (int i = 0; i < kMethodCount; ++i) {
+    if (name == kMethodNames[i]) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+PacVm::PacVm(const PacProgram* program, PacHost* host)
+    : program_(program), host_(host), array_escaped_(false), allocated_(0) {
+}
+
+bool PacVm::Initialize(std::string* error) {
+  allocated_ = 0;
+  globals_.assign(program_->globals.size(), PacValue());
+  arrays_.clear();
+  objects_.clear();
+  stack_.clear();
+  frames_.clear();
+  Frame frame = {0, -1, 0};
+  frames_.push_back(frame);
+  stack_.resize(program_->functions[0].num_locals);
+  bool ok = Run(error);
+  stack_.clear();
+  frames_.clear();
+  return ok;
+}
+
+bool PacVm::Call(int function, const std::vector<PacValue>& args,
+                 PacValue* result, std::string* error) {
+  if (function <= 0 || function >= (int)program_->functions.size()) {
+    *error = "no such function";
+    return false;
+  }
+  const PacFunction& callee = program_->functions[function];
+  size_t array_mark = arrays_.size();
+  size_t object_mark = objects_.size();
+  array_escaped_ = false;
+  allocated_ = 0;
+  stack_.clear();
+  frames_.clear();
+  for (size_t i = 0; i < args.size() && (int)i < callee.num_params; ++i) {
+    stack_.push_back(args[i]);
+  }
+  stack_.resize(callee.num_locals);
+  Frame frame = {function, -1, 0};
+  frames_.push_back(frame);
+  bool ok = Run(error);
+  if (ok) {
+    *result = stack_.back();
+    if (IsReference(*result)) {
+      array_escaped_ = true;
+    }
+  }
+  stack_.clear();
+  frames_.clear();
+  if (!array_escaped_) {
+    arrays_.resize(array_mark);
+    objects_.resize(object_mark);
+  }
+  return ok;
+}
+
+int PacVm::NewArray() {
+  arrays_.push_back(std::vector<PacValue>());
+  return (int)arrays_.size() - 1;
+}
+
+bool PacVm::Allocate(size_t bytes, std::string* error) {
+  allocated_ += bytes;
+  if (allocated_ > kMaxCallBytes) {
+    *error = "script used too much memory";
+    return false;
+  }
+  return true;
+}
+
+bool PacVm::AllocateString(size_t length, std::string* error) {
+  if (length > kMaxStringLength) {
+    *error = "string too long";
+    return false;
+  }
+  return Allocate(length, error);
+}
+
+std::string PacVm::ToString(const PacValue& value) const {
+  switch (value.type) {
+    case PacValue::kUndefined:
+      return "undefined";
+    case PacValue::kNull:
+      return "null";
+    case PacValue::kBoolean:
+      return value.number != 0 ? "true" : "false";
+    case PacValue::kNumber:
+      return NumberToString(value.number);
+    case PacValue::kString:
+      return value.string;
+    case PacValue::kArray: {
+      std::string result;
+      const std::vector<PacValue>& elements = arrays_[value.array];
+      for (size_t i = 0; i < elements.size(); ++i) {
+        if (i > 0) {
+          result += ',';
+        }
+        if (elements[i].type != PacValue::kUndefined &&
+            elements[i].type != PacValue::kNull) {
+          result += ToString(elements[i]);
+        }
+        if (result.size() > kMaxStringLength) {
+          // Too long to be used anyway; see AllocateString.
+          break;
+        }
+      }
+      return result;
+    }
+    case PacValue::kObject:
+      return "[object Object]";
+  }
+  return "";
+}
+
+bool PacVm::LooseEquals(const PacValue& a, const PacValue& b) const {
+  if (a.type == b.type) {
+    switch (a.type) {
+      case PacValue::kUndefined:
+      case PacValue::kNull:
+        return true;
+      case PacValue::kBoolean:
+      case PacValue::kNumber:
+        return a.number == b.number;
+      case PacValue::kString:
+        return a.string == b.string;
+      case PacValue::kArray:
+      case PacValue::kObject:
+        return a.array == b.array;
+    }
+  }
+  bool a_nullish = a.type == PacValue::kUndefined ||
+      a.type == PacValue::kNull;
+  bool b_nullish = b.type == PacValue::kUndefined ||
+      b.type == PacValue::kNull;
+  if (a_nullish || b_nullish) {
+    return a_nullish && b_nullish;
+  }
+  if (IsReference(a) || IsReference(b)) {
+    return ToString(a) == ToString(b);
+  }
+  return ToNumber(a) == ToNumber(b);
+}
+
+bool PacVm::Add(const PacValue& a, const PacValue& b, PacValue* result,
+                std::string* error) {
+  if (a.type == PacValue::kString || b.type == PacValue::kString ||
+      IsReference(a) || IsReference(b)) {
+    std::string left = ToString(a);
+    std::string right = ToString(b);
+    if (!AllocateString(left.size() + right.size(), error)) {
+      return false;
+    }
+    *result = PacValue(left + right);
+    return true;
+  }
+  *result = PacValue(ToNumber(a) + ToNumber(b));
+  return true;
+}
+
+// Returns -1, 0 or 1, or 2 if the values are unordered (NaN).
+int PacVm::Compare(const PacValue& a, const PacValue& b) const {
+  if (a.type == PacValue::kString && b.type == PacValue::kString) {
+    int result = a.string.compare(b.string);
+    return result < 0 ? -1 : (result > 0 ? 1 : 0);
+  }
+  double x = ToNumber(a);
+  double y = ToNumber(b);
+  if (IsNaN(x) || IsNaN(y)) {
+    return 2;
+  }
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+bool PacVm::Run(std::string* error) {
+  const std::vector<int>& code = program_->code;
+  int pc = program_->functions[frames_.back().function].entry;
+  for (int budget = kMaxInstructions; budget > 0; --budget) {
+    switch (code[pc++]) {
+      case kPacInstrPushConstant:
+        stack_.push_back(program_->constants[code[pc++]]);
+        break;
+      case kPacInstrPushUndefined:
+        stack_.push_back(PacValue());
+        break;
+      case kPacInstrPushNull: {
+        PacValue value;
+        value.type = PacValue::kNull;
+        stack_.push_back(value);
+        break;
+      }
+      case kPacInstrPushTrue:
+        stack_.push_back(PacValue(true));
+        break;
+      case kPacInstrPushFalse:
+        stack_.push_back(PacValue(false));
+        break;
+      case kPacInstrLoadLocal: {
+        // Copied first, since push_back may move the stack.
+        PacValue value = stack_[frames_.back().base + code[pc++]];
+        stack_.push_back(value);
+        break;
+      }
+      case kPacInstrStoreLocal:
+        stack_[frames_.back().base + code[pc++]] = stack_.back();
+        stack_.pop_back();
+        break;
+      case kPacInstrLoadGlobal:
+        stack_.push_back(globals_[code[pc++]]);
+        break;
+      case kPacInstrStoreGlobal:
+        if (IsReference(stack_.back())) {
+          array_escaped_ = true;
+        }
+        globals_[code[pc++]] = stack_.back();
+        stack_.pop_back();
+        break;
+      case kPacInstrPop:
+        stack_.pop_back();
+        break;
+      case kPacInstrDup: {
+        PacValue value = stack_.back();
+        stack_.push_back(value);
+        break;
+      }
+      case kPacInstrAdd:
+      case kPacInstrSub:
+      case kPacInstrMul:
+      case kPacInstrDiv:
+      case kPacInstrMod:
+      case kPacInstrEq:
+      case kPacInstrNe:
+      case kPacInstrStrictEq:
+      case kPacInstrStrictNe:
+      case kPacInstrLt:
+      case kPacInstrLe:
+      case kPacInstrGt:
+      case kPacInstrGe: {
+        int op = code[pc - 1];
+        PacValue& a = stack_[stack_.size() - 2];
+        const PacValue& b = stack_.back();
+        PacValue result;
+        switch (op) {
+          case kPacInstrAdd:
+            if (!Add(a, b, &result, error)) {
+              return false;
+            }
+            break;
+          case kPacInstrSub:
+            result = PacValue(ToNumber(a) - ToNumber(b));
+            break;
+          case kPacInstrMul:
+            result = PacValue(ToNumber(a) * ToNumber(b));
+            break;
+          case kPacInstrDiv:
+            result = PacValue(ToNumber(a) / ToNumber(b));
+            break;
+          case kPacInstrMod:
+            result = PacValue(fmod(ToNumber(a), ToNumber(b)));
+            break;
+          case kPacInstrEq:
+            result = PacValue(LooseEquals(a, b));
+            break;
+          case kPacInstrNe:
+            result = PacValue(!LooseEquals(a, b));
+            break;
+          case kPacInstrStrictEq:
+          case kPacInstrStrictNe: {
+            bool equal = a.type == b.type && LooseEquals(a, b);
+            result = PacValue(op == kPacInstrStrictEq ? equal : !equal);
+            break;
+          }
+          case kPacInstrLt:
+            result = PacValue(Compare(a, b) == -1);
+            break;
+          case kPacInstrLe: {
+            int order = Compare(a, b);
+            result = PacValue(order == -1 || order == 0);
+            break;
+          }
+          case kPacInstrGt:
+            result = PacValue(Compare(a, b) == 1);
+            break;
+          case kPacInstrGe: {
+            int order = Compare(a, b);
+            result = PacValue(order == 1 || order == 0);
+            break;
+          }
+        }
+        stack_.pop_back();
+        stack_.back() = result;
+        break;
+      }
+      case kPacInstrNeg:
+        stack_.back() = PacValue(-ToNumber(stack_.back()));
+        break;
+      case kPacInstrToNumber:
+        stack_.back() = PacValue(ToNumber(stack_.back()));
+        break;
+      case kPacInstrNot:
+        stack_.back() = PacValue(!ToBoolean(stack_.back()));
+        break;
+      case kPacInstrTypeof: {
+        static const char* kTypeNames[] = {
+          "undefined", "object", "boolean", "number", "string", "object",
+          "object",
+        };
+        stack_.back() = PacValue(std::string(kTypeNames[stack_.back().type]));
+        break;
+      }
+      case kPacInstrJump:
+        pc = code[pc];
+        break;
+      case kPacInstrJumpIfFalse: {
+        bool condition = ToBoolean(stack_.back());
+        stack_.pop_back();
+        pc = condition ? pc + 1 : code[pc];
+        break;
+      }
+      case kPacInstrJumpIfFalseOrPop:
+      case kPacInstrJumpIfTrueOrPop: {
+        bool jump_if = code[pc - 1] == kPacInstrJumpIfTrueOrPop;
+        if (ToBoolean(stack_.back()) == jump_if) {
+          pc = code[pc];
+        } else {
+          stack_.pop_back();
+          ++pc;
+        }
+        break;
+      }
+      case kPacInstrCall: {
+        int function = code[pc++];
+        int argc = code[pc++];
+        const PacFunction& callee = program_->functions[function];
+        if (frames_.size() >= kMaxCallDepth) {
+          *error = "too much recursion in " + callee.name;
+          return false;
+        }
+        for (; argc > callee.num_params; --argc) {
+          stack_.pop_back();
+        }
+        size_t base = stack_.size() - argc;
+        stack_.resize(base + callee.num_locals);
+        Frame frame = {function, pc, base};
+        frames_.push_back(frame);
+        pc = callee.entry;
+        break;
+      }
+      case kPacInstrCallBuiltin:
+      case kPacInstrCallMethod: {
+        bool method = code[pc - 1] == kPacInstrCallMethod;
+        int id = code[pc++];
+        int argc = code[pc++];
+        size_t first = stack_.size() - argc;
+        PacValue result;
+        bool ok = method ?
+            CallMethod(id, &stack_[first - 1], argc ? &stack_[first] : NULL,
+                       argc, &result, error) :
+            CallBuiltin(id, argc ? &stack_[first] : NULL, argc, &result,
+                        error);
+        if (!ok || !Charge(result, error)) {
+          return false;
+        }
+        stack_.resize(method ? first - 1 : first);
+        stack_.push_back(result);
+        break;
+      }
+      case kPacInstrGetLength: {
+        PacValue& value = stack_.back();
+        if (value.type == PacValue::kString) {
+          value = PacValue((double)value.string.size());
+        } else if (value.type == PacValue::kArray) {
+          value = PacValue((double)arrays_[value.array].size());
+        } else if (value.type == PacValue::kObject) {
+          std::map<std::string, PacValue>::const_iterator it =
+              objects_[value.array].find("length");
+          value = it != objects_[value.array].end() ? it->second : PacValue();
+        } else {
+          *error = "length of " + ToString(value);
+          return false;
+        }
+        break;
+      }
+      case kPacInstrGetIndex: {
+        PacValue index = stack_.back();
+        stack_.pop_back();
+        PacValue& object = stack_.back();
+        if (object.type == PacValue::kObject) {
+          // Only own properties; there is no prototype chain.
+          const std::map<std::string, PacValue>& properties =
+              objects_[object.array];
+          std::map<std::string, PacValue>::const_iterator it =
+              properties.find(ToString(index));
+          object = it != properties.end() ? it->second : PacValue();
+          break;
+        }
+        double number = ToNumber(index);
+        int i = (int)number;
+        PacValue result;
+        if (number == i && i >= 0) {
+          if (object.type == PacValue::kString &&
+              i < (int)object.string.size()) {
+            result = PacValue(object.string.substr(i, 1));
+          } else if (object.type == PacValue::kArray &&
+                     i < (int)arrays_[object.array].size()) {
+            result = arrays_[object.array][i];
+          }
+        }
+        if (object.type == PacValue::kUndefined ||
+            object.type == PacValue::kNull) {
+          *error = "cannot index " + ToString(object);
+          return false;
+        }
+        object = result;
+        break;
+      }
+      case kPacInstrMakeArray: {
+        int count = code[pc++];
+        if (arrays_.size() >= kMaxArrays) {
+          *error = "too many arrays";
+          return false;
+        }
+        if (!Allocate(count * sizeof(PacValue), error)) {
+          return false;
+        }
+        int array = NewArray();
+        arrays_[array].assign(stack_.end() - count, stack_.end());
+        stack_.resize(stack_.size() - count);
+        PacValue value;
+        value.type = PacValue::kArray;
+        value.array = array;
+        stack_.push_back(value);
+        break;
+      }
+      case kPacInstrMakeObject: {
+        int count = code[pc++];
+        if (objects_.size() >= kMaxArrays) {
+          *error = "too many objects";
+          return false;
+        }
+        if (!Allocate(count * 2 * sizeof(PacValue), error)) {
+          return false;
+        }
+        objects_.push_back(std::map<std::string, PacValue>());
+        std::map<std::string, PacValue>& properties = objects_.back();
+        size_t first = stack_.size() - 2 * count;
+        for (size_t i = first; i < stack_.size(); i += 2) {
+          properties[stack_[i].string] = stack_[i + 1];
+        }
+        stack_.resize(first);
+        PacValue value;
+        value.type = PacValue::kObject;
+        value.array = (int)objects_.size() - 1;
+        stack_.push_back(value);
+        break;
+      }
+      case kPacInstrReturn: {
+        PacValue result = stack_.back();
+        Frame frame = frames_.back();
+        frames_.pop_back();
+        stack_.resize(frame.base);
+        stack_.push_back(result);
+        if (frames_.empty()) {
+          return true;
+        }
+        pc = frame.return_pc;
+        break;
+      }
+      case kPacInstrDecide: {
+        const PacDecisionTable& table = program_->tables[code[pc++]];
+        int miss = code[pc++];
+        const PacValue& value = stack_.back();
+        if (value.type != PacValue::kString ||
+            value.string.find('\0') != std::string::npos) {
+          stack_.pop_back();
+          ++pc;
+          break;
+        }
+        int rule = table.Lookup(value.string);
+        stack_.pop_back();
+        if (rule < 0) {
+          pc = miss;
+        } else {
+          stack_.push_back(program_->constants[table.results[rule]]);
+        }
+        break;
+      }
+      default:
+        *error = "bad instruction";
+        return false;
+    }
+  }
+  *error = "script ran too long";
+  return false;
+}
+
+bool PacVm::CallBuiltin(int builtin, PacValue* args, int argc,
+                        PacValue* result, std::string* error) {
+  std::string arg0 = argc > 0 ? ToString(args[0]) : std::string();
+  std::string arg1 = argc > 1 ? ToString(args[1]) : std::string();
+  switch (builtin) {
+    case kBuiltinIsPlainHostName:
+      *result = PacValue(arg0.find_first_of(".:") == std::string::npos);
+      return true;
+    case kBuiltinDnsDomainIs:
+      *result = PacValue(arg0.size() >= arg1.size() &&
+                         arg0.compare(arg0.size() - arg1.size(),
+                                      arg1.size(), arg1) == 0);
+      return true;
+    case kBuiltinLocalHostOrDomainIs:
+      *result = PacValue(arg0 == arg1 ||
+                         (arg0.find('.') == std::string::npos &&
+                          arg1.compare(0, arg0.size() + 1, arg0 + ".") == 0));
+      return true;
+    case kBuiltinIsResolvable: {
+      std::string address;
+      *result = PacValue(host_->ResolveHost(arg0, &address));
+      return true;
+    }
+    case kBuiltinDnsResolve: {
+      std::string address;
+      if (host_->ResolveHost(arg0, &address)) {
+        *result = PacValue(address);
+      } else {
+        result->type = PacValue::kNull;
+      }
+      return true;
+    }
+    case kBuiltinIsInNet: {
+      unsigned int address, pattern, mask;
+      std::string resolved;
+      if (!ParseIpv4(arg0, &address)) {
+        if (!host_->ResolveHost(arg0, &resolved) ||
+            !ParseIpv4(resolved, &address)) {
+          *result = PacValue(false);
+          return true;
+        }
+      }
+      if (argc < 3 || !ParseIpv4(arg1, &pattern) ||
+          !ParseIpv4(ToString(args[2]), &mask)) {
+        *result = PacValue(false);
+        return true;
+      }
+      *result = PacValue((address & mask) == (pattern & mask));
+      return true;
+    }
+    case kBuiltinMyIpAddress:
+      *result = PacValue(host_->MyIpAddress());
+      return true;
+    case kBuiltinDnsDomainLevels: {
+      int levels = 0;
+      for (size_t i = 0; i < arg0.size(); ++i) {
+        levels += arg0[i] == '.';
+      }
+      *result = PacValue((double)levels);
+      return true;
+    }
+    case kBuiltinShExpMatch:
+      *result = PacValue(ShellExpressionMatch(arg0.c_str(), arg1.c_str()));
+      return true;
+    case kBuiltinWeekdayRange: {
+      bool gmt = TakeGmtArgument(args, &argc);
+      int low = argc > 0 ? WeekdayIndex(ToString(args[0])) : -1;
+      int high = argc > 1 ? WeekdayIndex(ToString(args[1])) : low;
+      if (low < 0 || high < 0) {
+        *result = PacValue(false);
+        return true;
+      }
+      *result = PacValue(InWrappedRange(CurrentTime(gmt).tm_wday, low,
+                                        high));
+      return true;
+    }
+    case kBuiltinTimeRange: {
+      bool gmt = TakeGmtArgument(args, &argc);
+      struct tm now = CurrentTime(gmt);
+      int seconds = now.tm_hour * 3600 + now.tm_min * 60 + now.tm_sec;
+      int values[6];
+      for (int i = 0; i < argc && i < 6; ++i) {
+        values[i] = ToInteger(args[i]);
+      }
+      switch (argc) {
+        case 1:
+          *result = PacValue(now.tm_hour == values[0]);
+          return true;
+        case 2:
+          // timeRange(9, 17) covers 9:00:00 up to 17:59:59.
+          *result = PacValue(InWrappedRange(now.tm_hour, values[0],
+                                            values[1]));
+          return true;
+        case 4:
+          *result = PacValue(InWrappedRange(
+              seconds, values[0] * 3600 + values[1] * 60,
+              values[2] * 3600 + values[3] * 60 + 59));
+          return true;
+        case 6:
+          *result = PacValue(InWrappedRange(
+              seconds, values[0] * 3600 + values[1] * 60 + values[2],
+              values[3] * 3600 + values[4] * 60 + values[5]));
+          return true;
+      }
+      *result = PacValue(false);
+      return true;
+    }
+    case kBuiltinAlert:
+      DebugLog("npswitchproxy: PAC alert: %s\n", arg0.c_str());
+      *result = PacValue();
+      return true;
+  }
+  *error = "unknown function";
+  return false;
+}
+
+// Counts what a builtin or method returned against the limits. Split
+// arrays count their elements as they are made.
+bool PacVm::Charge(const PacValue& value, std::string* error) {
+  if (value.type == PacValue::kString) {
+    return AllocateString(value.string.size(), error);
+  }
+  return true;
+}
+
+bool PacVm::CallMethod(int method, PacValue* receiver, PacValue* args,
+                       int argc, PacValue* result, std::string* error) {
+  if (receiver->type == PacValue::kUndefined ||
+      receiver->type == PacValue::kNull) {
+    *error = std::string("cannot call ") + kMethodNames[method] + " on " +
+        ToString(*receiver);
+    return false;
+  }
+  if (receiver->type == PacValue::kArray) {
+    const std::vector<PacValue>& elements = arrays_[receiver->array];
+    switch (method) {
+      case kMethodJoin: {
+        std::string separator = argc > 0 &&
+            args[0].type != PacValue::kUndefined ? ToString(args[0]) : ",";
+        std::string joined;
+        for (size_t i = 0; i < elements.size(); ++i) {
+          if (i > 0) {
+            joined += separator;
+          }
+          if (elements[i].type != PacValue::kUndefined &&
+              elements[i].type != PacValue::kNull) {
+            joined += ToString(elements[i]);
+          }
+          if (joined.size() > kMaxStringLength) {
+            *error = "string too long";
+            return false;
+          }
+        }
+        *result = PacValue(joined);
+        return true;
+      }
+      case kMethodIndexOf: {
+        int found = -1;
+        for (size_t i = 0; argc > 0 && i < elements.size(); ++i) {
+          if (elements[i].type == args[0].type &&
+              LooseEquals(elements[i], args[0])) {
+            found = (int)i;
+            break;
+          }
+        }
+        *result = PacValue((double)found);
+        return true;
+      }
+      case kMethodToString:
+        *result = PacValue(ToString(*receiver));
+        return true;
+    }
+    *error = std::string("arrays have no method ") + kMethodNames[method];
+    return false;
+  }
+  std::string text = ToString(*receiver);
+  int size = (int)text.size();
+  std::string arg0 = argc > 0 ? ToString(args[0]) : std::string();
+  switch (method) {
+    case kMethodToLowerCase:
+      *result = PacValue(ToLower(text));
+      return true;
+    case kMethodToUpperCase: {
+      std::string upper(text);
+      for (size_t i = 0; i < upper.size(); ++i) {
+        upper[i] = (char)toupper((unsigned char)upper[i]);
+      }
+      *result = PacValue(upper);
+      return true;
+    }
+    case kMethodIndexOf: {
+      int from = argc > 1 ? Clamp(ToInteger(args[1]), 0, size) : 0;
+      size_t found = text.find(argc > 0 ? arg0 : "undefined", from);
+      *result = PacValue(found == std::string::npos ? -1.0 : (double)found);
+      return true;
+    }
+    case kMethodLastIndexOf: {
+      size_t from = std::string::npos;
+      if (argc > 1 && !IsNaN(ToNumber(args[1]))) {
+        from = (size_t)Clamp(ToInteger(args[1]), 0, size);
+      }
+      size_t found = text.rfind(argc > 0 ? arg0 : "undefined", from);
+      *result = PacValue(found == std::string::npos ? -1.0 : (double)found);
+      return true;
+    }
+    case kMethodSubstring: {
+      int start = argc > 0 ? Clamp(ToInteger(args[0]), 0, size) : 0;
+      int end = argc > 1 && args[1].type != PacValue::kUndefined ?
+          Clamp(ToInteger(args[1]), 0, size) : size;
+      if (start > end) {
+        int swap = start;
+        start = end;
+        end = swap;
+      }
+      *result = PacValue(text.substr(start, end - start));
+      return true;
+    }
+    case kMethodSubstr: {
+      int start = argc > 0 ? ToInteger(args[0]) : 0;
+      if (start < 0) {
+        start = start + size < 0 ? 0 : start + size;
+      }
+      start = Clamp(start, 0, size);
+      int length = argc > 1 && args[1].type != PacValue::kUndefined ?
+          Clamp(ToInteger(args[1]), 0, size - start) : size - start;
+      *result = PacValue(text.substr(start, length));
+      return true;
+    }
+    case kMethodSlice: {
+      int start = argc > 0 ? ToInteger(args[0]) : 0;
+      int end = argc > 1 && args[1].type != PacValue::kUndefined ?
+          ToInteger(args[1]) : size;
+      start = Clamp(start < 0 ? start + size : start, 0, size);
+      end = Clamp(end < 0 ? end + size : end, 0, size);
+      *result = PacValue(start < end ? text.substr(start, end - start) :
+                         std::string());
+      return true;
+    }
+    case kMethodCharAt:
+    case kMethodCharCodeAt: {
+      int index = argc > 0 ? ToInteger(args[0]) : 0;
+      bool valid = index >= 0 && index < size;
+      if (method == kMethodCharAt) {
+        *result = PacValue(valid ? text.substr(index, 1) : std::string());
+      } else {
+        *result = PacValue(valid ? (double)(unsigned char)text[index] :
+                           sqrt(-1.0));
+      }
+      return true;
+    }
+    case kMethodSplit: {
+      if (arrays_.size() >= kMaxArrays) {
+        *error = "too many arrays";
+        return false;
+      }
+      int array = NewArray();
+      std::vector<PacValue>& parts = arrays_[array];
+      if (argc == 0 || args[0].type == PacValue::kUndefined) {
+        parts.push_back(PacValue(text));
+      } else if (arg0.empty()) {
+        for (int i = 0; i < size; ++i) {
+          if (!Allocate(sizeof(PacValue) + 1, error)) {
+            return false;
+          }
+          parts.push_back(PacValue(text.substr(i, 1)));
+        }
+      } else {
+        size_t begin = 0;
+        size_t found;
+        while ((found = text.find(arg0, begin)) != std::string::npos) {
+          if (!Allocate(sizeof(PacValue) + found - begin, error)) {
+            return false;
+          }
+          parts.push_back(PacValue(text.substr(begin, found - begin)));
+          begin = found + arg0.size();
+        }
+        parts.push_back(PacValue(text.substr(begin)));
+      }
+      result->type = PacValue::kArray;
+      result->array = array;
+      return true;
+    }
+    case kMethodTrim: {
+      size_t begin = text.find_first_not_of(" \t\r\n\v\f");
+      size_t end = text.find_last_not_of(" \t\r\n\v\f");
+      *result = PacValue(begin == std::string::npos ? std::string() :
+                         text.substr(begin, end - begin + 1));
+      return true;
+    }
+    case kMethodReplace: {
+      // Only string patterns; the first occurrence is replaced.
+      std::string replacement = argc > 1 ? ToString(args[1]) : "undefined";
+      size_t found = text.find(arg0);
+      if (found != std::string::npos) {
+        if (!AllocateString(text.size() + replacement.size(), error)) {
+          return false;
+        }
+        text.replace(found, arg0.size(), replacement);
+      }
+      *result = PacValue(text);
+      return true;
+    }
+    case kMethodToString:
+      *result = PacValue(text);
+      return true;
+  }
+  *error = std::string("strings have no method ") + kMethodNames[method];
+  return false;
+}
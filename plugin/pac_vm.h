@@ -0,0 +1,200 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Bytecode and the stack machine that runs compiled PAC scripts.
+
+#ifndef __PAC_VM_H__
+#define __PAC_VM_H__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "pac_decision_table.h"
+
+// Each instruction is an opcode followed by its operands, all ints.
+enum PacOpcode {
+  kPacInstrPushConstant,       // constant index
+  kPacInstrPushUndefined,
+  kPacInstrPushNull,
+  kPacInstrPushTrue,
+  kPacInstrPushFalse,
+  kPacInstrLoadLocal,          // slot
+  kPacInstrStoreLocal,         // slot; pops the value
+  kPacInstrLoadGlobal,         // slot
+  kPacInstrStoreGlobal,        // slot; pops the value
+  kPacInstrPop,
+  kPacInstrDup,
+  kPacInstrAdd,
+  kPacInstrSub,
+  kPacInstrMul,
+  kPacInstrDiv,
+  kPacInstrMod,
+  kPacInstrNeg,
+  kPacInstrToNumber,
+  kPacInstrNot,
+  kPacInstrTypeof,
+  kPacInstrEq,
+  kPacInstrNe,
+  kPacInstrStrictEq,
+  kPacInstrStrictNe,
+  kPacInstrLt,
+  kPacInstrLe,
+  kPacInstrGt,
+  kPacInstrGe,
+  kPacInstrJump,               // target
+  kPacInstrJumpIfFalse,        // target; pops the condition
+  kPacInstrJumpIfFalseOrPop,   // target; keeps a falsy value for '&&'
+  kPacInstrJumpIfTrueOrPop,    // target; keeps a truthy value for '||'
+  kPacInstrCall,               // function, argument count
+  kPacInstrCallBuiltin,        // builtin, argument count
+  kPacInstrCallMethod,         // method, argument count; the receiver is below
+                               // the arguments
+  kPacInstrGetLength,
+  kPacInstrGetIndex,
+  kPacInstrMakeArray,          // element count
+  kPacInstrMakeObject,         // property count; pops names and values,
+                               // pushed in turn
+  kPacInstrReturn,
+  kPacInstrDecide,             // table, miss target; pops the host. A hit
+                               // pushes the result and goes on to the
+                               // kPacInstrReturn that follows, a miss jumps
+                               // to the target, and a value the table
+                               // cannot decide on skips the return so that
+                               // the rules run one by one.
+};
+
+// How many operands follow opcode in the code.
+int PacOperandCount(int opcode);
+
+struct PacValue {
+  enum Type {
+    kUndefined,
+    kNull,
+    kBoolean,
+    kNumber,
+    kString,
+    kArray,
+    kObject,
+  };
+
+  PacValue() : type(kUndefined), number(0), array(-1) {}
+  explicit PacValue(bool value)
+      : type(kBoolean), number(value ? 1 : 0), array(-1) {}
+  explicit PacValue(double value) : type(kNumber), number(value), array(-1) {}
+  explicit PacValue(const std::string& value)
+      : type(kString), number(0), string(value), array(-1) {}
+
+  Type type;
+  double number;       // Also holds booleans.
+  std::string string;
+  int array;           // Index into the arrays or objects of the VM.
+};
+
+struct PacFunction {
+  PacFunction() : num_params(0), num_locals(0), entry(0) {}
+
+  std::string name;
+  int num_params;
+  int num_locals;  // Parameters included.
+  int entry;       // Offset of the first instruction.
+};
+
+struct PacProgram {
+  // The top level code of the script is functions[0].
+  std::vector<PacFunction> functions;
+  std::vector<int> code;
+  std::vector<PacValue> constants;
+  std::vector<std::string> globals;
+  std::vector<PacDecisionTable> tables;
+
+  int FindFunction(const std::string& name) const;
+};
+
+// Functions provided by PAC implementations, in addition to the ones
+// written in the script. Returns -1 if name is none of them.
+int FindPacBuiltin(const std::string& name);
+const char* PacBuiltinName(int builtin);
+
+// String and array methods; -1 if not supported.
+int FindPacMethod(const std::string& name);
+
+// What the PAC helpers need from the outside world.
+class PacHost {
+ public:
+  virtual ~PacHost() {}
+
+  // Resolves host to a numeric address; false if it does not resolve.
+  virtual bool ResolveHost(const std::string& host, std::string* address) = 0;
+  virtual std::string MyIpAddress() = 0;
+};
+
+// Runs a program. The top level code is run once by Initialize and the
+// globals it sets up are kept for all later calls. Strings are handled as
+// bytes, which is exact for the ASCII host names and URLs PAC scripts
+// work on. Not thread-safe.
+class PacVm {
+ public:
+  PacVm(const PacProgram* program, PacHost* host);
+
+  bool Initialize(std::string* error);
+  bool Call(int function, const std::vector<PacValue>& args,
+            PacValue* result, std::string* error);
+
+  std::string ToString(const PacValue& value) const;
+
+ private:
+  struct Frame {
+    int function;
+    int return_pc;
+    size_t base;  // Stack index of the first local.
+  };
+
+  bool Run(std::string* error);
+  bool CallBuiltin(int builtin, PacValue* args, int argc, PacValue* result,
+                   std::string* error);
+  bool CallMethod(int method, PacValue* receiver, PacValue* args, int argc,
+                  PacValue* result, std::string* error);
+  bool LooseEquals(const PacValue& a, const PacValue& b) const;
+  bool Add(const PacValue& a, const PacValue& b, PacValue* result,
+           std::string* error);
+  int Compare(const PacValue& a, const PacValue& b) const;
+  int NewArray();
+  // Counts bytes a call creates; fails once it made too many.
+  bool Allocate(size_t bytes, std::string* error);
+  // Also fails for a string longer than any script needs.
+  bool AllocateString(size_t length, std::string* error);
+  bool Charge(const PacValue& value, std::string* error);
+  bool IsReference(const PacValue& value) const {
+    return value.type == PacValue::kArray || value.type == PacValue::kObject;
+  }
+
+  const PacProgram* program_;
+  PacHost* host_;
+  std::vector<PacValue> stack_;
+  std::vector<PacValue> globals_;
+  std::vector<Frame> frames_;
+  // Arrays and objects are never shared between scripts and are small,
+  // so they are simply kept until the VM goes away; the ones created
+  // during a call are dropped after it unless a global may still refer to
+  // them. Objects are maps, so that a generated script can look a host
+  // up in a table of thousands without a chain of comparisons.
+  std::vector<std::vector<PacValue> > arrays_;
+  std::vector<std::map<std::string, PacValue> > objects_;
+  bool array_escaped_;
+  size_t allocated_;  // By the running Initialize or Call.
+};
+
+#endif  // __PAC_VM_H__
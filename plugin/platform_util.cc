@@ -0,0 +1,236 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "platform_util.h"
+
+#if !defined(_WINDOWS)
+#include <errno.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#if defined(__APPLE__)
+#include <mach/mach_time.h>
+#endif
+
+#if defined(_WINDOWS)
+
+Mutex::Mutex() {
+  InitializeCriticalSection(&cs_);
+}
+
+Mutex::~Mutex() {
+  DeleteCriticalSection(&cs_);
+}
+
+void Mutex::Lock() {
+  EnterCriticalSection(&cs_);
+}
+
+void Mutex::Unlock() {
+  LeaveCriticalSection(&cs_);
+}
+
+WaitableEvent::WaitableEvent(bool manual_reset) {
+  event_ = CreateEvent(NULL, manual_reset ? TRUE : FALSE, FALSE, NULL);
+}
+
+WaitableEvent::~WaitableEvent() {
+  CloseHandle(event_);
+}
+
+void WaitableEvent::Signal() {
+  SetEvent(event_);
+}
+
+void WaitableEvent::Reset() {
+  ResetEvent(event_);
+}
+
+bool WaitableEvent::Wait(int timeout_ms) {
+  DWORD timeout = timeout_ms < 0 ? INFINITE : (DWORD)timeout_ms;
+  return WaitForSingleObject(event_, timeout) == WAIT_OBJECT_0;
+}
+
+Thread::Thread() : handle_(NULL), func_(NULL), arg_(NULL), started_(false) {
+}
+
+Thread::~Thread() {
+  Join();
+}
+
+DWORD WINAPI Thread::ThreadProc(LPVOID param) {
+  Thread* thread = (Thread*)param;
+  thread->func_(thread->arg_);
+  return 0;
+}
+
+bool Thread::Start(ThreadFunc func, void* arg) {
+  if (started_) {
+    return false;
+  }
+  func_ = func;
+  arg_ = arg;
+  handle_ = CreateThread(NULL, 0, ThreadProc, this, 0, NULL);
+  started_ = handle_ != NULL;
+  return started_;
+}
+
+void Thread::Join() {
+  if (!started_) {
+    return;
+  }
+  WaitForSingleObject(handle_, INFINITE);
+  CloseHandle(handle_);
+  handle_ = NULL;
+  started_ = false;
+}
+
+int64_t NowNanos() {
+  static LARGE_INTEGER frequency = {0};
+  if (frequency.QuadPart == 0) {
+    QueryPerformanceFrequency(&frequency);
+  }
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return (int64_t)(counter.QuadPart * 1000000000.0 / frequency.QuadPart);
+}
+
+void SleepMillis(int ms) {
+  Sleep(ms);
+}
+
+#else  // !_WINDOWS
+
+Mutex::Mutex() {
+  pthread_mutex_init(&mutex_, NULL);
+}
+
+Mutex::~Mutex() {
+  pthread_mutex_destroy(&mutex_);
+}
+
+void Mutex::Lock() {
+  pthread_mutex_lock(&mutex_);
+}
+
+void Mutex::Unlock() {
+  pthread_mutex_unlock(&mutex_);
+}
+
+WaitableEvent::WaitableEvent(bool manual_reset)
+    : manual_reset_(manual_reset), signaled_(false) {
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&cond_, NULL);
+}
+
+WaitableEvent::~WaitableEvent() {
+  pthread_cond_destroy(&cond_);
+  pthread_mutex_destroy(&mutex_);
+}
+
+void WaitableEvent::Signal() {
+  pthread_mutex_lock(&mutex_);
+  signaled_ = true;
+  pthread_cond_broadcast(&cond_);
+  pthread_mutex_unlock(&mutex_);
+}
+
+void WaitableEvent::Reset() {
+  pthread_mutex_lock(&mutex_);
+  signaled_ = false;
+  pthread_mutex_unlock(&mutex_);
+}
+
+bool WaitableEvent::Wait(int timeout_ms) {
+  pthread_mutex_lock(&mutex_);
+  if (timeout_ms < 0) {
+    while (!signaled_) {
+      pthread_cond_wait(&cond_, &mutex_);
+    }
+  } else {
+    // pthread_cond_timedwait takes an absolute wall clock deadline.
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    struct timespec deadline;
+    int64_t nsec = now.tv_usec * 1000LL + (timeout_ms % 1000) * 1000000LL;
+    deadline.tv_sec = now.tv_sec + timeout_ms / 1000 + nsec / 1000000000LL;
+    deadline.tv_nsec = nsec % 1000000000LL;
+    while (!signaled_) {
+      if (pthread_cond_timedwait(&cond_, &mutex_, &deadline) == ETIMEDOUT) {
+        break;
+      }
+    }
+  }
+  bool signaled = signaled_;
+  if (signaled && !manual_reset_) {
+    signaled_ = false;
+  }
+  pthread_mutex_unlock(&mutex_);
+  return signaled;
+}
+
+Thread::Thread() : func_(NULL), arg_(NULL), started_(false) {
+}
+
+Thread::~Thread() {
+  Join();
+}
+
+void* Thread::ThreadProc(void* param) {
+  Thread* thread = (Thread*)param;
+  thread->func_(thread->arg_);
+  return NULL;
+}
+
+bool Thread::Start(ThreadFunc func, void* arg) {
+  if (started_) {
+    return false;
+  }
+  func_ = func;
+  arg_ = arg;
+  started_ = pthread_create(&handle_, NULL, ThreadProc, this) == 0;
+  return started_;
+}
+
+void Thread::Join() {
+  if (!started_) {
+    return;
+  }
+  pthread_join(handle_, NULL);
+  started_ = false;
+}
+
+int64_t NowNanos() {
+#if defined(__APPLE__)
+  // clock_gettime is not available on the Mac versions we support.
+  static mach_timebase_info_data_t timebase = {0, 0};
+  if (timebase.denom == 0) {
+    mach_timebase_info(&timebase);
+  }
+  return (int64_t)(mach_absolute_time() * timebase.numer / timebase.denom);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+void SleepMillis(int ms) {
+  usleep(ms * 1000);
+}
+
+#endif  // _WINDOWS
@@ -0,0 +1,128 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Thin wrappers over the threading and clock primitives of the platforms
+// the plugin runs on, so that the portable code does not need #ifdefs.
+
+#ifndef __PLATFORM_UTIL_H__
+#define __PLATFORM_UTIL_H__
+
+#if defined(_WINDOWS)
+// winsock2.h must come before windows.h, otherwise windows.h drags in the
+// old winsock.h and the two conflict. FD_SETSIZE must match net_util.h.
+#ifndef FD_SETSIZE
+#define FD_SETSIZE 1024
+#endif
+#include <winsock2.h>
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "nptypes.h"
+
+#if defined(_WINDOWS) && !defined(snprintf)
+#define snprintf _snprintf
+#endif
+#if defined(_WINDOWS) && !defined(strtoull)
+#define strtoull _strtoui64
+#endif
+
+class Mutex {
+ public:
+  Mutex();
+  ~Mutex();
+  void Lock();
+  void Unlock();
+
+ private:
+#if defined(_WINDOWS)
+  CRITICAL_SECTION cs_;
+#else
+  pthread_mutex_t mutex_;
+#endif
+  Mutex(const Mutex&);
+  void operator=(const Mutex&);
+};
+
+class ScopedLock {
+ public:
+  explicit ScopedLock(Mutex* mutex) : mutex_(mutex) { mutex_->Lock(); }
+  ~ScopedLock() { mutex_->Unlock(); }
+
+ private:
+  Mutex* mutex_;
+  ScopedLock(const ScopedLock&);
+  void operator=(const ScopedLock&);
+};
+
+// An event that worker threads can sleep on and be woken up from.
+// An auto-reset event goes back to non-signaled when a waiter wakes up.
+class WaitableEvent {
+ public:
+  explicit WaitableEvent(bool manual_reset);
+  ~WaitableEvent();
+  void Signal();
+  void Reset();
+  // Returns true if the event was signaled, false on timeout.
+  // A negative timeout_ms waits forever.
+  bool Wait(int timeout_ms);
+
+ private:
+#if defined(_WINDOWS)
+  HANDLE event_;
+#else
+  pthread_mutex_t mutex_;
+  pthread_cond_t cond_;
+  bool manual_reset_;
+  bool signaled_;
+#endif
+  WaitableEvent(const WaitableEvent&);
+  void operator=(const WaitableEvent&);
+};
+
+typedef void (*ThreadFunc)(void* arg);
+
+class Thread {
+ public:
+  Thread();
+  ~Thread();
+  bool Start(ThreadFunc func, void* arg);
+  void Join();
+  bool IsStarted() const { return started_; }
+
+ private:
+#if defined(_WINDOWS)
+  static DWORD WINAPI ThreadProc(LPVOID param);
+  HANDLE handle_;
+#else
+  static void* ThreadProc(void* param);
+  pthread_t handle_;
+#endif
+  ThreadFunc func_;
+  void* arg_;
+  bool started_;
+  Thread(const Thread&);
+  void operator=(const Thread&);
+};
+
+// Monotonic clock, not affected by wall clock adjustments.
+int64_t NowNanos();
+inline int64_t NowMicros() { return NowNanos() / 1000; }
+inline int64_t NowMillis() { return NowNanos() / 1000000; }
+
+void SleepMillis(int ms);
+
+#endif  // __PLATFORM_UTIL_H__
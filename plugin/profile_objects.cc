@@ -0,0 +1,216 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "profile_objects.h"
+
+#include <string.h>
+
+#include <string>
+
+#include "np_util.h"
+#include "npswitchproxy.h"
+#include "profile_store.h"
+
+namespace {
+
+const char* kLengthProperty = "length";
+const char* kIdProperty = "id";
+const char* kProxyProperty = "proxy";
+const char* kNotesProperty = "notes";
+
+struct ProfileListObj : NPObject {
+  NPP npp;
+  ProfileStoreRef* store;
+};
+
+struct ProfileObj : NPObject {
+  ProfileStoreRef* store;
+  uint32_t id;
+};
+
+// The name of a string identifier, or empty for an index.
+std::string IdentifierName(NPIdentifier identifier) {
+  if (!npnfuncs->identifierisstring(identifier)) {
+    return std::string();
+  }
+  std::string name;
+  NPUTF8* utf8 = npnfuncs->utf8fromidentifier(identifier);
+  if (utf8) {
+    name = utf8;
+    npnfuncs->memfree(utf8);
+  }
+  return name;
+}
+
+NPObject* AllocateProfileList(NPP npp, NPClass*) {
+  ProfileListObj* obj = new ProfileListObj;
+  obj->npp = npp;
+  obj->store = NULL;
+  return obj;
+}
+
+NPObject* AllocateProfile(NPP, NPClass*) {
+  ProfileObj* obj = new ProfileObj;
+  obj->store = NULL;
+  obj->id = 0;
+  return obj;
+}
+
+void DeallocateProfileList(NPObject* obj) {
+  ProfileListObj* list = (ProfileListObj*)obj;
+  if (list->store) {
+    list->store->Release();
+  }
+  delete list;
+}
+
+void DeallocateProfile(NPObject* obj) {
+  ProfileObj* profile = (ProfileObj*)obj;
+  if (profile->store) {
+    profile->store->Release();
+  }
+  delete profile;
+}
+
+bool HasNoMethod(NPObject*, NPIdentifier) {
+  return false;
+}
+
+bool HasProfileListProperty(NPObject* obj, NPIdentifier name) {
+  ProfileListObj* list = (ProfileListObj*)obj;
+  if (npnfuncs->identifierisstring(name)) {
+    return IdentifierName(name) == kLengthProperty;
+  }
+  ProfileStore* store = list->store->store();
+  int32_t index = npnfuncs->intfromidentifier(name);
+  return store && index >= 0 && (size_t)index < store->Count();
+}
+
+bool HasProfileProperty(NPObject* obj, NPIdentifier name) {
+  std::string property = IdentifierName(name);
+  return property == kIdProperty || property == kProxyProperty ||
+      property == kNotesProperty;
+}
+
+bool GetProfileProperty(NPObject* obj, NPIdentifier name,
+                        NPVariant* result) {
+  ProfileObj* profile = (ProfileObj*)obj;
+  ProfileStore* store = profile->store->store();
+  std::string property = IdentifierName(name);
+  std::string value;
+  VOID_TO_NPVARIANT(*result);
+  if (property == kIdProperty) {
+    INT32_TO_NPVARIANT((int32_t)profile->id, *result);
+  } else if (property == kProxyProperty) {
+    if (store &&
+        store->GetField(profile->id, ProfileStore::kProxyField, &value)) {
+      StringToNPVariant(value, result);
+    }
+  } else if (property == kNotesProperty) {
+    if (store &&
+        store->GetField(profile->id, ProfileStore::kNotesField, &value)) {
+      StringToNPVariant(value, result);
+    }
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool EnumerateProfile(NPObject* obj, NPIdentifier** identifiers,
+                      uint32_t* count) {
+  const NPUTF8* names[] = { kIdProperty, kProxyProperty, kNotesProperty };
+  *count = sizeof(names) / sizeof(names[0]);
+  *identifiers =
+      (NPIdentifier*)npnfuncs->memalloc(*count * sizeof(NPIdentifier));
+  if (!*identifiers) {
+    return false;
+  }
+  npnfuncs->getstringidentifiers(names, *count, *identifiers);
+  return true;
+}
+
+NPClass profile_class = {
+  NP_CLASS_STRUCT_VERSION,
+  AllocateProfile,
+  DeallocateProfile,
+  NULL,
+  HasNoMethod,
+  NULL,
+  NULL,
+  HasProfileProperty,
+  GetProfileProperty,
+  NULL,
+  NULL,
+  EnumerateProfile,
+  NULL,
+};
+
+bool GetProfileListProperty(NPObject* obj, NPIdentifier name,
+                            NPVariant* result) {
+  ProfileListObj* list = (ProfileListObj*)obj;
+  ProfileStore* store = list->store->store();
+  if (npnfuncs->identifierisstring(name)) {
+    if (IdentifierName(name) != kLengthProperty) {
+      return false;
+    }
+    INT32_TO_NPVARIANT(store ? (int32_t)store->Count() : 0, *result);
+    return true;
+  }
+  VOID_TO_NPVARIANT(*result);
+  int32_t index = npnfuncs->intfromidentifier(name);
+  uint32_t id;
+  if (!store || index < 0 || !store->IdAt(index, &id)) {
+    return true;
+  }
+  ProfileObj* profile =
+      (ProfileObj*)npnfuncs->createobject(list->npp, &profile_class);
+  if (!profile) {
+    return false;
+  }
+  profile->store = list->store;
+  profile->store->AddRef();
+  profile->id = id;
+  OBJECT_TO_NPVARIANT(profile, *result);
+  return true;
+}
+
+NPClass profile_list_class = {
+  NP_CLASS_STRUCT_VERSION,
+  AllocateProfileList,
+  DeallocateProfileList,
+  NULL,
+  HasNoMethod,
+  NULL,
+  NULL,
+  HasProfileListProperty,
+  GetProfileListProperty,
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+};
+
+}  // namespace
+
+NPObject* CreateProfileListObject(NPP npp, ProfileStoreRef* store) {
+  ProfileListObj* list =
+      (ProfileListObj*)npnfuncs->createobject(npp, &profile_list_class);
+  if (list) {
+    list->store = store;
+    store->AddRef();
+  }
+  return list;
+}
@@ -0,0 +1,63 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Scriptable views over the saved profiles, so that a page can walk
+// thousands of them without the plugin building a javascript copy of each.
+
+#ifndef __PROFILE_OBJECTS_H__
+#define __PROFILE_OBJECTS_H__
+
+#include "npapi.h"
+#include "npruntime.h"
+
+class ProfileStore;
+
+// What the views reach a store through. Whoever closes the store detaches
+// it first; views that outlive the store then find no store behind it.
+// Each view holds a reference, as does the owner of the store.
+class ProfileStoreRef {
+ public:
+  explicit ProfileStoreRef(ProfileStore* store)
+      : store_(store), ref_count_(1) {}
+
+  // NULL once detached.
+  ProfileStore* store() const { return store_; }
+  void Detach() { store_ = NULL; }
+
+  void AddRef() { ++ref_count_; }
+  void Release() {
+    if (--ref_count_ == 0) {
+      delete this;
+    }
+  }
+
+ private:
+  ~ProfileStoreRef() {}
+
+  ProfileStore* store_;
+  int ref_count_;
+};
+
+// Creates plugin.profiles: a live array-like object with a length and an
+// element per index, in list order. An element is created when it is
+// read and is itself a view that reads id, proxy and notes from the store
+// on each access, so rendering the visible rows of a long list touches
+// only those rows. Once a profile is deleted, its proxy and notes read as
+// undefined. Once the store is detached, the list is empty and the
+// elements read before read as deleted profiles do. The object takes a
+// reference to store. The caller owns the returned reference.
+NPObject* CreateProfileListObject(NPP npp, ProfileStoreRef* store);
+
+#endif  // __PROFILE_OBJECTS_H__
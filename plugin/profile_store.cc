@@ -0,0 +1,606 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "profile_store.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "hash_util.h"
+#include "npswitchproxy.h"
+#include "proxy_server_list.h"
+#include "stats.h"
+
+// How long a change may sit in memory before it is synced to disk.
+static const int kProfileStoreSyncMs = 1000;
+// Logs smaller than this are never compacted.
+static const size_t kMinCompactBytes = 64 * 1024;
+// A log is compacted once it is this many times its live size.
+static const size_t kCompactRatio = 4;
+// Buckets of an empty fingerprint index.
+static const size_t kMinIndexBuckets = 16;
+
+static const char kLogMagic[4] = {'S', 'P', 'P', 'L'};
+static const uint32_t kLogVersion = 1;
+static const size_t kHeaderSize = 8;
+// Payload size and checksum.
+static const size_t kRecordHeaderSize = 8;
+// Larger records can only come from a corrupt log.
+static const uint32_t kMaxRecordSize = 1024 * 1024;
+
+namespace {
+
+enum RecordType {
+  kAddRecord = 1,
+  kSetFieldRecord = 2,
+  kDeleteRecord = 3,
+  kClearRecord = 4,
+};
+
+// Records are little endian on every platform, so that a profile
+// directory may be copied between machines.
+void PutUint32(uint32_t value, std::string* out) {
+  for (int i = 0; i < 4; ++i) {
+    *out += (char)((value >> (8 * i)) & 0xff);
+  }
+}
+
+void PutInt64(int64_t value, std::string* out) {
+  for (int i = 0; i < 8; ++i) {
+    *out += (char)(((uint64_t)value >> (8 * i)) & 0xff);
+  }
+}
+
+void PutString(const std::string& value, std::string* out) {
+  PutUint32((uint32_t)value.size(), out);
+  *out += value;
+}
+
+std::string AddPayload(const Profile& profile) {
+  std::string payload;
+  payload += (char)kAddRecord;
+  PutUint32(profile.id, &payload);
+  PutInt64(profile.position, &payload);
+  PutString(profile.proxy, &payload);
+  PutString(profile.notes, &payload);
+  return payload;
+}
+
+uint32_t Checksum(const char* data, size_t size) {
+  return (uint32_t)Fnv1a64(data, size);
+}
+
+void AppendRecordTo(const std::string& payload, std::string* log) {
+  PutUint32((uint32_t)payload.size(), log);
+  PutUint32(Checksum(payload.data(), payload.size()), log);
+  *log += payload;
+}
+
+// Reads fields off a record; every read fails once the record is used up.
+class RecordReader {
+ public:
+  RecordReader(const char* data, size_t size)
+      : data_((const unsigned char*)data), size_(size) {}
+
+  bool ReadByte(int* value) {
+    if (size_ < 1) {
+      return false;
+    }
+    *value = data_[0];
+    Skip(1);
+    return true;
+  }
+
+  bool ReadUint32(uint32_t* value) {
+    if (size_ < 4) {
+      return false;
+    }
+    *value = 0;
+    for (int i = 0; i < 4; ++i) {
+      *value |= (uint32_t)data_[i] << (8 * i);
+    }
+    Skip(4);
+    return true;
+  }
+
+  bool ReadInt64(int64_t* value) {
+    if (size_ < 8) {
+      return false;
+    }
+    uint64_t result = 0;
+    for (int i = 0; i < 8; ++i) {
+      result |= (uint64_t)data_[i] << (8 * i);
+    }
+    *value = (int64_t)result;
+    Skip(8);
+    return true;
+  }
+
+  bool ReadString(std::string* value) {
+    uint32_t len;
+    if (!ReadUint32(&len) || size_ < len) {
+      return false;
+    }
+    value->assign((const char*)data_, len);
+    Skip(len);
+    return true;
+  }
+
+ private:
+  void Skip(size_t len) {
+    data_ += len;
+    size_ -= len;
+  }
+
+  const unsigned char* data_;
+  size_t size_;
+};
+
+bool ComparePosition(const Profile& a, const Profile& b) {
+  return a.position < b.position ||
+      (a.position == b.position && a.id < b.id);
+}
+
+std::string LogHeader() {
+  std::string header(kLogMagic, sizeof(kLogMagic));
+  PutUint32(kLogVersion, &header);
+  return header;
+}
+
+}  // namespace
+
+FingerprintIndex::FingerprintIndex()
+    : buckets_(kMinIndexBuckets), size_(0) {
+}
+
+size_t FingerprintIndex::BucketOf(uint64_t fingerprint) const {
+  return (size_t)(Mix64(fingerprint) & (buckets_.size() - 1));
+}
+
+void FingerprintIndex::Insert(uint64_t fingerprint, uint32_t id) {
+  if (size_ >= buckets_.size()) {
+    Grow();
+  }
+  Entry entry = {fingerprint, id};
+  buckets_[BucketOf(fingerprint)].push_back(entry);
+  ++size_;
+}
+
+void FingerprintIndex::Remove(uint64_t fingerprint, uint32_t id) {
+  std::vector<Entry>& bucket = buckets_[BucketOf(fingerprint)];
+  for (size_t i = 0; i < bucket.size(); ++i) {
+    if (bucket[i].fingerprint == fingerprint && bucket[i].id == id) {
+      bucket[i] = bucket.back();
+      bucket.pop_back();
+      --size_;
+      return;
+    }
+  }
+}
+
+void FingerprintIndex::Clear() {
+  std::vector<std::vector<Entry> >(kMinIndexBuckets).swap(buckets_);
+  size_ = 0;
+}
+
+void FingerprintIndex::Find(uint64_t fingerprint,
+                            std::vector<uint32_t>* ids) const {
+  const std::vector<Entry>& bucket = buckets_[BucketOf(fingerprint)];
+  for (size_t i = 0; i < bucket.size(); ++i) {
+    if (bucket[i].fingerprint == fingerprint) {
+      ids->push_back(bucket[i].id);
+    }
+  }
+}
+
+void FingerprintIndex::Grow() {
+  std::vector<std::vector<Entry> > old_buckets(buckets_.size() * 2);
+  old_buckets.swap(buckets_);
+  for (size_t i = 0; i < old_buckets.size(); ++i) {
+    for (size_t j = 0; j < old_buckets[i].size(); ++j) {
+      buckets_[BucketOf(old_buckets[i][j].fingerprint)].push_back(
+          old_buckets[i][j]);
+    }
+  }
+}
+
+ProfileStore::ProfileStore()
+    : wake_event_(false), stop_(false), order_valid_(false), next_id_(1),
+      first_position_(0), dirty_(false) {
+}
+
+ProfileStore::~ProfileStore() {
+  Close();
+}
+
+bool ProfileStore::Open(const std::string& path) {
+  Close();
+  ScopedLock lock(&lock_);
+  if (!owner_lock_.TryLock(path + ".lock")) {
+    DebugLog("ProfileStore: %s is in use by another process\n",
+             path.c_str());
+    return false;
+  }
+  path_ = path;
+  profiles_.clear();
+  order_valid_ = false;
+  fingerprints_.Clear();
+  next_id_ = 1;
+  first_position_ = 0;
+  pending_.clear();
+  size_t size = 0;
+  size_t valid_size = 0;
+  {
+    MappedFile mapped;
+    if (mapped.Open(path)) {
+      size = mapped.size();
+      if (!Replay(mapped.data(), size, &valid_size)) {
+        return false;
+      }
+    }
+  }
+  if (size == 0) {
+    pending_ = LogHeader();
+  }
+  if (valid_size < size) {
+    // Appending after a torn record would make everything after it
+    // unreadable, so start over from what was read.
+    DebugLog("ProfileStore: dropped %d bytes of %s\n",
+             (int)(size - valid_size), path.c_str());
+    if (!CompactLocked()) {
+      return false;
+    }
+  } else if (!file_.Open(path) || !SyncLocked()) {
+    return false;
+  }
+  stop_ = false;
+  return thread_.Start(ThreadMain, this);
+}
+
+void ProfileStore::Close() {
+  if (thread_.IsStarted()) {
+    {
+      ScopedLock lock(&lock_);
+      stop_ = true;
+    }
+    wake_event_.Signal();
+    thread_.Join();
+  }
+  ScopedLock lock(&lock_);
+  SyncLocked();
+  file_.Close();
+  owner_lock_.Unlock();
+}
+
+bool ProfileStore::Replay(const char* data, size_t size,
+                          size_t* valid_size) {
+  *valid_size = 0;
+  if (size == 0) {
+    return true;
+  }
+  uint32_t version;
+  if (size < kHeaderSize || memcmp(data, kLogMagic, sizeof(kLogMagic)) ||
+      !RecordReader(data + 4, 4).ReadUint32(&version) ||
+      version != kLogVersion) {
+    DebugLog("ProfileStore: %s is not a profile log\n", path_.c_str());
+    return false;
+  }
+  size_t offset = kHeaderSize;
+  while (offset + kRecordHeaderSize <= size) {
+    uint32_t payload_size;
+    uint32_t checksum;
+    RecordReader record_header(data + offset, kRecordHeaderSize);
+    record_header.ReadUint32(&payload_size);
+    record_header.ReadUint32(&checksum);
+    const char* payload = data + offset + kRecordHeaderSize;
+    if (payload_size > kMaxRecordSize ||
+        payload_size > size - offset - kRecordHeaderSize ||
+        Checksum(payload, payload_size) != checksum) {
+      break;
+    }
+    RecordReader reader(payload, payload_size);
+    int type;
+    uint32_t id;
+    if (!reader.ReadByte(&type) || !reader.ReadUint32(&id)) {
+      break;
+    }
+    if (type == kAddRecord) {
+      Profile profile;
+      profile.id = id;
+      if (!reader.ReadInt64(&profile.position) ||
+          !reader.ReadString(&profile.proxy) ||
+          !reader.ReadString(&profile.notes)) {
+        break;
+      }
+      std::map<uint32_t, Profile>::iterator it = profiles_.find(id);
+      if (it != profiles_.end()) {
+        fingerprints_.Remove(ProxyDescriptionFingerprint(it->second.proxy),
+                             id);
+      }
+      profiles_[id] = profile;
+      fingerprints_.Insert(ProxyDescriptionFingerprint(profile.proxy), id);
+      first_position_ = std::min(first_position_, profile.position);
+    } else if (type == kSetFieldRecord) {
+      int field;
+      std::string value;
+      if (!reader.ReadByte(&field) || !reader.ReadString(&value)) {
+        break;
+      }
+      std::map<uint32_t, Profile>::iterator it = profiles_.find(id);
+      if (it != profiles_.end() && field == kProxyField) {
+        fingerprints_.Remove(ProxyDescriptionFingerprint(it->second.proxy),
+                             id);
+        it->second.proxy = value;
+        fingerprints_.Insert(ProxyDescriptionFingerprint(value), id);
+      } else if (it != profiles_.end()) {
+        it->second.notes = value;
+      }
+    } else if (type == kDeleteRecord) {
+      std::map<uint32_t, Profile>::iterator it = profiles_.find(id);
+      if (it != profiles_.end()) {
+        fingerprints_.Remove(ProxyDescriptionFingerprint(it->second.proxy),
+                             id);
+        profiles_.erase(it);
+      }
+    } else if (type == kClearRecord) {
+      profiles_.clear();
+      fingerprints_.Clear();
+    } else {
+      break;
+    }
+    next_id_ = std::max(next_id_, id + 1);
+    offset += kRecordHeaderSize + payload_size;
+  }
+  *valid_size = offset;
+  return true;
+}
+
+void ProfileStore::List(std::vector<Profile>* profiles) {
+  ScopedLock lock(&lock_);
+  profiles->clear();
+  profiles->reserve(profiles_.size());
+  for (std::map<uint32_t, Profile>::const_iterator it = profiles_.begin();
+       it != profiles_.end(); ++it) {
+    profiles->push_back(it->second);
+  }
+  std::sort(profiles->begin(), profiles->end(), ComparePosition);
+}
+
+bool ProfileStore::Get(uint32_t id, Profile* profile) {
+  ScopedLock lock(&lock_);
+  std::map<uint32_t, Profile>::const_iterator it = profiles_.find(id);
+  if (it == profiles_.end()) {
+    return false;
+  }
+  *profile = it->second;
+  return true;
+}
+
+size_t ProfileStore::Count() {
+  ScopedLock lock(&lock_);
+  return profiles_.size();
+}
+
+bool ProfileStore::IdAt(size_t index, uint32_t* id) {
+  ScopedLock lock(&lock_);
+  if (index >= profiles_.size()) {
+    return false;
+  }
+  if (!order_valid_) {
+    SortOrderLocked();
+  }
+  *id = order_[index];
+  return true;
+}
+
+bool ProfileStore::GetField(uint32_t id, Field field, std::string* value) {
+  ScopedLock lock(&lock_);
+  std::map<uint32_t, Profile>::const_iterator it = profiles_.find(id);
+  if (it == profiles_.end()) {
+    return false;
+  }
+  *value = field == kProxyField ? it->second.proxy : it->second.notes;
+  return true;
+}
+
+bool ProfileStore::FindByProxy(const std::string& description,
+                               uint32_t* id) {
+  std::string canonical = CanonicalProxyDescription(description);
+  std::vector<uint32_t> ids;
+  ScopedLock lock(&lock_);
+  fingerprints_.Find(Fnv1a64(canonical.data(), canonical.size()), &ids);
+  const Profile* first = NULL;
+  for (size_t i = 0; i < ids.size(); ++i) {
+    std::map<uint32_t, Profile>::const_iterator it = profiles_.find(ids[i]);
+    if (it == profiles_.end() ||
+        (first && !ComparePosition(it->second, *first))) {
+      continue;
+    }
+    // Two descriptions may share a fingerprint without being equivalent.
+    if (CanonicalProxyDescription(it->second.proxy) == canonical) {
+      first = &it->second;
+    }
+  }
+  if (!first) {
+    return false;
+  }
+  *id = first->id;
+  return true;
+}
+
+uint32_t ProfileStore::Add(const std::string& proxy,
+                           const std::string& notes) {
+  ScopedLock lock(&lock_);
+  Profile profile;
+  profile.id = next_id_++;
+  profile.position = --first_position_;
+  profile.proxy = proxy;
+  profile.notes = notes;
+  profiles_[profile.id] = profile;
+  order_valid_ = false;
+  fingerprints_.Insert(ProxyDescriptionFingerprint(proxy), profile.id);
+  AppendRecord(AddPayload(profile));
+  return profile.id;
+}
+
+bool ProfileStore::SetField(uint32_t id, Field field,
+                            const std::string& value) {
+  ScopedLock lock(&lock_);
+  std::map<uint32_t, Profile>::iterator it = profiles_.find(id);
+  if (it == profiles_.end()) {
+    return false;
+  }
+  std::string& current =
+      field == kProxyField ? it->second.proxy : it->second.notes;
+  if (current == value) {
+    return true;
+  }
+  if (field == kProxyField) {
+    fingerprints_.Remove(ProxyDescriptionFingerprint(current), id);
+    fingerprints_.Insert(ProxyDescriptionFingerprint(value), id);
+  }
+  current = value;
+  std::string payload;
+  payload += (char)kSetFieldRecord;
+  PutUint32(id, &payload);
+  payload += (char)field;
+  PutString(value, &payload);
+  AppendRecord(payload);
+  return true;
+}
+
+bool ProfileStore::Delete(uint32_t id) {
+  ScopedLock lock(&lock_);
+  std::map<uint32_t, Profile>::iterator it = profiles_.find(id);
+  if (it == profiles_.end()) {
+    return false;
+  }
+  fingerprints_.Remove(ProxyDescriptionFingerprint(it->second.proxy), id);
+  profiles_.erase(it);
+  order_valid_ = false;
+  std::string payload;
+  payload += (char)kDeleteRecord;
+  PutUint32(id, &payload);
+  AppendRecord(payload);
+  return true;
+}
+
+void ProfileStore::Clear() {
+  ScopedLock lock(&lock_);
+  profiles_.clear();
+  order_valid_ = false;
+  fingerprints_.Clear();
+  std::string payload;
+  payload += (char)kClearRecord;
+  PutUint32(0, &payload);
+  AppendRecord(payload);
+}
+
+void ProfileStore::SortOrderLocked() {
+  std::vector<std::pair<int64_t, uint32_t> > positions;
+  positions.reserve(profiles_.size());
+  for (std::map<uint32_t, Profile>::const_iterator it = profiles_.begin();
+       it != profiles_.end(); ++it) {
+    positions.push_back(std::make_pair(it->second.position, it->first));
+  }
+  // Same order as ComparePosition.
+  std::sort(positions.begin(), positions.end());
+  order_.resize(positions.size());
+  for (size_t i = 0; i < positions.size(); ++i) {
+    order_[i] = positions[i].second;
+  }
+  order_valid_ = true;
+}
+
+bool ProfileStore::Sync() {
+  ScopedLock lock(&lock_);
+  return SyncLocked();
+}
+
+void ProfileStore::AppendRecord(const std::string& payload) {
+  AppendRecordTo(payload, &pending_);
+}
+
+bool ProfileStore::SyncLocked() {
+  if (!pending_.empty()) {
+    if (!file_.Append(pending_)) {
+      return false;
+    }
+    pending_.clear();
+    dirty_ = true;
+  }
+  if (!dirty_) {
+    return true;
+  }
+  if (!file_.Sync()) {
+    return false;
+  }
+  dirty_ = false;
+  stats::Set("profileStoreBytes", (int64_t)file_.size());
+  return true;
+}
+
+size_t ProfileStore::LiveBytesLocked() const {
+  size_t size = kHeaderSize;
+  for (std::map<uint32_t, Profile>::const_iterator it = profiles_.begin();
+       it != profiles_.end(); ++it) {
+    // Type, id, position and two string lengths.
+    size += kRecordHeaderSize + 21 + it->second.proxy.size() +
+        it->second.notes.size();
+  }
+  return size;
+}
+
+bool ProfileStore::CompactLocked() {
+  std::string log = LogHeader();
+  for (std::map<uint32_t, Profile>::const_iterator it = profiles_.begin();
+       it != profiles_.end(); ++it) {
+    AppendRecordTo(AddPayload(it->second), &log);
+  }
+  // Records not written yet are covered by the snapshot.
+  pending_.clear();
+  file_.Close();
+  if (!WriteFileAtomically(path_, log) || !file_.Open(path_)) {
+    return false;
+  }
+  dirty_ = true;
+  stats::Add("profileStoreCompactions", 1);
+  return SyncLocked();
+}
+
+// static
+void ProfileStore::ThreadMain(void* arg) {
+  ((ProfileStore*)arg)->Run();
+}
+
+void ProfileStore::Run() {
+  while (true) {
+    wake_event_.Wait(kProfileStoreSyncMs);
+    ScopedLock lock(&lock_);
+    if (stop_) {
+      break;
+    }
+    if (!SyncLocked()) {
+      DebugLog("ProfileStore: cannot sync %s\n", path_.c_str());
+    }
+    if (file_.size() > kMinCompactBytes &&
+        file_.size() > kCompactRatio * LiveBytesLocked() &&
+        !CompactLocked()) {
+      DebugLog("ProfileStore: cannot compact %s\n", path_.c_str());
+    }
+  }
+}
@@ -0,0 +1,146 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#ifndef __PROFILE_STORE_H__
+#define __PROFILE_STORE_H__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "file_util.h"
+#include "nptypes.h"
+#include "platform_util.h"
+
+// A saved proxy profile, as listed in the popup.
+struct Profile {
+  Profile() : id(0), position(0) {}
+
+  uint32_t id;
+  int64_t position;  // Profiles are listed by increasing position.
+  std::string proxy;
+  std::string notes;
+};
+
+// Maps proxy description fingerprints to the ids of the profiles that
+// have them. A hash table with chaining, sized to the number of entries,
+// so that a lookup costs the same however many profiles there are.
+class FingerprintIndex {
+ public:
+  FingerprintIndex();
+
+  void Insert(uint64_t fingerprint, uint32_t id);
+  void Remove(uint64_t fingerprint, uint32_t id);
+  void Clear();
+  // Appends the ids with fingerprint to ids.
+  void Find(uint64_t fingerprint, std::vector<uint32_t>* ids) const;
+
+ private:
+  struct Entry {
+    uint64_t fingerprint;
+    uint32_t id;
+  };
+
+  size_t BucketOf(uint64_t fingerprint) const;
+  void Grow();
+
+  std::vector<std::vector<Entry> > buckets_;
+  size_t size_;
+};
+
+// Keeps the saved profiles in an append-only log, so that changing one
+// field of one profile writes a few bytes rather than the whole list. The
+// log is read through a memory mapping when the store is opened and
+// replayed into an in-memory index that answers all reads. Appends are
+// buffered and a background thread syncs them to disk every
+// kProfileStoreSyncMs, and rewrites the log with only the live profiles
+// once it is mostly superseded records. A torn record at the end, left by
+// a crash, is dropped. The log belongs to one process, since ids are
+// handed out from memory and a compaction replaces the file: Open fails
+// while another process has it open. All methods are thread-safe.
+class ProfileStore {
+ public:
+  enum Field {
+    kProxyField,
+    kNotesField,
+  };
+
+  ProfileStore();
+  ~ProfileStore();
+
+  // Opens the log at path, creating it if needed, and starts the
+  // background thread. Locks path + ".lock" while it is open.
+  bool Open(const std::string& path);
+  // Syncs what is left, stops the background thread and unlocks.
+  void Close();
+
+  // All profiles in list order.
+  void List(std::vector<Profile>* profiles);
+  bool Get(uint32_t id, Profile* profile);
+  // The number of profiles and the id of the one at index in list order,
+  // for walking the list without copying it.
+  size_t Count();
+  bool IdAt(size_t index, uint32_t* id);
+  // Reads one field of one profile.
+  bool GetField(uint32_t id, Field field, std::string* value);
+  // The first profile in list order whose proxy description is
+  // equivalent to description, as told by CanonicalProxyDescription. The
+  // fingerprint index narrows the search down to a few candidates.
+  bool FindByProxy(const std::string& description, uint32_t* id);
+  // Adds a profile in front of all others and returns its id.
+  uint32_t Add(const std::string& proxy, const std::string& notes);
+  bool SetField(uint32_t id, Field field, const std::string& value);
+  bool Delete(uint32_t id);
+  void Clear();
+
+  // Writes and syncs the buffered records now.
+  bool Sync();
+
+ private:
+  static void ThreadMain(void* arg);
+  void Run();
+  bool Replay(const char* data, size_t size, size_t* valid_size);
+  void AppendRecord(const std::string& payload);
+  bool SyncLocked();
+  // The size the log would have after a compaction.
+  size_t LiveBytesLocked() const;
+  // Rewrites the log with one record per live profile.
+  bool CompactLocked();
+  void SortOrderLocked();
+
+  std::string path_;
+  FileLock owner_lock_;
+  Thread thread_;
+  WaitableEvent wake_event_;
+
+  Mutex lock_;  // Guards everything below.
+  bool stop_;
+  AppendOnlyFile file_;
+  std::map<uint32_t, Profile> profiles_;
+  FingerprintIndex fingerprints_;  // Of profiles_[id].proxy.
+  // The ids of profiles_ in list order, sorted again on the first IdAt
+  // after profiles were added or deleted.
+  std::vector<uint32_t> order_;
+  bool order_valid_;
+  uint32_t next_id_;
+  int64_t first_position_;
+  std::string pending_;  // Records not written to file_ yet.
+  bool dirty_;  // Records were written since the last sync.
+
+  ProfileStore(const ProfileStore&);
+  void operator=(const ProfileStore&);
+};
+
+#endif  // __PROFILE_STORE_H__
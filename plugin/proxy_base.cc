@@ -0,0 +1,99 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "proxy_base.h"
+
+#include "platform_util.h"
+
+namespace {
+
+// The connections of one ApplyPayloadToConnections call. Each thread takes
+// the next name not taken yet until none are left, so that one slow
+// connection does not hold up the others queued behind it.
+struct BulkApply {
+  ProxyBase* backend;
+  const ProxyPayload* payload;
+  const std::vector<std::string>* names;
+  std::vector<bool>* results;
+  Mutex lock;  // Guards next.
+  size_t next;
+};
+
+void ApplyNext(void* arg) {
+  BulkApply* apply = (BulkApply*)arg;
+  while (true) {
+    size_t index;
+    {
+      ScopedLock lock(&apply->lock);
+      if (apply->next == apply->names->size()) {
+        return;
+      }
+      index = apply->next++;
+    }
+    // vector<bool> packs its entries into shared words.
+    bool ok = apply->backend->ApplyPayloadToConnection(
+        *apply->payload, (*apply->names)[index]);
+    ScopedLock lock(&apply->lock);
+    (*apply->results)[index] = ok;
+  }
+}
+
+}  // namespace
+
+bool ProxyBase::UpdateProxyConfig(const ProxyConfig& config, int fields) {
+  if ((fields & kAllProxyConfigFields) == kAllProxyConfigFields) {
+    return SetProxyConfig(config);
+  }
+  ProxyConfig current;
+  if (!GetProxyConfig(&current)) {
+    return false;
+  }
+  current.CopyFields(config, fields);
+  return SetProxyConfig(current);
+}
+
+bool ProxyBase::ApplyPayloadToConnections(
+    const ProxyPayload& payload, const std::vector<std::string>& names,
+    int max_threads, std::vector<bool>* results) {
+  results->assign(names.size(), false);
+  BulkApply apply;
+  apply.backend = this;
+  apply.payload = &payload;
+  apply.names = &names;
+  apply.results = results;
+  apply.next = 0;
+  int num_threads = names.size() < (size_t)max_threads ?
+      (int)names.size() : max_threads;
+  std::vector<Thread*> threads;
+  for (int i = 1; i < num_threads; ++i) {
+    Thread* thread = new Thread;
+    if (!thread->Start(ApplyNext, &apply)) {
+      delete thread;
+      break;
+    }
+    threads.push_back(thread);
+  }
+  ApplyNext(&apply);
+  for (size_t i = 0; i < threads.size(); ++i) {
+    threads[i]->Join();
+    delete threads[i];
+  }
+  for (size_t i = 0; i < results->size(); ++i) {
+    if (!(*results)[i]) {
+      return false;
+    }
+  }
+  return true;
+}
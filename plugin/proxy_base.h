@@ -7,14 +7,58 @@
 //
 #ifndef __PROXY_BASE_H__
 #define __PROXY_BASE_H__
+#include <string>
+#include <vector>
+
 #include "proxy_config.h"
 
+// A proxy setting already converted into the form the platform applies,
+// so that switching to it does no parsing or string conversion.
+class ProxyPayload {
+ public:
+  virtual ~ProxyPayload() {}
+};
+
 class ProxyBase {
  public:
-  virtual bool PlatformDependentStartup() { return TRUE; }
+  virtual ~ProxyBase() {}
+  virtual bool PlatformDependentStartup() { return true; }
   virtual void PlatformDependentShutdown() {}
   virtual bool GetActiveConnectionName(const void** connection_name) = 0;
   virtual bool GetProxyConfig(ProxyConfig* config) = 0;
-  virtual bool SetProxyConfig(const ProxyConfig& config) = 0; 
+  virtual bool SetProxyConfig(const ProxyConfig& config) {
+    ProxyPayload* payload = CompilePayload(config);
+    bool ok = payload && ApplyPayload(*payload);
+    delete payload;
+    return ok;
+  }
+  // Sets only the fields of config in fields, a mask of ProxyConfigField,
+  // and leaves the others as they are. This default reads the setting and
+  // writes all of it back; backends that can write single fields do
+  // neither for the fields not in the mask.
+  virtual bool UpdateProxyConfig(const ProxyConfig& config, int fields);
+
+  // Converts config for ApplyPayload, which may be called any number of
+  // times with it. Returns NULL if config cannot be applied. The caller
+  // owns the result, which only this backend can apply.
+  virtual ProxyPayload* CompilePayload(const ProxyConfig& config) = 0;
+  virtual bool ApplyPayload(const ProxyPayload& payload) = 0;
+
+  // The names, in UTF-8, of all connections a setting can be applied to,
+  // active or not, e.g. the network services on the Mac or "LAN" and the
+  // dial-up and VPN entries on Windows.
+  virtual bool EnumerateConnections(std::vector<std::string>* names) = 0;
+  // Like ApplyPayload, for the connection named as EnumerateConnections
+  // does. May be called from several threads at once.
+  virtual bool ApplyPayloadToConnection(const ProxyPayload& payload,
+                                        const std::string& name) = 0;
+
+  // Applies payload to all of names at once, on up to max_threads threads
+  // including the calling one, and sets (*results)[i] to whether names[i]
+  // succeeded. Returns true if all did.
+  bool ApplyPayloadToConnections(const ProxyPayload& payload,
+                                 const std::vector<std::string>& names,
+                                 int max_threads,
+                                 std::vector<bool>* results);
 };
 #endif //__PROXY_BASE_H__
\ No newline at end of file
@@ -16,6 +16,10 @@
 
 #include "proxy_config.h"
 
+#include <string.h>
+
+#include <algorithm>
+
 #include "npswitchproxy.h"
 
 const char* kAutoDetectProperty = "autoDetect";
@@ -39,6 +43,74 @@ inline bool SafeStrCmp(const char* src, const char* target) {
   return strncmp(src, target, kMaxPropertyNameLen) == 0;
 }
 
+// NULL reads as undefined and "" as an empty string, so they differ.
+static bool SameString(const char* a, const char* b) {
+  return a == b || (a && b && strcmp(a, b) == 0);
+}
+
+bool ProxyConfig::Equals(const ProxyConfig& other) const {
+  return auto_detect == other.auto_detect &&
+      auto_config == other.auto_config &&
+      use_proxy == other.use_proxy &&
+      SameString(auto_config_url, other.auto_config_url) &&
+      SameString(proxy_server, other.proxy_server) &&
+      SameString(bypass_list, other.bypass_list);
+}
+
+void ProxyConfig::CopyFields(const ProxyConfig& other, int mask) {
+  ProxyConfig& from = const_cast<ProxyConfig&>(other);
+  for (int field = 1; field & kAllProxyConfigFields; field <<= 1) {
+    if (!(mask & field)) {
+      continue;
+    }
+    if (BoolField(field)) {
+      *BoolField(field) = *from.BoolField(field);
+    } else {
+      char** value = StringField(field);
+      const char* from_value = *from.StringField(field);
+      delete [] *value;
+      *value = NULL;
+      if (from_value) {
+        *value = new char[strlen(from_value) + 1];
+        strcpy(*value, from_value);
+      }
+    }
+  }
+}
+
+bool* ProxyConfig::BoolField(int field) {
+  switch (field) {
+    case kAutoDetectField:
+      return &auto_detect;
+    case kAutoConfigField:
+      return &auto_config;
+    case kUseProxyField:
+      return &use_proxy;
+  }
+  return NULL;
+}
+
+char** ProxyConfig::StringField(int field) {
+  switch (field) {
+    case kAutoConfigUrlField:
+      return &auto_config_url;
+    case kProxyServerField:
+      return &proxy_server;
+    case kBypassListField:
+      return &bypass_list;
+  }
+  return NULL;
+}
+
+void ProxyConfig::Swap(ProxyConfig* other) {
+  std::swap(auto_detect, other->auto_detect);
+  std::swap(auto_config, other->auto_config);
+  std::swap(use_proxy, other->use_proxy);
+  std::swap(auto_config_url, other->auto_config_url);
+  std::swap(proxy_server, other->proxy_server);
+  std::swap(bypass_list, other->bypass_list);
+}
+
 static NPObject* Allocate(NPP instance, NPClass* npclass) {
   return (NPObject*) new ProxyConfigObj;
 }
@@ -20,6 +20,26 @@
 #include "npfunctions.h"
 #include "npruntime.h"
 
+// The names of the fields in javascript, as getProxyConfig returns them
+// and setProxyConfig takes them.
+extern const char* kAutoDetectProperty;
+extern const char* kAutoConfigProperty;
+extern const char* kUseProxyProperty;
+extern const char* kAutoConfigUrlProperty;
+extern const char* kProxyServerProperty;
+extern const char* kBypassListProperty;
+
+// Masks of ProxyConfig fields, for changing only some of them.
+enum ProxyConfigField {
+  kAutoDetectField = 1 << 0,
+  kAutoConfigField = 1 << 1,
+  kUseProxyField = 1 << 2,
+  kAutoConfigUrlField = 1 << 3,
+  kProxyServerField = 1 << 4,
+  kBypassListField = 1 << 5,
+  kAllProxyConfigFields = (1 << 6) - 1,
+};
+
 struct ProxyConfig {
   ProxyConfig() {
     auto_detect = false;
@@ -31,11 +51,19 @@ struct ProxyConfig {
   }
 
   ~ProxyConfig() {
-    delete auto_config_url;
-    delete proxy_server;
-    delete bypass_list;
+    delete [] auto_config_url;
+    delete [] proxy_server;
+    delete [] bypass_list;
   }
 
+  bool Equals(const ProxyConfig& other) const;
+  void Swap(ProxyConfig* other);
+  // Copies the fields in mask from other.
+  void CopyFields(const ProxyConfig& other, int mask);
+  // The member of a single field; NULL if the field is of the other type.
+  bool* BoolField(int field);
+  char** StringField(int field);
+
   bool auto_detect;
   bool auto_config;
   bool use_proxy;
@@ -44,6 +72,8 @@ struct ProxyConfig {
   char* bypass_list;
 };
 
+// Read-only once created: javascript cannot set its properties, so one
+// object may be handed out for as long as the setting does not change.
 struct ProxyConfigObj : NPObject {
   ProxyConfig config;
 };
@@ -0,0 +1,437 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "proxy_prober.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include "dns_resolver.h"
+#include "net_util.h"
+#include "npswitchproxy.h"
+#include "proxy_server_list.h"
+
+static const int kDefaultProbeIntervalMs = 15000;
+static const int kDefaultProbeTimeoutMs = 3000;
+static const double kDefaultEwmaAlpha = 0.3;
+// Keeps a round within what a single fd_set can hold.
+static const size_t kMaxConcurrentProbes = 256;
+static const size_t kMaxResponseLength = 512;
+// How often a round asks the resolver about names it is still looking up.
+static const int kResolvePollMs = 10;
+
+namespace {
+
+enum ProbeState {
+  kProbeResolving,
+  kProbeConnecting,
+  kProbeHandshaking,
+  kProbeDone,
+};
+
+struct Probe {
+  SocketHandle socket;
+  ProbeState state;
+  bool success;
+  int64_t start_us;
+  int64_t end_us;
+  std::string response;
+};
+
+bool IsAlive(const ProxyHealth& health) {
+  return health.latency_ms >= 0 && health.success_rate >= 0.5;
+}
+
+bool BetterHealth(const ProxyHealth& a, const ProxyHealth& b) {
+  bool a_alive = IsAlive(a);
+  bool b_alive = IsAlive(b);
+  if (a_alive != b_alive) {
+    return a_alive;
+  }
+  if (a.latency_ms != b.latency_ms) {
+    // Unknown latency sorts last.
+    if (a.latency_ms < 0 || b.latency_ms < 0) {
+      return a.latency_ms >= 0;
+    }
+    return a.latency_ms < b.latency_ms;
+  }
+  return a.success_rate > b.success_rate;
+}
+
+void FinishProbe(Probe* probe, bool success) {
+  probe->state = kProbeDone;
+  probe->success = success;
+  probe->end_us = NowMicros();
+  if (probe->socket != INVALID_SOCKET) {
+    CloseSocket(probe->socket);
+  }
+  probe->socket = INVALID_SOCKET;
+}
+
+// Starts connecting probe to addr. Returns false if the probe is over.
+bool StartConnect(Probe* probe, const struct sockaddr_storage& addr,
+                  socklen_t addr_len) {
+  probe->socket = CreateNonBlockingSocket(addr.ss_family);
+  if (probe->socket == INVALID_SOCKET) {
+    return false;
+  }
+  // select() could not watch it, as with many files open.
+  if (!FitsInFdSet(probe->socket)) {
+    FinishProbe(probe, false);
+    return false;
+  }
+  probe->start_us = NowMicros();
+  if (ConnectNonBlocking(probe->socket, (const struct sockaddr*)&addr,
+                         addr_len) == kConnectFailed) {
+    FinishProbe(probe, false);
+    return false;
+  }
+  // Completion, even of an immediate connect, is seen through select.
+  probe->state = kProbeConnecting;
+  return true;
+}
+
+}  // namespace
+
+ProxyProber::Options::Options()
+    : interval_ms(kDefaultProbeIntervalMs),
+      timeout_ms(kDefaultProbeTimeoutMs),
+      connect_handshake(false),
+      handshake_target("www.google.com:443"),
+      alpha(kDefaultEwmaAlpha),
+      resolver(NULL) {
+}
+
+ProxyProber::ProxyProber() : wake_event_(false), stop_(false) {
+}
+
+ProxyProber::ProxyProber(const Options& options)
+    : options_(options), wake_event_(false), stop_(false) {
+}
+
+ProxyProber::~ProxyProber() {
+  Stop();
+}
+
+bool ProxyProber::Start() {
+  if (thread_.IsStarted()) {
+    return true;
+  }
+  {
+    ScopedLock lock(&lock_);
+    stop_ = false;
+  }
+  return thread_.Start(ThreadMain, this);
+}
+
+void ProxyProber::Stop() {
+  if (!thread_.IsStarted()) {
+    return;
+  }
+  {
+    ScopedLock lock(&lock_);
+    stop_ = true;
+  }
+  wake_event_.Signal();
+  thread_.Join();
+}
+
+// static
+void ProxyProber::ThreadMain(void* arg) {
+  ((ProxyProber*)arg)->Run();
+}
+
+void ProxyProber::Run() {
+  while (true) {
+    {
+      ScopedLock lock(&lock_);
+      if (stop_) {
+        break;
+      }
+    }
+    RunProbeRound();
+    wake_event_.Wait(options_.interval_ms);
+  }
+}
+
+void ProxyProber::SetTargets(const std::vector<std::string>& proxies) {
+  std::vector<Target> targets;
+  std::map<EndpointKey, EndpointStats> stats;
+  for (size_t i = 0; i < proxies.size(); ++i) {
+    Target target;
+    target.proxy = proxies[i];
+    std::vector<ProxyServer> servers;
+    ParseProxyServerList(proxies[i].c_str(), &servers);
+    for (size_t j = 0; j < servers.size(); ++j) {
+      EndpointKey key;
+      key.host = servers[j].host;
+      key.port = servers[j].port;
+      bool seen = false;
+      for (size_t k = 0; k < target.endpoints.size(); ++k) {
+        if (target.endpoints[k].host == key.host &&
+            target.endpoints[k].port == key.port) {
+          seen = true;
+          break;
+        }
+      }
+      if (!seen) {
+        target.endpoints.push_back(key);
+      }
+      stats[key] = EndpointStats();
+    }
+    targets.push_back(target);
+  }
+  {
+    ScopedLock lock(&lock_);
+    for (std::map<EndpointKey, EndpointStats>::iterator it = stats.begin();
+         it != stats.end(); ++it) {
+      std::map<EndpointKey, EndpointStats>::const_iterator old =
+          stats_.find(it->first);
+      if (old != stats_.end()) {
+        it->second = old->second;
+      }
+    }
+    targets_.swap(targets);
+    stats_.swap(stats);
+  }
+  wake_event_.Signal();
+}
+
+void ProxyProber::RecordSample(const EndpointKey& key, bool success,
+                               double latency_ms) {
+  ScopedLock lock(&lock_);
+  std::map<EndpointKey, EndpointStats>::iterator it = stats_.find(key);
+  if (it == stats_.end()) {
+    // The targets were replaced while probing.
+    return;
+  }
+  EndpointStats& stats = it->second;
+  double alpha = options_.alpha;
+  if (stats.probes == 0) {
+    stats.success_rate = success ? 1 : 0;
+  } else {
+    stats.success_rate = alpha * (success ? 1 : 0) +
+                         (1 - alpha) * stats.success_rate;
+  }
+  if (success) {
+    if (stats.latency_ms < 0) {
+      stats.latency_ms = latency_ms;
+    } else {
+      stats.latency_ms = alpha * latency_ms + (1 - alpha) * stats.latency_ms;
+    }
+  }
+  ++stats.probes;
+}
+
+void ProxyProber::RunProbeRound() {
+  std::vector<EndpointKey> endpoints;
+  {
+    ScopedLock lock(&lock_);
+    for (std::map<EndpointKey, EndpointStats>::const_iterator it =
+             stats_.begin(); it != stats_.end(); ++it) {
+      endpoints.push_back(it->first);
+    }
+  }
+  std::string handshake;
+  if (options_.connect_handshake) {
+    handshake = "CONNECT " + options_.handshake_target + " HTTP/1.1\r\n" +
+                "Host: " + options_.handshake_target + "\r\n\r\n";
+  }
+
+  for (size_t batch = 0; batch < endpoints.size();
+       batch += kMaxConcurrentProbes) {
+    size_t count = std::min(kMaxConcurrentProbes, endpoints.size() - batch);
+    std::vector<Probe> probes(count);
+    size_t pending = 0;
+    // Looking up the names counts against the timeout too.
+    int64_t deadline = NowMicros() + options_.timeout_ms * 1000LL;
+    for (size_t i = 0; i < count; ++i) {
+      const EndpointKey& key = endpoints[batch + i];
+      Probe& probe = probes[i];
+      probe.socket = INVALID_SOCKET;
+      probe.state = kProbeDone;
+      probe.success = false;
+      probe.start_us = probe.end_us = 0;
+      // The resolver knows IPv4 only; an IPv6 literal never blocks.
+      if (options_.resolver && key.host.find(':') == std::string::npos) {
+        probe.state = kProbeResolving;
+        ++pending;
+        continue;
+      }
+      struct sockaddr_storage addr;
+      socklen_t addr_len;
+      if (NowMicros() < deadline &&
+          ResolveHostPort(key.host.c_str(), key.port, &addr, &addr_len) &&
+          StartConnect(&probe, addr, addr_len)) {
+        ++pending;
+      }
+    }
+
+    while (pending > 0) {
+      bool resolving = false;
+      for (size_t i = 0; i < count; ++i) {
+        Probe& probe = probes[i];
+        if (probe.state != kProbeResolving) {
+          continue;
+        }
+        const EndpointKey& key = endpoints[batch + i];
+        uint32_t address;
+        DnsResolver::Result result =
+            options_.resolver->Lookup(key.host, &address);
+        if (result == DnsResolver::kPending) {
+          resolving = true;
+          continue;
+        }
+        probe.state = kProbeDone;
+        struct sockaddr_storage addr;
+        struct sockaddr_in* addr4 = (struct sockaddr_in*)&addr;
+        memset(&addr, 0, sizeof(addr));
+        addr4->sin_family = AF_INET;
+        addr4->sin_port = htons((uint16_t)key.port);
+        addr4->sin_addr.s_addr = htonl(address);
+        if (result != DnsResolver::kFound ||
+            !StartConnect(&probe, addr, sizeof(*addr4))) {
+          --pending;
+        }
+      }
+      int64_t remaining = deadline - NowMicros();
+      if (pending == 0 || remaining <= 0) {
+        break;
+      }
+      if (resolving && remaining > kResolvePollMs * 1000LL) {
+        remaining = kResolvePollMs * 1000LL;
+      }
+      fd_set read_fds, write_fds, error_fds;
+      FD_ZERO(&read_fds);
+      FD_ZERO(&write_fds);
+      FD_ZERO(&error_fds);
+      SocketHandle max_fd = 0;
+      bool watching = false;
+      for (size_t i = 0; i < count; ++i) {
+        Probe& probe = probes[i];
+        if (probe.state == kProbeDone || probe.state == kProbeResolving) {
+          continue;
+        }
+        watching = true;
+        if (probe.state == kProbeConnecting) {
+          FD_SET(probe.socket, &write_fds);
+          // Winsock reports a failed connect through the error set.
+          FD_SET(probe.socket, &error_fds);
+        } else {
+          FD_SET(probe.socket, &read_fds);
+        }
+        if (probe.socket > max_fd) {
+          max_fd = probe.socket;
+        }
+      }
+      if (!watching) {
+        // Winsock fails a select() without sockets.
+        SleepMillis((int)((remaining + 999) / 1000));
+        continue;
+      }
+      struct timeval tv;
+      tv.tv_sec = (long)(remaining / 1000000);
+      tv.tv_usec = (long)(remaining % 1000000);
+      int ready = select((int)max_fd + 1, &read_fds, &write_fds, &error_fds,
+                         &tv);
+      if (ready < 0) {
+        break;
+      }
+      for (size_t i = 0; i < count; ++i) {
+        Probe& probe = probes[i];
+        if (probe.state == kProbeConnecting) {
+          if (FD_ISSET(probe.socket, &error_fds)) {
+            FinishProbe(&probe, false);
+            --pending;
+          } else if (FD_ISSET(probe.socket, &write_fds)) {
+            if (GetSocketError(probe.socket) != 0) {
+              FinishProbe(&probe, false);
+              --pending;
+            } else if (handshake.empty()) {
+              FinishProbe(&probe, true);
+              --pending;
+            } else if (SocketSend(probe.socket, handshake.data(),
+                                  (int)handshake.size()) !=
+                       (int)handshake.size()) {
+              FinishProbe(&probe, false);
+              --pending;
+            } else {
+              probe.state = kProbeHandshaking;
+            }
+          }
+        } else if (probe.state == kProbeHandshaking &&
+                   FD_ISSET(probe.socket, &read_fds)) {
+          char buffer[256];
+          int len = SocketRecv(probe.socket, buffer, sizeof(buffer));
+          if (len <= 0) {
+            if (len < 0 && LastSocketCallWouldBlock()) {
+              continue;
+            }
+            FinishProbe(&probe, false);
+            --pending;
+            continue;
+          }
+          probe.response.append(buffer, len);
+          // Any status line proves that a live proxy answered, even a 407.
+          if (probe.response.find("\r\n") != std::string::npos ||
+              probe.response.size() >= kMaxResponseLength) {
+            FinishProbe(&probe, probe.response.compare(0, 5, "HTTP/") == 0);
+            --pending;
+          }
+        }
+      }
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+      Probe& probe = probes[i];
+      if (probe.state != kProbeDone) {
+        FinishProbe(&probe, false);  // Timed out.
+      }
+      RecordSample(endpoints[batch + i], probe.success,
+                   (probe.end_us - probe.start_us) / 1000.0);
+    }
+  }
+  DebugLog("npswitchproxy: probed %d endpoints\n", (int)endpoints.size());
+}
+
+void ProxyProber::GetHealth(std::vector<ProxyHealth>* health) {
+  health->clear();
+  ScopedLock lock(&lock_);
+  for (size_t i = 0; i < targets_.size(); ++i) {
+    const Target& target = targets_[i];
+    ProxyHealth result;
+    result.proxy = target.proxy;
+    bool latency_known = true;
+    for (size_t j = 0; j < target.endpoints.size(); ++j) {
+      const EndpointStats& stats = stats_[target.endpoints[j]];
+      if (j == 0 || stats.success_rate < result.success_rate) {
+        result.success_rate = stats.success_rate;
+      }
+      if (j == 0 || stats.probes < result.probes) {
+        result.probes = stats.probes;
+      }
+      if (stats.latency_ms < 0) {
+        latency_known = false;
+      } else if (stats.latency_ms > result.latency_ms) {
+        result.latency_ms = stats.latency_ms;
+      }
+    }
+    if (!latency_known) {
+      result.latency_ms = -1;
+    }
+    health->push_back(result);
+  }
+  std::stable_sort(health->begin(), health->end(), BetterHealth);
+}
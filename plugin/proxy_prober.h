@@ -0,0 +1,114 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#ifndef __PROXY_PROBER_H__
+#define __PROXY_PROBER_H__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "platform_util.h"
+
+class DnsResolver;
+
+// Health of one saved proxy description, as exposed to the UI.
+struct ProxyHealth {
+  ProxyHealth() : latency_ms(-1), success_rate(0), probes(0) {}
+
+  std::string proxy;    // The description passed to SetTargets.
+  // Slowest endpoint EWMA; negative while any endpoint's is unknown.
+  double latency_ms;
+  double success_rate;  // Worst endpoint EWMA success rate in [0, 1].
+  int probes;           // Probe rounds that covered every endpoint.
+};
+
+// Periodically probes the endpoints of a set of proxy descriptions. Every
+// round opens non-blocking TCP connects to all endpoints at once and waits
+// for them from a single select() loop, optionally following up with a
+// CONNECT handshake. Names are looked up within the same timeout as the
+// connects. Latency and success rate are smoothed with an EWMA.
+class ProxyProber {
+ public:
+  struct Options {
+    Options();
+
+    int interval_ms;
+    int timeout_ms;
+    // If set, a "CONNECT <handshake_target> HTTP/1.1" is sent after the TCP
+    // connect and the probe succeeds on any HTTP status line.
+    bool connect_handshake;
+    std::string handshake_target;
+    // Weight of the newest sample in the EWMA.
+    double alpha;
+    // Not owned. Looks up endpoint names while the round waits for the
+    // others; NULL resolves them in place, one after the other, for as
+    // long as the timeout allows.
+    DnsResolver* resolver;
+  };
+
+  ProxyProber();
+  explicit ProxyProber(const Options& options);
+  ~ProxyProber();
+
+  bool Start();
+  void Stop();
+
+  // Replaces the probed proxy descriptions. Health of endpoints shared with
+  // the previous set is kept. Wakes up the probing thread.
+  void SetTargets(const std::vector<std::string>& proxies);
+
+  // Probes every endpoint once in the calling thread.
+  void RunProbeRound();
+
+  // Returns health per description, sorted so that the best one is first:
+  // reachable before unreachable, then by latency.
+  void GetHealth(std::vector<ProxyHealth>* health);
+
+ private:
+  struct EndpointKey {
+    std::string host;
+    int port;
+    bool operator<(const EndpointKey& other) const {
+      return port < other.port || (port == other.port && host < other.host);
+    }
+  };
+
+  struct EndpointStats {
+    EndpointStats() : latency_ms(-1), success_rate(0), probes(0) {}
+    double latency_ms;
+    double success_rate;
+    int probes;
+  };
+
+  struct Target {
+    std::string proxy;
+    std::vector<EndpointKey> endpoints;
+  };
+
+  static void ThreadMain(void* arg);
+  void Run();
+  void RecordSample(const EndpointKey& key, bool success, double latency_ms);
+
+  Options options_;
+  Thread thread_;
+  WaitableEvent wake_event_;
+  Mutex lock_;  // Guards everything below.
+  bool stop_;
+  std::vector<Target> targets_;
+  std::map<EndpointKey, EndpointStats> stats_;
+};
+
+#endif  // __PROXY_PROBER_H__
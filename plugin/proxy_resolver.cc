@@ -0,0 +1,252 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "proxy_resolver.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+
+#include "hash_util.h"
+#include "pac_script.h"
+#include "proxy_server_list.h"
+#include "stats.h"
+
+// URLs a worker takes at a time: few enough that one slow PAC lookup does
+// not hold up the others, enough that the lock is rarely contended.
+static const size_t kChunkSize = 64;
+// Below this many URLs waking the workers costs more than it saves.
+static const size_t kMinParallelUrls = 256;
+
+namespace {
+
+// The lower case scheme of url, "http" if it has none, and its port,
+// the default one of the scheme if none is given.
+void GetSchemeAndPort(const std::string& url, std::string* scheme,
+                      int* port) {
+  size_t begin = url.find("://");
+  if (begin == std::string::npos) {
+    *scheme = "http";
+    begin = 0;
+  } else {
+    scheme->resize(begin);
+    for (size_t i = 0; i < begin; ++i) {
+      (*scheme)[i] = (char)tolower((unsigned char)url[i]);
+    }
+    begin += 3;
+  }
+  if (*scheme == "https" || *scheme == "wss") {
+    *port = 443;
+  } else if (*scheme == "ftp") {
+    *port = 21;
+  } else {
+    *port = 80;
+  }
+  size_t end = url.find_first_of("/?#", begin);
+  if (end == std::string::npos) {
+    end = url.size();
+  }
+  size_t at = url.rfind('@', end);
+  if (at != std::string::npos && at >= begin) {
+    begin = at + 1;
+  }
+  size_t colon = url.find(':', begin);
+  if (begin < end && url[begin] == '[') {
+    size_t close = url.find(']', begin);
+    colon = close < end ? url.find(':', close) : std::string::npos;
+  }
+  if (colon < end && colon + 1 < end) {
+    *port = atoi(url.c_str() + colon + 1);
+  }
+}
+
+}  // namespace
+
+ProxyResolver::ProxyResolver(PacHost* host, int num_threads)
+    : host_(host), num_threads_(num_threads < 1 ? 1 : num_threads),
+      settings_(NULL), pac_hash_(0), urls_(NULL), results_(NULL),
+      stop_(false), next_url_(0), busy_workers_(0), done_event_(false) {
+  Worker* worker = new Worker;
+  worker->resolver = this;
+  workers_.push_back(worker);
+}
+
+ProxyResolver::~ProxyResolver() {
+  {
+    ScopedLock lock(&lock_);
+    stop_ = true;
+  }
+  for (size_t i = 1; i < workers_.size(); ++i) {
+    workers_[i]->wake_event.Signal();
+    workers_[i]->thread.Join();
+  }
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    delete workers_[i]->script;
+    delete workers_[i];
+  }
+}
+
+// static
+void ProxyResolver::ThreadMain(void* arg) {
+  Worker* worker = (Worker*)arg;
+  worker->resolver->Run(worker);
+}
+
+void ProxyResolver::Run(Worker* worker) {
+  while (true) {
+    worker->wake_event.Wait(-1);
+    {
+      ScopedLock lock(&lock_);
+      if (stop_) {
+        break;
+      }
+    }
+    ResolveChunks(worker);
+    bool last;
+    {
+      ScopedLock lock(&lock_);
+      last = --busy_workers_ == 0;
+    }
+    if (last) {
+      done_event_.Signal();
+    }
+  }
+}
+
+bool ProxyResolver::StartWorkers() {
+  while ((int)workers_.size() < num_threads_) {
+    Worker* worker = new Worker;
+    worker->resolver = this;
+    if (!worker->thread.Start(ThreadMain, worker)) {
+      delete worker;
+      break;
+    }
+    workers_.push_back(worker);
+  }
+  return workers_.size() > 1;
+}
+
+void ProxyResolver::Resolve(const ProxySettings& settings,
+                            const std::vector<std::string>& urls,
+                            std::vector<std::string>* results) {
+  int64_t start_us = NowMicros();
+  results->assign(urls.size(), std::string());
+  settings_ = &settings;
+  pac_hash_ = Fnv1a64(settings.pac_source.data(), settings.pac_source.size());
+  bypass_list_.Parse(settings.bypass_list.c_str());
+  // Resolved once per batch rather than once per URL.
+  scheme_results_.clear();
+  std::vector<ProxyServerGroup> groups;
+  if (settings.use_proxy &&
+      ParseProxyServerGroups(settings.proxy_server.c_str(), &groups)) {
+    for (size_t i = 0; i < groups.size(); ++i) {
+      if (scheme_results_.find(groups[i].scheme) == scheme_results_.end()) {
+        scheme_results_[groups[i].scheme] = FormatPacResult(groups[i]);
+      }
+    }
+  }
+  urls_ = &urls;
+  results_ = results;
+
+  int helpers = 0;
+  if (urls.size() >= kMinParallelUrls && num_threads_ > 1 &&
+      StartWorkers()) {
+    helpers = (int)workers_.size() - 1;
+  }
+  {
+    ScopedLock lock(&lock_);
+    next_url_ = 0;
+    busy_workers_ = helpers;
+  }
+  for (int i = 1; i <= helpers; ++i) {
+    workers_[i]->wake_event.Signal();
+  }
+  ResolveChunks(workers_[0]);
+  if (helpers) {
+    done_event_.Wait(-1);
+  }
+  settings_ = NULL;
+  urls_ = NULL;
+  results_ = NULL;
+  stats::Add("resolverBatches", 1);
+  stats::Add("resolverUrls", (int64_t)urls.size());
+  stats::Set("resolverLastBatchUs", NowMicros() - start_us);
+}
+
+void ProxyResolver::ResolveChunks(Worker* worker) {
+  bool script_loaded = false;
+  while (true) {
+    size_t begin;
+    size_t end;
+    {
+      ScopedLock lock(&lock_);
+      begin = next_url_;
+      if (begin >= urls_->size()) {
+        return;
+      }
+      end = begin + kChunkSize < urls_->size() ?
+          begin + kChunkSize : urls_->size();
+      next_url_ = end;
+    }
+    // A worker keeps its copy of the script across batches and recompiles
+    // it only when the script in use changes.
+    if (!script_loaded && !settings_->pac_source.empty()) {
+      if (!worker->script) {
+        worker->script = new PacScript(host_);
+      }
+      std::string error;
+      if (!worker->script->IsLoaded() ||
+          worker->script->script_hash() != pac_hash_) {
+        worker->script->Load(settings_->pac_source, &error);
+      }
+      script_loaded = true;
+    }
+    for (size_t i = begin; i < end; ++i) {
+      ResolveUrl(worker, (*urls_)[i], &(*results_)[i]);
+    }
+  }
+}
+
+void ProxyResolver::ResolveUrl(Worker* worker, const std::string& url,
+                               std::string* result) {
+  std::string host;
+  if (!GetHostFromUrl(url, &host)) {
+    return;
+  }
+  if (!settings_->pac_source.empty() && worker->script->IsLoaded() &&
+      worker->script->script_hash() == pac_hash_) {
+    std::string error;
+    if (!worker->script->FindProxyForURL(url, result, &error)) {
+      result->clear();
+    }
+    return;
+  }
+  if (!settings_->use_proxy) {
+    *result = "DIRECT";
+    return;
+  }
+  std::string scheme;
+  int port;
+  GetSchemeAndPort(url, &scheme, &port);
+  if (bypass_list_.Matches(host, port)) {
+    *result = "DIRECT";
+    return;
+  }
+  std::map<std::string, std::string>::const_iterator it =
+      scheme_results_.find(scheme);
+  if (it == scheme_results_.end()) {
+    it = scheme_results_.find("");
+  }
+  *result = it != scheme_results_.end() ? it->second : "DIRECT";
+}
@@ -0,0 +1,103 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#ifndef __PROXY_RESOLVER_H__
+#define __PROXY_RESOLVER_H__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "bypass_list.h"
+#include "platform_util.h"
+
+class PacHost;
+class PacScript;
+
+// What decides the proxies of a URL, copied so that worker threads never
+// look at state the main thread may change.
+struct ProxySettings {
+  ProxySettings() : use_proxy(false) {}
+
+  bool use_proxy;
+  std::string proxy_server;  // As in ProxyConfig::proxy_server.
+  std::string bypass_list;
+  // The auto-config script in use, if any. It takes precedence over
+  // proxy_server, as in WinINet.
+  std::string pac_source;
+};
+
+// Answers which proxies each of a batch of URLs goes through, in the form
+// FindProxyForURL returns them, e.g. "PROXY a:80; PROXY b:80" or
+// "DIRECT". Large batches are split over a small pool of worker threads,
+// each with its own copy of the PAC script since PacScript is not
+// thread-safe; the calling thread works on the batch too. Resolve must not
+// be called from two threads at once.
+class ProxyResolver {
+ public:
+  // host is not owned, is shared by all workers and must be thread-safe.
+  // NULL means the system resolver.
+  ProxyResolver(PacHost* host, int num_threads);
+  ~ProxyResolver();
+
+  // Fills results with one entry per URL, empty for a URL that has no
+  // host or that the script failed on.
+  void Resolve(const ProxySettings& settings,
+               const std::vector<std::string>& urls,
+               std::vector<std::string>* results);
+
+ private:
+  struct Worker {
+    Worker() : resolver(NULL), script(NULL), wake_event(false) {}
+
+    ProxyResolver* resolver;
+    PacScript* script;
+    Thread thread;
+    WaitableEvent wake_event;
+  };
+
+  static void ThreadMain(void* arg);
+  void Run(Worker* worker);
+  bool StartWorkers();
+  // Resolves chunks of the current batch until none are left.
+  void ResolveChunks(Worker* worker);
+  void ResolveUrl(Worker* worker, const std::string& url,
+                  std::string* result);
+
+  PacHost* host_;
+  int num_threads_;
+  // Worker 0 stands for the calling thread and has no thread of its own.
+  std::vector<Worker*> workers_;
+
+  // The batch being resolved. Written by Resolve before the workers are
+  // woken up and read-only until they are done.
+  const ProxySettings* settings_;
+  uint64_t pac_hash_;
+  BypassList bypass_list_;
+  std::map<std::string, std::string> scheme_results_;
+  const std::vector<std::string>* urls_;
+  std::vector<std::string>* results_;
+
+  Mutex lock_;  // Guards everything below.
+  bool stop_;
+  size_t next_url_;
+  int busy_workers_;
+  WaitableEvent done_event_;
+
+  ProxyResolver(const ProxyResolver&);
+  void operator=(const ProxyResolver&);
+};
+
+#endif  // __PROXY_RESOLVER_H__
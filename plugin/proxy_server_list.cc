@@ -0,0 +1,291 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "proxy_server_list.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "hash_util.h"
+#include "platform_util.h"
+
+static const char* kPacSuffix = ";pac=";
+static const int kMaxServerWeight = 100;
+
+static bool IsSeparator(char c) {
+  return c == ';' || isspace((unsigned char)c);
+}
+
+// Schemes of a canonical description, in order. The first three are the
+// ones a group without a scheme applies to.
+static const char* kCanonicalSchemes[] = {"http", "https", "ftp", "socks"};
+static const int kSchemesCoveredByDefault = 3;
+
+static std::string CanonicalServer(const ProxyServer& server,
+                                   bool balanced) {
+  std::string result;
+  for (size_t i = 0; i < server.host.size(); ++i) {
+    result += (char)tolower((unsigned char)server.host[i]);
+  }
+  if (result.find(':') != std::string::npos) {
+    result = "[" + result + "]";
+  }
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ":%d", server.port);
+  result += suffix;
+  if (balanced && server.weight != 1) {
+    snprintf(suffix, sizeof(suffix), "*%d", server.weight);
+    result += suffix;
+  }
+  return result;
+}
+
+static std::string CanonicalGroup(const ProxyServerGroup& group) {
+  std::vector<std::string> servers;
+  for (size_t i = 0; i < group.servers.size(); ++i) {
+    servers.push_back(CanonicalServer(group.servers[i], group.balanced));
+  }
+  if (group.balanced) {
+    std::sort(servers.begin(), servers.end());
+  }
+  std::string result;
+  for (size_t i = 0; i < servers.size(); ++i) {
+    if (i > 0) {
+      result += group.balanced ? '|' : ',';
+    }
+    result += servers[i];
+  }
+  return result;
+}
+
+int DefaultProxyPort(const std::string& scheme) {
+  return scheme == "socks" ? 1080 : 80;
+}
+
+std::string FormatPacResult(const ProxyServerGroup& group) {
+  std::string result;
+  for (size_t i = 0; i < group.servers.size(); ++i) {
+    const ProxyServer& server = group.servers[i];
+    char port[16];
+    snprintf(port, sizeof(port), ":%d", server.port);
+    if (!result.empty()) {
+      result += "; ";
+    }
+    result += group.scheme == "socks" ? "SOCKS " : "PROXY ";
+    result += server.host.find(':') != std::string::npos ?
+        "[" + server.host + "]" : server.host;
+    result += port;
+  }
+  return result;
+}
+
+bool ParseHostPort(const char* begin, const char* end, int default_port,
+                   std::string* host, int* port) {
+  while (begin < end && isspace((unsigned char)*begin)) {
+    ++begin;
+  }
+  while (end > begin && isspace((unsigned char)end[-1])) {
+    --end;
+  }
+  // WinINet accepts "http=http://host:port".
+  for (const char* p = begin; p + 3 <= end; ++p) {
+    if (p[0] == ':' && p[1] == '/' && p[2] == '/') {
+      begin = p + 3;
+      break;
+    }
+    if (!isalpha((unsigned char)*p)) {
+      break;
+    }
+  }
+  const char* host_end = end;
+  const char* port_begin = NULL;
+  if (begin < end && *begin == '[') {
+    const char* close = (const char*)memchr(begin, ']', end - begin);
+    if (!close) {
+      return false;
+    }
+    host->assign(begin + 1, close - begin - 1);
+    if (close + 1 < end && close[1] == ':') {
+      port_begin = close + 2;
+    }
+  } else {
+    const char* colon = (const char*)memchr(begin, ':', end - begin);
+    if (colon) {
+      host_end = colon;
+      port_begin = colon + 1;
+    }
+    host->assign(begin, host_end - begin);
+  }
+  if (host->empty()) {
+    return false;
+  }
+  *port = default_port;
+  if (port_begin) {
+    int value = 0;
+    const char* p = port_begin;
+    for (; p < end && isdigit((unsigned char)*p); ++p) {
+      value = value * 10 + (*p - '0');
+      if (value > 65535) {
+        return false;
+      }
+    }
+    // Tolerate a trailing '/' as in "http://host:80/".
+    if (p == port_begin || (p < end && *p != '/') || value == 0) {
+      return false;
+    }
+    *port = value;
+  }
+  return true;
+}
+
+bool ParseProxyServerGroups(const char* description,
+                            std::vector<ProxyServerGroup>* groups) {
+  groups->clear();
+  if (!description) {
+    return false;
+  }
+  const char* end = strstr(description, kPacSuffix);
+  if (!end) {
+    end = description + strlen(description);
+  }
+  const char* ptr = description;
+  while (ptr < end) {
+    while (ptr < end && IsSeparator(*ptr)) {
+      ++ptr;
+    }
+    const char* entry_end = ptr;
+    while (entry_end < end && !IsSeparator(*entry_end)) {
+      ++entry_end;
+    }
+    if (entry_end == ptr) {
+      break;
+    }
+    ProxyServerGroup group;
+    const char* value = ptr;
+    const char* equal = (const char*)memchr(ptr, '=', entry_end - ptr);
+    if (equal) {
+      for (const char* p = ptr; p < equal; ++p) {
+        group.scheme += (char)tolower((unsigned char)*p);
+      }
+      value = equal + 1;
+    }
+    group.balanced = memchr(value, '|', entry_end - value) != NULL;
+    while (value < entry_end) {
+      const char* server_end = value;
+      while (server_end < entry_end && *server_end != ',' &&
+             *server_end != '|') {
+        ++server_end;
+      }
+      ProxyServer server;
+      server.scheme = group.scheme;
+      const char* host_end = server_end;
+      const char* star = (const char*)memchr(value, '*', server_end - value);
+      if (star) {
+        host_end = star;
+        server.weight = atoi(std::string(star + 1, server_end).c_str());
+      }
+      if (server.weight > 0 && server.weight <= kMaxServerWeight &&
+          ParseHostPort(value, host_end, DefaultProxyPort(group.scheme),
+                        &server.host, &server.port)) {
+        group.servers.push_back(server);
+      }
+      value = server_end + 1;
+    }
+    if (!group.servers.empty()) {
+      groups->push_back(group);
+    }
+    ptr = entry_end;
+  }
+  return !groups->empty();
+}
+
+bool ParseProxyServerList(const char* description,
+                          std::vector<ProxyServer>* servers) {
+  servers->clear();
+  std::vector<ProxyServerGroup> groups;
+  ParseProxyServerGroups(description, &groups);
+  for (size_t i = 0; i < groups.size(); ++i) {
+    servers->insert(servers->end(), groups[i].servers.begin(),
+                    groups[i].servers.end());
+  }
+  return !servers->empty();
+}
+
+std::string CanonicalProxyDescription(const std::string& description) {
+  std::vector<ProxyServerGroup> groups;
+  ParseProxyServerGroups(description.c_str(), &groups);
+  const ProxyServerGroup* default_group = NULL;
+  for (size_t i = 0; i < groups.size() && !default_group; ++i) {
+    if (groups[i].scheme.empty()) {
+      default_group = &groups[i];
+    }
+  }
+  std::string result;
+  std::string http_group;
+  for (int i = 0; i < (int)(sizeof(kCanonicalSchemes) /
+                            sizeof(kCanonicalSchemes[0])); ++i) {
+    const std::string scheme = kCanonicalSchemes[i];
+    const ProxyServerGroup* group = NULL;
+    // WinINet uses the first entry given for a scheme.
+    for (size_t j = 0; j < groups.size() && !group; ++j) {
+      if (groups[j].scheme == scheme) {
+        group = &groups[j];
+      }
+    }
+    if (!group && i < kSchemesCoveredByDefault) {
+      group = default_group;
+    }
+    if (!group) {
+      continue;
+    }
+    std::string canonical = CanonicalGroup(*group);
+    if (scheme == "http") {
+      http_group = canonical;
+    } else if (scheme == "ftp" && canonical == http_group) {
+      // The popup writes a server for all schemes either way.
+      continue;
+    }
+    if (!result.empty()) {
+      result += ';';
+    }
+    result += scheme + "=" + canonical;
+  }
+  size_t pac = description.find(kPacSuffix);
+  if (pac != std::string::npos) {
+    size_t begin = pac + strlen(kPacSuffix);
+    size_t end = description.find(';', begin);
+    if (end == std::string::npos) {
+      end = description.size();
+    }
+    while (begin < end && isspace((unsigned char)description[begin])) {
+      ++begin;
+    }
+    while (end > begin && isspace((unsigned char)description[end - 1])) {
+      --end;
+    }
+    result += kPacSuffix;
+    result.append(description, begin, end - begin);
+  }
+  return result;
+}
+
+uint64_t ProxyDescriptionFingerprint(const std::string& description) {
+  std::string canonical = CanonicalProxyDescription(description);
+  return Fnv1a64(canonical.data(), canonical.size());
+}
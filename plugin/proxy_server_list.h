@@ -0,0 +1,83 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#ifndef __PROXY_SERVER_LIST_H__
+#define __PROXY_SERVER_LIST_H__
+
+#include <string>
+#include <vector>
+
+#include "nptypes.h"
+
+// One entry of a proxy server description.
+struct ProxyServer {
+  ProxyServer() : port(0), weight(1) {}
+
+  std::string scheme;  // "http", "https", "ftp", "socks" or empty for all.
+  std::string host;
+  int port;
+  int weight;  // Share of a balanced group, given as "host:port*weight".
+};
+
+// Interchangeable servers for one scheme. Written either as a comma
+// separated list in order of preference, e.g. "http=a:80,b:80", or as a
+// '|' separated pool to spread the load over, e.g. "http=a:80*2|b:80|c:80".
+struct ProxyServerGroup {
+  ProxyServerGroup() : balanced(false) {}
+
+  std::string scheme;
+  std::vector<ProxyServer> servers;
+  bool balanced;
+};
+
+// Parses the WinINet style description kept in ProxyConfig::proxy_server,
+// e.g. "proxy:8080" or "http=a:80;https=b:443 socks=c:1080". Entries may be
+// separated by ';' or whitespace. A ";pac=<url>" suffix as stored by the
+// popup is skipped. Returns false if no server could be parsed.
+bool ParseProxyServerGroups(const char* description,
+                            std::vector<ProxyServerGroup>* groups);
+
+// Same as above, with all groups flattened into one list.
+bool ParseProxyServerList(const char* description,
+                          std::vector<ProxyServer>* servers);
+
+// Parses a single "host[:port]" (IPv6 literals in brackets) with an
+// optional "scheme://" prefix. Returns false on an empty host or bad port.
+bool ParseHostPort(const char* begin, const char* end, int default_port,
+                   std::string* host, int* port);
+
+// The servers of group in order of preference, as FindProxyForURL would
+// return them, e.g. "PROXY a:80; PROXY b:80". PAC has no notion of a
+// balanced pool, so a pool becomes a failover list.
+std::string FormatPacResult(const ProxyServerGroup& group);
+
+// The port WinINet assumes when a server is given without one.
+int DefaultProxyPort(const std::string& scheme);
+
+// Rewrites a description as stored by the popup into one canonical form,
+// so that equivalent descriptions compare equal: schemes in the order
+// http, https, ftp, socks, lower case hosts, explicit ports and no stray
+// separators. A group without a scheme stands for each of http, https and
+// ftp not given explicitly, as it does for WinINet, and ftp is left out
+// when it is the same as http, so "a:80" equals both
+// "http=a:80;https=a:80;ftp=a:80" and "http=a:80;https=a:80". Failover
+// order is kept; the members of a balanced pool are sorted. A
+// ";pac=<url>" suffix is kept, trimmed.
+std::string CanonicalProxyDescription(const std::string& description);
+
+// A 64-bit hash of the canonical form of description.
+uint64_t ProxyDescriptionFingerprint(const std::string& description);
+
+#endif  // __PROXY_SERVER_LIST_H__
@@ -0,0 +1,844 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "proxy_trace.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "npswitchproxy.h"
+#include "stats.h"
+#include "utf_convert.h"
+
+const char* kRecordTraceVariable = "SWITCHPROXY_RECORD_TRACE";
+const char* kReplayTraceVariable = "SWITCHPROXY_REPLAY_TRACE";
+const char* kPlayTraceVariable = "SWITCHPROXY_PLAY_TRACE";
+
+static const char kTraceMagic[4] = {'S', 'P', 'T', 'R'};
+static const int kTraceVersion = 1;
+// Larger records can only come from a corrupt trace.
+static const uint64_t kMaxTraceRecordSize = 1024 * 1024;
+// Threads a TracePlayer makes overlapping calls on; bulk applies in the
+// plugin use kBulkApplyThreads of them.
+static const size_t kTracePlayerLanes = 8;
+
+namespace {
+
+enum TraceCall {
+  kStartupCall,
+  kShutdownCall,
+  kGetActiveConnectionNameCall,
+  kGetProxyConfigCall,
+  kSetProxyConfigCall,
+  kCompilePayloadCall,
+  kApplyPayloadCall,
+  kEnumerateConnectionsCall,
+  kApplyPayloadToConnectionCall,
+  kUpdateProxyConfigCall,
+  kTraceCallCount,
+};
+
+enum ConfigFlags {
+  kAutoDetectFlag = 1 << 0,
+  kAutoConfigFlag = 1 << 1,
+  kUseProxyFlag = 1 << 2,
+  kHasAutoConfigUrlFlag = 1 << 3,
+  kHasProxyServerFlag = 1 << 4,
+  kHasBypassListFlag = 1 << 5,
+};
+
+// What CompilePayload hands out: the backend's payload, or none when
+// replaying, and the id the trace knows it by.
+class TracedPayload : public ProxyPayload {
+ public:
+  TracedPayload(ProxyPayload* payload, uint32_t id)
+      : payload(payload), id(id) {}
+  virtual ~TracedPayload() { delete payload; }
+
+  ProxyPayload* payload;
+  uint32_t id;
+};
+
+void PutVarint(uint64_t value, std::string* out) {
+  while (value >= 0x80) {
+    *out += (char)(value | 0x80);
+    value >>= 7;
+  }
+  *out += (char)value;
+}
+
+void PutString(const std::string& value, std::string* out) {
+  PutVarint(value.size(), out);
+  *out += value;
+}
+
+void PutConfig(const ProxyConfig& config, std::string* out) {
+  *out += (char)((config.auto_detect ? kAutoDetectFlag : 0) |
+                 (config.auto_config ? kAutoConfigFlag : 0) |
+                 (config.use_proxy ? kUseProxyFlag : 0) |
+                 (config.auto_config_url ? kHasAutoConfigUrlFlag : 0) |
+                 (config.proxy_server ? kHasProxyServerFlag : 0) |
+                 (config.bypass_list ? kHasBypassListFlag : 0));
+  if (config.auto_config_url) {
+    PutString(config.auto_config_url, out);
+  }
+  if (config.proxy_server) {
+    PutString(config.proxy_server, out);
+  }
+  if (config.bypass_list) {
+    PutString(config.bypass_list, out);
+  }
+}
+
+char* NewCString(const std::string& value) {
+  char* result = new char[value.size() + 1];
+  memcpy(result, value.c_str(), value.size() + 1);
+  return result;
+}
+
+// Reads fields off a record; every read fails once the record is used up.
+class TraceReader {
+ public:
+  TraceReader(const char* data, size_t size)
+      : data_((const unsigned char*)data), size_(size) {}
+
+  size_t remaining() const { return size_; }
+
+  bool ReadVarint(uint64_t* value) {
+    *value = 0;
+    for (int shift = 0; shift < 64 && size_ > 0; shift += 7) {
+      unsigned char byte = *data_++;
+      --size_;
+      *value |= (uint64_t)(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool ReadBytes(uint64_t len, std::string* value) {
+    if (size_ < len) {
+      return false;
+    }
+    value->assign((const char*)data_, (size_t)len);
+    data_ += len;
+    size_ -= (size_t)len;
+    return true;
+  }
+
+  bool ReadString(std::string* value) {
+    uint64_t len;
+    return ReadVarint(&len) && ReadBytes(len, value);
+  }
+
+  bool ReadConfig(ProxyConfig* config) {
+    if (size_ < 1) {
+      return false;
+    }
+    int flags = *data_++;
+    --size_;
+    config->auto_detect = (flags & kAutoDetectFlag) != 0;
+    config->auto_config = (flags & kAutoConfigFlag) != 0;
+    config->use_proxy = (flags & kUseProxyFlag) != 0;
+    return ReadOptionalString(flags & kHasAutoConfigUrlFlag,
+                              &config->auto_config_url) &&
+        ReadOptionalString(flags & kHasProxyServerFlag,
+                           &config->proxy_server) &&
+        ReadOptionalString(flags & kHasBypassListFlag,
+                           &config->bypass_list);
+  }
+
+ private:
+  bool ReadOptionalString(int present, char** value) {
+    std::string str;
+    if (!present) {
+      return true;
+    }
+    if (!ReadString(&str)) {
+      return false;
+    }
+    delete [] *value;
+    *value = NewCString(str);
+    return true;
+  }
+
+  const unsigned char* data_;
+  size_t size_;
+};
+
+// The leading config of fields, as PutConfig wrote it.
+std::string ConfigFields(const std::string& fields) {
+  TraceReader reader(fields.data(), fields.size());
+  ProxyConfig config;
+  if (!reader.ReadConfig(&config)) {
+    return "";
+  }
+  return fields.substr(0, fields.size() - reader.remaining());
+}
+
+bool CompareStart(const TraceRecord& a, const TraceRecord& b) {
+  return a.start_us < b.start_us;
+}
+
+void DeleteConnectionName(const void* name) {
+#if defined(_WINDOWS)
+  delete [] (const wchar_t*)name;
+#else
+  delete [] (const char*)name;
+#endif
+}
+
+}  // namespace
+
+bool IsTracing() {
+  return !GetPathFromEnvironment(kRecordTraceVariable).empty() ||
+      !GetPathFromEnvironment(kReplayTraceVariable).empty() ||
+      !GetPathFromEnvironment(kPlayTraceVariable).empty();
+}
+
+bool ReadTrace(const std::string& path, std::vector<TraceRecord>* records) {
+  records->clear();
+  MappedFile trace;
+  if (!trace.Open(path) || trace.size() < sizeof(kTraceMagic) + 1 ||
+      memcmp(trace.data(), kTraceMagic, sizeof(kTraceMagic)) ||
+      trace.data()[sizeof(kTraceMagic)] != kTraceVersion) {
+    DebugLog("ReadTrace: %s is not a trace\n", path.c_str());
+    return false;
+  }
+  size_t offset = sizeof(kTraceMagic) + 1;
+  TraceReader reader(trace.data() + offset, trace.size() - offset);
+  uint64_t size;
+  std::string record;
+  // A record cut short by a crash ends the trace.
+  while (reader.ReadVarint(&size) && size <= kMaxTraceRecordSize &&
+         reader.ReadBytes(size, &record)) {
+    TraceReader fields(record.data(), record.size());
+    uint64_t method;
+    uint64_t ok;
+    uint64_t start_us;
+    uint64_t latency_us;
+    if (!fields.ReadVarint(&method) || !fields.ReadVarint(&ok) ||
+        !fields.ReadVarint(&start_us) || !fields.ReadVarint(&latency_us)) {
+      break;
+    }
+    if (method >= kTraceCallCount) {
+      continue;  // From a newer plugin.
+    }
+    TraceRecord call;
+    call.method = (int)method;
+    call.ok = ok != 0;
+    call.start_us = (int64_t)start_us;
+    call.latency_us = (int64_t)latency_us;
+    call.fields = record.substr(record.size() - fields.remaining());
+    records->push_back(call);
+  }
+  DebugLog("ReadTrace: %d calls from %s\n", (int)records->size(),
+           path.c_str());
+  return true;
+}
+
+RecordingProxy::RecordingProxy(ProxyBase* backend)
+    : backend_(backend), trace_start_us_(NowMicros()), next_payload_id_(1) {
+}
+
+RecordingProxy::~RecordingProxy() {
+  file_.Sync();
+  delete backend_;
+}
+
+bool RecordingProxy::Open(const std::string& path) {
+  ScopedLock lock(&lock_);
+  DeleteFileAtPath(path);
+  if (!file_.Open(path)) {
+    return false;
+  }
+  std::string header(kTraceMagic, sizeof(kTraceMagic));
+  header += (char)kTraceVersion;
+  trace_start_us_ = NowMicros();
+  return file_.Append(header);
+}
+
+void RecordingProxy::Record(int method, bool ok, int64_t start_us,
+                            const std::string& fields) {
+  int64_t end_us = NowMicros();
+  std::string record;
+  record += (char)method;
+  record += (char)ok;
+  ScopedLock lock(&lock_);
+  PutVarint(start_us > trace_start_us_ ? start_us - trace_start_us_ : 0,
+            &record);
+  PutVarint(end_us - start_us, &record);
+  record += fields;
+  std::string size;
+  PutVarint(record.size(), &size);
+  file_.Append(size + record);
+}
+
+bool RecordingProxy::PlatformDependentStartup() {
+  int64_t start_us = NowMicros();
+  bool ok = backend_->PlatformDependentStartup();
+  Record(kStartupCall, ok, start_us, "");
+  return ok;
+}
+
+void RecordingProxy::PlatformDependentShutdown() {
+  int64_t start_us = NowMicros();
+  backend_->PlatformDependentShutdown();
+  Record(kShutdownCall, true, start_us, "");
+  ScopedLock lock(&lock_);
+  file_.Sync();
+}
+
+bool RecordingProxy::GetActiveConnectionName(const void** connection_name) {
+  int64_t start_us = NowMicros();
+  bool ok = backend_->GetActiveConnectionName(connection_name);
+  std::string fields;
+  if (ok) {
+    fields += (char)(*connection_name != NULL);
+    if (*connection_name) {
+#if defined(_WINDOWS)
+      PutString(WideToUtf8((const wchar_t*)*connection_name), &fields);
+#else
+      PutString((const char*)*connection_name, &fields);
+#endif
+    }
+  }
+  Record(kGetActiveConnectionNameCall, ok, start_us, fields);
+  return ok;
+}
+
+bool RecordingProxy::GetProxyConfig(ProxyConfig* config) {
+  int64_t start_us = NowMicros();
+  bool ok = backend_->GetProxyConfig(config);
+  std::string fields;
+  if (ok) {
+    PutConfig(*config, &fields);
+  }
+  Record(kGetProxyConfigCall, ok, start_us, fields);
+  return ok;
+}
+
+bool RecordingProxy::SetProxyConfig(const ProxyConfig& config) {
+  int64_t start_us = NowMicros();
+  bool ok = backend_->SetProxyConfig(config);
+  std::string fields;
+  PutConfig(config, &fields);
+  Record(kSetProxyConfigCall, ok, start_us, fields);
+  return ok;
+}
+
+bool RecordingProxy::UpdateProxyConfig(const ProxyConfig& config,
+                                       int mask) {
+  int64_t start_us = NowMicros();
+  bool ok = backend_->UpdateProxyConfig(config, mask);
+  std::string fields;
+  PutConfig(config, &fields);
+  PutVarint(mask, &fields);
+  Record(kUpdateProxyConfigCall, ok, start_us, fields);
+  return ok;
+}
+
+ProxyPayload* RecordingProxy::CompilePayload(const ProxyConfig& config) {
+  int64_t start_us = NowMicros();
+  ProxyPayload* payload = backend_->CompilePayload(config);
+  std::string fields;
+  PutConfig(config, &fields);
+  TracedPayload* traced = NULL;
+  if (payload) {
+    ScopedLock lock(&lock_);
+    traced = new TracedPayload(payload, next_payload_id_++);
+  }
+  PutVarint(traced ? traced->id : 0, &fields);
+  Record(kCompilePayloadCall, traced != NULL, start_us, fields);
+  return traced;
+}
+
+bool RecordingProxy::ApplyPayload(const ProxyPayload& payload) {
+  const TracedPayload& traced = (const TracedPayload&)payload;
+  int64_t start_us = NowMicros();
+  bool ok = backend_->ApplyPayload(*traced.payload);
+  std::string fields;
+  PutVarint(traced.id, &fields);
+  Record(kApplyPayloadCall, ok, start_us, fields);
+  return ok;
+}
+
+bool RecordingProxy::EnumerateConnections(std::vector<std::string>* names) {
+  int64_t start_us = NowMicros();
+  bool ok = backend_->EnumerateConnections(names);
+  std::string fields;
+  if (ok) {
+    PutVarint(names->size(), &fields);
+    for (size_t i = 0; i < names->size(); ++i) {
+      PutString((*names)[i], &fields);
+    }
+  }
+  Record(kEnumerateConnectionsCall, ok, start_us, fields);
+  return ok;
+}
+
+bool RecordingProxy::ApplyPayloadToConnection(const ProxyPayload& payload,
+                                              const std::string& name) {
+  const TracedPayload& traced = (const TracedPayload&)payload;
+  int64_t start_us = NowMicros();
+  bool ok = backend_->ApplyPayloadToConnection(*traced.payload, name);
+  std::string fields;
+  PutVarint(traced.id, &fields);
+  PutString(name, &fields);
+  Record(kApplyPayloadToConnectionCall, ok, start_us, fields);
+  return ok;
+}
+
+ReplayProxy::ReplayProxy()
+    : calls_(kTraceCallCount), next_(kTraceCallCount) {
+}
+
+ReplayProxy::~ReplayProxy() {
+}
+
+bool ReplayProxy::Open(const std::string& path) {
+  std::vector<TraceRecord> records;
+  if (!ReadTrace(path, &records)) {
+    return false;
+  }
+  for (size_t i = 0; i < records.size(); ++i) {
+    Call call;
+    call.ok = records[i].ok;
+    call.latency_us = records[i].latency_us;
+    call.fields = records[i].fields;
+    calls_[records[i].method].push_back(call);
+  }
+  return true;
+}
+
+bool ReplayProxy::Replay(int method, Call* call) {
+  return Replay(method, NULL, call);
+}
+
+bool ReplayProxy::Replay(int method, const std::string* connection,
+                         Call* call) {
+  {
+    ScopedLock lock(&lock_);
+    std::vector<Call>& calls = calls_[method];
+    if (calls.empty()) {
+      return false;
+    }
+    size_t index = next_[method];
+    if (connection) {
+      // Bring the connection's call forward to be the next one.
+      for (size_t i = index; i < calls.size(); ++i) {
+        TraceReader fields(calls[i].fields.data(), calls[i].fields.size());
+        uint64_t payload_id;
+        std::string name;
+        if (fields.ReadVarint(&payload_id) && fields.ReadString(&name) &&
+            name == *connection) {
+          std::swap(calls[index], calls[i]);
+          break;
+        }
+      }
+    }
+    if (index < calls.size()) {
+      ++next_[method];
+    } else {
+      index = calls.size() - 1;
+    }
+    *call = calls[index];
+  }
+  if (call->latency_us > 0) {
+    SleepMillis((int)((call->latency_us + 500) / 1000));
+  }
+  return true;
+}
+
+bool ReplayProxy::PlatformDependentStartup() {
+  Call call;
+  return !Replay(kStartupCall, &call) || call.ok;
+}
+
+void ReplayProxy::PlatformDependentShutdown() {
+  Call call;
+  Replay(kShutdownCall, &call);
+}
+
+bool ReplayProxy::GetActiveConnectionName(const void** connection_name) {
+  Call call;
+  if (!Replay(kGetActiveConnectionNameCall, &call) || !call.ok) {
+    return false;
+  }
+  TraceReader fields(call.fields.data(), call.fields.size());
+  uint64_t has_name;
+  std::string name;
+  if (!fields.ReadVarint(&has_name)) {
+    return false;
+  }
+  *connection_name = NULL;
+  if (has_name) {
+    if (!fields.ReadString(&name)) {
+      return false;
+    }
+#if defined(_WINDOWS)
+    std::wstring wide_name = Utf8ToWide(name);
+    wchar_t* result = new wchar_t[wide_name.size() + 1];
+    memcpy(result, wide_name.c_str(),
+           (wide_name.size() + 1) * sizeof(wchar_t));
+    *connection_name = result;
+#else
+    *connection_name = NewCString(name);
+#endif
+  }
+  return true;
+}
+
+bool ReplayProxy::GetProxyConfig(ProxyConfig* config) {
+  Call call;
+  if (!Replay(kGetProxyConfigCall, &call) || !call.ok) {
+    return false;
+  }
+  TraceReader fields(call.fields.data(), call.fields.size());
+  return fields.ReadConfig(config);
+}
+
+bool ReplayProxy::SetProxyConfig(const ProxyConfig& config) {
+  Call call;
+  if (!Replay(kSetProxyConfigCall, &call)) {
+    return false;
+  }
+  std::string fields;
+  PutConfig(config, &fields);
+  if (fields != call.fields) {
+    stats::Add("traceReplayMismatches", 1);
+  }
+  return call.ok;
+}
+
+bool ReplayProxy::UpdateProxyConfig(const ProxyConfig& config, int mask) {
+  Call call;
+  if (!Replay(kUpdateProxyConfigCall, &call)) {
+    return false;
+  }
+  std::string fields;
+  PutConfig(config, &fields);
+  PutVarint(mask, &fields);
+  if (fields != call.fields) {
+    stats::Add("traceReplayMismatches", 1);
+  }
+  return call.ok;
+}
+
+ProxyPayload* ReplayProxy::CompilePayload(const ProxyConfig& config) {
+  Call call;
+  if (!Replay(kCompilePayloadCall, &call) || !call.ok) {
+    return NULL;
+  }
+  std::string recorded = ConfigFields(call.fields);
+  std::string fields;
+  PutConfig(config, &fields);
+  if (fields != recorded) {
+    stats::Add("traceReplayMismatches", 1);
+  }
+  TraceReader reader(call.fields.data() + recorded.size(),
+                     call.fields.size() - recorded.size());
+  uint64_t id;
+  if (!reader.ReadVarint(&id)) {
+    return NULL;
+  }
+  return new TracedPayload(NULL, (uint32_t)id);
+}
+
+bool ReplayProxy::ApplyPayload(const ProxyPayload& payload) {
+  Call call;
+  if (!Replay(kApplyPayloadCall, &call)) {
+    return false;
+  }
+  TraceReader fields(call.fields.data(), call.fields.size());
+  uint64_t id;
+  if (!fields.ReadVarint(&id) ||
+      id != ((const TracedPayload&)payload).id) {
+    stats::Add("traceReplayMismatches", 1);
+  }
+  return call.ok;
+}
+
+bool ReplayProxy::EnumerateConnections(std::vector<std::string>* names) {
+  Call call;
+  if (!Replay(kEnumerateConnectionsCall, &call) || !call.ok) {
+    return false;
+  }
+  TraceReader fields(call.fields.data(), call.fields.size());
+  uint64_t count;
+  if (!fields.ReadVarint(&count)) {
+    return false;
+  }
+  names->clear();
+  std::string name;
+  for (uint64_t i = 0; i < count; ++i) {
+    if (!fields.ReadString(&name)) {
+      return false;
+    }
+    names->push_back(name);
+  }
+  return true;
+}
+
+// Connections are applied to on several threads, so the recorded order
+// is one of many; each call is answered with the next recorded one for
+// the same connection instead.
+bool ReplayProxy::ApplyPayloadToConnection(const ProxyPayload& payload,
+                                           const std::string& name) {
+  Call call;
+  if (!Replay(kApplyPayloadToConnectionCall, &name, &call)) {
+    return false;
+  }
+  TraceReader fields(call.fields.data(), call.fields.size());
+  uint64_t id;
+  if (!fields.ReadVarint(&id) ||
+      id != ((const TracedPayload&)payload).id) {
+    stats::Add("traceReplayMismatches", 1);
+  }
+  return call.ok;
+}
+
+struct TracePlayer::Lane {
+  Lane() : work_event(false), player(NULL), record(NULL) {}
+
+  Thread thread;
+  WaitableEvent work_event;
+  TracePlayer* player;
+  const TraceRecord* record;  // NULL while idle. Guarded by player->lock_.
+};
+
+TracePlayer::TracePlayer(ProxyBase* target)
+    : target_(target), wake_event_(false), stop_(false) {
+}
+
+TracePlayer::~TracePlayer() {
+  Stop();
+  for (std::map<uint32_t, ProxyPayload*>::iterator it = payloads_.begin();
+       it != payloads_.end(); ++it) {
+    delete it->second;
+  }
+}
+
+bool TracePlayer::Open(const std::string& path) {
+  if (!ReadTrace(path, &records_)) {
+    return false;
+  }
+  // Records are written as calls finish; play them as they started.
+  std::stable_sort(records_.begin(), records_.end(), CompareStart);
+  return true;
+}
+
+bool TracePlayer::Start() {
+  stop_ = false;
+  return thread_.Start(ThreadMain, this);
+}
+
+void TracePlayer::Stop() {
+  if (!thread_.IsStarted()) {
+    return;
+  }
+  {
+    ScopedLock lock(&lock_);
+    stop_ = true;
+  }
+  wake_event_.Signal();
+  thread_.Join();
+}
+
+// static
+void TracePlayer::ThreadMain(void* arg) {
+  ((TracePlayer*)arg)->Run();
+}
+
+// static
+void TracePlayer::LaneMain(void* arg) {
+  Lane* lane = (Lane*)arg;
+  TracePlayer* player = lane->player;
+  while (true) {
+    // Looked at before waiting, as the signals for a record and for stop
+    // may come as one.
+    const TraceRecord* record;
+    {
+      ScopedLock lock(&player->lock_);
+      record = lane->record;
+      if (!record && player->stop_) {
+        return;
+      }
+    }
+    if (!record) {
+      lane->work_event.Wait(-1);
+      continue;
+    }
+    player->Play(*record);
+    {
+      ScopedLock lock(&player->lock_);
+      lane->record = NULL;
+    }
+    player->wake_event_.Signal();
+  }
+}
+
+void TracePlayer::Run() {
+  int64_t start_us = NowMicros();
+  int64_t late_us = 0;
+  for (size_t i = 0; i < records_.size(); ++i) {
+    const TraceRecord& record = records_[i];
+    if (record.method == kStartupCall || record.method == kShutdownCall) {
+      continue;
+    }
+    int64_t due_us = start_us + record.start_us;
+    int64_t now_us = NowMicros();
+    while (now_us < due_us) {
+      wake_event_.Wait((int)((due_us - now_us + 999) / 1000));
+      {
+        ScopedLock lock(&lock_);
+        if (stop_) {
+          break;
+        }
+      }
+      now_us = NowMicros();
+    }
+    if (!Dispatch(&record)) {
+      break;
+    }
+    late_us += NowMicros() - due_us;
+    stats::Set("tracePlayLateUs", late_us);
+  }
+  {
+    ScopedLock lock(&lock_);
+    stop_ = true;
+  }
+  for (size_t i = 0; i < lanes_.size(); ++i) {
+    lanes_[i]->work_event.Signal();
+    lanes_[i]->thread.Join();
+    delete lanes_[i];
+  }
+  lanes_.clear();
+  stats::Set("tracePlayUs", NowMicros() - start_us);
+  DebugLog("TracePlayer: done after %d ms\n",
+           (int)((NowMicros() - start_us) / 1000));
+}
+
+bool TracePlayer::Dispatch(const TraceRecord* record) {
+  while (true) {
+    Lane* lane = NULL;
+    {
+      ScopedLock lock(&lock_);
+      if (stop_) {
+        return false;
+      }
+      // A call that had finished when record started, e.g. the
+      // CompilePayload of an ApplyPayload on the same thread, must finish
+      // first here too, however much slower it runs.
+      bool blocked = false;
+      for (size_t i = 0; i < lanes_.size() && !blocked; ++i) {
+        const TraceRecord* busy = lanes_[i]->record;
+        if (!busy) {
+          lane = lanes_[i];
+        } else if (busy->start_us + busy->latency_us <= record->start_us) {
+          blocked = true;
+        }
+      }
+      if (blocked) {
+        lane = NULL;
+      } else if (!lane && lanes_.size() < kTracePlayerLanes) {
+        lane = new Lane;
+        lane->player = this;
+        if (!lane->thread.Start(LaneMain, lane)) {
+          delete lane;
+          return false;
+        }
+        lanes_.push_back(lane);
+      }
+      if (lane) {
+        lane->record = record;
+      }
+    }
+    if (lane) {
+      lane->work_event.Signal();
+      return true;
+    }
+    // Every lane is busy or a call record follows is still under way; the
+    // next one done wakes us.
+    wake_event_.Wait(-1);
+  }
+}
+
+ProxyPayload* TracePlayer::FindPayload(uint32_t id) {
+  ScopedLock lock(&lock_);
+  std::map<uint32_t, ProxyPayload*>::iterator it = payloads_.find(id);
+  return it == payloads_.end() ? NULL : it->second;
+}
+
+void TracePlayer::Play(const TraceRecord& record) {
+  TraceReader fields(record.fields.data(), record.fields.size());
+  ProxyConfig config;
+  uint64_t value;
+  std::string name;
+  bool ok = false;
+  switch (record.method) {
+    case kGetActiveConnectionNameCall: {
+      const void* connection_name = NULL;
+      ok = target_->GetActiveConnectionName(&connection_name);
+      if (ok && connection_name) {
+        DeleteConnectionName(connection_name);
+      }
+      break;
+    }
+    case kGetProxyConfigCall:
+      ok = target_->GetProxyConfig(&config);
+      break;
+    case kSetProxyConfigCall:
+      ok = fields.ReadConfig(&config) && target_->SetProxyConfig(config);
+      break;
+    case kUpdateProxyConfigCall:
+      ok = fields.ReadConfig(&config) && fields.ReadVarint(&value) &&
+          target_->UpdateProxyConfig(config, (int)value);
+      break;
+    case kCompilePayloadCall:
+      if (fields.ReadConfig(&config) && fields.ReadVarint(&value)) {
+        ProxyPayload* payload = target_->CompilePayload(config);
+        ok = payload != NULL;
+        ScopedLock lock(&lock_);
+        ProxyPayload*& slot = payloads_[(uint32_t)value];
+        delete slot;
+        slot = payload;
+      }
+      break;
+    case kApplyPayloadCall:
+      if (fields.ReadVarint(&value)) {
+        ProxyPayload* payload = FindPayload((uint32_t)value);
+        ok = payload && target_->ApplyPayload(*payload);
+      }
+      break;
+    case kEnumerateConnectionsCall: {
+      std::vector<std::string> names;
+      ok = target_->EnumerateConnections(&names);
+      break;
+    }
+    case kApplyPayloadToConnectionCall:
+      if (fields.ReadVarint(&value) && fields.ReadString(&name)) {
+        ProxyPayload* payload = FindPayload((uint32_t)value);
+        ok = payload && target_->ApplyPayloadToConnection(*payload, name);
+      }
+      break;
+  }
+  stats::Add("tracePlayCalls", 1);
+  if (ok != record.ok) {
+    stats::Add("tracePlayMismatches", 1);
+  }
+}
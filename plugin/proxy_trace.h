@@ -0,0 +1,194 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Backends that record the calls the plugin makes to the platform and
+// answer them from the recording, and a player that makes the recorded
+// calls again, so that a slow session from the field can be rerun and
+// profiled, on a machine without that platform or against it.
+//
+// A trace starts with "SPTR" and a version byte. Each call is a record
+// of a varint size and that many bytes: the method, whether it
+// succeeded, when it started and how long it took, in microseconds and
+// all as varints, then what the method took and gave.
+// Strings are UTF-8 on every platform, so that a trace recorded on
+// Windows or the Mac replays anywhere.
+
+#ifndef __PROXY_TRACE_H__
+#define __PROXY_TRACE_H__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "file_util.h"
+#include "platform_util.h"
+#include "proxy_base.h"
+#include "proxy_config.h"
+
+// Set to a path, records the session there; see NP_Initialize.
+extern const char* kRecordTraceVariable;
+// Set to the path of a trace, replays it instead of using the platform.
+extern const char* kReplayTraceVariable;
+// Set to the path of a trace, makes its calls again against the backend
+// in use; see TracePlayer.
+extern const char* kPlayTraceVariable;
+
+// Whether the environment asks for a trace to be recorded, replayed or
+// played. The shared state is left off then: its thread reads the system
+// on a schedule of its own, which would make no two runs alike.
+bool IsTracing();
+
+// One call of a trace.
+struct TraceRecord {
+  int method;
+  bool ok;
+  int64_t start_us;  // From the start of the trace.
+  int64_t latency_us;
+  std::string fields;  // What the method took and gave.
+};
+
+// Reads the calls of the trace at path in the order they were recorded,
+// which is the order they finished in.
+bool ReadTrace(const std::string& path, std::vector<TraceRecord>* records);
+
+// Passes every call through to another backend and appends it to a trace.
+class RecordingProxy : public ProxyBase {
+ public:
+  // Takes ownership of backend.
+  explicit RecordingProxy(ProxyBase* backend);
+  virtual ~RecordingProxy();
+
+  // Starts a new trace at path, replacing any old one.
+  bool Open(const std::string& path);
+
+  virtual bool PlatformDependentStartup();
+  virtual void PlatformDependentShutdown();
+  virtual bool GetActiveConnectionName(const void** connection_name);
+  virtual bool GetProxyConfig(ProxyConfig* config);
+  virtual bool SetProxyConfig(const ProxyConfig& config);
+  virtual bool UpdateProxyConfig(const ProxyConfig& config, int fields);
+  virtual ProxyPayload* CompilePayload(const ProxyConfig& config);
+  virtual bool ApplyPayload(const ProxyPayload& payload);
+  virtual bool EnumerateConnections(std::vector<std::string>* names);
+  virtual bool ApplyPayloadToConnection(const ProxyPayload& payload,
+                                        const std::string& name);
+
+ private:
+  void Record(int method, bool ok, int64_t start_us,
+              const std::string& fields);
+
+  ProxyBase* backend_;
+  Mutex lock_;  // Guards all below; calls may come from several threads.
+  AppendOnlyFile file_;
+  int64_t trace_start_us_;
+  uint32_t next_payload_id_;
+
+  RecordingProxy(const RecordingProxy&);
+  void operator=(const RecordingProxy&);
+};
+
+// Answers each call with the next recorded call of the same method, after
+// waiting as long as that call took. Once the calls of a method are used
+// up, the last one is repeated. Arguments that differ from the recorded
+// ones are counted in the traceReplayMismatches stat.
+class ReplayProxy : public ProxyBase {
+ public:
+  ReplayProxy();
+  virtual ~ReplayProxy();
+
+  bool Open(const std::string& path);
+
+  virtual bool PlatformDependentStartup();
+  virtual void PlatformDependentShutdown();
+  virtual bool GetActiveConnectionName(const void** connection_name);
+  virtual bool GetProxyConfig(ProxyConfig* config);
+  virtual bool SetProxyConfig(const ProxyConfig& config);
+  virtual bool UpdateProxyConfig(const ProxyConfig& config, int fields);
+  virtual ProxyPayload* CompilePayload(const ProxyConfig& config);
+  virtual bool ApplyPayload(const ProxyPayload& payload);
+  virtual bool EnumerateConnections(std::vector<std::string>* names);
+  virtual bool ApplyPayloadToConnection(const ProxyPayload& payload,
+                                        const std::string& name);
+
+ private:
+  struct Call {
+    bool ok;
+    int64_t latency_us;
+    std::string fields;
+  };
+
+  // Takes the next call of method and waits out its latency. False if
+  // the trace has none.
+  bool Replay(int method, Call* call);
+  // Like Replay, preferring the next call for connection if not NULL.
+  bool Replay(int method, const std::string* connection, Call* call);
+
+  Mutex lock_;  // Guards next_; calls may come from several threads.
+  std::vector<std::vector<Call> > calls_;  // By method.
+  std::vector<size_t> next_;
+
+  ReplayProxy(const ReplayProxy&);
+  void operator=(const ReplayProxy&);
+};
+
+// Makes the calls of a trace again against a backend, each at the offset
+// from the start it was recorded at and with the arguments it had, so
+// that a session from the field can be rerun and profiled against the
+// platform on a test machine, or checked against a ReplayProxy of the
+// same trace. Calls that overlapped in the session overlap again, on up
+// to kTracePlayerLanes threads, and a call that followed another, as on
+// the same thread, waits for it. Startup and shutdown are left to the
+// plugin. Outcomes that differ from the recorded ones are counted in the
+// tracePlayMismatches stat, and how late calls started in tracePlayLateUs.
+class TracePlayer {
+ public:
+  // target is not owned.
+  explicit TracePlayer(ProxyBase* target);
+  ~TracePlayer();
+
+  bool Open(const std::string& path);
+  // Plays the trace on a thread of its own.
+  bool Start();
+  // Makes no more calls and waits for those under way.
+  void Stop();
+
+ private:
+  struct Lane;
+
+  static void ThreadMain(void* arg);
+  static void LaneMain(void* arg);
+  void Run();
+  // Hands record to an idle lane, starting one if needed, once the calls
+  // that had finished when it started have. False once stopped.
+  bool Dispatch(const TraceRecord* record);
+  void Play(const TraceRecord& record);
+  ProxyPayload* FindPayload(uint32_t id);
+
+  ProxyBase* target_;
+  std::vector<TraceRecord> records_;
+  Thread thread_;
+  WaitableEvent wake_event_;  // Stop, or a lane became idle.
+
+  Mutex lock_;  // Guards everything below.
+  bool stop_;
+  std::vector<Lane*> lanes_;
+  // What CompilePayload gave, by the id the trace knows it by.
+  std::map<uint32_t, ProxyPayload*> payloads_;
+
+  TracePlayer(const TracePlayer&);
+  void operator=(const TracePlayer&);
+};
+
+#endif  // __PROXY_TRACE_H__
@@ -0,0 +1,82 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "route_cache.h"
+
+#include "hash_util.h"
+
+static uint64_t HashHostPort(const std::string& host, int port) {
+  return Mix64(Fnv1a64(host.data(), host.size()) ^ (uint64_t)port);
+}
+
+RouteCache::RouteCache(int capacity)
+    : sets_((capacity + kWays - 1) / kWays),
+      clock_(0),
+      hits_(0),
+      misses_(0) {
+  if (sets_ == 0) {
+    sets_ = 1;
+  }
+  entries_.resize(sets_ * kWays);
+}
+
+RouteCache::Entry* RouteCache::FindSet(uint64_t hash) {
+  return &entries_[(size_t)(hash % sets_) * kWays];
+}
+
+bool RouteCache::Lookup(const std::string& host, int port,
+                        uint32_t generation, bool* direct) {
+  uint64_t hash = HashHostPort(host, port);
+  Entry* set = FindSet(hash);
+  for (int i = 0; i < kWays; ++i) {
+    Entry& entry = set[i];
+    if (entry.hash == hash && entry.generation == generation &&
+        entry.port == port && entry.host == host) {
+      entry.last_use = ++clock_;
+      *direct = entry.direct;
+      ++hits_;
+      return true;
+    }
+  }
+  ++misses_;
+  return false;
+}
+
+void RouteCache::Insert(const std::string& host, int port,
+                        uint32_t generation, bool direct) {
+  uint64_t hash = HashHostPort(host, port);
+  Entry* set = FindSet(hash);
+  // Prefer a slot of the same host, then a stale or empty one, then the
+  // least recently used.
+  Entry* victim = &set[0];
+  for (int i = 0; i < kWays; ++i) {
+    Entry& entry = set[i];
+    if (entry.hash == hash && entry.port == port && entry.host == host) {
+      victim = &entry;
+      break;
+    }
+    if (victim->generation == generation &&
+        (entry.generation != generation ||
+         entry.last_use < victim->last_use)) {
+      victim = &entry;
+    }
+  }
+  victim->hash = hash;
+  victim->host = host;
+  victim->port = port;
+  victim->generation = generation;
+  victim->last_use = ++clock_;
+  victim->direct = direct;
+}
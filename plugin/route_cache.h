@@ -0,0 +1,70 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#ifndef __ROUTE_CACHE_H__
+#define __ROUTE_CACHE_H__
+
+#include <string>
+#include <vector>
+
+#include "nptypes.h"
+
+// Remembers per destination whether the forwarder sends it direct or
+// through an upstream, so the bypass list is evaluated once per host.
+// Entries carry the generation of the profile they were computed for;
+// bumping the generation on a profile switch invalidates all of them at
+// once without touching the table.
+//
+// The table is set-associative: a host can only live in the kWays slots of
+// its set, and a full set evicts its least recently used slot. Only the
+// forwarder's event loop thread uses it, so there is no locking.
+class RouteCache {
+ public:
+  // capacity is rounded up to a whole number of sets.
+  explicit RouteCache(int capacity);
+
+  // Returns true and sets direct if host:port has an entry of generation.
+  bool Lookup(const std::string& host, int port, uint32_t generation,
+              bool* direct);
+  void Insert(const std::string& host, int port, uint32_t generation,
+              bool direct);
+
+  int64_t hits() const { return hits_; }
+  int64_t misses() const { return misses_; }
+
+ private:
+  enum { kWays = 4 };
+
+  struct Entry {
+    Entry() : hash(0), port(0), generation(0), last_use(0), direct(false) {}
+
+    uint64_t hash;
+    std::string host;
+    int port;
+    uint32_t generation;  // 0 for an empty slot.
+    uint32_t last_use;
+    bool direct;
+  };
+
+  Entry* FindSet(uint64_t hash);
+
+  std::vector<Entry> entries_;
+  size_t sets_;
+  uint32_t clock_;
+  int64_t hits_;
+  int64_t misses_;
+};
+
+#endif  // __ROUTE_CACHE_H__
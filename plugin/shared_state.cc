@@ -0,0 +1,509 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "shared_state.h"
+
+#include <string.h>
+
+#if !defined(_WINDOWS)
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "file_util.h"
+#include "npswitchproxy.h"
+#include "stats.h"
+#include "utf_convert.h"
+
+// How often every process looks at the shared memory: the leader for
+// refreshes other processes asked for, the others for a new generation
+// or a leader that is gone. This touches no system API.
+static const int kSharedStatePollMs = 200;
+// How often the leader reads the system when nobody asked it to. Changes
+// the plugin makes itself come with a RequestRefresh, and so do network
+// changes; this only catches changes made outside the plugin.
+static const int64_t kSharedStateFallbackReadMs = 5000;
+// How long Open waits for the first attempt to lead.
+static const int kSharedStateReadyMs = 1000;
+// Readers give up, and ask the system, after this many torn copies.
+static const int kMaxReadAttempts = 100;
+
+static const uint32_t kBlockMagic = 0x54535053;  // "SPST"
+static const uint32_t kBlockVersion = 1;
+static const size_t kBlockDataSize = 16 * 1024;
+
+enum StateFlags {
+  kAutoDetectFlag = 1 << 0,
+  kAutoConfigFlag = 1 << 1,
+  kUseProxyFlag = 1 << 2,
+  kHasAutoConfigUrlFlag = 1 << 3,
+  kHasProxyServerFlag = 1 << 4,
+  kHasBypassListFlag = 1 << 5,
+};
+
+// The layout of the shared memory. All processes map the same build of
+// the plugin, or at least the same kBlockVersion.
+struct SharedState::Block {
+  uint32_t magic;
+  uint32_t version;
+  // Odd while the leader writes the fields after refresh_requests.
+  volatile uint32_t sequence;
+  // Bumped by each RequestRefresh, in any process.
+  volatile uint32_t refresh_requests;
+  // 0 until the first state is published.
+  uint32_t generation;
+  // The value of refresh_requests before the state was read.
+  uint32_t served_requests;
+  uint32_t flags;
+  // The bytes of data in use; 0 if there is no usable state.
+  uint32_t size;
+  char data[kBlockDataSize];
+};
+
+#if defined(_WINDOWS)
+static void FullBarrier() {
+  MemoryBarrier();
+}
+
+static uint32_t AtomicIncrement(volatile uint32_t* value) {
+  return (uint32_t)InterlockedIncrement((volatile LONG*)value);
+}
+#else
+static void FullBarrier() {
+  __sync_synchronize();
+}
+
+static uint32_t AtomicIncrement(volatile uint32_t* value) {
+  return __sync_add_and_fetch(value, 1);
+}
+#endif
+
+static void PutString(const std::string& value, std::string* data) {
+  uint32_t size = (uint32_t)value.size();
+  data->append((const char*)&size, sizeof(size));
+  data->append(value);
+}
+
+static bool GetString(const std::string& data, size_t* offset,
+                      std::string* value) {
+  uint32_t size;
+  if (data.size() - *offset < sizeof(size)) {
+    return false;
+  }
+  memcpy(&size, data.data() + *offset, sizeof(size));
+  *offset += sizeof(size);
+  if (data.size() - *offset < size) {
+    return false;
+  }
+  value->assign(data, *offset, size);
+  *offset += size;
+  return true;
+}
+
+static uint32_t EncodeState(const SystemState& state, std::string* data) {
+  PutString(state.auto_config_url, data);
+  PutString(state.proxy_server, data);
+  PutString(state.bypass_list, data);
+  PutString(state.connection_name, data);
+  return (state.auto_detect ? kAutoDetectFlag : 0) |
+      (state.auto_config ? kAutoConfigFlag : 0) |
+      (state.use_proxy ? kUseProxyFlag : 0) |
+      (state.has_auto_config_url ? kHasAutoConfigUrlFlag : 0) |
+      (state.has_proxy_server ? kHasProxyServerFlag : 0) |
+      (state.has_bypass_list ? kHasBypassListFlag : 0);
+}
+
+static bool DecodeState(uint32_t flags, const std::string& data,
+                        SystemState* state) {
+  size_t offset = 0;
+  if (!GetString(data, &offset, &state->auto_config_url) ||
+      !GetString(data, &offset, &state->proxy_server) ||
+      !GetString(data, &offset, &state->bypass_list) ||
+      !GetString(data, &offset, &state->connection_name)) {
+    return false;
+  }
+  state->auto_detect = (flags & kAutoDetectFlag) != 0;
+  state->auto_config = (flags & kAutoConfigFlag) != 0;
+  state->use_proxy = (flags & kUseProxyFlag) != 0;
+  state->has_auto_config_url = (flags & kHasAutoConfigUrlFlag) != 0;
+  state->has_proxy_server = (flags & kHasProxyServerFlag) != 0;
+  state->has_bypass_list = (flags & kHasBypassListFlag) != 0;
+  return true;
+}
+
+SystemState::SystemState()
+    : auto_detect(false), auto_config(false), use_proxy(false),
+      has_auto_config_url(false), has_proxy_server(false),
+      has_bypass_list(false) {
+}
+
+bool SystemState::Equals(const SystemState& other) const {
+  return auto_detect == other.auto_detect &&
+      auto_config == other.auto_config &&
+      use_proxy == other.use_proxy &&
+      has_auto_config_url == other.has_auto_config_url &&
+      has_proxy_server == other.has_proxy_server &&
+      has_bypass_list == other.has_bypass_list &&
+      auto_config_url == other.auto_config_url &&
+      proxy_server == other.proxy_server &&
+      bypass_list == other.bypass_list &&
+      connection_name == other.connection_name;
+}
+
+SharedState::SharedState()
+    : wake_event_(false), ready_event_(true), read_(NULL), changed_(NULL),
+      read_arg_(NULL), block_(NULL),
+#if defined(_WINDOWS)
+      file_(INVALID_HANDLE_VALUE), mapping_(NULL), leader_mutex_(NULL),
+#else
+      fd_(-1),
+#endif
+      stop_(false), leader_(false), has_published_(false),
+      published_failure_(false), next_read_ms_(0), observed_generation_(0),
+      requested_(0),
+      has_requested_(false) {
+}
+
+SharedState::~SharedState() {
+  Close();
+}
+
+bool SharedState::Open(const std::string& name, ReadCallback read,
+                       ChangedCallback changed, void* arg) {
+  Close();
+#if defined(_WINDOWS)
+  // A file in the per-user cache directory keeps the state for the next
+  // start. Without one the memory lives only as long as the processes.
+  std::string directory = GetUserCacheDirectory();
+  if (!directory.empty()) {
+    file_ = CreateFileW(Utf8ToWide(JoinPath(directory, name)).c_str(),
+                        GENERIC_READ | GENERIC_WRITE,
+                        FILE_SHARE_READ | FILE_SHARE_WRITE |
+                        FILE_SHARE_DELETE,
+                        NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  }
+  // Local\ names are per session, which keeps users apart.
+  std::wstring wide_name = Utf8ToWide("Local\\SwitchProxy-" + name);
+  mapping_ = CreateFileMappingW(file_, NULL, PAGE_READWRITE,
+                                0, sizeof(Block), wide_name.c_str());
+  if (!mapping_) {
+    return false;
+  }
+  block_ = (Block*)MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0,
+                                 sizeof(Block));
+  leader_mutex_ = CreateMutexW(NULL, FALSE, (wide_name + L"-leader").c_str());
+  if (!block_ || !leader_mutex_) {
+    Close();
+    return false;
+  }
+#else
+  // A file in the per-user cache directory, so that users are kept apart
+  // and the leader lock can be taken on it.
+  std::string directory = GetUserCacheDirectory();
+  if (directory.empty()) {
+    return false;
+  }
+  fd_ = open(JoinPath(directory, name).c_str(), O_RDWR | O_CREAT, 0600);
+  struct stat info;
+  if (fd_ < 0 || fstat(fd_, &info) != 0 ||
+      ((size_t)info.st_size < sizeof(Block) &&
+       ftruncate(fd_, sizeof(Block)) != 0)) {
+    Close();
+    return false;
+  }
+  void* data = mmap(NULL, sizeof(Block), PROT_READ | PROT_WRITE, MAP_SHARED,
+                    fd_, 0);
+  if (data == MAP_FAILED) {
+    Close();
+    return false;
+  }
+  block_ = (Block*)data;
+#endif
+  if (block_->magic == 0) {
+    // Whoever gets here first writes the same values.
+    block_->version = kBlockVersion;
+    FullBarrier();
+    block_->magic = kBlockMagic;
+  } else if (block_->magic != kBlockMagic ||
+             block_->version != kBlockVersion) {
+    DebugLog("SharedState: %s has another layout\n", name.c_str());
+    Close();
+    return false;
+  }
+  read_ = read;
+  changed_ = changed;
+  read_arg_ = arg;
+  stop_ = false;
+  // A state left by another process or an earlier session is served as it
+  // is; the leader publishes what changed on its own time.
+  SystemState state;
+  uint32_t generation;
+  uint32_t served_requests;
+  bool has_state = CopyBlock(&state, &generation, &served_requests);
+  observed_generation_ = has_state ? generation : 0;
+  ready_event_.Reset();
+  if (!thread_.Start(ThreadMain, this)) {
+    Close();
+    return false;
+  }
+  if (!has_state) {
+    ready_event_.Wait(kSharedStateReadyMs);
+  }
+  return true;
+}
+
+void SharedState::Close() {
+  if (thread_.IsStarted()) {
+    {
+      ScopedLock lock(&lock_);
+      stop_ = true;
+    }
+    wake_event_.Signal();
+    thread_.Join();
+  }
+#if defined(_WINDOWS)
+  if (block_) {
+    UnmapViewOfFile(block_);
+  }
+  if (mapping_) {
+    CloseHandle(mapping_);
+  }
+  if (leader_mutex_) {
+    CloseHandle(leader_mutex_);
+  }
+  if (file_ != INVALID_HANDLE_VALUE) {
+    CloseHandle(file_);
+  }
+  file_ = INVALID_HANDLE_VALUE;
+  mapping_ = NULL;
+  leader_mutex_ = NULL;
+#else
+  if (block_) {
+    munmap(block_, sizeof(Block));
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  fd_ = -1;
+#endif
+  block_ = NULL;
+  has_published_ = false;
+  published_failure_ = false;
+  has_requested_ = false;
+}
+
+bool SharedState::Read(SystemState* state, uint32_t* generation) {
+  uint32_t served_requests;
+  if (!block_ || !CopyBlock(state, generation, &served_requests) ||
+      (has_requested_ && (int32_t)(served_requests - requested_) < 0)) {
+    return false;
+  }
+  has_requested_ = false;
+  return true;
+}
+
+bool SharedState::ReadGeneration(uint32_t* generation) {
+  if (!block_) {
+    return false;
+  }
+  for (int attempt = 0; attempt < kMaxReadAttempts; ++attempt) {
+    uint32_t sequence = block_->sequence;
+    FullBarrier();
+    if (sequence & 1) {
+      continue;
+    }
+    uint32_t current = block_->generation;
+    uint32_t served_requests = block_->served_requests;
+    uint32_t size = block_->size;
+    FullBarrier();
+    if (block_->sequence != sequence) {
+      continue;
+    }
+    if (current == 0 || size == 0 ||
+        (has_requested_ && (int32_t)(served_requests - requested_) < 0)) {
+      return false;
+    }
+    has_requested_ = false;
+    *generation = current;
+    return true;
+  }
+  return false;
+}
+
+void SharedState::RequestRefresh() {
+  if (!block_) {
+    return;
+  }
+  requested_ = AtomicIncrement(&block_->refresh_requests);
+  has_requested_ = true;
+  if (IsLeader()) {
+    wake_event_.Signal();
+  }
+}
+
+bool SharedState::IsLeader() {
+  ScopedLock lock(&lock_);
+  return leader_;
+}
+
+bool SharedState::CopyBlock(SystemState* state, uint32_t* generation,
+                            uint32_t* served_requests) {
+  for (int attempt = 0; attempt < kMaxReadAttempts; ++attempt) {
+    uint32_t sequence = block_->sequence;
+    FullBarrier();
+    if (sequence & 1) {
+      continue;
+    }
+    *generation = block_->generation;
+    *served_requests = block_->served_requests;
+    uint32_t flags = block_->flags;
+    uint32_t size = block_->size;
+    std::string data;
+    if (size <= kBlockDataSize) {
+      data.assign(block_->data, size);
+    }
+    FullBarrier();
+    if (block_->sequence != sequence) {
+      continue;
+    }
+    return *generation != 0 && !data.empty() &&
+        DecodeState(flags, data, state);
+  }
+  return false;
+}
+
+void SharedState::ThreadMain(void* arg) {
+  ((SharedState*)arg)->Run();
+}
+
+void SharedState::Run() {
+  while (true) {
+    bool leader = IsLeader();
+    if (!leader && TryLead()) {
+      // What the last leader published only needs publishing again if it
+      // is out of date.
+      uint32_t generation;
+      uint32_t served_requests;
+      has_published_ = CopyBlock(&published_, &generation, &served_requests);
+      published_failure_ = false;
+      next_read_ms_ = 0;
+      stats::Add("sharedStateElections", 1);
+      ScopedLock lock(&lock_);
+      leader = leader_ = true;
+    }
+    uint32_t requests = block_->refresh_requests;
+    int64_t now_ms = NowMillis();
+    if (leader && (requests != block_->served_requests ||
+                   now_ms >= next_read_ms_)) {
+      next_read_ms_ = now_ms + kSharedStateFallbackReadMs;
+      stats::Add("sharedStateSystemReads", 1);
+      SystemState state;
+      if (!read_(read_arg_, &state)) {
+        if (!published_failure_ || block_->served_requests != requests) {
+          Publish(NULL, requests);
+        }
+      } else if (!has_published_ || !state.Equals(published_) ||
+                 block_->served_requests != requests) {
+        Publish(&state, requests);
+      }
+    }
+    // Only a hint that the state changed, so the generation is read
+    // without the sequence lock; Read copies the state itself.
+    uint32_t generation = block_->generation;
+    if (generation != observed_generation_) {
+      observed_generation_ = generation;
+      if (changed_) {
+        changed_(read_arg_);
+      }
+    }
+    ready_event_.Signal();
+    wake_event_.Wait(kSharedStatePollMs);
+    ScopedLock lock(&lock_);
+    if (stop_) {
+      break;
+    }
+  }
+  if (IsLeader()) {
+    Unlead();
+    ScopedLock lock(&lock_);
+    leader_ = false;
+  }
+}
+
+#if defined(_WINDOWS)
+// The mutex belongs to the leader's thread, and is abandoned, which hands
+// it to the next waiter, if the process dies.
+bool SharedState::TryLead() {
+  DWORD result = WaitForSingleObject(leader_mutex_, 0);
+  return result == WAIT_OBJECT_0 || result == WAIT_ABANDONED;
+}
+
+void SharedState::Unlead() {
+  ReleaseMutex(leader_mutex_);
+}
+#else
+// flock locks go away with the last descriptor of the process that took
+// them, and are held per open file, so two SharedStates in one process
+// compete like two processes do.
+bool SharedState::TryLead() {
+  return flock(fd_, LOCK_EX | LOCK_NB) == 0;
+}
+
+void SharedState::Unlead() {
+  flock(fd_, LOCK_UN);
+}
+#endif
+
+// state NULL publishes that the system could not be read. Only the state
+// itself, not a served refresh, bumps the generation.
+void SharedState::Publish(const SystemState* state,
+                          uint32_t served_requests) {
+  std::string data;
+  uint32_t flags = 0;
+  if (state) {
+    flags = EncodeState(*state, &data);
+    if (data.size() > kBlockDataSize) {
+      DebugLog("SharedState: %d bytes do not fit\n", (int)data.size());
+      data.clear();
+    }
+  }
+  bool changed = state ? !has_published_ || !state->Equals(published_) :
+      !published_failure_;
+  uint32_t sequence = block_->sequence;
+  if (sequence & 1) {
+    // The last leader died in the middle of a write.
+    ++sequence;
+  }
+  block_->sequence = sequence + 1;
+  FullBarrier();
+  if (changed && ++block_->generation == 0) {
+    block_->generation = 1;
+  }
+  block_->served_requests = served_requests;
+  block_->flags = flags;
+  block_->size = (uint32_t)data.size();
+  memcpy(block_->data, data.data(), data.size());
+  FullBarrier();
+  block_->sequence = sequence + 2;
+  if (state) {
+    published_ = *state;
+  }
+  has_published_ = state != NULL;
+  published_failure_ = state == NULL;
+  stats::Add("sharedStatePublishes", 1);
+}
@@ -0,0 +1,139 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#ifndef __SHARED_STATE_H__
+#define __SHARED_STATE_H__
+
+#include <string>
+
+#include "nptypes.h"
+#include "platform_util.h"
+
+// What the plugin asks the system for most often: the proxy setting and
+// the active connection.
+struct SystemState {
+  SystemState();
+
+  bool Equals(const SystemState& other) const;
+
+  bool auto_detect;
+  bool auto_config;
+  bool use_proxy;
+  // Whether the strings below are set at all, as opposed to empty.
+  bool has_auto_config_url;
+  bool has_proxy_server;
+  bool has_bypass_list;
+  std::string auto_config_url;
+  std::string proxy_server;
+  std::string bypass_list;
+  // As the UI shows it, in UTF-8; empty if there is no connection.
+  std::string connection_name;
+};
+
+// Every browser profile loads its own copy of the plugin, and each would
+// otherwise query the system for the same state. SharedState keeps one
+// copy of it in memory shared by all of them. One process, elected
+// through a lock the system drops when the process dies, reads the
+// system when any process asks for it with RequestRefresh, otherwise
+// only every kSharedStateFallbackReadMs, and publishes what changed. All
+// others only read the shared copy, under a sequence lock: the leader
+// makes the sequence odd while it writes, and a reader retries if the
+// sequence was odd or moved while it copied. Every change bumps the
+// generation.
+// The memory is backed by a file that outlives the processes, so that the
+// next start serves the last state right away, until the new leader has
+// read the system and published what changed.
+class SharedState {
+ public:
+  // Reads the state from the system, on the leader's thread.
+  typedef bool (*ReadCallback)(void* arg, SystemState* state);
+  // Called on the state's thread, in every process, once the published
+  // state has changed.
+  typedef void (*ChangedCallback)(void* arg);
+
+  SharedState();
+  ~SharedState();
+
+  // Maps the shared memory called name, creating it if needed, and
+  // starts the thread that takes over as leader whenever there is none.
+  // If the memory holds no state yet and this process is elected right
+  // away, the state is published before Open returns. changed may be
+  // NULL.
+  bool Open(const std::string& name, ReadCallback read,
+            ChangedCallback changed, void* arg);
+  void Close();
+
+  // Copies the published state. Fails if there is none, if the leader
+  // could not read it, or while a refresh this process asked for is
+  // pending; the caller then asks the system itself. Main thread only.
+  bool Read(SystemState* state, uint32_t* generation);
+  // The generation Read would return, without copying the state; fails
+  // when Read would. Lets a caller holding what it made of an earlier
+  // Read tell that it is still current.
+  bool ReadGeneration(uint32_t* generation);
+  // Has the leader read the system again soon, e.g. after this process
+  // changed the setting or the network changed. Main thread only.
+  void RequestRefresh();
+
+  bool IsLeader();
+
+ private:
+  struct Block;
+
+  static void ThreadMain(void* arg);
+  void Run();
+  bool TryLead();
+  void Unlead();
+  // Copies the published state; false if there is none.
+  bool CopyBlock(SystemState* state, uint32_t* generation,
+                 uint32_t* served_requests);
+  void Publish(const SystemState* state, uint32_t served_requests);
+
+  Thread thread_;
+  WaitableEvent wake_event_;
+  WaitableEvent ready_event_;
+  ReadCallback read_;
+  ChangedCallback changed_;
+  void* read_arg_;
+  Block* block_;
+#if defined(_WINDOWS)
+  HANDLE file_;
+  HANDLE mapping_;
+  HANDLE leader_mutex_;
+#else
+  int fd_;
+#endif
+
+  Mutex lock_;  // Guards stop_ and leader_.
+  bool stop_;
+  bool leader_;
+
+  // Owned by the leader's thread.
+  SystemState published_;
+  bool has_published_;
+  bool published_failure_;  // The last publish said the read failed.
+  int64_t next_read_ms_;  // When to read the system unasked.
+  // Owned by the thread.
+  uint32_t observed_generation_;  // The last one changed_ was called for.
+
+  // Owned by the main thread.
+  uint32_t requested_;  // The refresh this process asked for last.
+  bool has_requested_;
+
+  SharedState(const SharedState&);
+  void operator=(const SharedState&);
+};
+
+#endif  // __SHARED_STATE_H__
@@ -0,0 +1,46 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "stats.h"
+
+#include "platform_util.h"
+
+namespace stats {
+
+static Mutex counters_lock;
+static std::map<std::string, int64_t> counters_map;
+
+void Add(const char* name, int64_t delta) {
+  ScopedLock lock(&counters_lock);
+  counters_map[name] += delta;
+}
+
+void Set(const char* name, int64_t value) {
+  ScopedLock lock(&counters_lock);
+  counters_map[name] = value;
+}
+
+int64_t Get(const char* name) {
+  ScopedLock lock(&counters_lock);
+  std::map<std::string, int64_t>::const_iterator it = counters_map.find(name);
+  return it == counters_map.end() ? 0 : it->second;
+}
+
+void Snapshot(std::map<std::string, int64_t>* counters) {
+  ScopedLock lock(&counters_lock);
+  *counters = counters_map;
+}
+
+}  // namespace stats
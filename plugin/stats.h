@@ -0,0 +1,38 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Process wide named counters, readable from javascript as plugin.stats.
+// Names are camelCase since they become javascript property names.
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <map>
+#include <string>
+
+#include "nptypes.h"
+
+namespace stats {
+
+void Add(const char* name, int64_t delta);
+void Set(const char* name, int64_t value);
+int64_t Get(const char* name);
+
+// Copies all counters.
+void Snapshot(std::map<std::string, int64_t>* counters);
+
+}  // namespace stats
+
+#endif  // __STATS_H__
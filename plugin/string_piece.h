@@ -0,0 +1,42 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#ifndef __STRING_PIECE_H__
+#define __STRING_PIECE_H__
+
+#include <stddef.h>
+#include <string.h>
+
+#include <string>
+
+// A pointer and a length into a buffer owned by someone else.
+struct StringPiece {
+  StringPiece() : data(NULL), len(0) {}
+  StringPiece(const char* d, size_t l) : data(d), len(l) {}
+  explicit StringPiece(const char* str) : data(str), len(str ? strlen(str) : 0) {}
+  explicit StringPiece(const std::string& str)
+      : data(str.data()), len(str.size()) {}
+
+  bool empty() const { return len == 0; }
+  std::string ToString() const { return std::string(data, len); }
+  bool Equals(const char* str) const {
+    return strlen(str) == len && memcmp(data, str, len) == 0;
+  }
+
+  const char* data;
+  size_t len;
+};
+
+#endif  // __STRING_PIECE_H__
@@ -0,0 +1,148 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Switches the system setting through the plugin's NPAPI entry points on
+// the headless browser, whose backend keeps the setting in memory, so the
+// time is that of the plugin alone. "first apply" compiles each profile;
+// "switch" goes back and forth between profiles compiled before, as the
+// popup does. "setProxyConfig" applies the same settings from fields,
+// parsed and converted on every call, as before profiles were compiled.
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "headless_plugin.h"
+#include "test_util.h"
+
+namespace {
+
+const int kProfiles = 1000;
+const int kSwitches = 10000;
+
+NPVariant StringArg(const char* value) {
+  NPVariant arg;
+  STRINGZ_TO_NPVARIANT(value, arg);
+  return arg;
+}
+
+int AddProfile(HeadlessPlugin* plugin, const std::string& proxy) {
+  NPVariant args[2] = { StringArg(proxy.c_str()), StringArg("") };
+  NPVariant result;
+  if (!plugin->Invoke("addProfile", args, 2, &result)) {
+    return -1;
+  }
+  return NPVARIANT_IS_INT32(result) ? NPVARIANT_TO_INT32(result) :
+      NPVARIANT_IS_DOUBLE(result) ? (int)NPVARIANT_TO_DOUBLE(result) : -1;
+}
+
+bool ApplyProfile(HeadlessPlugin* plugin, int id) {
+  NPVariant arg;
+  INT32_TO_NPVARIANT(id, arg);
+  NPVariant result;
+  if (!plugin->Invoke("applyProfile", &arg, 1, &result)) {
+    return false;
+  }
+  headless::ReleaseVariantValue(&result);
+  return true;
+}
+
+bool SetProxyConfig(HeadlessPlugin* plugin, const std::string& proxy) {
+  NPObject* fields = HeadlessPlugin::NewObject();
+  NPVariant value;
+  BOOLEAN_TO_NPVARIANT(true, value);
+  headless::JSSetProperty(fields, headless::GetStringIdentifier("useProxy"),
+                          &value);
+  value = StringArg(proxy.c_str());
+  headless::JSSetProperty(
+      fields, headless::GetStringIdentifier("proxyServer"), &value);
+  NPVariant arg;
+  OBJECT_TO_NPVARIANT(fields, arg);
+  NPVariant result;
+  bool ok = plugin->Invoke("setProxyConfig", &arg, 1, &result);
+  if (ok) {
+    headless::ReleaseVariantValue(&result);
+  }
+  headless::ReleaseObject(fields);
+  return ok;
+}
+
+// Applies ids[0], ids[1], ... in turn, kSwitches times in all.
+void MeasureSwitches(HeadlessPlugin* plugin, const char* label,
+                     const std::vector<int>& ids) {
+  int failures = 0;
+  int64_t start_us = NowMicros();
+  for (int i = 0; i < kSwitches; ++i) {
+    failures += !ApplyProfile(plugin, ids[i % ids.size()]);
+  }
+  ReportBenchmark(label, kSwitches, NowMicros() - start_us);
+  if (failures) {
+    printf("%s: %d applies failed\n", label, failures);
+  }
+}
+
+}  // namespace
+
+int main() {
+  HeadlessPlugin::SetSystemProxy(false, NULL);
+  HeadlessPlugin plugin;
+  if (!plugin.Start()) {
+    printf("the plugin did not start\n");
+    return 1;
+  }
+  NPVariant name = StringArg("apply-bench");
+  NPVariant result;
+  plugin.Invoke("useProfileStore", &name, 1, &result);
+
+  std::vector<std::string> proxies;
+  std::vector<int> ids;
+  char proxy[128];
+  for (int i = 0; i < kProfiles; ++i) {
+    snprintf(proxy, sizeof(proxy),
+             "http=proxy%d.example.com:8080;https=secure%d.example.com:443",
+             i, i);
+    proxies.push_back(proxy);
+    ids.push_back(AddProfile(&plugin, proxy));
+  }
+  int pool = AddProfile(&plugin, "a.example:80,b.example:80");
+  int pac = AddProfile(&plugin, "c.example:80;pac=local");
+
+  int64_t start_us = NowMicros();
+  for (int i = 0; i < kProfiles; ++i) {
+    ApplyProfile(&plugin, ids[i]);
+  }
+  ReportBenchmark("applyProfile, first apply", kProfiles,
+                  NowMicros() - start_us);
+
+  std::vector<int> two(ids.begin(), ids.begin() + 2);
+  MeasureSwitches(&plugin, "applyProfile, switch between 2", two);
+  MeasureSwitches(&plugin, "applyProfile, switch among 1000", ids);
+  std::vector<int> kinds;
+  kinds.push_back(ids[0]);
+  kinds.push_back(pool);
+  kinds.push_back(pac);
+  MeasureSwitches(&plugin, "applyProfile, switch plain/pool/pac", kinds);
+
+  start_us = NowMicros();
+  for (int i = 0; i < kSwitches; ++i) {
+    SetProxyConfig(&plugin, proxies[i % 2]);
+  }
+  ReportBenchmark("setProxyConfig, switch between 2", kSwitches,
+                  NowMicros() - start_us);
+
+  plugin.Stop();
+  return 0;
+}
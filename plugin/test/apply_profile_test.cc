@@ -0,0 +1,121 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// applyProfile through the plugin's NPAPI entry points, on the headless
+// browser: the script a profile brought in stays only as long as a
+// profile with a script is applied, and nothing changes when the setting
+// could not be applied.
+
+#include <string>
+
+#include "headless_plugin.h"
+#include "test_util.h"
+
+namespace {
+
+NPVariant StringArg(const char* value) {
+  NPVariant arg;
+  STRINGZ_TO_NPVARIANT(value, arg);
+  return arg;
+}
+
+int AddProfile(HeadlessPlugin* plugin, const char* proxy) {
+  NPVariant args[2] = { StringArg(proxy), StringArg("") };
+  NPVariant result;
+  if (!plugin->Invoke("addProfile", args, 2, &result)) {
+    return -1;
+  }
+  return NPVARIANT_IS_INT32(result) ? NPVARIANT_TO_INT32(result) :
+      NPVARIANT_IS_DOUBLE(result) ? (int)NPVARIANT_TO_DOUBLE(result) : -1;
+}
+
+bool ApplyProfile(HeadlessPlugin* plugin, int id) {
+  NPVariant arg;
+  INT32_TO_NPVARIANT(id, arg);
+  NPVariant result;
+  if (!plugin->Invoke("applyProfile", &arg, 1, &result)) {
+    return false;
+  }
+  headless::ReleaseVariantValue(&result);
+  return true;
+}
+
+// What findProxyForURL answers, "" if it has no script to ask.
+std::string FindProxy(HeadlessPlugin* plugin) {
+  NPVariant arg = StringArg("http://www.example.com/");
+  NPVariant result;
+  if (!plugin->Invoke("findProxyForURL", &arg, 1, &result)) {
+    return "";
+  }
+  std::string proxies;
+  if (NPVARIANT_IS_STRING(result)) {
+    proxies.assign(NPVARIANT_TO_STRING(result).UTF8Characters,
+                   NPVARIANT_TO_STRING(result).UTF8Length);
+  }
+  headless::ReleaseVariantValue(&result);
+  return proxies;
+}
+
+bool HasPacScript(HeadlessPlugin* plugin) {
+  return !FindProxy(plugin).empty();
+}
+
+void TestPlainProfileUnloadsScript(HeadlessPlugin* plugin) {
+  int pac = AddProfile(plugin, "a.example:80;pac=local");
+  int plain = AddProfile(plugin, "b.example:80");
+  CHECK(pac >= 0);
+  CHECK(plain >= 0);
+
+  CHECK(ApplyProfile(plugin, pac));
+  CHECK(HasPacScript(plugin));
+  CHECK(ApplyProfile(plugin, plain));
+  CHECK(!HasPacScript(plugin));
+  // Once more, now that the profiles are compiled.
+  CHECK(ApplyProfile(plugin, pac));
+  CHECK(HasPacScript(plugin));
+  CHECK(ApplyProfile(plugin, plain));
+  CHECK(!HasPacScript(plugin));
+}
+
+void TestFailedApplyKeepsScript(HeadlessPlugin* plugin) {
+  int pac = AddProfile(plugin, "c.example:80;pac=local");
+  int other_pac = AddProfile(plugin, "e.example:80;pac=local");
+  int plain = AddProfile(plugin, "d.example:80");
+  CHECK(ApplyProfile(plugin, pac));
+  std::string proxies = FindProxy(plugin);
+  CHECK(proxies.find("c.example:80") != std::string::npos);
+
+  HeadlessPlugin::FailApplies(true);
+  CHECK(!ApplyProfile(plugin, other_pac));
+  CHECK(!ApplyProfile(plugin, plain));
+  HeadlessPlugin::FailApplies(false);
+  CHECK_EQ(proxies, FindProxy(plugin));
+}
+
+}  // namespace
+
+int main() {
+  HeadlessPlugin::SetSystemProxy(false, NULL);
+  HeadlessPlugin plugin;
+  CHECK(plugin.Start());
+  NPVariant name;
+  STRINGZ_TO_NPVARIANT("apply-test", name);
+  NPVariant result;
+  CHECK(plugin.Invoke("useProfileStore", &name, 1, &result));
+  TestPlainProfileUnloadsScript(&plugin);
+  TestFailedApplyKeepsScript(&plugin);
+  plugin.Stop();
+  return TestResult("apply_profile_test");
+}
@@ -0,0 +1,138 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// DnsResolver against a loopback name server that never answers: a stop
+// lets go of what was in flight, and a restart asks again.
+
+#include "dns_resolver.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <string>
+
+#include "net_util.h"
+#include "test_util.h"
+
+namespace {
+
+// A UDP socket on loopback that takes queries and answers none.
+class SilentServer {
+ public:
+  SilentServer() : port_(0) {
+    socket_ = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(socket_, (struct sockaddr*)&addr, sizeof(addr)) == 0 &&
+        getsockname(socket_, (struct sockaddr*)&addr, &len) == 0) {
+      port_ = ntohs(addr.sin_port);
+    }
+  }
+  ~SilentServer() { CloseSocket(socket_); }
+
+  std::string address() const {
+    char address[32];
+    snprintf(address, sizeof(address), "127.0.0.1:%d", port_);
+    return address;
+  }
+
+  // Whether a query came in within timeout_ms.
+  bool ReceiveQuery(int timeout_ms) {
+    fd_set read_fds;
+    FD_ZERO(&read_fds);
+    FD_SET(socket_, &read_fds);
+    struct timeval tv;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    if (select(socket_ + 1, &read_fds, NULL, NULL, &tv) <= 0) {
+      return false;
+    }
+    char packet[512];
+    return recv(socket_, packet, sizeof(packet), 0) > 0;
+  }
+
+ private:
+  SocketHandle socket_;
+  int port_;
+};
+
+struct Waiter {
+  DnsResolver* resolver;
+  DnsResolver::Result result;
+  int64_t elapsed_ms;
+};
+
+void WaitForAnswer(void* arg) {
+  Waiter* waiter = (Waiter*)arg;
+  int64_t start_ms = NowMillis();
+  uint32_t address;
+  waiter->result = waiter->resolver->Resolve("slow.example", 20000, &address);
+  waiter->elapsed_ms = NowMillis() - start_ms;
+}
+
+void TestStopReleasesPending() {
+  SilentServer server;
+  DnsResolver::Options options;
+  options.server = server.address();
+  options.timeout_ms = 10000;
+  DnsResolver resolver(options);
+  CHECK(resolver.Start());
+  uint32_t address;
+  CHECK_EQ(DnsResolver::kPending, resolver.Lookup("slow.example", &address));
+  CHECK(server.ReceiveQuery(2000));
+
+  Waiter waiter = { &resolver, DnsResolver::kPending, 0 };
+  Thread thread;
+  CHECK(thread.Start(WaitForAnswer, &waiter));
+  SleepMillis(100);
+  resolver.Stop();
+  thread.Join();
+  CHECK(waiter.result != DnsResolver::kFound);
+  CHECK(waiter.elapsed_ms < 5000);
+
+  // After a restart the name is looked up again rather than left waiting
+  // for a query that no longer exists.
+  CHECK(resolver.Start());
+  CHECK_EQ(DnsResolver::kPending, resolver.Lookup("slow.example", &address));
+  CHECK(server.ReceiveQuery(2000));
+  resolver.Stop();
+}
+
+void TestSystemLookup() {
+  SilentServer server;
+  DnsResolver::Options options;
+  options.server = server.address();
+  DnsResolver resolver(options);
+  CHECK(resolver.Start());
+  // A single-label name goes to the system resolver on the helper thread.
+  uint32_t address = 0;
+  CHECK_EQ(DnsResolver::kFound, resolver.Resolve("localhost", 5000, &address));
+  CHECK_EQ(std::string("127.0.0.1"), FormatIpv4(address));
+  resolver.Stop();
+}
+
+}  // namespace
+
+int main() {
+  InitializeSockets();
+  TestStopReleasesPending();
+  TestSystemLookup();
+  return TestResult("dns_resolver_test");
+}
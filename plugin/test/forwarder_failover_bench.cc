@@ -0,0 +1,298 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// How long the forwarder takes to fail over between the upstreams of a
+// group, and to come back, against local stand-ins for the upstreams whose
+// faults the benchmark switches on and off:
+// - refused: the upstream is down and its port refuses connections;
+// - black hole: connects to it hang, so only the connect timeout helps;
+// - recovery: the upstream comes back, and traffic returns to it once its
+//   breaker lets a trial connection through.
+// Each request is a plain HTTP GET through the forwarder, timed from
+// connecting to it until the whole response is in. Linux only.
+
+#include "forwarder.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "net_util.h"
+#include "platform_util.h"
+#include "test_util.h"
+
+namespace {
+
+const int kRequests = 200;
+const int kRecoveryPollMs = 10;
+
+// Answers every request it gets with a body naming it, then closes.
+class UpstreamStub {
+ public:
+  explicit UpstreamStub(char name)
+      : name_(name), socket_(INVALID_SOCKET), port_(0), stop_(false) {}
+  ~UpstreamStub() { Stop(); }
+
+  // Listens on port, or an ephemeral one if port is 0.
+  bool Start(int port) {
+    socket_ = ListenOnLoopback(port, &port_);
+    if (socket_ == INVALID_SOCKET) {
+      return false;
+    }
+    stop_ = false;
+    return thread_.Start(ThreadMain, this);
+  }
+
+  // Closes the port, so that connects to it are refused.
+  void Stop() {
+    if (!thread_.IsStarted()) {
+      return;
+    }
+    {
+      ScopedLock lock(&lock_);
+      stop_ = true;
+    }
+    thread_.Join();
+    CloseSocket(socket_);
+    socket_ = INVALID_SOCKET;
+  }
+
+  int port() const { return port_; }
+
+ private:
+  static void ThreadMain(void* arg) {
+    static_cast<UpstreamStub*>(arg)->Run();
+  }
+
+  void Run() {
+    for (;;) {
+      {
+        ScopedLock lock(&lock_);
+        if (stop_) {
+          return;
+        }
+      }
+      fd_set read_fds;
+      FD_ZERO(&read_fds);
+      FD_SET(socket_, &read_fds);
+      struct timeval timeout = { 0, 20 * 1000 };
+      if (select(socket_ + 1, &read_fds, NULL, NULL, &timeout) <= 0) {
+        continue;
+      }
+      int conn = accept(socket_, NULL, NULL);
+      if (conn < 0) {
+        continue;
+      }
+      fcntl(conn, F_SETFL, fcntl(conn, F_GETFL) & ~O_NONBLOCK);
+      std::string request;
+      char buffer[4096];
+      int n;
+      while (request.find("\r\n\r\n") == std::string::npos &&
+             (n = recv(conn, buffer, sizeof(buffer), 0)) > 0) {
+        request.append(buffer, n);
+      }
+      char response[128];
+      snprintf(response, sizeof(response),
+               "HTTP/1.1 200 OK\r\nContent-Length: 1\r\n"
+               "Connection: close\r\n\r\n%c", name_);
+      send(conn, response, strlen(response), 0);
+      close(conn);
+    }
+  }
+
+  char name_;
+  int socket_;
+  int port_;
+  Mutex lock_;
+  bool stop_;
+  Thread thread_;
+};
+
+// A port that never completes a connect: it listens with a backlog of
+// zero and its queue is kept full by connections nobody accepts, so the
+// SYNs of further connects are dropped.
+class BlackHole {
+ public:
+  BlackHole() : socket_(-1), port_(0) {
+    socket_ = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(socket_, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(socket_, 0) != 0 ||
+        getsockname(socket_, (struct sockaddr*)&addr, &len) != 0) {
+      return;
+    }
+    port_ = ntohs(addr.sin_port);
+    // Fill the queue until a connect stops completing.
+    for (int i = 0; i < 16; ++i) {
+      int s = socket(AF_INET, SOCK_STREAM, 0);
+      fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK);
+      fillers_.push_back(s);
+      if (connect(s, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+        continue;
+      }
+      fd_set write_fds;
+      FD_ZERO(&write_fds);
+      FD_SET(s, &write_fds);
+      struct timeval timeout = { 0, 100 * 1000 };
+      if (errno == EINPROGRESS &&
+          select(s + 1, NULL, &write_fds, NULL, &timeout) == 0) {
+        return;
+      }
+    }
+    port_ = 0;
+  }
+
+  ~BlackHole() {
+    for (size_t i = 0; i < fillers_.size(); ++i) {
+      close(fillers_[i]);
+    }
+    close(socket_);
+  }
+
+  // 0 if the queue could not be filled.
+  int port() const { return port_; }
+
+ private:
+  int socket_;
+  int port_;
+  std::vector<int> fillers_;
+};
+
+// Sends one GET through the forwarder and returns the body, the name of
+// the upstream that answered, or 0 on failure.
+char Fetch(int forwarder_port, int64_t* elapsed_us) {
+  int64_t start_us = NowMicros();
+  int s = socket(AF_INET, SOCK_STREAM, 0);
+  struct timeval timeout = { 30, 0 };
+  setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons((unsigned short)forwarder_port);
+  std::string response;
+  if (connect(s, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+    static const char kRequest[] =
+        "GET http://www.example.com/ HTTP/1.1\r\n"
+        "Host: www.example.com\r\n\r\n";
+    send(s, kRequest, sizeof(kRequest) - 1, 0);
+    char buffer[1024];
+    int n;
+    while ((n = recv(s, buffer, sizeof(buffer), 0)) > 0) {
+      response.append(buffer, n);
+    }
+  }
+  close(s);
+  *elapsed_us = NowMicros() - start_us;
+  size_t body = response.find("\r\n\r\n");
+  return body != std::string::npos && body + 4 < response.size() ?
+      response[body + 4] : 0;
+}
+
+std::string Group(int first_port, int second_port) {
+  char description[128];
+  snprintf(description, sizeof(description),
+           "http=127.0.0.1:%d,127.0.0.1:%d", first_port, second_port);
+  return description;
+}
+
+// The first request after the fault, then kRequests more.
+void MeasureFailover(const char* label, Forwarder* forwarder,
+                     char expected) {
+  char name[128];
+  int64_t elapsed_us;
+  char answered = Fetch(forwarder->port(), &elapsed_us);
+  snprintf(name, sizeof(name), "%s, first request", label);
+  ReportBenchmark(name, 1, elapsed_us);
+  int wrong = answered != expected;
+  int64_t total_us = 0;
+  for (int i = 0; i < kRequests; ++i) {
+    wrong += Fetch(forwarder->port(), &elapsed_us) != expected;
+    total_us += elapsed_us;
+  }
+  snprintf(name, sizeof(name), "%s, next requests", label);
+  ReportBenchmark(name, kRequests, total_us);
+  if (wrong) {
+    printf("%s: %d requests not answered by upstream %c\n", label, wrong,
+           expected);
+  }
+}
+
+void Run(int connect_timeout_ms) {
+  UpstreamStub first('A');
+  UpstreamStub second('B');
+  if (!first.Start(0) || !second.Start(0)) {
+    printf("cannot start the upstream stand-ins\n");
+    return;
+  }
+  Forwarder::Options options;
+  options.connect_timeout_ms = connect_timeout_ms;
+  Forwarder forwarder(options);
+  if (!forwarder.Start(0)) {
+    printf("cannot start the forwarder\n");
+    return;
+  }
+  char label[128];
+  forwarder.SetProfile(Group(first.port(), second.port()), "");
+  snprintf(label, sizeof(label), "healthy");
+  MeasureFailover(label, &forwarder, 'A');
+
+  first.Stop();
+  snprintf(label, sizeof(label), "refused");
+  MeasureFailover(label, &forwarder, 'B');
+
+  // Back on the same port; requests keep coming until one reaches it.
+  int64_t start_us = NowMicros();
+  first.Start(first.port());
+  int64_t elapsed_us;
+  while (Fetch(forwarder.port(), &elapsed_us) != 'A' &&
+         NowMicros() - start_us < 60 * 1000000LL) {
+    SleepMillis(kRecoveryPollMs);
+  }
+  ReportBenchmark("recovery, until traffic returns", 1,
+                  NowMicros() - start_us);
+
+  BlackHole black_hole;
+  if (!black_hole.port()) {
+    printf("cannot make a port that drops connects\n");
+    return;
+  }
+  forwarder.SetProfile(Group(black_hole.port(), second.port()), "");
+  snprintf(label, sizeof(label), "black hole, %d ms connect timeout",
+           connect_timeout_ms);
+  MeasureFailover(label, &forwarder, 'B');
+  forwarder.Stop();
+}
+
+}  // namespace
+
+int main() {
+  InitializeSockets();
+  Run(500);
+  Run(100);
+  return 0;
+}
@@ -0,0 +1,154 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// getProxyConfig through the plugin's NPAPI entry points, on the headless
+// browser: it returns one object while the setting stays the same, and
+// tells that it did without allocating, in the plugin or in the browser.
+
+#include <stdlib.h>
+
+#include <new>
+
+#include "headless_plugin.h"
+#include "test_util.h"
+
+// Every operator new of the process, the plugin's included.
+static int64_t new_calls = 0;
+
+void* operator new(size_t size) {
+  ++new_calls;
+  void* p = malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* p) throw() {
+  free(p);
+}
+
+void operator delete[](void* p) throw() {
+  free(p);
+}
+
+void operator delete(void* p, size_t) throw() {
+  free(p);
+}
+
+void operator delete[](void* p, size_t) throw() {
+  free(p);
+}
+
+namespace {
+
+const int kCalls = 1000;
+
+// plugin.getProxyConfig(), with the reference the caller gets.
+NPObject* GetProxyConfig(HeadlessPlugin* plugin) {
+  NPVariant result;
+  if (!plugin->Invoke("getProxyConfig", &result) ||
+      !NPVARIANT_IS_OBJECT(result)) {
+    return NULL;
+  }
+  return NPVARIANT_TO_OBJECT(result);
+}
+
+bool UseProxy(HeadlessPlugin* plugin, NPObject* config) {
+  NPVariant value;
+  CHECK(plugin->GetProperty(config, "useProxy", &value));
+  return NPVARIANT_IS_BOOLEAN(value) && NPVARIANT_TO_BOOLEAN(value);
+}
+
+void TestSameObjectWhileUnchanged(HeadlessPlugin* plugin) {
+  NPObject* first = GetProxyConfig(plugin);
+  CHECK(first != NULL);
+  if (!first) {
+    return;
+  }
+  CHECK(UseProxy(plugin, first));
+  NPObject* second = GetProxyConfig(plugin);
+  CHECK(first == second);
+  headless::ReleaseObject(first);
+  headless::ReleaseObject(second);
+}
+
+void TestNoAllocationsWhileUnchanged(HeadlessPlugin* plugin) {
+  plugin->WaitForSharedState();
+  NPObject* first = GetProxyConfig(plugin);
+  int64_t news = new_calls;
+  int64_t browser_allocations = HeadlessPlugin::browser_allocations();
+  int reads = HeadlessPlugin::system_reads();
+  bool same = true;
+  for (int i = 0; i < kCalls; ++i) {
+    NPObject* config = GetProxyConfig(plugin);
+    same = same && config == first;
+    headless::ReleaseObject(config);
+  }
+  CHECK(same);
+  CHECK_EQ(0, new_calls - news);
+  CHECK_EQ(0, HeadlessPlugin::browser_allocations() - browser_allocations);
+  CHECK_EQ(reads, HeadlessPlugin::system_reads());
+  headless::ReleaseObject(first);
+}
+
+void TestNewObjectAfterChange(HeadlessPlugin* plugin) {
+  NPObject* before = GetProxyConfig(plugin);
+  NPObject* fields = HeadlessPlugin::NewObject();
+  NPVariant value;
+  BOOLEAN_TO_NPVARIANT(false, value);
+  headless::JSSetProperty(fields, headless::GetStringIdentifier("useProxy"),
+                          &value);
+  NPVariant arg;
+  OBJECT_TO_NPVARIANT(fields, arg);
+  NPVariant result;
+  CHECK(plugin->Invoke("setProxyConfig", &arg, 1, &result));
+  headless::ReleaseVariantValue(&result);
+  headless::ReleaseObject(fields);
+
+  // Right away, before the shared state caught up.
+  NPObject* after = GetProxyConfig(plugin);
+  CHECK(after != NULL && after != before);
+  if (after) {
+    CHECK(!UseProxy(plugin, after));
+  }
+  // And once it did, without allocating again.
+  plugin->WaitForSharedState();
+  NPObject* current = GetProxyConfig(plugin);
+  CHECK(current == after);
+  int64_t news = new_calls;
+  headless::ReleaseObject(GetProxyConfig(plugin));
+  CHECK_EQ(0, new_calls - news);
+  headless::ReleaseObject(current);
+  headless::ReleaseObject(after);
+  headless::ReleaseObject(before);
+}
+
+}  // namespace
+
+int main() {
+  HeadlessPlugin::SetSystemProxy(true, "proxy.example:8080");
+  HeadlessPlugin plugin;
+  CHECK(plugin.Start());
+  TestSameObjectWhileUnchanged(&plugin);
+  TestNoAllocationsWhileUnchanged(&plugin);
+  TestNewObjectAfterChange(&plugin);
+  plugin.Stop();
+  return TestResult("get_proxy_config_test");
+}
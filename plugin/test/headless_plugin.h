@@ -0,0 +1,587 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Runs the plugin the way a browser does, without one: NP_Initialize with
+// NPN functions that keep identifiers, objects and javascript values in
+// plain memory, an instance and its scriptable object, and a fake system
+// proxy setting in place of the platform backend. Each Start gets data and
+// cache directories of its own, so saved profiles and the shared state
+// start empty. One plugin per process, on the calling thread.
+
+#ifndef __HEADLESS_PLUGIN_H__
+#define __HEADLESS_PLUGIN_H__
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "npswitchproxy.h"
+#include "platform_util.h"
+#include "proxy_base.h"
+#include "proxy_config.h"
+
+namespace headless {
+
+// The system proxy setting the fake backend reads and writes, shared by
+// all threads of the plugin.
+struct FakeSystem {
+  FakeSystem()
+      : main_thread(pthread_self()), reads(0), applies(0),
+        fail_applies(false) {}
+
+  Mutex lock;
+  ProxyConfig config;
+  // The thread the page's calls run on.
+  pthread_t main_thread;
+  // Reads made on main_thread. The shared state also reads the setting,
+  // on a thread of its own and whenever it sees fit.
+  int reads;
+  int applies;
+  // Whether applying a setting fails, as without the rights to.
+  bool fail_applies;
+};
+
+inline FakeSystem* System() {
+  static FakeSystem* system = new FakeSystem;
+  return system;
+}
+
+struct FakePayload : ProxyPayload {
+  ProxyConfig config;
+};
+
+class FakeProxy : public ProxyBase {
+ public:
+  virtual bool GetActiveConnectionName(const void** connection_name) {
+    *connection_name = NULL;
+    return true;
+  }
+  virtual bool GetProxyConfig(ProxyConfig* config) {
+    ScopedLock lock(&System()->lock);
+    if (pthread_equal(pthread_self(), System()->main_thread)) {
+      ++System()->reads;
+    }
+    config->CopyFields(System()->config, kAllProxyConfigFields);
+    return true;
+  }
+  virtual ProxyPayload* CompilePayload(const ProxyConfig& config) {
+    FakePayload* payload = new FakePayload;
+    payload->config.CopyFields(config, kAllProxyConfigFields);
+    return payload;
+  }
+  virtual bool ApplyPayload(const ProxyPayload& payload) {
+    ScopedLock lock(&System()->lock);
+    if (System()->fail_applies) {
+      return false;
+    }
+    ++System()->applies;
+    System()->config.CopyFields(((const FakePayload&)payload).config,
+                                kAllProxyConfigFields);
+    return true;
+  }
+  virtual bool EnumerateConnections(std::vector<std::string>* names) {
+    names->assign(1, "LAN");
+    return true;
+  }
+  virtual bool ApplyPayloadToConnection(const ProxyPayload& payload,
+                                        const std::string& name) {
+    return name == "LAN" && ApplyPayload(payload);
+  }
+};
+
+inline ProxyBase* CreateFakeProxy() {
+  return new FakeProxy;
+}
+
+// What the fake browser keeps.
+struct Browser {
+  Browser() : allocations(0) {}
+
+  // String identifiers point to their interned name, so that the plugin's
+  // name comparisons on them work; integer ones are odd.
+  std::set<std::string> strings;
+  int64_t allocations;  // Calls to NPN_MemAlloc.
+  std::string exception;
+  Mutex async_lock;
+  std::vector<std::pair<void (*)(void*), void*> > async_calls;
+};
+
+inline Browser* GetBrowser() {
+  static Browser* browser = new Browser;
+  return browser;
+}
+
+inline bool IsIntIdentifier(NPIdentifier identifier) {
+  return ((size_t)identifier & 1) != 0;
+}
+
+inline NPIdentifier GetStringIdentifier(const NPUTF8* name) {
+  return (NPIdentifier)GetBrowser()->strings.insert(name).first->c_str();
+}
+
+inline void GetStringIdentifiers(const NPUTF8** names, int32_t count,
+                                 NPIdentifier* identifiers) {
+  for (int32_t i = 0; i < count; ++i) {
+    identifiers[i] = GetStringIdentifier(names[i]);
+  }
+}
+
+inline NPIdentifier GetIntIdentifier(int32_t value) {
+  return (NPIdentifier)(((size_t)(uint32_t)value << 1) | 1);
+}
+
+inline bool IdentifierIsString(NPIdentifier identifier) {
+  return !IsIntIdentifier(identifier);
+}
+
+inline int32_t IntFromIdentifier(NPIdentifier identifier) {
+  return IsIntIdentifier(identifier) ?
+      (int32_t)(uint32_t)((size_t)identifier >> 1) : -1;
+}
+
+inline void* MemAlloc(uint32_t size) {
+  ++GetBrowser()->allocations;
+  return malloc(size);
+}
+
+inline void MemFree(void* ptr) {
+  free(ptr);
+}
+
+inline NPUTF8* Utf8FromIdentifier(NPIdentifier identifier) {
+  if (IsIntIdentifier(identifier)) {
+    return NULL;
+  }
+  const char* name = (const char*)identifier;
+  NPUTF8* copy = (NPUTF8*)MemAlloc((uint32_t)strlen(name) + 1);
+  strcpy(copy, name);
+  return copy;
+}
+
+// The key of a property: the name, or the decimal index.
+inline std::string PropertyKey(NPIdentifier identifier) {
+  if (!IsIntIdentifier(identifier)) {
+    return (const char*)identifier;
+  }
+  char key[16];
+  snprintf(key, sizeof(key), "%d", IntFromIdentifier(identifier));
+  return key;
+}
+
+inline NPObject* CreateObject(NPP npp, NPClass* npclass) {
+  NPObject* obj = npclass->allocate ? npclass->allocate(npp, npclass) :
+      (NPObject*)malloc(sizeof(NPObject));
+  obj->_class = npclass;
+  obj->referenceCount = 1;
+  return obj;
+}
+
+inline NPObject* RetainObject(NPObject* obj) {
+  ++obj->referenceCount;
+  return obj;
+}
+
+inline void ReleaseObject(NPObject* obj) {
+  if (--obj->referenceCount == 0) {
+    if (obj->_class->deallocate) {
+      obj->_class->deallocate(obj);
+    } else {
+      free(obj);
+    }
+  }
+}
+
+inline void ReleaseVariantValue(NPVariant* variant) {
+  if (NPVARIANT_IS_STRING(*variant)) {
+    MemFree((void*)NPVARIANT_TO_STRING(*variant).UTF8Characters);
+  } else if (NPVARIANT_IS_OBJECT(*variant)) {
+    ReleaseObject(NPVARIANT_TO_OBJECT(*variant));
+  }
+  VOID_TO_NPVARIANT(*variant);
+}
+
+// A copy the holder owns: strings are copied and objects retained.
+inline NPVariant CopyVariant(const NPVariant& value) {
+  NPVariant copy = value;
+  if (NPVARIANT_IS_STRING(value)) {
+    uint32_t len = NPVARIANT_TO_STRING(value).UTF8Length;
+    char* utf8 = (char*)malloc(len + 1);
+    memcpy(utf8, NPVARIANT_TO_STRING(value).UTF8Characters, len);
+    utf8[len] = 0;
+    STRINGN_TO_NPVARIANT(utf8, len, copy);
+  } else if (NPVARIANT_IS_OBJECT(value)) {
+    RetainObject(NPVARIANT_TO_OBJECT(value));
+  }
+  return copy;
+}
+
+// A javascript Object or Array.
+struct JSObject : NPObject {
+  std::map<std::string, NPVariant> properties;
+  bool is_array;
+  int32_t length;
+};
+
+inline NPObject* AllocateJSObject(NPP, NPClass*) {
+  JSObject* obj = new JSObject;
+  obj->is_array = false;
+  obj->length = 0;
+  return obj;
+}
+
+inline void DeallocateJSObject(NPObject* obj) {
+  JSObject* js = (JSObject*)obj;
+  for (std::map<std::string, NPVariant>::iterator it =
+           js->properties.begin(); it != js->properties.end(); ++it) {
+    ReleaseVariantValue(&it->second);
+  }
+  delete js;
+}
+
+inline bool JSHasProperty(NPObject* obj, NPIdentifier name) {
+  JSObject* js = (JSObject*)obj;
+  return js->properties.count(PropertyKey(name)) ||
+      (js->is_array && PropertyKey(name) == "length");
+}
+
+inline bool JSGetProperty(NPObject* obj, NPIdentifier name,
+                          NPVariant* result) {
+  JSObject* js = (JSObject*)obj;
+  std::string key = PropertyKey(name);
+  if (js->is_array && key == "length") {
+    INT32_TO_NPVARIANT(js->length, *result);
+    return true;
+  }
+  std::map<std::string, NPVariant>::iterator it = js->properties.find(key);
+  if (it == js->properties.end()) {
+    VOID_TO_NPVARIANT(*result);
+    return true;
+  }
+  *result = CopyVariant(it->second);
+  if (NPVARIANT_IS_STRING(*result)) {
+    // Handed out strings are freed with NPN_MemFree.
+    const NPString& str = NPVARIANT_TO_STRING(*result);
+    char* utf8 = (char*)MemAlloc(str.UTF8Length + 1);
+    memcpy(utf8, str.UTF8Characters, str.UTF8Length + 1);
+    free((void*)str.UTF8Characters);
+    STRINGN_TO_NPVARIANT(utf8, str.UTF8Length, *result);
+  }
+  return true;
+}
+
+inline bool JSSetProperty(NPObject* obj, NPIdentifier name,
+                          const NPVariant* value) {
+  JSObject* js = (JSObject*)obj;
+  std::string key = PropertyKey(name);
+  std::map<std::string, NPVariant>::iterator it = js->properties.find(key);
+  if (it != js->properties.end()) {
+    ReleaseVariantValue(&it->second);
+  }
+  js->properties[key] = CopyVariant(*value);
+  if (js->is_array && IsIntIdentifier(name) &&
+      IntFromIdentifier(name) >= js->length) {
+    js->length = IntFromIdentifier(name) + 1;
+  }
+  return true;
+}
+
+inline bool JSHasMethod(NPObject* obj, NPIdentifier name) {
+  return ((JSObject*)obj)->is_array && PropertyKey(name) == "push";
+}
+
+inline bool JSInvoke(NPObject* obj, NPIdentifier name, const NPVariant* args,
+                     uint32_t count, NPVariant* result) {
+  JSObject* js = (JSObject*)obj;
+  if (!JSHasMethod(obj, name)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < count; ++i) {
+    JSSetProperty(obj, GetIntIdentifier(js->length), &args[i]);
+  }
+  INT32_TO_NPVARIANT(js->length, *result);
+  return true;
+}
+
+inline NPClass* JSClass() {
+  static NPClass js_class = {
+    NP_CLASS_STRUCT_VERSION, AllocateJSObject, DeallocateJSObject, NULL,
+    JSHasMethod, JSInvoke, NULL, JSHasProperty, JSGetProperty,
+    JSSetProperty, NULL,
+  };
+  return &js_class;
+}
+
+inline NPObject* NewJSObject(bool is_array) {
+  JSObject* obj = (JSObject*)CreateObject(NULL, JSClass());
+  obj->is_array = is_array;
+  return obj;
+}
+
+// The window, whose Object() and Array() make new ones.
+inline bool WindowHasMethod(NPObject*, NPIdentifier name) {
+  return PropertyKey(name) == "Object" || PropertyKey(name) == "Array";
+}
+
+inline bool WindowInvoke(NPObject* obj, NPIdentifier name, const NPVariant*,
+                         uint32_t, NPVariant* result) {
+  if (!WindowHasMethod(obj, name)) {
+    return false;
+  }
+  OBJECT_TO_NPVARIANT(NewJSObject(PropertyKey(name) == "Array"), *result);
+  return true;
+}
+
+inline NPObject* Window() {
+  static NPClass window_class = {
+    NP_CLASS_STRUCT_VERSION, NULL, NULL, NULL, WindowHasMethod,
+    WindowInvoke, NULL, NULL, NULL, NULL, NULL,
+  };
+  static NPObject* window = CreateObject(NULL, &window_class);
+  return window;
+}
+
+inline NPError GetValue(NPP, NPNVariable variable, void* value) {
+  if (variable != NPNVWindowNPObject) {
+    return NPERR_GENERIC_ERROR;
+  }
+  *(NPObject**)value = RetainObject(Window());
+  return NPERR_NO_ERROR;
+}
+
+inline bool Invoke(NPP, NPObject* obj, NPIdentifier name,
+                   const NPVariant* args, uint32_t count, NPVariant* result) {
+  VOID_TO_NPVARIANT(*result);
+  return obj->_class->invoke && obj->_class->invoke(obj, name, args, count,
+                                                    result);
+}
+
+inline bool GetProperty(NPP, NPObject* obj, NPIdentifier name,
+                        NPVariant* result) {
+  VOID_TO_NPVARIANT(*result);
+  return obj->_class->getProperty &&
+      obj->_class->getProperty(obj, name, result);
+}
+
+inline bool SetProperty(NPP, NPObject* obj, NPIdentifier name,
+                        const NPVariant* value) {
+  return obj->_class->setProperty &&
+      obj->_class->setProperty(obj, name, value);
+}
+
+inline bool HasProperty(NPP, NPObject* obj, NPIdentifier name) {
+  return obj->_class->hasProperty && obj->_class->hasProperty(obj, name);
+}
+
+inline void SetException(NPObject*, const NPUTF8* message) {
+  GetBrowser()->exception = message ? message : "";
+}
+
+inline void PluginThreadAsyncCall(NPP, void (*func)(void*), void* data) {
+  ScopedLock lock(&GetBrowser()->async_lock);
+  GetBrowser()->async_calls.push_back(std::make_pair(func, data));
+}
+
+inline NPNetscapeFuncs* BrowserFunctions() {
+  static NPNetscapeFuncs funcs;
+  memset(&funcs, 0, sizeof(funcs));
+  funcs.size = sizeof(funcs);
+  funcs.version = (NP_VERSION_MAJOR << 8) | NP_VERSION_MINOR;
+  funcs.memalloc = MemAlloc;
+  funcs.memfree = MemFree;
+  funcs.getvalue = GetValue;
+  funcs.getstringidentifier = GetStringIdentifier;
+  funcs.getstringidentifiers = GetStringIdentifiers;
+  funcs.getintidentifier = GetIntIdentifier;
+  funcs.identifierisstring = IdentifierIsString;
+  funcs.utf8fromidentifier = Utf8FromIdentifier;
+  funcs.intfromidentifier = IntFromIdentifier;
+  funcs.createobject = CreateObject;
+  funcs.retainobject = RetainObject;
+  funcs.releaseobject = ReleaseObject;
+  funcs.invoke = Invoke;
+  funcs.getproperty = GetProperty;
+  funcs.setproperty = SetProperty;
+  funcs.hasproperty = HasProperty;
+  funcs.releasevariantvalue = ReleaseVariantValue;
+  funcs.setexception = SetException;
+  funcs.pluginthreadasynccall = PluginThreadAsyncCall;
+  return &funcs;
+}
+
+}  // namespace headless
+
+class HeadlessPlugin {
+ public:
+  HeadlessPlugin() : plugin_(NULL) {
+    memset(&npp_, 0, sizeof(npp_));
+    memset(&plugin_funcs_, 0, sizeof(plugin_funcs_));
+  }
+  ~HeadlessPlugin() { Stop(); }
+
+  bool Start() {
+    char directory[] = "/tmp/switchproxy-test-XXXXXX";
+    if (!mkdtemp(directory)) {
+      return false;
+    }
+    directory_ = directory;
+    {
+      ScopedLock lock(&headless::System()->lock);
+      headless::System()->main_thread = pthread_self();
+    }
+    setenv("XDG_DATA_HOME", (directory_ + "/data").c_str(), 1);
+    setenv("XDG_CACHE_HOME", (directory_ + "/cache").c_str(), 1);
+    SetProxyFactory(headless::CreateFakeProxy);
+    plugin_funcs_.size = sizeof(plugin_funcs_);
+    if (NP_Initialize(headless::BrowserFunctions(), &plugin_funcs_) !=
+        NPERR_NO_ERROR) {
+      return false;
+    }
+    char mime_type[] = "application/x-switch-proxy";
+    if (plugin_funcs_.newp(mime_type, &npp_, NP_EMBED, 0, NULL, NULL,
+                           NULL) != NPERR_NO_ERROR ||
+        plugin_funcs_.getvalue(&npp_, NPPVpluginScriptableNPObject,
+                               &plugin_) != NPERR_NO_ERROR) {
+      return false;
+    }
+    return true;
+  }
+
+  // Destroys the instance and shuts the plugin down.
+  void Stop() {
+    if (directory_.empty()) {
+      return;
+    }
+    if (plugin_) {
+      headless::ReleaseObject(plugin_);
+      plugin_ = NULL;
+    }
+    plugin_funcs_.destroy(&npp_, NULL);
+    NP_Shutdown();
+    std::string command = "rm -rf '" + directory_ + "'";
+    if (system(command.c_str()) != 0) {
+      fprintf(stderr, "cannot remove %s\n", directory_.c_str());
+    }
+    directory_.clear();
+  }
+
+  NPObject* plugin() { return plugin_; }
+  NPP npp() { return &npp_; }
+
+  // Calls plugin.method(args...).
+  bool Invoke(const char* method, const NPVariant* args, uint32_t count,
+              NPVariant* result) {
+    return headless::Invoke(&npp_, plugin_,
+                            headless::GetStringIdentifier(method), args,
+                            count, result);
+  }
+  bool Invoke(const char* method, NPVariant* result) {
+    return Invoke(method, NULL, 0, result);
+  }
+  bool GetProperty(NPObject* obj, const char* name, NPVariant* result) {
+    return headless::GetProperty(&npp_, obj,
+                                 headless::GetStringIdentifier(name), result);
+  }
+  bool GetElement(NPObject* obj, int32_t index, NPVariant* result) {
+    return headless::GetProperty(&npp_, obj,
+                                 headless::GetIntIdentifier(index), result);
+  }
+
+  // Calls getProxyConfig until the shared state has caught up with a
+  // change and answers for it again, or a few seconds went by.
+  void WaitForSharedState() {
+    for (int i = 0; i < 300; ++i) {
+      int reads = system_reads();
+      CallGetProxyConfig();
+      SleepMillis(10);
+      if (system_reads() == reads) {
+        CallGetProxyConfig();
+        if (system_reads() == reads) {
+          return;
+        }
+      }
+    }
+  }
+
+  // A new javascript {} or [], with one reference for the caller.
+  static NPObject* NewObject() { return headless::NewJSObject(false); }
+  static NPObject* NewArray() { return headless::NewJSObject(true); }
+
+  // Runs what other threads handed to the main thread with
+  // NPN_PluginThreadAsyncCall.
+  static void RunAsyncCalls() {
+    std::vector<std::pair<void (*)(void*), void*> > calls;
+    {
+      ScopedLock lock(&headless::GetBrowser()->async_lock);
+      calls.swap(headless::GetBrowser()->async_calls);
+    }
+    for (size_t i = 0; i < calls.size(); ++i) {
+      calls[i].first(calls[i].second);
+    }
+  }
+
+  // Calls to NPN_MemAlloc so far.
+  static int64_t browser_allocations() {
+    return headless::GetBrowser()->allocations;
+  }
+
+  // Sets the fake system setting, as a change outside the plugin would.
+  static void SetSystemProxy(bool use_proxy, const char* proxy_server) {
+    headless::FakeSystem* system = headless::System();
+    ScopedLock lock(&system->lock);
+    system->config.use_proxy = use_proxy;
+    delete [] system->config.proxy_server;
+    system->config.proxy_server = NULL;
+    if (proxy_server) {
+      system->config.proxy_server = new char[strlen(proxy_server) + 1];
+      strcpy(system->config.proxy_server, proxy_server);
+    }
+  }
+  // Reads of the setting made on the thread that started the plugin.
+  static int system_reads() {
+    ScopedLock lock(&headless::System()->lock);
+    return headless::System()->reads;
+  }
+  static int system_applies() {
+    ScopedLock lock(&headless::System()->lock);
+    return headless::System()->applies;
+  }
+  // Has every later apply fail, or succeed again.
+  static void FailApplies(bool fail) {
+    ScopedLock lock(&headless::System()->lock);
+    headless::System()->fail_applies = fail;
+  }
+
+ private:
+  void CallGetProxyConfig() {
+    NPVariant result;
+    if (Invoke("getProxyConfig", &result)) {
+      headless::ReleaseVariantValue(&result);
+    }
+  }
+
+  NPP_t npp_;
+  NPPluginFuncs plugin_funcs_;
+  NPObject* plugin_;
+  std::string directory_;
+};
+
+#endif  // __HEADLESS_PLUGIN_H__
@@ -0,0 +1,233 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Parses request heads as the forwarder receives them from browsers:
+// proxy-form GETs with the headers and cookies of a current browser, a
+// POST, CONNECTs and an origin-form request. "scalar" parses the same
+// heads with a loop over every byte instead of the blocks of ByteScanner,
+// and finds the same request line and Host header.
+
+#include "http_parser.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "test_util.h"
+
+namespace {
+
+const int64_t kBytesPerMeasurement = 64 * 1024 * 1024;
+
+const char* const kRequests[] = {
+  "GET http://www.example.com/news/world/article-2011-04-18.html?ref=home "
+  "HTTP/1.1\r\n"
+  "Host: www.example.com\r\n"
+  "Proxy-Connection: keep-alive\r\n"
+  "User-Agent: Mozilla/5.0 (Windows NT 6.1; WOW64) AppleWebKit/534.24 "
+  "(KHTML, like Gecko) Chrome/11.0.696.16 Safari/534.24\r\n"
+  "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8"
+  "\r\n"
+  "Referer: http://www.example.com/\r\n"
+  "Accept-Encoding: gzip,deflate,sdch\r\n"
+  "Accept-Language: en-US,en;q=0.8,zh-CN;q=0.6\r\n"
+  "Accept-Charset: ISO-8859-1,utf-8;q=0.7,*;q=0.3\r\n"
+  "Cookie: __utma=173272373.1393426178.1302246585.1303086582.1303108817.12; "
+  "__utmz=173272373.1302246585.1.1.utmcsr=(direct)|utmccn=(direct)|"
+  "utmcmd=(none); session=6f1c3a9be2d84d07a1f2e0c5b7d9e3f1; prefs=hl%3Den\r\n"
+  "\r\n",
+
+  "GET http://static.example-cdn.net/img/sprites/toolbar-2x.png HTTP/1.1\r\n"
+  "Host: static.example-cdn.net\r\n"
+  "Proxy-Connection: keep-alive\r\n"
+  "User-Agent: Mozilla/5.0 (Windows NT 6.1; WOW64) AppleWebKit/534.24 "
+  "(KHTML, like Gecko) Chrome/11.0.696.16 Safari/534.24\r\n"
+  "Accept: */*\r\n"
+  "Referer: http://www.example.com/news/world/article-2011-04-18.html\r\n"
+  "Accept-Encoding: gzip,deflate,sdch\r\n"
+  "Accept-Language: en-US,en;q=0.8\r\n"
+  "If-Modified-Since: Tue, 12 Apr 2011 08:14:03 GMT\r\n"
+  "If-None-Match: \"4d3f8a-2b1c-4a0b7e1c\"\r\n"
+  "\r\n",
+
+  "POST http://api.example.org/v2/events HTTP/1.1\r\n"
+  "Host: api.example.org\r\n"
+  "Content-Length: 182\r\n"
+  "Content-Type: application/x-www-form-urlencoded\r\n"
+  "Origin: http://www.example.com\r\n"
+  "User-Agent: Mozilla/5.0 (Macintosh; U; Intel Mac OS X 10_6_7; en-us) "
+  "AppleWebKit/533.20.25 (KHTML, like Gecko) Version/5.0.4 "
+  "Safari/533.20.27\r\n"
+  "Accept: application/json, text/javascript, */*\r\n"
+  "\r\n",
+
+  "CONNECT mail.example.com:443 HTTP/1.1\r\n"
+  "Host: mail.example.com:443\r\n"
+  "Proxy-Connection: keep-alive\r\n"
+  "User-Agent: Mozilla/5.0 (Windows NT 6.1; WOW64) AppleWebKit/534.24 "
+  "(KHTML, like Gecko) Chrome/11.0.696.16 Safari/534.24\r\n"
+  "\r\n",
+
+  "CONNECT [2001:db8::1]:8443 HTTP/1.0\r\n\r\n",
+
+  "GET /wpad.dat HTTP/1.1\r\n"
+  "host:wpad.corp.example\r\n"
+  "Connection: close\r\n"
+  "\r\n",
+};
+
+// As ParseHttpRequestHead, one byte at a time.
+HttpParseResult ParseScalar(const char* data, size_t len,
+                            HttpRequestHead* head) {
+  *head = HttpRequestHead();
+  const char* end = data + len;
+  const char* line = data;
+  bool first_line = true;
+  for (const char* p = data; p < end; ++p) {
+    if (*p != '\n') {
+      continue;
+    }
+    const char* line_end = p > line && p[-1] == '\r' ? p - 1 : p;
+    if (first_line) {
+      const char* space = line;
+      while (space < line_end && *space != ' ') {
+        ++space;
+      }
+      const char* target = space + 1;
+      const char* target_end = target;
+      while (target_end < line_end && *target_end != ' ') {
+        ++target_end;
+      }
+      if (space == line || target_end >= line_end || target_end == target ||
+          line_end - target_end < 6 ||
+          strncmp(target_end + 1, "HTTP/", 5) != 0) {
+        return kHttpParseError;
+      }
+      head->method = StringPiece(line, space - line);
+      head->target = StringPiece(target, target_end - target);
+      head->version = StringPiece(target_end + 1, line_end - target_end - 1);
+      first_line = false;
+    } else if (line_end == line) {
+      head->head_length = p + 1 - data;
+      return kHttpParseDone;
+    } else if (head->host.empty() && line_end - line >= 5 &&
+               (line[0] | 0x20) == 'h' && (line[1] | 0x20) == 'o' &&
+               (line[2] | 0x20) == 's' && (line[3] | 0x20) == 't' &&
+               line[4] == ':') {
+      const char* value = line + 5;
+      while (value < line_end && (*value == ' ' || *value == '\t')) {
+        ++value;
+      }
+      const char* value_end = line_end;
+      while (value_end > value &&
+             (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+        --value_end;
+      }
+      head->host = StringPiece(value, value_end - value);
+    }
+    line = p + 1;
+  }
+  return kHttpParseIncomplete;
+}
+
+bool SameHead(const HttpRequestHead& a, const HttpRequestHead& b) {
+  return a.method.ToString() == b.method.ToString() &&
+         a.target.ToString() == b.target.ToString() &&
+         a.version.ToString() == b.version.ToString() &&
+         a.host.ToString() == b.host.ToString() &&
+         a.head_length == b.head_length;
+}
+
+typedef HttpParseResult (*ParseFunction)(const char* data, size_t len,
+                                         HttpRequestHead* head);
+
+void Measure(const char* label, ParseFunction parse,
+             const std::vector<std::string>& heads) {
+  size_t bytes = 0;
+  for (size_t i = 0; i < heads.size(); ++i) {
+    bytes += heads[i].size();
+  }
+  const int kRounds = (int)(kBytesPerMeasurement / bytes);
+  HttpRequestHead head;
+  size_t check = 0;
+  int64_t start_us = NowMicros();
+  for (int round = 0; round < kRounds; ++round) {
+    for (size_t i = 0; i < heads.size(); ++i) {
+      parse(heads[i].data(), heads[i].size(), &head);
+      check += head.head_length;
+    }
+  }
+  int64_t elapsed_us = NowMicros() - start_us;
+  char name[128];
+  snprintf(name, sizeof(name), "%s, per head", label);
+  ReportBenchmark(name, (int64_t)heads.size() * kRounds, elapsed_us);
+  snprintf(name, sizeof(name), "%s, throughput", label);
+  ReportThroughput(name, (int64_t)bytes * kRounds, elapsed_us);
+  // Keeps the loops from being optimized away.
+  if (check == 1) {
+    printf("\n");
+  }
+}
+
+// Routing needs the destination as well: the head, then where it goes.
+void MeasureDestination(const std::vector<std::string>& heads) {
+  const int kRounds = 200000;
+  HttpRequestHead head;
+  std::string scheme;
+  std::string host;
+  int port;
+  StringPiece path;
+  int routed = 0;
+  int64_t start_us = NowMicros();
+  for (int round = 0; round < kRounds; ++round) {
+    for (size_t i = 0; i < heads.size(); ++i) {
+      if (ParseHttpRequestHead(heads[i].data(), heads[i].size(), &head) ==
+              kHttpParseDone &&
+          GetRequestDestination(head, &scheme, &host, &port, &path)) {
+        ++routed;
+      }
+    }
+  }
+  ReportBenchmark("head and destination, per head",
+                  (int64_t)heads.size() * kRounds, NowMicros() - start_us);
+  if (routed != (int)heads.size() * kRounds) {
+    printf("%d of %d heads not routed\n", (int)heads.size() * kRounds - routed,
+           (int)heads.size() * kRounds);
+  }
+}
+
+}  // namespace
+
+int main() {
+  std::vector<std::string> heads;
+  for (size_t i = 0; i < sizeof(kRequests) / sizeof(kRequests[0]); ++i) {
+    heads.push_back(kRequests[i]);
+    HttpRequestHead head;
+    HttpRequestHead scalar_head;
+    if (ParseHttpRequestHead(heads[i].data(), heads[i].size(), &head) !=
+            kHttpParseDone ||
+        ParseScalar(heads[i].data(), heads[i].size(), &scalar_head) !=
+            kHttpParseDone ||
+        !SameHead(head, scalar_head)) {
+      printf("request %d: the parsers differ\n", (int)i);
+    }
+  }
+  Measure("request heads", ParseHttpRequestHead, heads);
+  Measure("request heads, scalar", ParseScalar, heads);
+  MeasureDestination(heads);
+  return 0;
+}
@@ -0,0 +1,180 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// PAC scripts and URLs shaped like those seen in the field, for the
+// benchmarks of the PAC engine and of what is built on it.
+
+#ifndef __PAC_CORPUS_H__
+#define __PAC_CORPUS_H__
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "pac_vm.h"
+
+// Answers DNS without the network: every name resolves, to an address
+// made up from its hash, so that isInNet takes both branches.
+class FakePacHost : public PacHost {
+ public:
+  virtual bool ResolveHost(const std::string& host, std::string* address) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < host.size(); ++i) {
+      hash = (hash ^ (unsigned char)host[i]) * 16777619u;
+    }
+    static const int kFirstOctets[] = { 10, 172, 192, 93 };
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%d.%d.%d.%d", kFirstOctets[hash % 4],
+             hash % 4 == 1 ? 16 + (hash >> 8) % 16 :
+             hash % 4 == 2 ? 168 : (hash >> 8) & 0xff,
+             (hash >> 16) & 0xff, (hash >> 24) | 1);
+    *address = buffer;
+    return true;
+  }
+  virtual std::string MyIpAddress() { return "10.1.2.3"; }
+};
+
+// A corporate PAC file: plain host names and the internal domains go
+// direct, then a chain of rules, one per host pattern, picks a proxy.
+// With network_rules, hosts on private networks then go direct and https
+// goes to a proxy of its own; everything else goes to the default
+// proxies. Without them, the result depends on nothing but the host.
+inline std::string PacScriptWithRules(int rules, bool network_rules) {
+  std::string script =
+      "var internal = [\".corp.example\", \".intranet.example\", "
+      "\".local\"];\n"
+      "function isInternal(host) {\n"
+      "  for (var i = 0; i < internal.length; i++) {\n"
+      "    if (dnsDomainIs(host, internal[i])) return true;\n"
+      "  }\n"
+      "  return false;\n"
+      "}\n"
+      "function FindProxyForURL(url, host) {\n"
+      "  host = host.toLowerCase();\n"
+      "  if (isPlainHostName(host) || isInternal(host)) return \"DIRECT\";\n";
+  char line[256];
+  for (int i = 0; i < rules; ++i) {
+    switch (i % 3) {
+      case 0:
+        snprintf(line, sizeof(line),
+                 "  if (dnsDomainIs(host, \".partner%d.example.com\")) "
+                 "return \"PROXY partner%d.corp.example:8080\";\n", i, i % 7);
+        break;
+      case 1:
+        snprintf(line, sizeof(line),
+                 "  if (shExpMatch(host, \"*.cdn%d.example.net\")) "
+                 "return \"DIRECT\";\n", i);
+        break;
+      default:
+        snprintf(line, sizeof(line),
+                 "  if (host == \"app%d.example.org\") "
+                 "return \"PROXY app.corp.example:3128; DIRECT\";\n", i);
+        break;
+    }
+    script += line;
+  }
+  if (network_rules) {
+    script +=
+        "  var ip = dnsResolve(host);\n"
+        "  if (ip && (isInNet(ip, \"10.0.0.0\", \"255.0.0.0\") ||\n"
+        "             isInNet(ip, \"172.16.0.0\", \"255.240.0.0\") ||\n"
+        "             isInNet(ip, \"192.168.0.0\", \"255.255.0.0\")))\n"
+        "    return \"DIRECT\";\n"
+        "  if (url.substring(0, 6) == \"https:\")\n"
+        "    return \"PROXY secure.corp.example:8443\";\n";
+  }
+  script +=
+      "  return \"PROXY proxy1.corp.example:8080; "
+      "PROXY proxy2.corp.example:8080\";\n"
+      "}\n";
+  return script;
+}
+
+// A branch office script: local names and the office networks go direct,
+// the rest by scheme to two proxies that take over from each other.
+inline std::string OfficePacScript() {
+  return
+      "function FindProxyForURL(url, host) {\n"
+      "  if (isPlainHostName(host) ||\n"
+      "      localHostOrDomainIs(host, \"intranet.corp.example\") ||\n"
+      "      shExpMatch(host, \"*.local\"))\n"
+      "    return \"DIRECT\";\n"
+      "  if (shExpMatch(host, \"10.*\") || shExpMatch(host, \"192.168.*\"))\n"
+      "    return \"DIRECT\";\n"
+      "  if (isInNet(myIpAddress(), \"10.1.0.0\", \"255.255.0.0\")) {\n"
+      "    if (url.substring(0, 4) == \"ftp:\")\n"
+      "      return \"PROXY ftp.corp.example:2121\";\n"
+      "    return \"PROXY proxy-a.corp.example:8080; \" +\n"
+      "        \"PROXY proxy-b.corp.example:8080; DIRECT\";\n"
+      "  }\n"
+      "  return \"PROXY proxy-b.corp.example:8080; \" +\n"
+      "      \"PROXY proxy-a.corp.example:8080; DIRECT\";\n"
+      "}\n";
+}
+
+// A blocking script as shared online: a list of domains in an array,
+// searched by a loop, sends them to a black hole.
+inline std::string BlocklistPacScript(int domains) {
+  std::string script = "var blocked = [";
+  char entry[64];
+  for (int i = 0; i < domains; ++i) {
+    snprintf(entry, sizeof(entry), "%s\"ads%d.example%d.com\"", i ? ", " : "",
+             i, i % 13);
+    script += entry;
+  }
+  script +=
+      "];\n"
+      "function FindProxyForURL(url, host) {\n"
+      "  for (var i = 0; i < blocked.length; i++) {\n"
+      "    if (dnsDomainIs(host, blocked[i]))\n"
+      "      return \"PROXY 127.0.0.1:9\";\n"
+      "  }\n"
+      "  return \"DIRECT\";\n"
+      "}\n";
+  return script;
+}
+
+// count URLs with distinct hosts, a mix of the rules' hosts, internal
+// ones and others.
+inline void DistinctUrls(int count, int rules, std::vector<std::string>* urls) {
+  char url[256];
+  for (int i = 0; i < count; ++i) {
+    int rule = rules ? i % rules : 0;
+    switch (i % 6) {
+      case 0:
+        snprintf(url, sizeof(url), "http://www%d.partner%d.example.com/a",
+                 i, rule - rule % 3);
+        break;
+      case 1:
+        snprintf(url, sizeof(url), "https://img%d.cdn%d.example.net/b.png",
+                 i, rule - rule % 3 + 1);
+        break;
+      case 2:
+        snprintf(url, sizeof(url), "http://wiki%d.corp.example/page", i);
+        break;
+      case 3:
+        snprintf(url, sizeof(url), "http://host%d/", i);
+        break;
+      default:
+        snprintf(url, sizeof(url), "%s://site%d.example%d.com/index.html",
+                 i % 2 ? "https" : "http", i, i % 97);
+        break;
+    }
+    urls->push_back(url);
+  }
+}
+
+#endif  // __PAC_CORPUS_H__
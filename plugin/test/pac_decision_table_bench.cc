@@ -0,0 +1,153 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Compares answering the host rule chains of a PAC file through their
+// decision tables with running the rules one by one, as the script does
+// without them. Both run the same compiled program; for the straight runs
+// the code that consults the tables is jumped over, so that the rules
+// compiled after it decide. The URLs hit every rule and the ones after
+// the chain alike.
+
+#include "pac_decision_table.h"
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "pac_ast.h"
+#include "pac_compiler.h"
+#include "pac_corpus.h"
+#include "pac_parser.h"
+#include "pac_script.h"
+#include "pac_vm.h"
+#include "test_util.h"
+
+namespace {
+
+const int kUrls = 10000;
+const int kRepeats = 5;
+
+bool Compile(const std::string& source, PacProgram* program) {
+  PacAst ast;
+  std::string error;
+  if (!ParsePacScript(source, &ast, &error) ||
+      !CompilePacScript(ast, program, &error)) {
+    printf("compile failed: %s\n", error.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Turns each load of the chain variable in front of a kPacInstrDecide into
+// a jump past the decision and its return.
+void SkipTables(PacProgram* program) {
+  std::vector<int>& code = program->code;
+  int previous = -1;
+  for (size_t pc = 0; pc < code.size();
+       pc += 1 + PacOperandCount(code[pc])) {
+    if (code[pc] == kPacInstrDecide && previous >= 0 &&
+        (code[previous] == kPacInstrLoadLocal ||
+         code[previous] == kPacInstrLoadGlobal)) {
+      code[previous] = kPacInstrJump;
+      code[previous + 1] = (int)pc + 1 + PacOperandCount(kPacInstrDecide) + 1;
+    }
+    previous = (int)pc;
+  }
+}
+
+// Runs FindProxyForURL for every URL kRepeats times; the results of the
+// last round are left in results.
+int64_t Run(const PacProgram& program,
+            const std::vector<std::vector<PacValue> >& args,
+            std::vector<std::string>* results) {
+  FakePacHost host;
+  PacVm vm(&program, &host);
+  std::string error;
+  if (!vm.Initialize(&error)) {
+    printf("%s\n", error.c_str());
+    return 0;
+  }
+  int function = program.FindFunction("FindProxyForURL");
+  results->assign(args.size(), std::string());
+  PacValue result;
+  int64_t start_us = NowMicros();
+  for (int round = 0; round < kRepeats; ++round) {
+    for (size_t i = 0; i < args.size(); ++i) {
+      if (vm.Call(function, args[i], &result, &error)) {
+        (*results)[i].swap(result.string);
+      }
+    }
+  }
+  return NowMicros() - start_us;
+}
+
+void Measure(int rules, const std::vector<std::string>& urls) {
+  std::string source = PacScriptWithRules(rules, false);
+  PacProgram tables;
+  PacProgram straight;
+  if (!Compile(source, &tables) || !Compile(source, &straight)) {
+    return;
+  }
+  SkipTables(&straight);
+
+  std::vector<std::vector<PacValue> > args(urls.size());
+  for (size_t i = 0; i < urls.size(); ++i) {
+    std::string host;
+    GetHostFromUrl(urls[i], &host);
+    args[i].push_back(PacValue(urls[i]));
+    args[i].push_back(PacValue(host));
+  }
+
+  char name[128];
+  std::vector<std::string> table_results;
+  std::vector<std::string> straight_results;
+  int64_t operations = (int64_t)urls.size() * kRepeats;
+  snprintf(name, sizeof(name), "%d rules, decision table", rules);
+  ReportBenchmark(name, operations, Run(tables, args, &table_results));
+  snprintf(name, sizeof(name), "%d rules, straight", rules);
+  ReportBenchmark(name, operations, Run(straight, args, &straight_results));
+  if (table_results != straight_results) {
+    printf("%d rules: the results differ\n", rules);
+  }
+
+  // The lookup alone, without the VM around it.
+  const PacDecisionTable& table = tables.tables[0];
+  int found = 0;
+  int64_t start_us = NowMicros();
+  for (int round = 0; round < kRepeats; ++round) {
+    for (size_t i = 0; i < args.size(); ++i) {
+      found += table.Lookup(args[i][1].string) >= 0;
+    }
+  }
+  snprintf(name, sizeof(name), "%d rules, PacDecisionTable::Lookup", rules);
+  ReportBenchmark(name, operations, NowMicros() - start_us);
+  if (!found) {
+    printf("%d rules: no host matched\n", rules);
+  }
+}
+
+}  // namespace
+
+int main() {
+  std::vector<std::string> urls;
+  static const int kRules[] = { 10, 50, 200, 1000 };
+  for (size_t i = 0; i < sizeof(kRules) / sizeof(kRules[0]); ++i) {
+    urls.clear();
+    DistinctUrls(kUrls, kRules[i], &urls);
+    Measure(kRules[i], urls);
+  }
+  return 0;
+}
@@ -0,0 +1,122 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Evaluations per second of FindProxyForURL on the VM, for PAC files of
+// the shapes found in the field. Each URL has a host of its own and the
+// result cache of PacScript is left out, so every call runs the script.
+// "load" is the time to parse, compile and run the top level code.
+
+#include "pac_vm.h"
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "pac_ast.h"
+#include "pac_compiler.h"
+#include "pac_corpus.h"
+#include "pac_parser.h"
+#include "pac_script.h"
+#include "test_util.h"
+
+namespace {
+
+const int kUrls = 10000;
+const int kLoads = 20;
+// Calls go on over the URLs, round after round, for at least this long.
+const int64_t kMinCallMicros = 300 * 1000;
+
+bool Compile(const std::string& source, PacProgram* program) {
+  PacAst ast;
+  std::string error;
+  if (!ParsePacScript(source, &ast, &error) ||
+      !CompilePacScript(ast, program, &error)) {
+    printf("compile failed: %s\n", error.c_str());
+    return false;
+  }
+  return true;
+}
+
+void Measure(const char* label, const std::string& source,
+             const std::vector<std::string>& urls) {
+  char name[128];
+  int64_t start_us = NowMicros();
+  for (int i = 0; i < kLoads; ++i) {
+    PacProgram program;
+    Compile(source, &program);
+    FakePacHost host;
+    PacVm vm(&program, &host);
+    std::string error;
+    vm.Initialize(&error);
+  }
+  snprintf(name, sizeof(name), "%s: load", label);
+  ReportBenchmark(name, kLoads, NowMicros() - start_us);
+
+  PacProgram program;
+  if (!Compile(source, &program)) {
+    return;
+  }
+  FakePacHost host;
+  PacVm vm(&program, &host);
+  std::string error;
+  if (!vm.Initialize(&error)) {
+    printf("%s: %s\n", label, error.c_str());
+    return;
+  }
+  int function = program.FindFunction("FindProxyForURL");
+  std::vector<std::vector<PacValue> > args(urls.size());
+  for (size_t i = 0; i < urls.size(); ++i) {
+    std::string url_host;
+    GetHostFromUrl(urls[i], &url_host);
+    args[i].push_back(PacValue(urls[i]));
+    args[i].push_back(PacValue(url_host));
+  }
+
+  PacValue result;
+  int failures = 0;
+  int64_t calls = 0;
+  int64_t elapsed_us = 0;
+  start_us = NowMicros();
+  while (elapsed_us < kMinCallMicros) {
+    for (size_t i = 0; i < args.size(); ++i) {
+      failures += !vm.Call(function, args[i], &result, &error);
+      // Checking the clock every call would be measured as well.
+      if (++calls % 256 == 0 &&
+          (elapsed_us = NowMicros() - start_us) >= kMinCallMicros) {
+        break;
+      }
+    }
+  }
+  snprintf(name, sizeof(name), "%s: FindProxyForURL", label);
+  ReportBenchmark(name, calls, NowMicros() - start_us);
+  if (failures) {
+    printf("%s: %d calls failed: %s\n", label, failures, error.c_str());
+  }
+}
+
+}  // namespace
+
+int main() {
+  std::vector<std::string> urls;
+  DistinctUrls(kUrls, 200, &urls);
+
+  Measure("office, 10 rules", OfficePacScript(), urls);
+  Measure("host rules, 20", PacScriptWithRules(20, false), urls);
+  Measure("host rules, 200", PacScriptWithRules(200, false), urls);
+  Measure("host and DNS rules, 200", PacScriptWithRules(200, true), urls);
+  Measure("blocklist, 500 domains", BlocklistPacScript(500), urls);
+  return 0;
+}
@@ -0,0 +1,156 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// plugin.profiles through the plugin's NPAPI entry points, on the headless
+// browser: one live list per store, and views that outlive their store
+// read as empty instead of reaching into it.
+
+#include <string>
+
+#include "headless_plugin.h"
+#include "test_util.h"
+
+namespace {
+
+NPVariant StringArg(const char* value) {
+  NPVariant arg;
+  STRINGZ_TO_NPVARIANT(value, arg);
+  return arg;
+}
+
+bool UseProfileStore(HeadlessPlugin* plugin, const char* name) {
+  NPVariant arg = StringArg(name);
+  NPVariant result;
+  return plugin->Invoke("useProfileStore", &arg, 1, &result) &&
+      NPVARIANT_IS_BOOLEAN(result) && NPVARIANT_TO_BOOLEAN(result);
+}
+
+void AddProfile(HeadlessPlugin* plugin, const char* proxy) {
+  NPVariant args[2] = { StringArg(proxy), StringArg("") };
+  NPVariant result;
+  CHECK(plugin->Invoke("addProfile", args, 2, &result));
+}
+
+// plugin.profiles, with the reference the caller gets.
+NPObject* GetProfiles(HeadlessPlugin* plugin) {
+  NPVariant result;
+  if (!plugin->GetProperty(plugin->plugin(), "profiles", &result) ||
+      !NPVARIANT_IS_OBJECT(result)) {
+    return NULL;
+  }
+  return NPVARIANT_TO_OBJECT(result);
+}
+
+int Length(HeadlessPlugin* plugin, NPObject* profiles) {
+  NPVariant result;
+  if (!plugin->GetProperty(profiles, "length", &result) ||
+      !NPVARIANT_IS_INT32(result)) {
+    return -1;
+  }
+  return NPVARIANT_TO_INT32(result);
+}
+
+// The proxy of profile, "undefined" if it has none.
+std::string Proxy(HeadlessPlugin* plugin, NPObject* profile) {
+  NPVariant result;
+  if (!plugin->GetProperty(profile, "proxy", &result)) {
+    return "error";
+  }
+  if (!NPVARIANT_IS_STRING(result)) {
+    return "undefined";
+  }
+  std::string proxy(NPVARIANT_TO_STRING(result).UTF8Characters,
+                    NPVARIANT_TO_STRING(result).UTF8Length);
+  headless::ReleaseVariantValue(&result);
+  return proxy;
+}
+
+void TestSameListWhileStoreOpen(HeadlessPlugin* plugin) {
+  CHECK(UseProfileStore(plugin, "first"));
+  NPObject* profiles = GetProfiles(plugin);
+  CHECK(profiles != NULL);
+  if (!profiles) {
+    return;
+  }
+  CHECK_EQ(0, Length(plugin, profiles));
+  AddProfile(plugin, "a.example:80");
+  AddProfile(plugin, "b.example:80");
+  CHECK_EQ(2, Length(plugin, profiles));
+
+  NPObject* again = GetProfiles(plugin);
+  CHECK(again == profiles);
+
+  NPVariant synced;
+  CHECK(plugin->Invoke("syncProfiles", &synced));
+  CHECK(NPVARIANT_IS_BOOLEAN(synced) && NPVARIANT_TO_BOOLEAN(synced));
+  headless::ReleaseObject(again);
+  headless::ReleaseObject(profiles);
+}
+
+void TestViewsOutliveStore(HeadlessPlugin* plugin) {
+  CHECK(UseProfileStore(plugin, "first"));
+  NPObject* profiles = GetProfiles(plugin);
+  CHECK(profiles != NULL);
+  if (!profiles) {
+    return;
+  }
+  NPVariant element;
+  CHECK(plugin->GetElement(profiles, 0, &element));
+  CHECK(NPVARIANT_IS_OBJECT(element));
+  if (!NPVARIANT_IS_OBJECT(element)) {
+    return;
+  }
+  NPObject* profile = NPVARIANT_TO_OBJECT(element);
+  CHECK_EQ(std::string("b.example:80"), Proxy(plugin, profile));
+
+  CHECK(UseProfileStore(plugin, "second"));
+  CHECK_EQ(0, Length(plugin, profiles));
+  CHECK(plugin->GetElement(profiles, 0, &element));
+  CHECK(NPVARIANT_IS_VOID(element));
+  CHECK_EQ(std::string("undefined"), Proxy(plugin, profile));
+
+  NPObject* current = GetProfiles(plugin);
+  CHECK(current != NULL && current != profiles);
+  if (current) {
+    CHECK_EQ(0, Length(plugin, current));
+    headless::ReleaseObject(current);
+  }
+  // The first store again, opened anew: the old views stay detached.
+  CHECK(UseProfileStore(plugin, "first"));
+  CHECK_EQ(0, Length(plugin, profiles));
+  current = GetProfiles(plugin);
+  CHECK(current != NULL && Length(plugin, current) == 2);
+  if (current) {
+    headless::ReleaseObject(current);
+  }
+  headless::ReleaseObject(profile);
+  headless::ReleaseObject(profiles);
+}
+
+}  // namespace
+
+int main() {
+  HeadlessPlugin plugin;
+  CHECK(plugin.Start());
+  TestSameListWhileStoreOpen(&plugin);
+  TestViewsOutliveStore(&plugin);
+  // Views the page still holds when the plugin shuts down.
+  NPObject* profiles = GetProfiles(&plugin);
+  plugin.Stop();
+  if (profiles) {
+    headless::ReleaseObject(profiles);
+  }
+  return TestResult("profile_objects_test");
+}
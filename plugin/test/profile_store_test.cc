@@ -0,0 +1,74 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// ProfileStore::FindByProxy: descriptions WinINet treats alike find the
+// same profile, and those it does not never do.
+
+#include "profile_store.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "proxy_server_list.h"
+#include "test_util.h"
+
+namespace {
+
+void TestEquivalentDescriptions() {
+  CHECK_EQ(CanonicalProxyDescription("a:80"),
+           CanonicalProxyDescription("http=a:80;https=a:80"));
+  CHECK_EQ(CanonicalProxyDescription("a:80"),
+           CanonicalProxyDescription("http=a:80;https=a:80;ftp=a:80"));
+  CHECK_EQ(CanonicalProxyDescription("A:80"),
+           CanonicalProxyDescription("https=a:80;http=a"));
+  CHECK(CanonicalProxyDescription("a:80") !=
+        CanonicalProxyDescription("http=a:80"));
+  CHECK(CanonicalProxyDescription("http=a:80;https=a:80;ftp=b:80") !=
+        CanonicalProxyDescription("a:80"));
+}
+
+void TestFindByProxy(ProfileStore* store) {
+  uint32_t per_scheme = store->Add("http=a:80;https=a:80", "");
+  uint32_t http_only = store->Add("http=b:80", "");
+  uint32_t id;
+  CHECK(store->FindByProxy("a:80", &id));
+  CHECK_EQ(per_scheme, id);
+  CHECK(store->FindByProxy("http=a:80;https=a:80;ftp=a:80", &id));
+  CHECK_EQ(per_scheme, id);
+  CHECK(store->FindByProxy("http=b", &id));
+  CHECK_EQ(http_only, id);
+  CHECK(!store->FindByProxy("b:80", &id));
+  CHECK(!store->FindByProxy("c:80", &id));
+}
+
+}  // namespace
+
+int main() {
+  char directory[] = "/tmp/switchproxy-test-XXXXXX";
+  CHECK(mkdtemp(directory) != NULL);
+  std::string path = std::string(directory) + "/profiles.log";
+  TestEquivalentDescriptions();
+  {
+    ProfileStore store;
+    CHECK(store.Open(path));
+    TestFindByProxy(&store);
+  }
+  unlink(path.c_str());
+  unlink((path + ".lock").c_str());
+  rmdir(directory);
+  return TestResult("profile_store_test");
+}
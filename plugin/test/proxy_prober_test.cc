@@ -0,0 +1,101 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// ProxyProber against loopback endpoints: one that listens and one that
+// refuses, with names looked up in place and through the DNS resolver.
+
+#include "proxy_prober.h"
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "dns_resolver.h"
+#include "net_util.h"
+#include "test_util.h"
+
+namespace {
+
+std::string Endpoint(const char* host, int port) {
+  char endpoint[64];
+  snprintf(endpoint, sizeof(endpoint), "%s:%d", host, port);
+  return endpoint;
+}
+
+// A loopback port nothing listens on.
+int RefusingPort() {
+  int port = 0;
+  SocketHandle socket = ListenOnLoopback(0, &port);
+  CloseSocket(socket);
+  return port;
+}
+
+const ProxyHealth* Find(const std::vector<ProxyHealth>& health,
+                        const std::string& proxy) {
+  for (size_t i = 0; i < health.size(); ++i) {
+    if (health[i].proxy == proxy) {
+      return &health[i];
+    }
+  }
+  return NULL;
+}
+
+void TestProbe(DnsResolver* resolver, const char* host) {
+  int port = 0;
+  SocketHandle listener = ListenOnLoopback(0, &port);
+  CHECK(listener != INVALID_SOCKET);
+  std::string live = Endpoint(host, port);
+  std::string dead = Endpoint("127.0.0.1", RefusingPort());
+  std::string both = live + "," + dead;
+
+  ProxyProber::Options options;
+  options.timeout_ms = 2000;
+  options.resolver = resolver;
+  ProxyProber prober(options);
+  std::vector<std::string> targets;
+  targets.push_back(live);
+  targets.push_back(dead);
+  targets.push_back(both);
+  prober.SetTargets(targets);
+  prober.RunProbeRound();
+
+  std::vector<ProxyHealth> health;
+  prober.GetHealth(&health);
+  CHECK_EQ((size_t)3, health.size());
+  CHECK_EQ(live, health[0].proxy);
+  const ProxyHealth* result = Find(health, live);
+  CHECK(result && result->latency_ms >= 0 && result->success_rate == 1);
+  result = Find(health, dead);
+  CHECK(result && result->latency_ms < 0 && result->success_rate == 0);
+  // One endpoint without a latency leaves the whole proxy without one.
+  result = Find(health, both);
+  CHECK(result && result->latency_ms < 0 && result->probes == 1);
+  CloseSocket(listener);
+}
+
+}  // namespace
+
+int main() {
+  InitializeSockets();
+  TestProbe(NULL, "127.0.0.1");
+  TestProbe(NULL, "localhost");
+  DnsResolver resolver;
+  CHECK(resolver.Start());
+  TestProbe(&resolver, "127.0.0.1");
+  TestProbe(&resolver, "localhost");
+  resolver.Stop();
+  return TestResult("proxy_prober_test");
+}
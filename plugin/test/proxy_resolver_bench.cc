@@ -0,0 +1,123 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Resolves batches of 10k URLs with distinct hosts, as resolveProxies
+// does, under manual settings and under PAC scripts with and without DNS
+// rules. The first batch after a settings change finds the PAC result
+// caches empty; the batches after it find them full. "one URL per call"
+// resolves the same URLs one Resolve at a time, as a page calling
+// findProxyForURL in a loop would, without the NPAPI overhead on top.
+
+#include "proxy_resolver.h"
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "pac_corpus.h"
+#include "test_util.h"
+
+namespace {
+
+const int kUrls = 10000;
+const int kRules = 200;
+const int kRepeats = 5;
+
+std::string BypassListWith(int entries) {
+  std::string list;
+  char entry[64];
+  for (int i = 0; i < entries; ++i) {
+    snprintf(entry, sizeof(entry), "*.internal%d.example.com;", i);
+    list += entry;
+  }
+  return list + "10.0.0.0/8;<local>";
+}
+
+void Measure(const char* label, const ProxySettings& settings,
+             int threads, const std::vector<std::string>& urls) {
+  FakePacHost host;
+  ProxyResolver resolver(&host, threads);
+  std::vector<std::string> results;
+  char name[128];
+
+  int64_t start_us = NowMicros();
+  resolver.Resolve(settings, urls, &results);
+  snprintf(name, sizeof(name), "%s, %d threads, first batch", label,
+           threads);
+  ReportBenchmark(name, (int64_t)urls.size(), NowMicros() - start_us);
+
+  start_us = NowMicros();
+  for (int i = 0; i < kRepeats; ++i) {
+    resolver.Resolve(settings, urls, &results);
+  }
+  snprintf(name, sizeof(name), "%s, %d threads, next batches", label,
+           threads);
+  ReportBenchmark(name, (int64_t)urls.size() * kRepeats,
+                  NowMicros() - start_us);
+
+  int empty = 0;
+  for (size_t i = 0; i < results.size(); ++i) {
+    empty += results[i].empty();
+  }
+  if (results.size() != urls.size() || empty) {
+    printf("%s: %d of %d URLs unresolved\n", label, empty,
+           (int)urls.size());
+  }
+}
+
+void MeasureOneUrlPerCall(const char* label, const ProxySettings& settings,
+                          const std::vector<std::string>& urls) {
+  FakePacHost host;
+  ProxyResolver resolver(&host, 1);
+  std::vector<std::string> url(1);
+  std::vector<std::string> results;
+  char name[128];
+  int64_t start_us = NowMicros();
+  for (size_t i = 0; i < urls.size(); ++i) {
+    url[0] = urls[i];
+    resolver.Resolve(settings, url, &results);
+  }
+  snprintf(name, sizeof(name), "%s, one URL per call", label);
+  ReportBenchmark(name, (int64_t)urls.size(), NowMicros() - start_us);
+}
+
+}  // namespace
+
+int main() {
+  std::vector<std::string> urls;
+  DistinctUrls(kUrls, kRules, &urls);
+
+  ProxySettings manual;
+  manual.use_proxy = true;
+  manual.proxy_server = "http=a.example:80,b.example:81;https=c.example:443";
+  manual.bypass_list = BypassListWith(kRules);
+
+  ProxySettings host_rules;
+  host_rules.pac_source = PacScriptWithRules(kRules, false);
+
+  ProxySettings network_rules;
+  network_rules.pac_source = PacScriptWithRules(kRules, true);
+
+  static const int kThreads[] = { 1, 4 };
+  for (int i = 0; i < 2; ++i) {
+    Measure("manual settings", manual, kThreads[i], urls);
+    Measure("PAC, host rules", host_rules, kThreads[i], urls);
+    Measure("PAC, host and DNS rules", network_rules, kThreads[i], urls);
+  }
+  MeasureOneUrlPerCall("manual settings", manual, urls);
+  MeasureOneUrlPerCall("PAC, host and DNS rules", network_rules, urls);
+  return 0;
+}
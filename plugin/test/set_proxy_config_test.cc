@@ -0,0 +1,76 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// setProxyConfig through the plugin's NPAPI entry points, on the headless
+// browser: while the shared state is current, an update asks the system
+// only what the backend needs to merge the fields given.
+
+#include "headless_plugin.h"
+#include "test_util.h"
+
+namespace {
+
+NPVariant StringArg(const char* value) {
+  NPVariant arg;
+  STRINGZ_TO_NPVARIANT(value, arg);
+  return arg;
+}
+
+// plugin.setProxyConfig({proxyServer: proxy_server}).
+bool SetProxyServer(HeadlessPlugin* plugin, const char* proxy_server) {
+  NPObject* fields = HeadlessPlugin::NewObject();
+  NPVariant value = StringArg(proxy_server);
+  headless::JSSetProperty(
+      fields, headless::GetStringIdentifier("proxyServer"), &value);
+  NPVariant arg;
+  OBJECT_TO_NPVARIANT(fields, arg);
+  NPVariant result;
+  bool ok = plugin->Invoke("setProxyConfig", &arg, 1, &result);
+  if (ok) {
+    headless::ReleaseVariantValue(&result);
+  }
+  headless::ReleaseObject(fields);
+  return ok;
+}
+
+void TestUpdateReadsSystemOnce(HeadlessPlugin* plugin) {
+  plugin->WaitForSharedState();
+  int reads = HeadlessPlugin::system_reads();
+  CHECK(SetProxyServer(plugin, "a.example:80"));
+  CHECK_EQ(1, HeadlessPlugin::system_reads() - reads);
+}
+
+void TestPositionalUpdateReadsSystemOnce(HeadlessPlugin* plugin) {
+  plugin->WaitForSharedState();
+  int reads = HeadlessPlugin::system_reads();
+  NPVariant args[2];
+  BOOLEAN_TO_NPVARIANT(true, args[0]);
+  args[1] = StringArg("b.example:80");
+  NPVariant result;
+  CHECK(plugin->Invoke("setProxyConfig", args, 2, &result));
+  CHECK_EQ(1, HeadlessPlugin::system_reads() - reads);
+}
+
+}  // namespace
+
+int main() {
+  HeadlessPlugin::SetSystemProxy(true, "proxy.example:8080");
+  HeadlessPlugin plugin;
+  CHECK(plugin.Start());
+  TestUpdateReadsSystemOnce(&plugin);
+  TestPositionalUpdateReadsSystemOnce(&plugin);
+  plugin.Stop();
+  return TestResult("set_proxy_config_test");
+}
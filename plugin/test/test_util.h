@@ -0,0 +1,81 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// What the tests and benchmarks share. Each is a program of its own: a
+// test runs its checks, reports the failed ones and exits with 1 if there
+// were any; a benchmark prints one line per measurement.
+
+#ifndef __TEST_UTIL_H__
+#define __TEST_UTIL_H__
+
+#include <stdio.h>
+
+#include "nptypes.h"
+#include "platform_util.h"
+
+static int test_failures = 0;
+
+#define CHECK(condition)                                                   \
+  do {                                                                     \
+    if (!(condition)) {                                                    \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,     \
+              #condition);                                                 \
+      ++test_failures;                                                     \
+    }                                                                      \
+  } while (0)
+
+#define CHECK_EQ(expected, actual)                                         \
+  do {                                                                     \
+    if (!((expected) == (actual))) {                                       \
+      fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed\n", __FILE__,        \
+              __LINE__, #expected, #actual);                               \
+      ++test_failures;                                                     \
+    }                                                                      \
+  } while (0)
+
+// Prints the outcome of the test called name and returns its exit code.
+inline int TestResult(const char* name) {
+  if (test_failures) {
+    printf("%s: %d checks failed\n", name, test_failures);
+    return 1;
+  }
+  printf("%s: passed\n", name);
+  return 0;
+}
+
+// Prints what operations operations took in elapsed_us, per operation and
+// per second.
+inline void ReportBenchmark(const char* name, int64_t operations,
+                            int64_t elapsed_us) {
+  if (elapsed_us <= 0) {
+    elapsed_us = 1;
+  }
+  printf("%-48s %10lld ops %9.1f ms %10.1f ns/op %12.0f ops/s\n", name,
+         (long long)operations, elapsed_us / 1000.0,
+         elapsed_us * 1000.0 / operations,
+         operations * 1000000.0 / elapsed_us);
+}
+
+// Like ReportBenchmark, with the throughput in MB/s of bytes processed.
+inline void ReportThroughput(const char* name, int64_t bytes,
+                             int64_t elapsed_us) {
+  if (elapsed_us <= 0) {
+    elapsed_us = 1;
+  }
+  printf("%-48s %10lld bytes %9.1f ms %10.1f MB/s\n", name, (long long)bytes,
+         elapsed_us / 1000.0, bytes / (double)elapsed_us);
+}
+
+#endif  // __TEST_UTIL_H__
@@ -0,0 +1,208 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// The cost of choosing an upstream in a balanced pool, and how evenly the
+// choices spread. Hosts are distinct, or drawn with the long-tailed
+// popularity of browsing, where a few sites get most requests. "skew" is
+// the load of the busiest upstream over its weighted share; "moved" is
+// the share of hosts that change upstream when one leaves the pool, which
+// ideally is that upstream's share and nothing more.
+
+#include "upstream_group.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "consistent_hash.h"
+#include "test_util.h"
+
+namespace {
+
+const int kHosts = 100000;
+const int kPicks = 1000000;
+// Connections open at a time in the bounded load runs.
+const int kOpenConnections = 512;
+
+std::string PoolDescription(int members, bool weighted) {
+  std::string description = "http=";
+  char member[64];
+  for (int i = 0; i < members; ++i) {
+    snprintf(member, sizeof(member), "%sproxy%d.pool.example:3128", i ? "|" : "",
+             i);
+    description += member;
+    if (weighted && i % 4 == 0) {
+      description += "*2";
+    }
+  }
+  return description;
+}
+
+void Hosts(int count, std::vector<std::string>* hosts) {
+  char host[64];
+  for (int i = 0; i < count; ++i) {
+    snprintf(host, sizeof(host), "www%d.site%d.example.com", i, i % 977);
+    hosts->push_back(host);
+  }
+}
+
+// Picks host indices with Zipf-like popularity: the k-th most popular
+// host is asked for about 1/k as often as the first.
+class PopularHosts {
+ public:
+  explicit PopularHosts(int count) : state_(12345) {
+    double total = 0;
+    for (int k = 1; k <= count; ++k) {
+      total += 1.0 / k;
+      cumulative_.push_back(total);
+    }
+  }
+
+  int Next() {
+    state_ = state_ * 6364136223846793005ULL + 1442695040888963407ULL;
+    double x = (state_ >> 11) * (1.0 / 9007199254740992.0) *
+        cumulative_.back();
+    size_t low = 0;
+    size_t high = cumulative_.size() - 1;
+    while (low < high) {
+      size_t middle = (low + high) / 2;
+      if (cumulative_[middle] < x) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    return (int)low;
+  }
+
+ private:
+  std::vector<double> cumulative_;
+  uint64_t state_;
+};
+
+double Skew(const UpstreamGroup& group, const std::vector<int>& counts) {
+  int total = 0;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    total += counts[i];
+  }
+  double skew = 0;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    double share = (double)group.upstreams[i].server.weight /
+        group.total_weight;
+    double load = counts[i] / (total * share);
+    skew = load > skew ? load : skew;
+  }
+  return skew;
+}
+
+void MeasureRing(int members, const std::vector<std::string>& hosts) {
+  UpstreamProfile* profile =
+      new UpstreamProfile(PoolDescription(members, false), "");
+  UpstreamGroup* group = profile->GroupForScheme("http");
+  std::vector<int> counts(members);
+  std::vector<int> first(hosts.size());
+  char name[128];
+
+  int64_t start_us = NowMicros();
+  for (size_t i = 0; i < hosts.size(); ++i) {
+    first[i] = group->ring.MemberAt(group->ring.FindPoint(hosts[i]));
+  }
+  snprintf(name, sizeof(name), "%d members, FindPoint", members);
+  ReportBenchmark(name, (int64_t)hosts.size(), NowMicros() - start_us);
+  for (size_t i = 0; i < hosts.size(); ++i) {
+    ++counts[first[i]];
+  }
+
+  // Without the last member: only its hosts should move.
+  std::vector<std::string> names;
+  std::vector<int> weights;
+  for (int i = 0; i + 1 < members; ++i) {
+    char member[64];
+    snprintf(member, sizeof(member), "proxy%d.pool.example:3128", i);
+    names.push_back(member);
+    weights.push_back(1);
+  }
+  ConsistentHashRing smaller;
+  smaller.Build(names, weights);
+  int moved = 0;
+  for (size_t i = 0; i < hosts.size(); ++i) {
+    moved += smaller.MemberAt(smaller.FindPoint(hosts[i])) != first[i];
+  }
+  printf("%-48s skew %.3f, moved %.1f%% (ideal %.1f%%)\n", name,
+         Skew(*group, counts), moved * 100.0 / hosts.size(),
+         100.0 / members);
+  profile->Release();
+}
+
+// Runs kPicks connections through PickBalanced, keeping kOpenConnections
+// open, and counts where they go and how many leave the host's first
+// choice to respect the load bound.
+void MeasurePick(const char* label, const std::string& description,
+                 const std::vector<std::string>& hosts) {
+  UpstreamProfile* profile = new UpstreamProfile(description, "");
+  UpstreamGroup* group = profile->GroupForScheme("http");
+  std::vector<int> counts(group->upstreams.size());
+  std::vector<bool> tried(group->upstreams.size());
+  std::vector<int> open(kOpenConnections, -1);
+  PopularHosts popular((int)hosts.size());
+  std::vector<int> picks(kPicks);
+  for (int i = 0; i < kPicks; ++i) {
+    picks[i] = popular.Next();
+  }
+  int diverted = 0;
+  int64_t now_ms = NowMillis();
+
+  int64_t start_us = NowMicros();
+  for (int i = 0; i < kPicks; ++i) {
+    const std::string& host = hosts[picks[i]];
+    int upstream = group->Pick(host, now_ms, tried);
+    // The oldest connection closes as the new one opens.
+    int slot = i % kOpenConnections;
+    if (open[slot] >= 0) {
+      --group->upstreams[open[slot]].active_connections;
+    }
+    ++group->upstreams[upstream].active_connections;
+    open[slot] = upstream;
+    ++counts[upstream];
+    diverted +=
+        group->ring.MemberAt(group->ring.FindPoint(host)) != upstream;
+  }
+  int64_t elapsed_us = NowMicros() - start_us;
+  char name[128];
+  snprintf(name, sizeof(name), "%s, Pick", label);
+  ReportBenchmark(name, kPicks, elapsed_us);
+  printf("%-48s skew %.3f, diverted %.1f%%\n", name, Skew(*group, counts),
+         diverted * 100.0 / kPicks);
+  profile->Release();
+}
+
+}  // namespace
+
+int main() {
+  std::vector<std::string> hosts;
+  Hosts(kHosts, &hosts);
+
+  static const int kMembers[] = { 2, 4, 8, 16, 64 };
+  for (size_t i = 0; i < sizeof(kMembers) / sizeof(kMembers[0]); ++i) {
+    MeasureRing(kMembers[i], hosts);
+  }
+  MeasurePick("4 members, popular hosts", PoolDescription(4, false), hosts);
+  MeasurePick("16 members, popular hosts", PoolDescription(16, false), hosts);
+  MeasurePick("16 weighted members, popular hosts", PoolDescription(16, true),
+              hosts);
+  return 0;
+}
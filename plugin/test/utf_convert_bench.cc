@@ -0,0 +1,168 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Converts what WinProxy converts on every Get and Set: a bypass list of
+// thousands of hosts, mostly ASCII, and a short mixed-script string. The
+// "scalar" lines convert the same text with the same validation and exact
+// sizing, but one character at a time, as without the ASCII blocks.
+
+#include "utf_convert.h"
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "test_util.h"
+
+namespace {
+
+// Each text is converted until about this many bytes went through.
+const int64_t kBytesPerMeasurement = 64 * 1024 * 1024;
+
+std::string BypassList(int hosts) {
+  std::string list;
+  char host[64];
+  for (int i = 0; i < hosts; ++i) {
+    snprintf(host, sizeof(host), "%s*.host%d.intranet.example.com",
+             i ? ";" : "", i);
+    list += host;
+  }
+  return list + ";<local>";
+}
+
+// ASCII with a non-ASCII character every few words.
+std::string MixedText(size_t bytes) {
+  static const char* kWords[] = {
+    "proxy", "caf\xc3\xa9", "server", "\xe2\x82\xac" "10", "host",
+    "\xe4\xbb\xa3\xe7\x90\x86", "bypass", "\xf0\x9f\x98\x80",
+  };
+  std::string text;
+  for (size_t i = 0; text.size() < bytes; ++i) {
+    text += kWords[i % (sizeof(kWords) / sizeof(kWords[0]))];
+    text += ' ';
+  }
+  return text;
+}
+
+// Decodes the character at p as utf_convert.cc does, an invalid byte to
+// U+FFFD, and returns its length.
+size_t DecodeScalar(const unsigned char* p, const unsigned char* end,
+                    uint32_t* code_point) {
+  unsigned char lead = p[0];
+  if (lead < 0x80) {
+    *code_point = lead;
+    return 1;
+  }
+  size_t len = lead >= 0xc2 && lead <= 0xdf ? 2 :
+      lead >= 0xe0 && lead <= 0xef ? 3 : lead >= 0xf0 && lead <= 0xf4 ? 4 : 0;
+  static const uint32_t kMinValue[] = { 0, 0, 0x80, 0x800, 0x10000 };
+  uint32_t value = lead & (0x7f >> len);
+  bool valid = len && (size_t)(end - p) >= len;
+  for (size_t i = 1; valid && i < len; ++i) {
+    valid = (p[i] & 0xc0) == 0x80;
+    value = (value << 6) | (p[i] & 0x3f);
+  }
+  if (!valid || value < kMinValue[len] || value > 0x10ffff ||
+      (value >= 0xd800 && value <= 0xdfff)) {
+    *code_point = 0xfffd;
+    return 1;
+  }
+  *code_point = value;
+  return len;
+}
+
+size_t Utf8ToUtf16Scalar(const std::string& text, std::vector<uint16_t>* out) {
+  const unsigned char* begin = (const unsigned char*)text.data();
+  const unsigned char* end = begin + text.size();
+  size_t len = 0;
+  uint32_t code_point;
+  for (const unsigned char* p = begin; p < end;) {
+    p += DecodeScalar(p, end, &code_point);
+    len += code_point >= 0x10000 ? 2 : 1;
+  }
+  uint16_t* q = &(*out)[0];
+  for (const unsigned char* p = begin; p < end;) {
+    p += DecodeScalar(p, end, &code_point);
+    if (code_point >= 0x10000) {
+      code_point -= 0x10000;
+      *q++ = (uint16_t)(0xd800 + (code_point >> 10));
+      *q++ = (uint16_t)(0xdc00 + (code_point & 0x3ff));
+    } else {
+      *q++ = (uint16_t)code_point;
+    }
+  }
+  return len;
+}
+
+void Measure(const char* label, const std::string& text) {
+  const int kRounds = (int)(kBytesPerMeasurement / text.size());
+  char name[128];
+  std::vector<uint16_t> wide(Utf16LengthOfUtf8(text.data(), text.size()));
+  std::string narrow(text.size(), '\0');
+  size_t check = 0;
+
+  int64_t start_us = NowMicros();
+  for (int i = 0; i < kRounds; ++i) {
+    size_t len = Utf16LengthOfUtf8(text.data(), text.size());
+    check += Utf8ToUtf16(text.data(), text.size(), &wide[0]) - len;
+  }
+  snprintf(name, sizeof(name), "%s: UTF-8 to UTF-16", label);
+  ReportThroughput(name, (int64_t)text.size() * kRounds,
+                   NowMicros() - start_us);
+
+  start_us = NowMicros();
+  for (int i = 0; i < kRounds; ++i) {
+    check += Utf8ToUtf16Scalar(text, &wide);
+  }
+  snprintf(name, sizeof(name), "%s: UTF-8 to UTF-16, scalar", label);
+  ReportThroughput(name, (int64_t)text.size() * kRounds,
+                   NowMicros() - start_us);
+
+  Utf8ToUtf16(text.data(), text.size(), &wide[0]);
+  start_us = NowMicros();
+  for (int i = 0; i < kRounds; ++i) {
+    size_t len = Utf8LengthOfUtf16(&wide[0], wide.size());
+    check += Utf16ToUtf8(&wide[0], wide.size(), &narrow[0]) - len;
+  }
+  snprintf(name, sizeof(name), "%s: UTF-16 to UTF-8", label);
+  ReportThroughput(name, (int64_t)text.size() * kRounds,
+                   NowMicros() - start_us);
+
+  start_us = NowMicros();
+  for (int i = 0; i < kRounds; ++i) {
+    check += IsValidUtf8(text.data(), text.size());
+  }
+  snprintf(name, sizeof(name), "%s: validate UTF-8", label);
+  ReportThroughput(name, (int64_t)text.size() * kRounds,
+                   NowMicros() - start_us);
+
+  if (narrow != text) {
+    printf("%s: round trip differs\n", label);
+  }
+  // Keeps the loops from being optimized away.
+  if (check == 1) {
+    printf("\n");
+  }
+}
+
+}  // namespace
+
+int main() {
+  Measure("bypass list, 5000 hosts", BypassList(5000));
+  Measure("mixed text, 64 KB", MixedText(64 * 1024));
+  Measure("proxy server, 40 bytes", "http=proxy1.example.com:8080;https=p2");
+  return 0;
+}
@@ -0,0 +1,284 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "utf_convert.h"
+
+#include <string>
+#include <vector>
+
+#include "test_util.h"
+
+namespace {
+
+typedef std::vector<uint16_t> Utf16;
+
+const uint16_t kReplacement = 0xfffd;
+
+// Converts with the exact-size contract: the length functions must
+// predict what the converters write.
+Utf16 ToUtf16(const std::string& text) {
+  size_t len = Utf16LengthOfUtf8(text.data(), text.size());
+  // One unit more than asked for, to catch writes past the end.
+  Utf16 result(len + 1, 0xbeef);
+  CHECK_EQ(len, Utf8ToUtf16(text.data(), text.size(), &result[0]));
+  CHECK_EQ(0xbeef, result[len]);
+  result.resize(len);
+  return result;
+}
+
+std::string ToUtf8(const Utf16& text) {
+  size_t len = Utf8LengthOfUtf16(text.empty() ? NULL : &text[0], text.size());
+  std::string result(len + 1, '#');
+  CHECK_EQ(len, Utf16ToUtf8(text.empty() ? NULL : &text[0], text.size(),
+                            &result[0]));
+  CHECK_EQ('#', result[len]);
+  result.resize(len);
+  return result;
+}
+
+// A plain encoder to compare against, one code point at a time.
+void AppendUtf8(uint32_t code_point, std::string* out) {
+  if (code_point < 0x80) {
+    *out += (char)code_point;
+  } else if (code_point < 0x800) {
+    *out += (char)(0xc0 | (code_point >> 6));
+    *out += (char)(0x80 | (code_point & 0x3f));
+  } else if (code_point < 0x10000) {
+    *out += (char)(0xe0 | (code_point >> 12));
+    *out += (char)(0x80 | ((code_point >> 6) & 0x3f));
+    *out += (char)(0x80 | (code_point & 0x3f));
+  } else {
+    *out += (char)(0xf0 | (code_point >> 18));
+    *out += (char)(0x80 | ((code_point >> 12) & 0x3f));
+    *out += (char)(0x80 | ((code_point >> 6) & 0x3f));
+    *out += (char)(0x80 | (code_point & 0x3f));
+  }
+}
+
+void AppendUtf16(uint32_t code_point, Utf16* out) {
+  if (code_point < 0x10000) {
+    out->push_back((uint16_t)code_point);
+  } else {
+    code_point -= 0x10000;
+    out->push_back((uint16_t)(0xd800 + (code_point >> 10)));
+    out->push_back((uint16_t)(0xdc00 + (code_point & 0x3ff)));
+  }
+}
+
+Utf16 Ascii16(const char* text) {
+  Utf16 result;
+  for (const char* p = text; *p; ++p) {
+    result.push_back((unsigned char)*p);
+  }
+  return result;
+}
+
+void TestEmpty() {
+  CHECK(ToUtf16("").empty());
+  CHECK(ToUtf8(Utf16()).empty());
+  CHECK(IsValidUtf8("", 0));
+}
+
+// Every length around the 16 byte blocks, so that both the block path
+// and the tail after it run.
+void TestAsciiLengths() {
+  for (size_t len = 0; len <= 70; ++len) {
+    std::string text;
+    for (size_t i = 0; i < len; ++i) {
+      text += (char)('!' + i % 90);
+    }
+    Utf16 wide = ToUtf16(text);
+    CHECK_EQ(len, wide.size());
+    for (size_t i = 0; i < wide.size() && i < len; ++i) {
+      CHECK_EQ((uint16_t)(unsigned char)text[i], wide[i]);
+    }
+    CHECK(ToUtf8(wide) == text);
+    CHECK(IsValidUtf8(text.data(), text.size()));
+  }
+}
+
+// A character of each length at every position of a 40 character ASCII
+// string, so that it falls at the start, middle and end of a block and
+// straddles the boundary between two.
+void TestNonAsciiAtEveryPosition() {
+  static const uint32_t kCodePoints[] = {
+    0xe9,      // 2 bytes
+    0x20ac,    // 3 bytes
+    0xfeff,    // 3 bytes, the byte order mark
+    0x1f600,   // 4 bytes, a surrogate pair in UTF-16
+    0x10ffff,  // The last code point.
+  };
+  for (size_t c = 0; c < sizeof(kCodePoints) / sizeof(kCodePoints[0]);
+       ++c) {
+    for (size_t position = 0; position <= 40; ++position) {
+      std::string text;
+      Utf16 expected;
+      for (size_t i = 0; i <= 40; ++i) {
+        uint32_t code_point = i == position ? kCodePoints[c] : 'a' + i % 26;
+        AppendUtf8(code_point, &text);
+        AppendUtf16(code_point, &expected);
+      }
+      CHECK(ToUtf16(text) == expected);
+      CHECK(ToUtf8(expected) == text);
+      CHECK(IsValidUtf8(text.data(), text.size()));
+    }
+  }
+}
+
+// Each byte that does not start a valid sequence becomes one U+FFFD, the
+// bytes after it are looked at again.
+void TestInvalidUtf8() {
+  static const struct {
+    const char* text;
+    int replacements;
+  } kCases[] = {
+    {"\x80", 1},                  // A lone continuation byte.
+    {"\xbf\x80", 2},
+    {"\xc0\x80", 2},              // Overlong NUL.
+    {"\xc1\xbf", 2},
+    {"\xe0\x80\x80", 3},          // Overlong 3 byte form.
+    {"\xf0\x80\x80\x80", 4},      // Overlong 4 byte form.
+    {"\xed\xa0\x80", 3},          // An encoded high surrogate.
+    {"\xed\xbf\xbf", 3},          // An encoded low surrogate.
+    {"\xf4\x90\x80\x80", 4},      // Above U+10FFFF.
+    {"\xf5\x80\x80\x80", 4},
+    {"\xff", 1},
+    {"\xe2\x82", 2},              // Truncated at the end.
+    {"\xf0\x9f\x98", 3},
+    {"\xe2\x28\xa1", 2},          // A lead byte followed by ASCII.
+  };
+  for (size_t i = 0; i < sizeof(kCases) / sizeof(kCases[0]); ++i) {
+    std::string text = kCases[i].text;
+    CHECK(!IsValidUtf8(text.data(), text.size()));
+    Utf16 wide = ToUtf16(text);
+    int replacements = 0;
+    for (size_t j = 0; j < wide.size(); ++j) {
+      replacements += wide[j] == kReplacement;
+    }
+    CHECK_EQ(kCases[i].replacements, replacements);
+  }
+  // ASCII after the invalid byte survives.
+  Utf16 expected = Ascii16("ab?cd");
+  expected[2] = kReplacement;
+  CHECK(ToUtf16("ab\xff" "cd") == expected);
+}
+
+// The same, with the invalid byte at every position of a long ASCII run,
+// so that the block path has to stop for it.
+void TestInvalidUtf8AtEveryPosition() {
+  for (size_t position = 0; position < 40; ++position) {
+    std::string text(40, 'x');
+    text[position] = '\x80';
+    Utf16 wide = ToUtf16(text);
+    CHECK_EQ(40u, wide.size());
+    for (size_t i = 0; i < wide.size(); ++i) {
+      CHECK_EQ(i == position ? kReplacement : (uint16_t)'x', wide[i]);
+    }
+    CHECK(!IsValidUtf8(text.data(), text.size()));
+  }
+}
+
+void TestSurrogates() {
+  // A valid pair.
+  Utf16 pair;
+  pair.push_back(0xd83d);
+  pair.push_back(0xde00);
+  CHECK(ToUtf8(pair) == "\xf0\x9f\x98\x80");
+  // An unpaired high surrogate, at the end and before a non-surrogate.
+  Utf16 high;
+  high.push_back(0xd800);
+  CHECK(ToUtf8(high) == "\xef\xbf\xbd");
+  high.push_back('a');
+  CHECK(ToUtf8(high) == "\xef\xbf\xbd" "a");
+  // An unpaired low surrogate.
+  Utf16 low;
+  low.push_back(0xdc00);
+  low.push_back(0xd800);
+  CHECK(ToUtf8(low) == "\xef\xbf\xbd\xef\xbf\xbd");
+  // Two high surrogates and then a low one pair the second.
+  Utf16 twice;
+  twice.push_back(0xd800);
+  twice.push_back(0xd83d);
+  twice.push_back(0xde00);
+  CHECK(ToUtf8(twice) == "\xef\xbf\xbd\xf0\x9f\x98\x80");
+}
+
+// A pair, and an unpaired surrogate, at every position of a long ASCII
+// run, including split across two blocks.
+void TestSurrogatesAtEveryPosition() {
+  for (size_t position = 0; position < 40; ++position) {
+    Utf16 text = Ascii16("0123456789abcdefghijklmnopqrstuvwxyzABCD");
+    text.insert(text.begin() + position, 0xdbff);
+    text.insert(text.begin() + position + 1, 0xdfff);
+    std::string expected = "0123456789abcdefghijklmnopqrstuvwxyzABCD";
+    expected.insert(position, "\xf4\x8f\xbf\xbf");
+    CHECK(ToUtf8(text) == expected);
+    CHECK(ToUtf16(expected) == text);
+
+    text.erase(text.begin() + position + 1);
+    expected.replace(position, 4, "\xef\xbf\xbd");
+    CHECK(ToUtf8(text) == expected);
+  }
+}
+
+// Random code points, mostly ASCII as proxy settings are, round trip.
+void TestRandomRoundTrip() {
+  uint32_t state = 12345;
+  for (int round = 0; round < 2000; ++round) {
+    std::string text;
+    Utf16 wide;
+    int len = round % 100;
+    for (int i = 0; i < len; ++i) {
+      state = state * 1103515245 + 12345;
+      uint32_t code_point;
+      switch ((state >> 16) % 8) {
+        case 0:
+          code_point = 0x80 + (state >> 8) % 0x780;
+          break;
+        case 1:
+          code_point = 0x800 + (state >> 4) % 0xd000;
+          if (code_point >= 0xd800 && code_point <= 0xdfff) {
+            code_point += 0x800;
+          }
+          break;
+        case 2:
+          code_point = 0x10000 + (state >> 4) % 0x100000;
+          break;
+        default:
+          code_point = (state >> 8) % 0x80;
+          break;
+      }
+      AppendUtf8(code_point, &text);
+      AppendUtf16(code_point, &wide);
+    }
+    CHECK(ToUtf16(text) == wide);
+    CHECK(ToUtf8(wide) == text);
+    CHECK(IsValidUtf8(text.data(), text.size()));
+  }
+}
+
+}  // namespace
+
+int main() {
+  TestEmpty();
+  TestAsciiLengths();
+  TestNonAsciiAtEveryPosition();
+  TestInvalidUtf8();
+  TestInvalidUtf8AtEveryPosition();
+  TestSurrogates();
+  TestSurrogatesAtEveryPosition();
+  TestRandomRoundTrip();
+  return TestResult("utf_convert_test");
+}
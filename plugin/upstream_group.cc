@@ -0,0 +1,249 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "upstream_group.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "dns_resolver.h"
+#include "platform_util.h"
+
+// A refused or timed out connect is strong enough evidence to stop using
+// an upstream right away; the cool-down keeps the cost of a false alarm low.
+static const int kBreakerFailureThreshold = 1;
+static const int kInitialCoolDownMs = 1000;
+static const int kMaxCoolDownMs = 30000;
+// How far above its weighted share of the connections an upstream of a
+// balanced group may go before new hosts spill over to the next one.
+static const double kLoadBound = 1.25;
+
+CircuitBreaker::CircuitBreaker()
+    : state_(kClosed),
+      consecutive_failures_(0),
+      cool_down_ms_(kInitialCoolDownMs),
+      open_until_ms_(0),
+      trial_in_flight_(false) {
+}
+
+bool CircuitBreaker::Allow(int64_t now_ms) {
+  switch (state_) {
+    case kClosed:
+      return true;
+    case kOpen:
+      if (now_ms < open_until_ms_) {
+        return false;
+      }
+      state_ = kHalfOpen;
+      trial_in_flight_ = true;
+      return true;
+    case kHalfOpen:
+      if (trial_in_flight_) {
+        return false;
+      }
+      trial_in_flight_ = true;
+      return true;
+  }
+  return false;
+}
+
+void CircuitBreaker::RecordSuccess() {
+  state_ = kClosed;
+  consecutive_failures_ = 0;
+  cool_down_ms_ = kInitialCoolDownMs;
+  trial_in_flight_ = false;
+}
+
+void CircuitBreaker::RecordFailure(int64_t now_ms) {
+  ++consecutive_failures_;
+  if (state_ == kHalfOpen) {
+    // The trial failed, back off further.
+    cool_down_ms_ = cool_down_ms_ * 2 > kMaxCoolDownMs ?
+        kMaxCoolDownMs : cool_down_ms_ * 2;
+  } else if (consecutive_failures_ < kBreakerFailureThreshold) {
+    return;
+  }
+  state_ = kOpen;
+  open_until_ms_ = now_ms + cool_down_ms_;
+  trial_in_flight_ = false;
+}
+
+int UpstreamGroup::Pick(const std::string& host, int64_t now_ms,
+                        const std::vector<bool>& tried) {
+  return balanced ? PickBalanced(host, now_ms, tried) :
+      PickFailover(now_ms, tried);
+}
+
+int UpstreamGroup::PickFailover(int64_t now_ms,
+                                const std::vector<bool>& tried) {
+  int first_untried = -1;
+  for (size_t i = 0; i < upstreams.size(); ++i) {
+    if (tried[i]) {
+      continue;
+    }
+    if (first_untried < 0) {
+      first_untried = (int)i;
+    }
+    if (upstreams[i].breaker.Allow(now_ms)) {
+      return (int)i;
+    }
+  }
+  return first_untried;
+}
+
+int UpstreamGroup::PickBalanced(const std::string& host, int64_t now_ms,
+                                const std::vector<bool>& tried) {
+  if (ring.empty()) {
+    return -1;
+  }
+  int total_connections = 0;
+  int untried = 0;
+  for (size_t i = 0; i < upstreams.size(); ++i) {
+    total_connections += upstreams[i].active_connections;
+    if (!tried[i]) {
+      ++untried;
+    }
+  }
+  if (untried == 0) {
+    return -1;
+  }
+  // Members in the order this host prefers them.
+  std::vector<int> order;
+  order.reserve(untried);
+  std::vector<bool> seen(tried);
+  size_t point = ring.FindPoint(host);
+  for (size_t n = 0; n < ring.size() && (int)order.size() < untried; ++n) {
+    int member = ring.MemberAt(point);
+    if (!seen[member]) {
+      seen[member] = true;
+      order.push_back(member);
+    }
+    point = ring.NextPoint(point);
+  }
+  // Allow() claims the half-open trial of a breaker, so only call it on
+  // the upstream that is going to be used.
+  for (size_t i = 0; i < order.size(); ++i) {
+    Upstream& upstream = upstreams[order[i]];
+    double share = (double)upstream.server.weight / total_weight;
+    double capacity = kLoadBound * share * (total_connections + 1);
+    if (upstream.active_connections < capacity &&
+        upstream.breaker.Allow(now_ms)) {
+      return order[i];
+    }
+  }
+  // All are over their bound or down; take the first that lets us in.
+  for (size_t i = 0; i < order.size(); ++i) {
+    if (upstreams[order[i]].breaker.Allow(now_ms)) {
+      return order[i];
+    }
+  }
+  return order[0];
+}
+
+void UpstreamGroup::BuildRing() {
+  std::vector<std::string> names;
+  std::vector<int> weights;
+  total_weight = 0;
+  for (size_t i = 0; i < upstreams.size(); ++i) {
+    char name[300];
+    snprintf(name, sizeof(name), "%s:%d", upstreams[i].server.host.c_str(),
+             upstreams[i].server.port);
+    names.push_back(name);
+    weights.push_back(upstreams[i].server.weight);
+    total_weight += upstreams[i].server.weight;
+  }
+  ring.Build(names, weights);
+}
+
+UpstreamProfile::UpstreamProfile(const std::string& description,
+                                 const std::string& bypass_list)
+    : description_(description), resolving_(true), ref_count_(1) {
+  bypass_list_.Parse(bypass_list.c_str());
+  std::vector<ProxyServerGroup> groups;
+  ParseProxyServerGroups(description.c_str(), &groups);
+  for (size_t i = 0; i < groups.size(); ++i) {
+    UpstreamGroup* group = new UpstreamGroup;
+    group->scheme = groups[i].scheme;
+    group->balanced = groups[i].balanced;
+    for (size_t j = 0; j < groups[i].servers.size(); ++j) {
+      Upstream upstream;
+      upstream.server = groups[i].servers[j];
+      group->upstreams.push_back(upstream);
+    }
+    if (group->balanced) {
+      group->BuildRing();
+    }
+    groups_.push_back(group);
+  }
+}
+
+UpstreamProfile::~UpstreamProfile() {
+  for (size_t i = 0; i < groups_.size(); ++i) {
+    delete groups_[i];
+  }
+}
+
+bool UpstreamProfile::ResolveUpstreams(DnsResolver* resolver) {
+  resolving_ = false;
+  for (size_t i = 0; i < groups_.size(); ++i) {
+    std::vector<Upstream>& upstreams = groups_[i]->upstreams;
+    for (size_t j = 0; j < upstreams.size(); ++j) {
+      Upstream& upstream = upstreams[j];
+      if (!upstream.resolving) {
+        continue;
+      }
+      const std::string& host = upstream.server.host;
+      // The resolver only does IPv4; an IPv6 literal never blocks.
+      if (!resolver || host.find(':') != std::string::npos) {
+        upstream.resolved = ResolveHostPort(host.c_str(),
+                                            upstream.server.port,
+                                            &upstream.addr,
+                                            &upstream.addr_len);
+        upstream.resolving = false;
+        continue;
+      }
+      uint32_t address;
+      DnsResolver::Result result = resolver->Lookup(host, &address);
+      if (result == DnsResolver::kPending) {
+        resolving_ = true;
+        continue;
+      }
+      upstream.resolving = false;
+      upstream.resolved = result == DnsResolver::kFound;
+      if (upstream.resolved) {
+        struct sockaddr_in* addr4 = (struct sockaddr_in*)&upstream.addr;
+        memset(addr4, 0, sizeof(*addr4));
+        addr4->sin_family = AF_INET;
+        addr4->sin_port = htons((uint16_t)upstream.server.port);
+        addr4->sin_addr.s_addr = htonl(address);
+        upstream.addr_len = sizeof(*addr4);
+      }
+    }
+  }
+  return !resolving_;
+}
+
+UpstreamGroup* UpstreamProfile::GroupForScheme(const std::string& scheme) {
+  UpstreamGroup* fallback = NULL;
+  for (size_t i = 0; i < groups_.size(); ++i) {
+    if (groups_[i]->scheme == scheme) {
+      return groups_[i];
+    }
+    if (groups_[i]->scheme.empty() && !fallback) {
+      fallback = groups_[i];
+    }
+  }
+  return fallback;
+}
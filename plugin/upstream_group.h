@@ -0,0 +1,149 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Upstream proxies of a forwarder profile. Everything here is owned and
+// used by the forwarder's event loop thread only.
+
+#ifndef __UPSTREAM_GROUP_H__
+#define __UPSTREAM_GROUP_H__
+
+#include <string>
+#include <vector>
+
+#include "bypass_list.h"
+#include "consistent_hash.h"
+#include "net_util.h"
+#include "proxy_server_list.h"
+
+class DnsResolver;
+
+// Stops sending connections to an upstream that just failed. After a
+// cool-down it lets a single trial connection through (half-open); the
+// trial either closes the breaker or reopens it with a longer cool-down.
+class CircuitBreaker {
+ public:
+  enum State {
+    kClosed,
+    kOpen,
+    kHalfOpen,
+  };
+
+  CircuitBreaker();
+
+  // Whether a new connection may be sent now.
+  bool Allow(int64_t now_ms);
+  void RecordSuccess();
+  void RecordFailure(int64_t now_ms);
+  // Gives the half-open trial back when its connection was abandoned
+  // before the outcome was known.
+  void CancelTrial() { trial_in_flight_ = false; }
+  State state() const { return state_; }
+
+ private:
+  State state_;
+  int consecutive_failures_;
+  int cool_down_ms_;
+  int64_t open_until_ms_;
+  bool trial_in_flight_;
+};
+
+struct Upstream {
+  Upstream()
+      : addr_len(0), resolved(false), resolving(true),
+        active_connections(0) {}
+
+  ProxyServer server;
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+  bool resolved;
+  bool resolving;  // The resolver has not answered yet.
+  CircuitBreaker breaker;
+  int active_connections;  // Connecting or relaying.
+};
+
+// Upstreams serving one scheme, either in order of preference or, for a
+// balanced group, as a pool shared through a consistent-hash ring.
+struct UpstreamGroup {
+  UpstreamGroup() : balanced(false), total_weight(0) {}
+
+  // Returns the upstream to try next for a connection to host, or -1 once
+  // all have been tried.
+  int Pick(const std::string& host, int64_t now_ms,
+           const std::vector<bool>& tried);
+
+  // Returns the first upstream not in tried whose breaker lets a
+  // connection through. If every breaker is open, the first untried one is
+  // returned anyway, since failing fast would not help anybody.
+  int PickFailover(int64_t now_ms, const std::vector<bool>& tried);
+
+  // Walks the ring from the hash of host, so that a host keeps going to
+  // the same upstream and its cache stays warm. An upstream is skipped
+  // while its breaker is open or while it carries more than its weighted
+  // share of the connections times kLoadBound ("consistent hashing with
+  // bounded loads"), which keeps one popular host from overloading it.
+  int PickBalanced(const std::string& host, int64_t now_ms,
+                   const std::vector<bool>& tried);
+
+  // Builds the ring; called once the upstreams are in place.
+  void BuildRing();
+
+  std::string scheme;
+  std::vector<Upstream> upstreams;
+  bool balanced;
+  int total_weight;
+  ConsistentHashRing ring;
+};
+
+// The upstream groups of a proxy description such as
+// "http=a:80,b:80;https=c:443", and the hosts that bypass them. Reference
+// counted, so that connections keep their upstreams alive across a profile
+// switch.
+class UpstreamProfile {
+ public:
+  UpstreamProfile(const std::string& description,
+                  const std::string& bypass_list);
+
+  // Looks up the upstream addresses that are not known yet, without
+  // blocking: names the resolver is still working on stay pending, and
+  // the caller tries again once it reports answers. Without a resolver,
+  // names are resolved in place. Returns false while any is pending.
+  bool ResolveUpstreams(DnsResolver* resolver);
+  bool resolving() const { return resolving_; }
+
+  // The group for scheme, falling back to the group without a scheme.
+  // NULL means the connection goes direct.
+  UpstreamGroup* GroupForScheme(const std::string& scheme);
+
+  const BypassList& bypass_list() const { return bypass_list_; }
+  const std::string& description() const { return description_; }
+
+  void AddRef() { ++ref_count_; }
+  void Release() {
+    if (--ref_count_ == 0) {
+      delete this;
+    }
+  }
+
+ private:
+  ~UpstreamProfile();
+
+  std::string description_;
+  BypassList bypass_list_;
+  std::vector<UpstreamGroup*> groups_;
+  bool resolving_;
+  int ref_count_;
+};
+
+#endif  // __UPSTREAM_GROUP_H__
@@ -0,0 +1,359 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "utf_convert.h"
+
+#if defined(_WINDOWS)
+#include <wchar.h>
+#endif
+
+#include "byte_scan.h"
+
+static const uint32_t kReplacementCharacter = 0xfffd;
+static const size_t kBlockSize = 16;
+
+// Decodes the sequence at p, which is before end and not ASCII. Returns
+// its length and sets code_point, or returns 0 if p does not start a
+// valid sequence.
+static inline size_t DecodeUtf8(const unsigned char* p,
+                                const unsigned char* end,
+                                uint32_t* code_point) {
+  unsigned char lead = p[0];
+  size_t len;
+  uint32_t value;
+  uint32_t min_value;
+  if (lead >= 0xc2 && lead <= 0xdf) {
+    len = 2;
+    value = lead & 0x1f;
+    min_value = 0x80;
+  } else if (lead >= 0xe0 && lead <= 0xef) {
+    len = 3;
+    value = lead & 0x0f;
+    min_value = 0x800;
+  } else if (lead >= 0xf0 && lead <= 0xf4) {
+    len = 4;
+    value = lead & 0x07;
+    min_value = 0x10000;
+  } else {
+    return 0;
+  }
+  if ((size_t)(end - p) < len) {
+    return 0;
+  }
+  for (size_t i = 1; i < len; ++i) {
+    if ((p[i] & 0xc0) != 0x80) {
+      return 0;
+    }
+    value = (value << 6) | (p[i] & 0x3f);
+  }
+  if (value < min_value || value > 0x10ffff ||
+      (value >= 0xd800 && value <= 0xdfff)) {
+    return 0;
+  }
+  *code_point = value;
+  return len;
+}
+
+// Like DecodeUtf8, but an invalid byte decodes to the replacement
+// character.
+static inline size_t DecodeUtf8OrReplace(const unsigned char* p,
+                                         const unsigned char* end,
+                                         uint32_t* code_point) {
+  size_t len = DecodeUtf8(p, end, code_point);
+  if (len == 0) {
+    *code_point = kReplacementCharacter;
+    return 1;
+  }
+  return len;
+}
+
+// Decodes the unit or surrogate pair at p, which is before end and not
+// ASCII. Returns the number of units used.
+static inline size_t DecodeUtf16(const uint16_t* p, const uint16_t* end,
+                                 uint32_t* code_point) {
+  uint32_t unit = p[0];
+  if (unit < 0xd800 || unit > 0xdfff) {
+    *code_point = unit;
+    return 1;
+  }
+  if (unit <= 0xdbff && end - p >= 2 && p[1] >= 0xdc00 && p[1] <= 0xdfff) {
+    *code_point = 0x10000 + ((unit - 0xd800) << 10) + (p[1] - 0xdc00);
+    return 2;
+  }
+  *code_point = kReplacementCharacter;
+  return 1;
+}
+
+static inline size_t Utf8Length(uint32_t code_point) {
+  return code_point < 0x80 ? 1 : code_point < 0x800 ? 2 :
+      code_point < 0x10000 ? 3 : 4;
+}
+
+// The number of ASCII bytes at the start of the 16 at p.
+static inline size_t AsciiPrefix(const unsigned char* p) {
+#if defined(BYTE_SCAN_SSE2)
+  if (HasSse2()) {
+    unsigned int mask = (unsigned int)_mm_movemask_epi8(
+        _mm_loadu_si128((const __m128i*)p));
+    return mask ? ByteScanner::CountTrailingZeros(mask) : kBlockSize;
+  }
+#endif
+  size_t i = 0;
+  while (i < kBlockSize && p[i] < 0x80) {
+    ++i;
+  }
+  return i;
+}
+
+// Widens the 16 ASCII bytes at p into out.
+static inline void WidenBlock(const unsigned char* p, uint16_t* out) {
+#if defined(BYTE_SCAN_SSE2)
+  if (HasSse2()) {
+    __m128i block = _mm_loadu_si128((const __m128i*)p);
+    __m128i zero = _mm_setzero_si128();
+    _mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi8(block, zero));
+    _mm_storeu_si128((__m128i*)(out + 8), _mm_unpackhi_epi8(block, zero));
+    return;
+  }
+#endif
+  for (size_t i = 0; i < kBlockSize; ++i) {
+    out[i] = p[i];
+  }
+}
+
+// The number of ASCII units at the start of the 16 at p.
+static inline size_t AsciiPrefix(const uint16_t* p) {
+#if defined(BYTE_SCAN_SSE2)
+  if (HasSse2()) {
+    __m128i high_bits = _mm_set1_epi16((short)0xff80);
+    __m128i zero = _mm_setzero_si128();
+    __m128i low = _mm_cmpeq_epi16(
+        _mm_and_si128(_mm_loadu_si128((const __m128i*)p), high_bits), zero);
+    __m128i high = _mm_cmpeq_epi16(
+        _mm_and_si128(_mm_loadu_si128((const __m128i*)(p + 8)), high_bits),
+        zero);
+    // Packed to one byte, and so one mask bit, per unit that is ASCII.
+    unsigned int mask = (unsigned int)_mm_movemask_epi8(
+        _mm_packs_epi16(low, high));
+    return ~mask & 0xffff ?
+        ByteScanner::CountTrailingZeros(~mask & 0xffff) : kBlockSize;
+  }
+#endif
+  size_t i = 0;
+  while (i < kBlockSize && p[i] < 0x80) {
+    ++i;
+  }
+  return i;
+}
+
+// Narrows the 16 ASCII units at p into out.
+static inline void NarrowBlock(const uint16_t* p, char* out) {
+#if defined(BYTE_SCAN_SSE2)
+  if (HasSse2()) {
+    _mm_storeu_si128((__m128i*)out, _mm_packus_epi16(
+        _mm_loadu_si128((const __m128i*)p),
+        _mm_loadu_si128((const __m128i*)(p + 8))));
+    return;
+  }
+#endif
+  for (size_t i = 0; i < kBlockSize; ++i) {
+    out[i] = (char)p[i];
+  }
+}
+
+size_t Utf16LengthOfUtf8(const char* data, size_t len) {
+  const unsigned char* p = (const unsigned char*)data;
+  const unsigned char* end = p + len;
+  size_t result = 0;
+  while (p < end) {
+    const unsigned char* block_end = end;
+    if ((size_t)(end - p) >= kBlockSize) {
+      size_t ascii = AsciiPrefix(p);
+      if (ascii == kBlockSize) {
+        p += kBlockSize;
+        result += kBlockSize;
+        continue;
+      }
+      block_end = p + kBlockSize;
+      p += ascii;
+      result += ascii;
+    }
+    // The rest of the block, one character at a time, so that text with
+    // a non-ASCII character every few bytes is not scanned again from
+    // each of them.
+    while (p < block_end) {
+      if (*p < 0x80) {
+        ++p;
+        ++result;
+        continue;
+      }
+      uint32_t code_point;
+      p += DecodeUtf8OrReplace(p, end, &code_point);
+      result += code_point >= 0x10000 ? 2 : 1;
+    }
+  }
+  return result;
+}
+
+size_t Utf8ToUtf16(const char* data, size_t len, uint16_t* out) {
+  const unsigned char* p = (const unsigned char*)data;
+  const unsigned char* end = p + len;
+  uint16_t* begin = out;
+  while (p < end) {
+    const unsigned char* block_end = end;
+    if ((size_t)(end - p) >= kBlockSize) {
+      if (AsciiPrefix(p) == kBlockSize) {
+        WidenBlock(p, out);
+        p += kBlockSize;
+        out += kBlockSize;
+        continue;
+      }
+      block_end = p + kBlockSize;
+    }
+    while (p < block_end) {
+      if (*p < 0x80) {
+        *out++ = *p++;
+        continue;
+      }
+      uint32_t code_point;
+      p += DecodeUtf8OrReplace(p, end, &code_point);
+      if (code_point >= 0x10000) {
+        code_point -= 0x10000;
+        *out++ = (uint16_t)(0xd800 + (code_point >> 10));
+        *out++ = (uint16_t)(0xdc00 + (code_point & 0x3ff));
+      } else {
+        *out++ = (uint16_t)code_point;
+      }
+    }
+  }
+  return out - begin;
+}
+
+size_t Utf8LengthOfUtf16(const uint16_t* data, size_t len) {
+  const uint16_t* p = data;
+  const uint16_t* end = data + len;
+  size_t result = 0;
+  while (p < end) {
+    const uint16_t* block_end = end;
+    if ((size_t)(end - p) >= kBlockSize) {
+      size_t ascii = AsciiPrefix(p);
+      if (ascii == kBlockSize) {
+        p += kBlockSize;
+        result += kBlockSize;
+        continue;
+      }
+      block_end = p + kBlockSize;
+      p += ascii;
+      result += ascii;
+    }
+    while (p < block_end) {
+      if (*p < 0x80) {
+        ++p;
+        ++result;
+        continue;
+      }
+      uint32_t code_point;
+      p += DecodeUtf16(p, end, &code_point);
+      result += Utf8Length(code_point);
+    }
+  }
+  return result;
+}
+
+size_t Utf16ToUtf8(const uint16_t* data, size_t len, char* out) {
+  const uint16_t* p = data;
+  const uint16_t* end = data + len;
+  char* begin = out;
+  while (p < end) {
+    const uint16_t* block_end = end;
+    if ((size_t)(end - p) >= kBlockSize) {
+      if (AsciiPrefix(p) == kBlockSize) {
+        NarrowBlock(p, out);
+        p += kBlockSize;
+        out += kBlockSize;
+        continue;
+      }
+      block_end = p + kBlockSize;
+    }
+    while (p < block_end) {
+      if (*p < 0x80) {
+        *out++ = (char)*p++;
+        continue;
+      }
+      uint32_t code_point;
+      p += DecodeUtf16(p, end, &code_point);
+      switch (Utf8Length(code_point)) {
+        case 2:
+          *out++ = (char)(0xc0 | (code_point >> 6));
+          break;
+        case 3:
+          *out++ = (char)(0xe0 | (code_point >> 12));
+          *out++ = (char)(0x80 | ((code_point >> 6) & 0x3f));
+          break;
+        default:
+          *out++ = (char)(0xf0 | (code_point >> 18));
+          *out++ = (char)(0x80 | ((code_point >> 12) & 0x3f));
+          *out++ = (char)(0x80 | ((code_point >> 6) & 0x3f));
+          break;
+      }
+      *out++ = (char)(0x80 | (code_point & 0x3f));
+    }
+  }
+  return out - begin;
+}
+
+bool IsValidUtf8(const char* data, size_t len) {
+  const unsigned char* p = (const unsigned char*)data;
+  const unsigned char* end = p + len;
+  while (p < end) {
+    const unsigned char* block_end = end;
+    if ((size_t)(end - p) >= kBlockSize) {
+      size_t ascii = AsciiPrefix(p);
+      if (ascii == kBlockSize) {
+        p += kBlockSize;
+        continue;
+      }
+      block_end = p + kBlockSize;
+      p += ascii;
+    }
+    while (p < block_end) {
+      if (*p < 0x80) {
+        ++p;
+        continue;
+      }
+      uint32_t code_point;
+      size_t sequence_len = DecodeUtf8(p, end, &code_point);
+      if (sequence_len == 0) {
+        return false;
+      }
+      p += sequence_len;
+    }
+  }
+  return true;
+}
+
+#if defined(_WINDOWS)
+std::wstring Utf8ToWide(const char* text, size_t len) {
+  std::wstring result(Utf16LengthOfUtf8(text, len), L'\0');
+  if (!result.empty()) {
+    Utf8ToUtf16(text, len, (uint16_t*)&result[0]);
+  }
+  return result;
+}
+
+std::string WideToUtf8(const wchar_t* text) {
+  return Utf16ToUtf8((const uint16_t*)text, wcslen(text));
+}
+#endif
@@ -0,0 +1,68 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Conversion between UTF-8 and UTF-16 without the platform converters, so
+// that strings are sized exactly once and converted without temporary
+// buffers. Runs of ASCII, which proxy settings are almost entirely made
+// of, are converted 16 characters at a time with SSE2.
+
+#ifndef __UTF_CONVERT_H__
+#define __UTF_CONVERT_H__
+
+#include <stddef.h>
+
+#include <string>
+
+#include "nptypes.h"
+
+// Invalid input, i.e. bytes that do not form a shortest-form UTF-8
+// sequence of a scalar value and unpaired surrogates, is not an error:
+// each invalid byte or unit becomes U+FFFD, as with the Windows
+// converters. The length functions count that in, so a buffer of the
+// size they return is always exactly filled.
+
+// The number of UTF-16 units the UTF-8 in data converts to.
+size_t Utf16LengthOfUtf8(const char* data, size_t len);
+// Converts data into out, which must have room for Utf16LengthOfUtf8
+// units. Returns the number of units written.
+size_t Utf8ToUtf16(const char* data, size_t len, uint16_t* out);
+
+// The number of bytes the UTF-16 in data converts to.
+size_t Utf8LengthOfUtf16(const uint16_t* data, size_t len);
+// Converts data into out, which must have room for Utf8LengthOfUtf16
+// bytes. Returns the number of bytes written.
+size_t Utf16ToUtf8(const uint16_t* data, size_t len, char* out);
+
+// Whether data is valid UTF-8 and would convert without replacements.
+bool IsValidUtf8(const char* data, size_t len);
+
+inline std::string Utf16ToUtf8(const uint16_t* data, size_t len) {
+  std::string result(Utf8LengthOfUtf16(data, len), '\0');
+  if (!result.empty()) {
+    Utf16ToUtf8(data, len, &result[0]);
+  }
+  return result;
+}
+
+#if defined(_WINDOWS)
+// wchar_t strings are UTF-16 on Windows.
+std::wstring Utf8ToWide(const char* text, size_t len);
+inline std::wstring Utf8ToWide(const std::string& text) {
+  return Utf8ToWide(text.data(), text.size());
+}
+std::string WideToUtf8(const wchar_t* text);
+#endif
+
+#endif  // __UTF_CONVERT_H__
@@ -18,10 +18,42 @@
 #include <windows.h>
 #include <wininet.h>
 
+#include <string>
+#include <vector>
+
 #include "../npswitchproxy.h"
 #include "../proxy_config.h"
+#include "../utf_convert.h"
+
+namespace {
+
+// The per connection options of a setting, converted to wide strings.
+class WinProxyPayload : public ProxyPayload {
+ public:
+  enum {
+    kValueCount = 3,
+  };
+
+  WinProxyPayload() : flags(PROXY_TYPE_DIRECT) {
+    for (int i = 0; i < kValueCount; ++i) {
+      has_value[i] = false;
+    }
+  }
+
+  DWORD flags;
+  // The auto-config URL, proxy server and bypass list, in the order of
+  // the options they go to. Missing ones are passed as NULL.
+  std::wstring values[kValueCount];
+  bool has_value[kValueCount];
+};
+
+}  // namespace
+
+// The name EnumerateConnections gives the default connection, which the
+// Inet APIs address as NULL.
+static const char* kLanConnectionName = "LAN";
 
-WinProxy::WinProxy() {
+WinProxy::WinProxy() : hRasApiLib_(NULL), pRasEnumEntries_(NULL) {
 }
 
 WinProxy::~WinProxy() {
@@ -29,22 +61,21 @@ WinProxy::~WinProxy() {
     FreeLibrary(hWinInetLib_);
     hWinInetLib_ = NULL;
   }
+  if (hRasApiLib_ != NULL) {
+    FreeLibrary(hRasApiLib_);
+    hRasApiLib_ = NULL;
+  }
 }
 
-// Converts the wide null-terminated string to utf8 null-terminated string.
-// Note that the return value should be freed after use.
-char* WinProxy::WStrToUtf8(LPCWSTR str) {
-  int bufferSize = WideCharToMultiByte(CP_UTF8, 0, (LPCWSTR)str, -1, NULL, 0, NULL, NULL);
-	char* m = new char[bufferSize];
-	WideCharToMultiByte(CP_UTF8, 0, str, -1, m, bufferSize, NULL, NULL);
-	return m;
-}
-
-LPWSTR WinProxy::Utf8ToWStr(const char * str) {
-  int bufferSize = MultiByteToWideChar(CP_UTF8, 0, (LPCSTR)str, -1, NULL, 0);
-  wchar_t *m = new wchar_t[bufferSize];
-  MultiByteToWideChar(CP_UTF8, 0, (LPCSTR)str, -1, m, bufferSize);
-  return m;
+// Converts the wide null-terminated string to utf8 null-terminated string,
+// allocated with new[] as ProxyConfig expects.
+static char* NewUtf8String(LPCWSTR str) {
+  size_t len = wcslen(str);
+  size_t utf8_len = Utf8LengthOfUtf16((const uint16_t*)str, len);
+  char* result = new char[utf8_len + 1];
+  Utf16ToUtf8((const uint16_t*)str, len, result);
+  result[utf8_len] = 0;
+  return result;
 }
 
 bool WinProxy::PlatformDependentStartup() {
@@ -88,6 +119,11 @@ bool WinProxy::PlatformDependentStartup() {
     FreeLibrary(hWinInetLib_);
     return false;
   }
+  hRasApiLib_ = LoadLibrary(TEXT("rasapi32.dll"));
+  if (hRasApiLib_ != NULL) {
+    pRasEnumEntries_ = (RasEnumEntriesFunc)GetProcAddress(
+        HMODULE(hRasApiLib_), "RasEnumEntriesW");
+  }
   return true;
 }
 
@@ -96,6 +132,11 @@ void WinProxy::PlatformDependentShutdown() {
     FreeLibrary(hWinInetLib_);
     hWinInetLib_ = NULL;
   }
+  if (hRasApiLib_ != NULL) {
+    FreeLibrary(hRasApiLib_);
+    hRasApiLib_ = NULL;
+    pRasEnumEntries_ = NULL;
+  }
 }
 
 // Gets current Inet connection name.
@@ -156,15 +197,15 @@ bool WinProxy::GetProxyConfig(ProxyConfig* config) {
     config->use_proxy = (conn_flag & PROXY_TYPE_PROXY) == PROXY_TYPE_PROXY;
 
     if (options[1].Value.pszValue != NULL) {
-      config->auto_config_url = WStrToUtf8(options[1].Value.pszValue);
+      config->auto_config_url = NewUtf8String(options[1].Value.pszValue);
       GlobalFree(options[1].Value.pszValue);
     }
     if (options[2].Value.pszValue != NULL) {
-      config->proxy_server = WStrToUtf8(options[2].Value.pszValue);
+      config->proxy_server = NewUtf8String(options[2].Value.pszValue);
       GlobalFree(options[2].Value.pszValue);
     }
     if (options[3].Value.pszValue != NULL) {
-      config->bypass_list = WStrToUtf8(options[3].Value.pszValue);
+      config->bypass_list = NewUtf8String(options[3].Value.pszValue);
       GlobalFree(options[3].Value.pszValue);
     }
     DebugLog("npswitchproxy: InternetGetOption succeeded.\n");
@@ -174,7 +215,177 @@ bool WinProxy::GetProxyConfig(ProxyConfig* config) {
   return false;
 }
 
-bool WinProxy::SetProxyConfig(const ProxyConfig& config) {
+ProxyPayload* WinProxy::CompilePayload(const ProxyConfig& config) {
+  WinProxyPayload* payload = new WinProxyPayload;
+  if (config.auto_config) {
+    payload->flags |= PROXY_TYPE_AUTO_PROXY_URL;
+  }
+  if (config.auto_detect) {
+    payload->flags |= PROXY_TYPE_AUTO_DETECT;
+  }
+  if (config.use_proxy) {
+    payload->flags |= PROXY_TYPE_PROXY;
+  }
+  const char* values[WinProxyPayload::kValueCount] = {
+    config.auto_config_url,
+    config.proxy_server,
+    config.bypass_list,
+  };
+  for (int i = 0; i < WinProxyPayload::kValueCount; ++i) {
+    if (values[i] != NULL) {
+      payload->values[i] = Utf8ToWide(values[i], strlen(values[i]));
+      payload->has_value[i] = true;
+    }
+  }
+  return payload;
+}
+
+bool WinProxy::ApplyPayload(const ProxyPayload& payload) {
+  LPWSTR connection_name;
+  if (!GetActiveConnectionName((const void**)&connection_name)) {
+      return false;
+  }
+  bool ok = SetPayloadOptions(payload, connection_name);
+  delete [] connection_name;
+  return ok;
+}
+
+bool WinProxy::UpdateProxyConfig(const ProxyConfig& config, int fields) {
+  static const int kFlagFields =
+      kAutoDetectField | kAutoConfigField | kUseProxyField;
+  const struct {
+    int field;
+    DWORD flag;
+    bool value;
+  } flag_fields[] = {
+    {kAutoDetectField, PROXY_TYPE_AUTO_DETECT, config.auto_detect},
+    {kAutoConfigField, PROXY_TYPE_AUTO_PROXY_URL, config.auto_config},
+    {kUseProxyField, PROXY_TYPE_PROXY, config.use_proxy},
+  };
+  const struct {
+    int field;
+    DWORD option;
+    const char* value;
+  } string_fields[] = {
+    {kAutoConfigUrlField, INTERNET_PER_CONN_AUTOCONFIG_URL,
+     config.auto_config_url},
+    {kProxyServerField, INTERNET_PER_CONN_PROXY_SERVER, config.proxy_server},
+    {kBypassListField, INTERNET_PER_CONN_PROXY_BYPASS, config.bypass_list},
+  };
+  INTERNET_PER_CONN_OPTION options[4];
+  std::wstring values[3];
+  DWORD count = 0;
+  LPWSTR connection_name;
+  if (!GetActiveConnectionName((const void**)&connection_name)) {
+    return false;
+  }
+  bool ok = true;
+  if (fields & kFlagFields) {
+    // The three flags share one option, so the ones not in fields are read
+    // back unless all of them are given.
+    DWORD flags = PROXY_TYPE_DIRECT;
+    if ((fields & kFlagFields) != kFlagFields) {
+      ok = QueryConnectionFlags(connection_name, &flags);
+    }
+    for (int i = 0; i < 3; ++i) {
+      if (fields & flag_fields[i].field) {
+        flags &= ~flag_fields[i].flag;
+        if (flag_fields[i].value) {
+          flags |= flag_fields[i].flag;
+        }
+      }
+    }
+    options[count].dwOption = INTERNET_PER_CONN_FLAGS;
+    options[count++].Value.dwValue = flags;
+  }
+  for (int i = 0; i < 3; ++i) {
+    if (fields & string_fields[i].field) {
+      options[count].dwOption = string_fields[i].option;
+      options[count].Value.pszValue = NULL;
+      if (string_fields[i].value != NULL) {
+        values[i] = Utf8ToWide(string_fields[i].value,
+                               strlen(string_fields[i].value));
+        // WinINet only reads the strings.
+        options[count].Value.pszValue = const_cast<LPWSTR>(values[i].c_str());
+      }
+      ++count;
+    }
+  }
+  if (ok && count > 0) {
+    INTERNET_PER_CONN_OPTION_LIST list;
+    unsigned long nSize = sizeof INTERNET_PER_CONN_OPTION_LIST;
+    list.pszConnection = connection_name;
+    list.dwSize = nSize;
+    list.pOptions = options;
+    list.dwOptionCount = count;
+    list.dwOptionError = 0;
+    ok = pInternetSetOption_(NULL, INTERNET_OPTION_PER_CONNECTION_OPTION,
+                             &list, nSize) != FALSE;
+    DebugLog("npswitchproxy: InternetSetOption of %d options %s.\n",
+             (int)count, ok ? "succeeded" : "failed");
+  }
+  delete [] connection_name;
+  return ok;
+}
+
+bool WinProxy::QueryConnectionFlags(LPWSTR connection_name, DWORD* flags) {
+  INTERNET_PER_CONN_OPTION option = {INTERNET_PER_CONN_FLAGS, 0};
+  INTERNET_PER_CONN_OPTION_LIST list;
+  unsigned long nSize = sizeof INTERNET_PER_CONN_OPTION_LIST;
+  list.pszConnection = connection_name;
+  list.dwSize = nSize;
+  list.pOptions = &option;
+  list.dwOptionCount = 1;
+  list.dwOptionError = 0;
+  if (!pInternetQueryOption_(NULL, INTERNET_OPTION_PER_CONNECTION_OPTION,
+                             &list, &nSize)) {
+    DebugLog("npswitchproxy: InternetQueryOption of the flags failed.\n");
+    return false;
+  }
+  *flags = option.Value.dwValue;
+  return true;
+}
+
+bool WinProxy::EnumerateConnections(std::vector<std::string>* names) {
+  names->clear();
+  names->push_back(kLanConnectionName);
+  if (pRasEnumEntries_ == NULL) {
+    return true;
+  }
+  std::vector<RASENTRYNAMEW> entries(1);
+  entries[0].dwSize = sizeof(RASENTRYNAMEW);
+  DWORD size = sizeof(RASENTRYNAMEW);
+  DWORD count = 0;
+  DWORD result = pRasEnumEntries_(NULL, NULL, &entries[0], &size, &count);
+  if (result == ERROR_BUFFER_TOO_SMALL) {
+    entries.resize(size / sizeof(RASENTRYNAMEW) + 1);
+    entries[0].dwSize = sizeof(RASENTRYNAMEW);
+    size = (DWORD)(entries.size() * sizeof(RASENTRYNAMEW));
+    result = pRasEnumEntries_(NULL, NULL, &entries[0], &size, &count);
+  }
+  if (result != ERROR_SUCCESS) {
+    DebugLog("npswitchproxy: RasEnumEntries failed: %d\n", (int)result);
+    return true;
+  }
+  for (DWORD i = 0; i < count; ++i) {
+    names->push_back(WideToUtf8(entries[i].szEntryName));
+  }
+  return true;
+}
+
+bool WinProxy::ApplyPayloadToConnection(const ProxyPayload& payload,
+                                        const std::string& name) {
+  if (name == kLanConnectionName) {
+    return SetPayloadOptions(payload, NULL);
+  }
+  std::wstring connection_name = Utf8ToWide(name);
+  return SetPayloadOptions(payload, &connection_name[0]);
+}
+
+bool WinProxy::SetPayloadOptions(const ProxyPayload& proxy_payload,
+                                 LPWSTR connection_name) {
+  const WinProxyPayload& payload =
+      static_cast<const WinProxyPayload&>(proxy_payload);
   INTERNET_PER_CONN_OPTION options[] = {
     {INTERNET_PER_CONN_FLAGS, 0},
     {INTERNET_PER_CONN_AUTOCONFIG_URL, 0},    
@@ -183,31 +394,18 @@ bool WinProxy::SetProxyConfig(const ProxyConfig& config) {
   };
   INTERNET_PER_CONN_OPTION_LIST list;     
   unsigned long nSize = sizeof INTERNET_PER_CONN_OPTION_LIST;
-  if (!GetActiveConnectionName((const void**)&list.pszConnection)) {
-      return false;
-  }
+  list.pszConnection = connection_name;
   list.dwSize = nSize;  
   list.pOptions = options;
   list.dwOptionCount = sizeof options / sizeof INTERNET_PER_CONN_OPTION;
   list.dwOptionError = 0;
-  options[0].Value.dwValue = PROXY_TYPE_DIRECT;
-  if (config.auto_config) {
-    options[0].Value.dwValue |= PROXY_TYPE_AUTO_PROXY_URL;
-  }
-  if (config.auto_detect) {
-    options[0].Value.dwValue |= PROXY_TYPE_AUTO_DETECT;
-  }
-  if (config.use_proxy) {
-    options[0].Value.dwValue |= PROXY_TYPE_PROXY;
-  }
-  if (config.auto_config_url != NULL) {
-    options[1].Value.pszValue = Utf8ToWStr(config.auto_config_url);
-  }
-  if (config.proxy_server != NULL) {
-    options[2].Value.pszValue = Utf8ToWStr(config.proxy_server);
-  }
-  if (config.bypass_list != NULL) {
-    options[3].Value.pszValue = Utf8ToWStr(config.bypass_list);
+  options[0].Value.dwValue = payload.flags;
+  for (int i = 0; i < WinProxyPayload::kValueCount; ++i) {
+    if (payload.has_value[i]) {
+      // WinINet only reads the strings.
+      options[i + 1].Value.pszValue =
+          const_cast<LPWSTR>(payload.values[i].c_str());
+    }
   }
   if (pInternetSetOption_(NULL, INTERNET_OPTION_PER_CONNECTION_OPTION,
                          &list, nSize)) {
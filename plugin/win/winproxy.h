@@ -17,6 +17,7 @@
 #define __WIN_WINPROXY_H__
 #include <windows.h>
 #include <wininet.h>
+#include <ras.h>
 #include "../npswitchproxy.h"
 #include "../proxy_config.h"
 #include "../proxy_base.h"
@@ -29,11 +30,20 @@ class WinProxy : public ProxyBase {
   virtual void PlatformDependentShutdown();
   virtual bool GetActiveConnectionName(const void** connection_name);
   virtual bool GetProxyConfig(ProxyConfig* config);
-  virtual bool SetProxyConfig(const ProxyConfig& config);
+  virtual bool UpdateProxyConfig(const ProxyConfig& config, int fields);
+  virtual ProxyPayload* CompilePayload(const ProxyConfig& config);
+  virtual bool ApplyPayload(const ProxyPayload& payload);
+  virtual bool EnumerateConnections(std::vector<std::string>* names);
+  virtual bool ApplyPayloadToConnection(const ProxyPayload& payload,
+                                        const std::string& name);
 
 private:
-  char* WStrToUtf8(LPCWSTR str);  // Helper functions to convert widechar to utf8.
-  LPWSTR Utf8ToWStr(const char * str);
+  // Sets the options of payload on connection_name, NULL for LAN.
+  bool SetPayloadOptions(const ProxyPayload& payload,
+                         LPWSTR connection_name);
+  // Reads the INTERNET_PER_CONN_FLAGS of connection_name, NULL for LAN.
+  bool QueryConnectionFlags(LPWSTR connection_name, DWORD* flags);
+
   typedef bool (__stdcall* InternetQueryOptionFunc) (
     HINTERNET hInternet, DWORD dwOption,
     LPVOID lpBuffer, LPDWORD lpdwBufferLength);
@@ -45,9 +55,16 @@ private:
   typedef bool (__stdcall* InternetGetConnectedStateExFunc) (
       LPDWORD lpdwFlags, LPTSTR lpszConnectionName,
       DWORD dwNameLen, DWORD dwReserved);
+
+  typedef DWORD (__stdcall* RasEnumEntriesFunc) (
+      LPCWSTR reserved, LPCWSTR lpszPhonebook,
+      LPRASENTRYNAMEW lprasentryname, LPDWORD lpcb, LPDWORD lpcEntries);
   HINSTANCE hWinInetLib_;
   InternetQueryOptionFunc pInternetQueryOption_;
   InternetSetOptionFunc pInternetSetOption_;
   InternetGetConnectedStateExFunc pInternetGetConnectedStateEx_;
+  // Optional; without it only the LAN connection is enumerated.
+  HINSTANCE hRasApiLib_;
+  RasEnumEntriesFunc pRasEnumEntries_;
 };
 #endif  // __WIN_WINPROXY_H__
@@ -0,0 +1,312 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+#include "wpad_discovery.h"
+
+#include <ctype.h>
+#include <stdio.h>
+
+#include "dns_resolver.h"
+#include "http_client.h"
+#include "npswitchproxy.h"
+#include "platform_util.h"
+#include "stats.h"
+
+static const int kDefaultTimeoutMs = 3000;
+static const int64_t kDefaultCacheTtlMs = 30 * 60 * 1000;
+static const int64_t kDefaultNegativeTtlMs = 2 * 60 * 1000;
+static const size_t kMaxScriptSize = 1 << 20;
+// Second-level labels that country codes hand out to the public, as in
+// "co.uk", "com.au" or "ne.jp".
+static const char* const kPublicSecondLevelLabels[] = {
+  "ac", "co", "com", "ed", "edu", "go", "gob", "gov", "gr", "gv", "int",
+  "lg", "ltd", "mil", "ne", "net", "nic", "nom", "or", "org", "plc", "sch",
+};
+
+struct WpadDiscovery::Round {
+  Round() : changed(false) {}
+
+  Mutex lock;  // Guards done and found of the probes.
+  WaitableEvent changed;
+  std::vector<Probe*> probes;
+  DnsResolver* resolver;
+  int timeout_ms;
+};
+
+struct WpadDiscovery::Probe {
+  Probe() : round(NULL), done(false), found(false) {}
+
+  Round* round;
+  std::string url;
+  Thread thread;
+  bool done;
+  bool found;
+};
+
+WpadDiscovery::Options::Options()
+    : port(80),
+      timeout_ms(kDefaultTimeoutMs),
+      cache_ttl_ms(kDefaultCacheTtlMs),
+      negative_ttl_ms(kDefaultNegativeTtlMs) {
+}
+
+WpadDiscovery::WpadDiscovery(DnsResolver* resolver)
+    : resolver_(resolver),
+      background_busy_(false) {
+}
+
+WpadDiscovery::WpadDiscovery(DnsResolver* resolver, const Options& options)
+    : resolver_(resolver),
+      options_(options),
+      background_busy_(false) {
+}
+
+WpadDiscovery::~WpadDiscovery() {
+  if (background_.IsStarted()) {
+    background_.Join();
+  }
+  ScopedLock lock(&lock_);
+  ReapRoundsLocked(true);
+}
+
+bool WpadDiscovery::LookupCacheLocked(const std::string& key,
+                                      std::string* url) {
+  std::map<std::string, CacheEntry>::iterator it = cache_.find(key);
+  if (it == cache_.end() || it->second.expires_ms <= NowMillis()) {
+    return false;
+  }
+  stats::Add("wpadCacheHits", 1);
+  *url = it->second.url;
+  return true;
+}
+
+bool WpadDiscovery::Discover(const std::string& connection,
+                             std::string* url) {
+  std::string domain =
+      options_.domain.empty() ? GetDnsDomain() : options_.domain;
+  std::string key = connection + '\n' + domain;
+  int64_t start_ms = NowMillis();
+  {
+    ScopedLock lock(&lock_);
+    ReapRoundsLocked(false);
+    if (LookupCacheLocked(key, url)) {
+      return !url->empty();
+    }
+  }
+  std::vector<std::string> hosts;
+  GetWpadCandidates(domain, &hosts);
+  *url = ProbeCandidates(hosts);
+  {
+    ScopedLock lock(&lock_);
+    CacheEntry& entry = cache_[key];
+    entry.url = *url;
+    entry.expires_ms = NowMillis() +
+        (url->empty() ? options_.negative_ttl_ms : options_.cache_ttl_ms);
+  }
+  stats::Add("wpadDiscoveries", 1);
+  stats::Set("wpadLastDiscoveryMs", NowMillis() - start_ms);
+  DebugLog("WpadDiscovery: %s: '%s'\n", domain.c_str(), url->c_str());
+  return !url->empty();
+}
+
+WpadDiscovery::Result WpadDiscovery::DiscoverInBackground(
+    const std::string& connection, std::string* url) {
+  std::string domain =
+      options_.domain.empty() ? GetDnsDomain() : options_.domain;
+  {
+    ScopedLock lock(&lock_);
+    if (LookupCacheLocked(connection + '\n' + domain, url)) {
+      return url->empty() ? kNotFound : kFound;
+    }
+    if (background_busy_) {
+      return kPending;
+    }
+    background_busy_ = true;
+    background_connection_ = connection;
+  }
+  // The previous discovery is done, since it cleared background_busy_.
+  if (background_.IsStarted()) {
+    background_.Join();
+  }
+  if (!background_.Start(BackgroundMain, this)) {
+    ScopedLock lock(&lock_);
+    background_busy_ = false;
+    return kNotFound;
+  }
+  return kPending;
+}
+
+// static
+void WpadDiscovery::BackgroundMain(void* arg) {
+  WpadDiscovery* wpad = (WpadDiscovery*)arg;
+  std::string connection;
+  {
+    ScopedLock lock(&wpad->lock_);
+    connection = wpad->background_connection_;
+  }
+  std::string url;
+  wpad->Discover(connection, &url);
+  ScopedLock lock(&wpad->lock_);
+  wpad->background_busy_ = false;
+}
+
+void WpadDiscovery::ClearCache() {
+  ScopedLock lock(&lock_);
+  cache_.clear();
+}
+
+// static
+void WpadDiscovery::ProbeMain(void* arg) {
+  Probe* probe = (Probe*)arg;
+  Round* round = probe->round;
+  HttpRequest request;
+  request.url = probe->url;
+  request.timeout_ms = round->timeout_ms;
+  request.max_body_size = kMaxScriptSize;
+  request.resolver = round->resolver;
+  HttpResponse response;
+  std::string error;
+  bool found = HttpGet(request, &response, &error) &&
+      response.status == 200 &&
+      response.body.find("FindProxyForURL") != std::string::npos;
+  ScopedLock lock(&round->lock);
+  probe->done = true;
+  probe->found = found;
+  round->changed.Signal();
+}
+
+std::string WpadDiscovery::ProbeCandidates(
+    const std::vector<std::string>& hosts) {
+  Round* round = new Round;
+  round->resolver = resolver_;
+  round->timeout_ms = options_.timeout_ms;
+  for (size_t i = 0; i < hosts.size(); ++i) {
+    Probe* probe = new Probe;
+    probe->round = round;
+    probe->url = "http://" + hosts[i];
+    if (options_.port != 80) {
+      char port[16];
+      snprintf(port, sizeof(port), ":%d", options_.port);
+      probe->url += port;
+    }
+    probe->url += "/wpad.dat";
+    round->probes.push_back(probe);
+  }
+  stats::Add("wpadProbes", (int64_t)hosts.size());
+  for (size_t i = 0; i < round->probes.size(); ++i) {
+    Probe* probe = round->probes[i];
+    if (!probe->thread.Start(ProbeMain, probe)) {
+      ScopedLock lock(&round->lock);
+      probe->done = true;
+    }
+  }
+
+  // The first candidate that served a script wins once every candidate
+  // before it has failed. At the deadline, the first one found so far
+  // does.
+  int64_t deadline_ms = NowMillis() + options_.timeout_ms;
+  std::string url;
+  while (true) {
+    bool decided = false;
+    bool expired = NowMillis() >= deadline_ms;
+    {
+      ScopedLock lock(&round->lock);
+      for (size_t i = 0; i < round->probes.size(); ++i) {
+        Probe* probe = round->probes[i];
+        if (probe->found) {
+          url = probe->url;
+          decided = true;
+          break;
+        }
+        if (!probe->done && !expired) {
+          break;
+        }
+        decided = i + 1 == round->probes.size();
+      }
+      decided = decided || round->probes.empty() || expired;
+    }
+    if (decided) {
+      break;
+    }
+    int64_t remaining_ms = deadline_ms - NowMillis();
+    if (remaining_ms > 0) {
+      round->changed.Wait((int)remaining_ms);
+    }
+  }
+  ScopedLock lock(&lock_);
+  rounds_.push_back(round);
+  return url;
+}
+
+void WpadDiscovery::ReapRoundsLocked(bool wait) {
+  size_t live = 0;
+  for (size_t i = 0; i < rounds_.size(); ++i) {
+    Round* round = rounds_[i];
+    bool done = true;
+    if (!wait) {
+      ScopedLock lock(&round->lock);
+      for (size_t j = 0; j < round->probes.size() && done; ++j) {
+        done = round->probes[j]->done;
+      }
+    }
+    if (!done) {
+      rounds_[live++] = round;
+      continue;
+    }
+    for (size_t j = 0; j < round->probes.size(); ++j) {
+      if (round->probes[j]->thread.IsStarted()) {
+        round->probes[j]->thread.Join();
+      }
+      delete round->probes[j];
+    }
+    delete round;
+  }
+  rounds_.resize(live);
+}
+
+void GetWpadCandidates(const std::string& domain,
+                       std::vector<std::string>* hosts) {
+  hosts->clear();
+  std::string name;
+  for (size_t i = 0; i < domain.size(); ++i) {
+    name += (char)tolower((unsigned char)domain[i]);
+  }
+  while (!name.empty() && name[name.size() - 1] == '.') {
+    name.erase(name.size() - 1);
+  }
+  while (!IsPublicSuffix(name)) {
+    hosts->push_back("wpad." + name);
+    name.erase(0, name.find('.') + 1);
+  }
+}
+
+bool IsPublicSuffix(const std::string& name) {
+  size_t dot = name.find('.');
+  if (dot == std::string::npos) {
+    return true;
+  }
+  if (name.find('.', dot + 1) != std::string::npos ||
+      name.size() - dot - 1 != 2) {
+    return false;
+  }
+  std::string second = name.substr(0, dot);
+  for (size_t i = 0; i < sizeof(kPublicSecondLevelLabels) /
+       sizeof(kPublicSecondLevelLabels[0]); ++i) {
+    if (second == kPublicSecondLevelLabels[i]) {
+      return true;
+    }
+  }
+  return false;
+}
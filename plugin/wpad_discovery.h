@@ -0,0 +1,119 @@
+/* ***** BEGIN LICENSE BLOCK *****
+* Copyright 2011 Wenzhang Zhu (wzzhu@cs.hku.hk)
+* Version: MPL 1.1/GPL 2.0/LGPL 2.1
+*
+* The contents of this file are subject to the Mozilla Public License Version
+* 1.1 (the "License"); you may not use this file except in compliance with
+* the License. You may obtain a copy of the License at
+* http://www.mozilla.org/MPL/
+*
+* Software distributed under the License is distributed on an "AS IS" basis,
+* WITHOUT WARRANTY OF ANY KIND, either express or implied. See the License
+* for the specific language governing rights and limitations under the
+* License.
+* ***** END LICENSE BLOCK ***** */
+
+// Web Proxy Auto-Discovery through DNS: the PAC file of a network is
+// served as http://wpad.<domain>/wpad.dat, where domain is the DNS suffix
+// of the machine or one of its parents.
+
+#ifndef __WPAD_DISCOVERY_H__
+#define __WPAD_DISCOVERY_H__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "nptypes.h"
+#include "platform_util.h"
+
+class DnsResolver;
+
+// Probes all candidates of the domain at once rather than one after the
+// other, so a discovery takes as long as the slowest useful answer and
+// not the sum of every timeout. The most specific candidate that serves a
+// script wins. Results, including failures, are cached per connection
+// and domain. Thread-safe.
+class WpadDiscovery {
+ public:
+  enum Result {
+    kPending,
+    kFound,
+    kNotFound,
+  };
+
+  struct Options {
+    Options();
+
+    // The DNS suffix to search from; empty for the one of the system.
+    std::string domain;
+    // Of the candidate servers; only stand-ins use anything but 80.
+    int port;
+    // For the whole discovery.
+    int timeout_ms;
+    int64_t cache_ttl_ms;
+    int64_t negative_ttl_ms;
+  };
+
+  // resolver is not owned; NULL means the system resolver.
+  explicit WpadDiscovery(DnsResolver* resolver);
+  WpadDiscovery(DnsResolver* resolver, const Options& options);
+  ~WpadDiscovery();
+
+  // Finds the PAC URL for the network of connection. Blocks for at most
+  // timeout_ms, or not at all when the answer is cached. Returns false if
+  // no candidate served a script.
+  bool Discover(const std::string& connection, std::string* url);
+  // Returns the cached result for connection at once. Otherwise starts
+  // discovering it on a background thread, unless that is under way
+  // already, and returns kPending; a later call gets the result.
+  Result DiscoverInBackground(const std::string& connection,
+                              std::string* url);
+  // Forgets all results, e.g. after the network changed.
+  void ClearCache();
+
+ private:
+  struct Round;
+  struct Probe;
+  struct CacheEntry {
+    std::string url;  // Empty if nothing was found.
+    int64_t expires_ms;
+  };
+
+  static void ProbeMain(void* arg);
+  static void BackgroundMain(void* arg);
+  // Copies the result cached for key; false if there is none.
+  bool LookupCacheLocked(const std::string& key, std::string* url);
+  std::string ProbeCandidates(const std::vector<std::string>& hosts);
+  // Frees rounds whose probes are done; with wait, waits for all first.
+  void ReapRoundsLocked(bool wait);
+
+  DnsResolver* resolver_;
+  Options options_;
+  Thread background_;
+
+  Mutex lock_;  // Guards everything below.
+  std::map<std::string, CacheEntry> cache_;
+  // Rounds that were decided before their slower probes finished.
+  std::vector<Round*> rounds_;
+  bool background_busy_;
+  std::string background_connection_;
+
+  WpadDiscovery(const WpadDiscovery&);
+  void operator=(const WpadDiscovery&);
+};
+
+// The candidate hosts for domain, most specific first: "a.example.com"
+// gives "wpad.a.example.com" and "wpad.example.com". The search stops
+// above the registrable domain, since anybody could register wpad.<tld>
+// or wpad.co.uk; see IsPublicSuffix.
+void GetWpadCandidates(const std::string& domain,
+                       std::vector<std::string>* hosts);
+
+// Whether name, lower case, is a suffix under which anybody can register
+// names: a top-level domain, or a generic second level such as "co.uk" or
+// "com.au" under a country code. Without the full public suffix list this
+// errs on the side of probing less.
+bool IsPublicSuffix(const std::string& name);
+
+#endif  // __WPAD_DISCOVERY_H__